@@ -229,7 +229,7 @@ LiteralValue LiteralValue::from_str_literal(const std::string &lexeme, const Loc
 }
 
 std::string LiteralValue::strip_quotes(const std::string &lexeme, char quote) {
-  assert(lexeme.size() >= 3);
+  assert(lexeme.size() >= 2);
   assert(lexeme.front() == quote);
   assert(lexeme.back() == quote);
 
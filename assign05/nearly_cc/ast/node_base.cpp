@@ -25,6 +25,7 @@ NodeBase::NodeBase()
   // TODO: initialize member variables (e.g., pointer to Symbol)
 {
   this->is_literal = false;
+  m_asm_slot = -1;
 }
 
 NodeBase::~NodeBase() {
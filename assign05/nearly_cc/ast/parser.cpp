@@ -0,0 +1,781 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <utility>
+#include <map>
+#include "node.h"
+#include "ast.h"
+#include "parse.tab.h"
+#include "lex.yy.h"
+#include "parser_state.h"
+#include "exceptions.h"
+#include "parser.h"
+
+namespace {
+
+// Binding strength of binary operators (0 means "not a binary operator").
+// All binary operators are left associative.
+int binary_precedence(int tag) {
+  switch (tag) {
+  case TOK_LOGICAL_OR:
+    return 1;
+  case TOK_LOGICAL_AND:
+    return 2;
+  case TOK_BITWISE_OR:
+    return 3;
+  case TOK_BITWISE_XOR:
+    return 4;
+  case TOK_AMPERSAND:
+    return 5;
+  case TOK_EQUALITY: case TOK_INEQUALITY:
+    return 6;
+  case TOK_LT: case TOK_LTE: case TOK_GT: case TOK_GTE:
+    return 7;
+  case TOK_LEFT_SHIFT: case TOK_RIGHT_SHIFT:
+    return 8;
+  case TOK_PLUS: case TOK_MINUS:
+    return 9;
+  case TOK_ASTERISK: case TOK_DIVIDE: case TOK_MOD:
+    return 10;
+  default:
+    return 0;
+  }
+}
+
+bool is_assignment_op(int tag) {
+  switch (tag) {
+  case TOK_ASSIGN: case TOK_MUL_ASSIGN: case TOK_DIV_ASSIGN: case TOK_MOD_ASSIGN:
+  case TOK_ADD_ASSIGN: case TOK_SUB_ASSIGN: case TOK_LEFT_ASSIGN: case TOK_RIGHT_ASSIGN:
+  case TOK_AND_ASSIGN: case TOK_XOR_ASSIGN: case TOK_OR_ASSIGN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool is_basic_type_keyword(int tag) {
+  switch (tag) {
+  case TOK_CHAR: case TOK_SHORT: case TOK_INT: case TOK_LONG:
+  case TOK_UNSIGNED: case TOK_SIGNED: case TOK_FLOAT: case TOK_DOUBLE:
+  case TOK_VOID: case TOK_CONST: case TOK_VOLATILE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// All variable declarations default to having "unspecified" storage
+// (same as handle_unspecified_storage() in parse_buildast.y)
+void handle_unspecified_storage(Node *ast) {
+  Node *unspecified_storage = new Node(NODE_TOK_UNSPECIFIED_STORAGE);
+  unspecified_storage->set_loc(ast->get_kid(0)->get_loc());
+  ast->prepend_kid(unspecified_storage);
+}
+
+}
+
+Parser::Parser(ParserState *pp, bool lazy_bodies)
+  : m_pp(pp)
+  , m_srcfile(pp->cur_loc.get_srcfile())
+  , m_head(0)
+  , m_count(0)
+  , m_lazy_bodies(lazy_bodies)
+  , m_replay(nullptr)
+  , m_replay_pos(0) {
+}
+
+Parser::~Parser() {
+}
+
+Node *Parser::parse() {
+  std::vector<Node *> decls;
+  do {
+    decls.push_back(parse_top_level_declaration());
+  } while (!at(0));
+
+  if (m_lazy_bodies)
+    parse_deferred_bodies();
+
+  Node *unit = new Node(AST_UNIT);
+  for (auto i = decls.begin(); i != decls.end(); ++i) {
+    Node *decl = *i;
+    // a definition whose body was never parsed isn't needed
+    if (decl->get_tag() == AST_FUNCTION_DEFINITION && decl->get_num_kids() < 4)
+      delete decl;
+    else
+      unit->append_kid(decl);
+  }
+
+  m_pp->parse_tree = unit;
+  return unit;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Token buffer
+////////////////////////////////////////////////////////////////////////
+
+const Parser::Token &Parser::peek(unsigned k) {
+  assert(k < MAX_LOOKAHEAD);
+  while (m_count <= k) {
+    // once the end of input is reached, it stays reached
+    if (m_count > 0) {
+      const Token &last = m_lookahead[(m_head + m_count - 1) % MAX_LOOKAHEAD];
+      if (last.tag == 0)
+        return last;
+    }
+
+    read_token(m_lookahead[(m_head + m_count) % MAX_LOOKAHEAD]);
+    ++m_count;
+  }
+  return m_lookahead[(m_head + k) % MAX_LOOKAHEAD];
+}
+
+void Parser::read_token(Token &tok) {
+  if (m_replay != nullptr && m_replay_pos < m_replay->size()) {
+    tok = (*m_replay)[m_replay_pos++];
+    return;
+  }
+
+  if (m_replay == nullptr) {
+    YYSTYPE yylval;
+    tok.tag = yylex(&yylval, m_pp->scan_info);
+  } else {
+    tok.tag = 0;
+  }
+
+  if (tok.tag != 0) {
+    tok.lexeme.swap(m_pp->last_lexeme);
+    tok.line = m_pp->last_line;
+    tok.col = m_pp->last_col;
+  } else {
+    tok.lexeme.clear();
+    tok.line = m_pp->cur_loc.get_line();
+    tok.col = m_pp->cur_loc.get_col();
+  }
+}
+
+Parser::Token Parser::next() {
+  peek();
+  if (m_lookahead[m_head].tag == 0)
+    return m_lookahead[m_head];
+
+  Token tok = std::move(m_lookahead[m_head]);
+  m_head = (m_head + 1) % MAX_LOOKAHEAD;
+  --m_count;
+  return tok;
+}
+
+Parser::Token Parser::expect(int tag) {
+  if (!at(tag))
+    syntax_error();
+  return next();
+}
+
+void Parser::syntax_error() {
+  SyntaxError::raise(token_loc(peek()), "syntax error");
+}
+
+Location Parser::token_loc(const Token &tok) const {
+  return Location(m_srcfile, tok.line, tok.col);
+}
+
+// Only tokens which are part of the AST get a Node
+Node *Parser::token_node(const Token &tok) {
+  Node *n = new Node(tok.tag, tok.lexeme);
+  n->set_loc(token_loc(tok));
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Declarations
+////////////////////////////////////////////////////////////////////////
+
+Node *Parser::parse_top_level_declaration() {
+  if (at_storage_class()) {
+    Node *storage = parse_storage_class();
+    // only variables can be thread-local
+    if (storage->get_tag() == TOK_THREAD_LOCAL)
+      return apply_storage_class(storage, parse_simple_variable_declaration());
+    bool is_static = storage->get_tag() == TOK_STATIC;
+    return apply_storage_class(storage, parse_function_or_variable_declaration(is_static));
+  }
+
+  if ((at(TOK_STRUCT) || at(TOK_UNION)) && at(TOK_IDENT, 1) && at(TOK_LBRACE, 2))
+    return parse_struct_or_union_definition();
+
+  return parse_function_or_variable_declaration(false);
+}
+
+Node *Parser::parse_function_or_variable_declaration(bool is_static) {
+  Node *type = parse_type();
+  if (at(TOK_IDENT) && at(TOK_LPAREN, 1))
+    return finish_function(type, is_static);
+  return finish_variable_declaration(type);
+}
+
+Node *Parser::parse_simple_variable_declaration() {
+  return finish_variable_declaration(parse_type());
+}
+
+Node *Parser::finish_variable_declaration(Node *type) {
+  Node *declarators = parse_declarator_list();
+  expect(TOK_SEMICOLON);
+  Node *decl = new Node(AST_VARIABLE_DECLARATION, {type, declarators});
+  handle_unspecified_storage(decl);
+  return decl;
+}
+
+Node *Parser::finish_function(Node *type, bool is_static) {
+  Node *name = token_node(expect(TOK_IDENT));
+  expect(TOK_LPAREN);
+  Node *params = parse_function_parameter_list();
+  expect(TOK_RPAREN);
+
+  if (at(TOK_SEMICOLON)) {
+    next();
+    return new Node(AST_FUNCTION_DECLARATION, {type, name, params});
+  }
+
+  if (!m_lazy_bodies)
+    return new Node(AST_FUNCTION_DEFINITION, {type, name, params, parse_function_body()});
+
+  // the body is added by parse_deferred_bodies(), if it's needed
+  Node *fn_def = new Node(AST_FUNCTION_DEFINITION, {type, name, params});
+  m_deferred.push_back({ fn_def, is_static, false, {} });
+  skim_function_body(m_deferred.back());
+  return fn_def;
+}
+
+Node *Parser::parse_function_body() {
+  expect(TOK_LBRACE);
+  Node *body = parse_statement_list();
+  expect(TOK_RBRACE);
+  return body;
+}
+
+// Save the tokens of a function body, finding its end by brace matching
+void Parser::skim_function_body(DeferredBody &deferred) {
+  if (!at(TOK_LBRACE))
+    syntax_error();
+
+  unsigned depth = 0;
+  do {
+    if (at(0))
+      syntax_error();
+    Token tok = next();
+    if (tok.tag == TOK_LBRACE)
+      ++depth;
+    else if (tok.tag == TOK_RBRACE)
+      --depth;
+    deferred.tokens.push_back(std::move(tok));
+  } while (depth > 0);
+}
+
+// A function is needed if it's exported, or if its name appears in the
+// body of a needed function. Needed bodies are parsed in source order
+// from tokens that keep their source positions, so a syntax error in a
+// body is reported just as eager parsing would report it.
+void Parser::parse_deferred_bodies() {
+  std::map<std::string, std::vector<unsigned>> defs_by_name;
+  std::vector<unsigned> worklist;
+  for (unsigned i = 0; i < m_deferred.size(); ++i) {
+    DeferredBody &deferred = m_deferred[i];
+    defs_by_name[deferred.fn_def->get_kid(1)->get_str()].push_back(i);
+    if (!deferred.is_static) {
+      deferred.needed = true;
+      worklist.push_back(i);
+    }
+  }
+
+  while (!worklist.empty()) {
+    const std::vector<Token> &tokens = m_deferred[worklist.back()].tokens;
+    worklist.pop_back();
+    for (auto i = tokens.begin(); i != tokens.end(); ++i) {
+      if (i->tag != TOK_IDENT)
+        continue;
+      auto j = defs_by_name.find(i->lexeme);
+      if (j == defs_by_name.end())
+        continue;
+      for (auto k = j->second.begin(); k != j->second.end(); ++k) {
+        if (!m_deferred[*k].needed) {
+          m_deferred[*k].needed = true;
+          worklist.push_back(*k);
+        }
+      }
+    }
+  }
+
+  for (auto i = m_deferred.begin(); i != m_deferred.end(); ++i) {
+    if (!i->needed)
+      continue;
+    m_replay = &i->tokens;
+    m_replay_pos = 0;
+    m_head = m_count = 0;
+    i->fn_def->append_kid(parse_function_body());
+  }
+  m_replay = nullptr;
+  m_deferred.clear();
+}
+
+Node *Parser::parse_declarator_list() {
+  Node *list = new Node(AST_DECLARATOR_LIST);
+  list->append_kid(parse_declarator());
+  while (at(TOK_COMMA)) {
+    next();
+    list->append_kid(parse_declarator());
+  }
+  return list;
+}
+
+// pointers are lower precedence than identifiers/arrays
+Node *Parser::parse_declarator() {
+  if (at(TOK_ASTERISK)) {
+    next();
+    return new Node(AST_POINTER_DECLARATOR, {parse_declarator()});
+  }
+
+  Node *declarator = new Node(AST_NAMED_DECLARATOR, {token_node(expect(TOK_IDENT))});
+  while (at(TOK_LBRACKET)) {
+    next();
+    Node *size = token_node(expect(TOK_INT_LIT));
+    expect(TOK_RBRACKET);
+    declarator = new Node(AST_ARRAY_DECLARATOR, {declarator, size});
+  }
+  return declarator;
+}
+
+Node *Parser::parse_function_parameter_list() {
+  Node *list = new Node(AST_FUNCTION_PARAMETER_LIST);
+
+  // "(void)" and "()" both mean no parameters
+  if (at(TOK_VOID) && at(TOK_RPAREN, 1)) {
+    next();
+    return list;
+  }
+  if (at(TOK_RPAREN))
+    return list;
+
+  for (;;) {
+    Node *type = parse_type();
+    list->append_kid(new Node(AST_FUNCTION_PARAMETER, {type, parse_declarator()}));
+    if (!at(TOK_COMMA))
+      break;
+    next();
+  }
+  return list;
+}
+
+// C essentially allows a salad of type keywords to be combined,
+// so we'll do that too. Semantic analysis can make sense of them later.
+Node *Parser::parse_type() {
+  if (at(TOK_STRUCT) || at(TOK_UNION)) {
+    int tag = next().tag == TOK_STRUCT ? AST_STRUCT_TYPE : AST_UNION_TYPE;
+    return new Node(tag, {token_node(expect(TOK_IDENT))});
+  }
+
+  if (!is_basic_type_keyword(peek().tag))
+    syntax_error();
+
+  Node *type = new Node(AST_BASIC_TYPE);
+  while (is_basic_type_keyword(peek().tag))
+    type->append_kid(token_node(next()));
+  return type;
+}
+
+Node *Parser::parse_struct_or_union_definition() {
+  int tag = next().tag == TOK_STRUCT ? AST_STRUCT_TYPE_DEFINITION : AST_UNION_TYPE_DEFINITION;
+  Node *name = token_node(expect(TOK_IDENT));
+  expect(TOK_LBRACE);
+  Node *fields = new Node(AST_FIELD_DEFINITION_LIST);
+  while (!at(TOK_RBRACE))
+    fields->append_kid(parse_simple_variable_declaration());
+  next();
+  expect(TOK_SEMICOLON);
+  return new Node(tag, {name, fields});
+}
+
+// Parse a storage class: static or extern, either of which may be
+// followed by __thread (or _Thread_local), or __thread by itself.
+// The thread-local storage class is a TOK_THREAD_LOCAL node whose
+// child is the static or extern storage class (if there is one).
+Node *Parser::parse_storage_class() {
+  Node *storage = token_node(next());
+  if (storage->get_tag() != TOK_THREAD_LOCAL && at(TOK_THREAD_LOCAL)) {
+    Node *tls = token_node(next());
+    tls->append_kid(storage);
+    storage = tls;
+  }
+  return storage;
+}
+
+// An explicit storage class replaces the (unspecified) storage class of
+// a variable declaration. Function declarations and definitions have no
+// storage class child, so for them it becomes the child of the function
+// name. A thread-local storage class without static or extern keeps the
+// unspecified storage class as its child.
+Node *Parser::apply_storage_class(Node *storage, Node *decl) {
+  if (decl->get_tag() != AST_VARIABLE_DECLARATION) {
+    decl->get_kid(1)->append_kid(storage);
+    return decl;
+  }
+
+  Node *replaced = decl->get_kid(0);
+  decl->shift_kid();
+  if (storage->get_tag() == TOK_THREAD_LOCAL && storage->get_num_kids() == 0)
+    storage->append_kid(replaced);
+  else
+    delete replaced;
+  decl->prepend_kid(storage);
+  return decl;
+}
+
+bool Parser::at_type_start(unsigned k) {
+  int tag = peek(k).tag;
+  return is_basic_type_keyword(tag) || tag == TOK_STRUCT || tag == TOK_UNION;
+}
+
+bool Parser::at_storage_class() {
+  return at(TOK_STATIC) || at(TOK_EXTERN) || at(TOK_THREAD_LOCAL);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Statements
+////////////////////////////////////////////////////////////////////////
+
+Node *Parser::parse_statement() {
+  if (at_type_start())
+    return parse_simple_variable_declaration();
+
+  if (at_storage_class()) {
+    Node *storage = parse_storage_class();
+    return apply_storage_class(storage, parse_simple_variable_declaration());
+  }
+
+  switch (peek().tag) {
+  case TOK_SEMICOLON:
+    next();
+    return new Node(AST_EMPTY_STATEMENT);
+
+  case TOK_RETURN:
+    {
+      next();
+      if (at(TOK_SEMICOLON)) {
+        next();
+        return new Node(AST_RETURN_STATEMENT);
+      }
+      Node *value = parse_assignment_expression();
+      expect(TOK_SEMICOLON);
+      return new Node(AST_RETURN_EXPRESSION_STATEMENT, {value});
+    }
+
+  case TOK_LBRACE:
+    {
+      next();
+      Node *list = parse_statement_list();
+      expect(TOK_RBRACE);
+      return list;
+    }
+
+  case TOK_WHILE:
+    {
+      next();
+      expect(TOK_LPAREN);
+      Node *cond = parse_assignment_expression();
+      expect(TOK_RPAREN);
+      Node *body = parse_statement();
+      return new Node(AST_WHILE_STATEMENT, {cond, body});
+    }
+
+  case TOK_DO:
+    {
+      next();
+      Node *body = parse_statement();
+      expect(TOK_WHILE);
+      expect(TOK_LPAREN);
+      Node *cond = parse_assignment_expression();
+      expect(TOK_RPAREN);
+      expect(TOK_SEMICOLON);
+      return new Node(AST_DO_WHILE_STATEMENT, {body, cond});
+    }
+
+  case TOK_FOR:
+    {
+      next();
+      expect(TOK_LPAREN);
+      Node *init = parse_assignment_expression();
+      expect(TOK_SEMICOLON);
+      Node *cond = parse_assignment_expression();
+      expect(TOK_SEMICOLON);
+      Node *update = parse_assignment_expression();
+      expect(TOK_RPAREN);
+      Node *body = parse_statement();
+      return new Node(AST_FOR_STATEMENT, {init, cond, update, body});
+    }
+
+  case TOK_IF:
+    {
+      next();
+      expect(TOK_LPAREN);
+      Node *cond = parse_assignment_expression();
+      expect(TOK_RPAREN);
+      Node *then_stmt = parse_statement();
+      // a dangling else belongs to the nearest if
+      if (!at(TOK_ELSE))
+        return new Node(AST_IF_STATEMENT, {cond, then_stmt});
+      next();
+      Node *else_stmt = parse_statement();
+      return new Node(AST_IF_ELSE_STATEMENT, {cond, then_stmt, else_stmt});
+    }
+
+  case TOK_ASM:
+    return parse_asm_statement();
+
+  default:
+    {
+      Node *expr = parse_assignment_expression();
+      expect(TOK_SEMICOLON);
+      return new Node(AST_EXPRESSION_STATEMENT, {expr});
+    }
+  }
+}
+
+// Statements up to (but not including) a closing brace
+Node *Parser::parse_statement_list() {
+  Node *list = new Node(AST_STATEMENT_LIST);
+  while (!at(TOK_RBRACE))
+    list->append_kid(parse_statement());
+  return list;
+}
+
+// GCC-style extended asm: the volatile qualifier is accepted but not
+// recorded (every asm statement is treated as volatile), and each of
+// the output, input, and clobber sections may be omitted along with
+// the ones following it
+Node *Parser::parse_asm_statement() {
+  expect(TOK_ASM);
+  if (at(TOK_VOLATILE))
+    next();
+  expect(TOK_LPAREN);
+  Node *asm_template = token_node(expect(TOK_STR_LIT));
+
+  Node *outputs = nullptr, *inputs = nullptr, *clobbers = new Node(AST_ASM_CLOBBER_LIST);
+  if (at(TOK_COLON)) {
+    next();
+    outputs = parse_asm_operand_list();
+    if (at(TOK_COLON)) {
+      next();
+      inputs = parse_asm_operand_list();
+      if (at(TOK_COLON)) {
+        next();
+        if (at(TOK_STR_LIT)) {
+          clobbers->append_kid(token_node(next()));
+          while (at(TOK_COMMA)) {
+            next();
+            clobbers->append_kid(token_node(expect(TOK_STR_LIT)));
+          }
+        }
+      }
+    }
+  }
+  if (outputs == nullptr)
+    outputs = new Node(AST_ASM_OPERAND_LIST);
+  if (inputs == nullptr)
+    inputs = new Node(AST_ASM_OPERAND_LIST);
+  Node *stmt = new Node(AST_ASM_STATEMENT, {asm_template, outputs, inputs, clobbers});
+  expect(TOK_RPAREN);
+  expect(TOK_SEMICOLON);
+  return stmt;
+}
+
+// Operands of an asm statement: a possibly empty list of
+// "constraint" (expression)
+Node *Parser::parse_asm_operand_list() {
+  Node *list = new Node(AST_ASM_OPERAND_LIST);
+  if (!at(TOK_STR_LIT))
+    return list;
+  for (;;) {
+    Node *constraint = token_node(expect(TOK_STR_LIT));
+    expect(TOK_LPAREN);
+    Node *expr = parse_assignment_expression();
+    expect(TOK_RPAREN);
+    list->append_kid(new Node(AST_ASM_OPERAND, {constraint, expr}));
+    if (!at(TOK_COMMA))
+      return list;
+    next();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Expressions
+////////////////////////////////////////////////////////////////////////
+
+// As in the bison grammar, the operator is the first child of
+// a binary, unary, or postfix expression.
+Node *Parser::parse_assignment_expression() {
+  // only a unary expression (not a cast) can be assigned to
+  bool is_cast = at_cast();
+  Node *lhs = is_cast ? parse_cast_expression() : parse_unary_expression();
+
+  if (!is_cast && is_assignment_op(peek().tag)) {
+    Node *op = token_node(next());
+    Node *rhs = parse_assignment_expression();
+    return new Node(AST_BINARY_EXPRESSION, {op, lhs, rhs});
+  }
+
+  return parse_conditional_expression(parse_binary_expression(lhs, 1));
+}
+
+Node *Parser::parse_conditional_expression(Node *cond) {
+  if (!at(TOK_QUESTION))
+    return cond;
+
+  next();
+  Node *if_true = parse_assignment_expression();
+  expect(TOK_COLON);
+  Node *if_false = parse_conditional_expression(parse_binary_expression(parse_cast_expression(), 1));
+  return new Node(AST_CONDITIONAL_EXPRESSION, {cond, if_true, if_false});
+}
+
+// Precedence climbing: lhs is the already-parsed left operand, and only
+// operators binding at least as tightly as min_prec are consumed
+Node *Parser::parse_binary_expression(Node *lhs, int min_prec) {
+  for (;;) {
+    int prec = binary_precedence(peek().tag);
+    if (prec == 0 || prec < min_prec)
+      return lhs;
+
+    Node *op = token_node(next());
+    Node *rhs = parse_cast_expression();
+    while (binary_precedence(peek().tag) > prec)
+      rhs = parse_binary_expression(rhs, prec + 1);
+
+    lhs = new Node(AST_BINARY_EXPRESSION, {op, lhs, rhs});
+  }
+}
+
+Node *Parser::parse_cast_expression() {
+  if (!at_cast())
+    return parse_unary_expression();
+
+  next();
+  Node *type = parse_type();
+  expect(TOK_RPAREN);
+  Node *operand = parse_cast_expression();
+  return new Node(AST_CAST_EXPRESSION, {type, operand});
+}
+
+Node *Parser::parse_unary_expression() {
+  switch (peek().tag) {
+  case TOK_PLUS: case TOK_MINUS: case TOK_NOT: case TOK_BITWISE_COMPL:
+    {
+      Node *op = token_node(next());
+      return new Node(AST_UNARY_EXPRESSION, {op, parse_cast_expression()});
+    }
+
+  case TOK_INCREMENT: case TOK_DECREMENT: case TOK_ASTERISK: case TOK_AMPERSAND:
+    {
+      Node *op = token_node(next());
+      return new Node(AST_UNARY_EXPRESSION, {op, parse_unary_expression()});
+    }
+
+  default:
+    return parse_postfix_expression();
+  }
+}
+
+Node *Parser::parse_postfix_expression() {
+  Node *expr = parse_primary_expression();
+
+  for (;;) {
+    switch (peek().tag) {
+    case TOK_INCREMENT: case TOK_DECREMENT:
+      {
+        Node *op = token_node(next());
+        expr = new Node(AST_POSTFIX_EXPRESSION, {op, expr});
+      }
+      break;
+
+    case TOK_LPAREN:
+      {
+        next();
+        Node *args = new Node(AST_ARGUMENT_EXPRESSION_LIST);
+        if (!at(TOK_RPAREN)) {
+          args->append_kid(parse_assignment_expression());
+          while (at(TOK_COMMA)) {
+            next();
+            args->append_kid(parse_assignment_expression());
+          }
+        }
+        expect(TOK_RPAREN);
+        expr = new Node(AST_FUNCTION_CALL_EXPRESSION, {expr, args});
+      }
+      break;
+
+    case TOK_DOT:
+      next();
+      expr = new Node(AST_FIELD_REF_EXPRESSION, {expr, token_node(expect(TOK_IDENT))});
+      break;
+
+    case TOK_ARROW:
+      next();
+      expr = new Node(AST_INDIRECT_FIELD_REF_EXPRESSION, {expr, token_node(expect(TOK_IDENT))});
+      break;
+
+    case TOK_LBRACKET:
+      {
+        next();
+        Node *index = parse_assignment_expression();
+        expect(TOK_RBRACKET);
+        expr = new Node(AST_ARRAY_ELEMENT_REF_EXPRESSION, {expr, index});
+      }
+      break;
+
+    default:
+      return expr;
+    }
+  }
+}
+
+Node *Parser::parse_primary_expression() {
+  switch (peek().tag) {
+  case TOK_INT_LIT: case TOK_CHAR_LIT: case TOK_FP_LIT: case TOK_STR_LIT:
+    return new Node(AST_LITERAL_VALUE, {token_node(next())});
+
+  case TOK_IDENT:
+    return new Node(AST_VARIABLE_REF, {token_node(next())});
+
+  case TOK_LPAREN:
+    {
+      next();
+      Node *expr = parse_assignment_expression();
+      expect(TOK_RPAREN);
+      return expr;
+    }
+
+  default:
+    syntax_error();
+  }
+}
+
+// A parenthesized type starts a cast
+bool Parser::at_cast() {
+  return at(TOK_LPAREN) && at_type_start(1);
+}
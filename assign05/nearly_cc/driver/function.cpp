@@ -24,6 +24,8 @@ Function::Function(const std::string &name, Node *funcdef_ast, Symbol *symbol)
   : m_name(name)
   , m_funcdef_ast(funcdef_ast)
   , m_symbol(symbol)
+  , m_vreg_slot_offset(0)
+  , m_attributes(0)
 {
   m_vr_alloc = new VregAllocator();
 }
@@ -20,9 +20,12 @@
 
 #include "global_variable.h"
 
-GlobalVariable::GlobalVariable(const std::string &name, std::shared_ptr<Type> type)
+GlobalVariable::GlobalVariable(const std::string &name, std::shared_ptr<Type> type,
+                               StorageClass storage, bool is_thread_local)
   : m_name(name)
-  , m_type(type) {
+  , m_type(type)
+  , m_storage(storage)
+  , m_is_thread_local(is_thread_local) {
 }
 
 GlobalVariable::~GlobalVariable() {
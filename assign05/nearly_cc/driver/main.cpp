@@ -25,13 +25,20 @@
 #include "parse.tab.h"
 #include "lex.yy.h"
 #include "parser_state.h"
+#include "parser.h"
 #include "unit.h"
 #include "semantic_analysis.h"
 #include "local_storage_allocation.h"
 #include "highlevel_codegen.h"
 #include "lowlevel_codegen.h"
 #include "highlevel_opt.h"
+#include "alias_analysis.h"
+#include "mod_ref_analysis.h"
+#include "function_attr_inference.h"
+#include "function_specialization.h"
 #include "lowlevel_opt.h"
+#include "machine_outliner.h"
+#include "call_frame_info.h"
 #include "highlevel_formatter.h"
 #include "lowlevel_formatter.h"
 #include "print_instruction_seq.h"
@@ -105,12 +112,20 @@ void scan_tokens(const std::string &filename, std::vector<Node *> &tokens) {
 // Process a source file by parsing it to produce an AST of
 // the entire translation unit. Returns a pointer to the root
 // of the AST.
-Node *parse(const std::string &filename) {
+Node *parse(const std::string &filename, const Options &options) {
   Node *ast = nullptr;
 
   auto callback = [&](ParserState *pp) {
-    // parse the input source code
-    yyparse(pp);
+    // parse the input source code (by default, with the recursive
+    // descent parser, which doesn't need a Node for every token)
+    if (options.has_option(Options::BISON_PARSER)) {
+      yyparse(pp);
+    } else {
+      // function bodies are parsed lazily, except when printing the AST
+      pp->lazy_tokens = true;
+      Parser parser(pp, options.get_ir_kind_goal() != IRKind::AST);
+      parser.parse();
+    }
 
     // free memory allocated by flex
     yylex_destroy(pp->scan_info);
@@ -119,6 +134,8 @@ Node *parse(const std::string &filename) {
 
     // delete any Nodes that were created by the lexer,
     // but weren't incorporated into the parse tree
+    if (pp->tokens.empty())
+      return;
     std::set<Node *> tree_nodes;
     ast->preorder([&tree_nodes](Node *n) { tree_nodes.insert(n); });
     for (auto i = pp->tokens.begin(); i != pp->tokens.end(); ++i) {
@@ -206,7 +223,7 @@ void print_symbol_tables(SemanticAnalysis &sema) {
 // Return value is the updated next label number
 // (so that we can guarantee that label numbers aren't
 // reused between functions in the same unit.)
-int codegen(std::shared_ptr<Function> function, const Options &options, int next_label_num) {
+int hl_codegen(std::shared_ptr<Function> function, const Options &options, int next_label_num) {
   assert(options.get_ir_kind_goal() >= IRKind::HIGHLEVEL_CODE);
 
   // Assign
@@ -226,9 +243,15 @@ int codegen(std::shared_ptr<Function> function, const Options &options, int next
   HighLevelCodegen hl_codegen(options, next_label_num);
   hl_codegen.generate(function);
 
+  return hl_codegen.get_next_label_num();
+}
+
+// Optimize the high-level code of a function (once the high-level code
+// of every function in the unit is available), and generate low-level code
+void codegen(std::shared_ptr<Function> function, const Options &options, const AliasAnalysis &alias_analysis, const ModRefAnalysis &mod_ref, const FunctionAttrInference &function_attrs) {
   // Optimizations on high-level IR (if optimizations are enabled)
   if (options.has_option(Options::OPTIMIZE)) {
-    HighLevelOpt hl_opt(options);
+    HighLevelOpt hl_opt(options, alias_analysis, mod_ref, function_attrs);
     hl_opt.optimize(function);
   }
 
@@ -245,8 +268,6 @@ int codegen(std::shared_ptr<Function> function, const Options &options, int next
       ll_opt.optimize(function);
     }
   }
-
-  return hl_codegen.get_next_label_num();
 }
 
 void print_strconst_and_globals(Unit &unit) {
@@ -259,14 +280,26 @@ void print_strconst_and_globals(Unit &unit) {
     printf("%s: .string %s \n", strconst.get_label().c_str(), lv.get_str_value().c_str());
   }
 
-  if (unit.has_global_variables())
-    printf("\n\t.section .bss\n");
-
-  for (auto i = unit.globalvar_cbegin(); i != unit.globalvar_cend(); ++i) {
-    std::string name = i->get_name();
-    std::shared_ptr<Type> type = i->get_type();
-    printf("\t.globl %s\n", name.c_str());
-    printf("%s: .space %u\n", name.c_str(), type->get_storage_size());
+  // Variables declared extern are defined in another unit. Thread-local
+  // variables go in .tbss, so that each thread has its own instance
+  // (at a fixed offset from the thread pointer).
+  for (int is_thread_local = 0; is_thread_local < 2; ++is_thread_local) {
+    bool has_section = false;
+    for (auto i = unit.globalvar_cbegin(); i != unit.globalvar_cend(); ++i) {
+      if (i->is_thread_local() != bool(is_thread_local) || i->get_storage() == StorageClass::EXTERN)
+        continue;
+      if (!has_section) {
+        printf(is_thread_local ? "\n\t.section .tbss,\"awT\",@nobits\n" : "\n\t.section .bss\n");
+        has_section = true;
+      }
+      std::string name = i->get_name();
+      std::shared_ptr<Type> type = i->get_type();
+      if (i->get_storage() != StorageClass::STATIC)
+        printf("\t.globl %s\n", name.c_str());
+      if (is_thread_local)
+        printf("\t.align %u\n", type->get_alignment());
+      printf("%s: .space %u\n", name.c_str(), type->get_storage_size());
+    }
   }
 }
 
@@ -279,7 +312,13 @@ void print_code(Unit &unit, CallbackFn print) {
     std::shared_ptr<Function> fn = *i;
     std::string fn_name = fn->get_name();
 
-    printf("\n\t.globl %s\n", fn_name.c_str());
+    // static functions and outlined functions (which have no symbol)
+    // are local to the unit
+    Symbol *fn_sym = fn->get_symbol();
+    if (fn_sym != nullptr && fn_sym->get_storage() != StorageClass::STATIC)
+      printf("\n\t.globl %s\n", fn_name.c_str());
+    else
+      printf("\n");
     printf("%s:\n", fn_name.c_str());
 
     print(fn, unit.get_options());
@@ -305,9 +344,16 @@ void print_assembly(Unit &unit) {
       assert(options.get_ir_kind_goal() == IRKind::LOWLEVEL_CODE);
       // print low-level instructions
       PrintInstructionSequence<LowLevelFormatter> print_iseq_ll;
+      print_iseq_ll.set_emit_locs(options.has_option(Options::LINE_TABLES));
       std::shared_ptr<InstructionSequence> ll_iseq = fn->get_ll_iseq();
       assert(ll_iseq);
+      // describe the stack frame at every instruction, for unwinding
+      CallFrameInfo call_frame_info(ll_iseq);
+      call_frame_info.execute();
+      print_iseq_ll.set_directives(call_frame_info.get_directives());
+      printf("\t.cfi_startproc\n");
       print_iseq_ll.print(ll_iseq);
+      printf("\t.cfi_endproc\n");
     });
 }
 
@@ -403,7 +449,7 @@ int process_source_file(Options &options, const std::string &filename) {
   // Create a Unit object to represent the entire
   // translation unit. The unit assumes ownership of
   // the AST.
-  Node *ast = parse(filename);
+  Node *ast = parse(filename, options);
   Unit unit(ast, options);
 
   if (ir_kind_goal == IRKind::AST) {
@@ -434,7 +480,7 @@ int process_source_file(Options &options, const std::string &filename) {
   for (auto i = global_symtab->cbegin(); i != global_symtab->cend(); ++i) {
     Symbol *sym = *i;
     if (sym->get_kind() == SymbolKind::VARIABLE)
-      unit.add_global_variable(GlobalVariable(sym->get_name(), sym->get_type()));
+      unit.add_global_variable(GlobalVariable(sym->get_name(), sym->get_type(), sym->get_storage(), sym->is_thread_local()));
   }
 
   // Generate code for functions
@@ -451,26 +497,65 @@ int process_source_file(Options &options, const std::string &filename) {
       // storage allocation decisions, etc.
       std::shared_ptr<Function> function(new Function(fn_name, child, fn_sym));
 
-      // Generate code!
-      next_label_num = codegen(function, options, next_label_num);
+      // Generate high-level code
+      next_label_num = hl_codegen(function, options, next_label_num);
 
       // Add to unit
       unit.add_function(function);
     }
   }
 
+  // Clone functions for calls with constant arguments
+  if (options.has_option(Options::OPTIMIZE)) {
+    FunctionSpecialization specialization(std::vector<std::shared_ptr<Function> >(unit.fn_cbegin(), unit.fn_cend()));
+    specialization.execute();
+    for (auto i = specialization.get_new_functions().begin(); i != specialization.get_new_functions().end(); ++i)
+      unit.add_function(*i);
+  }
+
+  // Points-to analysis, mod/ref summaries, and function attributes
+  // over the whole unit
+  std::vector<std::shared_ptr<Function> > functions(unit.fn_cbegin(), unit.fn_cend());
+  AliasAnalysis alias_analysis(functions);
+  ModRefAnalysis mod_ref(functions, alias_analysis);
+  FunctionAttrInference function_attrs(functions, mod_ref);
+  if (options.has_option(Options::OPTIMIZE)) {
+    alias_analysis.execute();
+    mod_ref.execute();
+    function_attrs.execute();
+  }
+
+  // Optimize, and generate low-level code
+  for (auto i = unit.fn_cbegin(); i != unit.fn_cend(); ++i)
+    codegen(*i, options, alias_analysis, mod_ref, function_attrs);
+
+  // Outline repeated low-level code (when optimizing for size)
+  if (options.has_option(Options::OPTIMIZE_SIZE) && ir_kind_goal == IRKind::LOWLEVEL_CODE) {
+    MachineOutliner outliner(std::vector<std::shared_ptr<Function> >(unit.fn_cbegin(), unit.fn_cend()));
+    outliner.execute();
+    for (auto i = outliner.get_new_functions().begin(); i != outliner.get_new_functions().end(); ++i)
+      unit.add_function(*i);
+  }
+
   str_const_hunt(&unit, unit.get_ast());
 
   // Print string constants and global variables
   // (these are the same regardless of code format)
   print_strconst_and_globals(unit);
 
+  CodeFormat code_format_goal = options.get_code_format_goal();
+
   // Code is generated in the .text section
   if (unit.has_functions())
     printf("\n\t.section .text\n");
 
+  // The .loc directives emitted with each function's code
+  // refer to the source file as file number 1
+  if (options.has_option(Options::LINE_TABLES) && code_format_goal == CodeFormat::ASSEMBLY
+      && ir_kind_goal == IRKind::LOWLEVEL_CODE)
+    printf("\t.file 1 \"%s\"\n", filename.c_str());
+
   // Now we can print the code of the unit (in whatever form it was requested)
-  CodeFormat code_format_goal = options.get_code_format_goal();
   if (code_format_goal == CodeFormat::ASSEMBLY) {
     print_assembly(unit);
   } else if (code_format_goal == CodeFormat::CFG) {
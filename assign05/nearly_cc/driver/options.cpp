@@ -56,12 +56,22 @@ const std::vector<CommandLineOption> OPTIONS = {
   { Options::PRINT_AST, "print AST", int(IRKind::AST) },
   { Options::PRINT_SYMTAB, "print symbol tables", int(IRKind::SYMBOL_TABLE) },
   { Options::OPTIMIZE, "enable optimizations" },
+  { Options::OPTIMIZE_SIZE, "reduce the size of cold code by outlining repeated instructions" },
   { Options::PRINT_CFG, "print control-flow graphs", int(CodeFormat::CFG) },
   { Options::HIGHLEVEL, "high-level code generation", int(IRKind::HIGHLEVEL_CODE) },
   { Options::PRINT_DATAFLOW, "print control-flow graphs with dataflow facts", int(CodeFormat::DATAFLOW_CFG), {
     "liveness", "registers containing live values",
     // If other kinds of dataflow values can be printed could go here
   }},
+  { Options::BISON_PARSER, "parse using the bison-generated parser" },
+  { Options::BASELINE_ISA, "don't use the popcnt, lzcnt, and tzcnt instructions" },
+  { Options::PREFETCH, "memory latency (in cycles) loop prefetches are issued ahead of", -1, {
+    "0", "don't insert prefetches",
+    "100", "100 cycles",
+    "200", "200 cycles (the default)",
+    "400", "400 cycles",
+  }},
+  { Options::LINE_TABLES, "emit .file/.loc directives mapping code to source lines" },
 };
 
 const CommandLineOption &find_option(const std::string &s) {
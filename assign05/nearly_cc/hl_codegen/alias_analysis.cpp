@@ -0,0 +1,436 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <set>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "alias_analysis.h"
+
+namespace {
+
+// the argument registers are also the incoming parameters
+const int VREG_FIRST_ARG = 1;
+const int VREG_LAST_ARG = 6;
+
+const std::set<HighLevelOpcode> NO_VALUE = {
+  HINS_nop, HINS_ret, HINS_jmp, HINS_call, HINS_enter, HINS_leave, HINS_cjmp_t, HINS_cjmp_f,
+  HINS_prefetch, HINS_asm, HINS_fence,
+};
+
+}
+
+AliasAnalysis::AliasAnalysis(const std::vector<std::shared_ptr<Function> > &functions)
+  : m_functions(functions)
+  , m_changed(false) {
+  for (unsigned i = 0; i < m_functions.size(); i++) {
+    m_function_index[m_functions[i].get()] = i;
+    m_function_by_name[m_functions[i]->get_name()] = i;
+  }
+}
+
+AliasAnalysis::~AliasAnalysis() {
+}
+
+void AliasAnalysis::execute() {
+  unsigned num_functions = m_functions.size();
+  m_vreg_nodes.assign(num_functions, std::map<int, int>());
+  m_num_defs.assign(num_functions, std::map<int, unsigned>());
+  m_frame_addr.assign(num_functions, std::map<int, long>());
+  m_fn_nodes.resize(num_functions);
+
+  for (unsigned i = 0; i < num_functions; i++) {
+    m_fn_nodes[i].ret = new_node();
+    m_fn_nodes[i].call_ret = new_node();
+
+    // any function can be called from outside the unit
+    for (int vreg = VREG_FIRST_ARG; vreg <= VREG_LAST_ARG; vreg++)
+      mark(get_pointee(get_vreg_node(i, vreg, false)), false, true);
+    mark(get_pointee(m_fn_nodes[i].ret), true, false);
+  }
+
+  for (unsigned i = 0; i < num_functions; i++) {
+    gen_constraints(i);
+    find_frame_addrs(i);
+  }
+
+  solve();
+
+  // make every node point directly to its class
+  for (unsigned i = 0; i < m_nodes.size(); i++)
+    m_nodes[i].parent = find(i);
+
+  m_class_owner.assign(m_nodes.size(), -1);
+  for (auto i = m_local_objects.begin(); i != m_local_objects.end(); ++i) {
+    int &owner = m_class_owner[find(i->second)];
+    owner = (owner == -1 || owner == int(i->first.first)) ? int(i->first.first) : -2;
+  }
+  for (auto i = m_global_objects.begin(); i != m_global_objects.end(); ++i)
+    m_class_owner[find(i->second)] = -2;
+}
+
+AliasAnalysis::AliasResult AliasAnalysis::alias(std::shared_ptr<Function> fn, const Operand &a, int a_size, const Operand &b, int b_size) const {
+  assert(a.is_memref() && b.is_memref());
+
+  auto it = m_function_index.find(fn.get());
+  if (it == m_function_index.end())
+    return MAY_ALIAS;
+  unsigned fn_index = it->second;
+
+  // the same address computation from vregs which are assigned only once
+  const std::map<int, unsigned> &num_defs = m_num_defs[fn_index];
+  auto single_def = [&num_defs](int vreg) {
+    auto i = num_defs.find(vreg);
+    return vreg > VREG_LAST_ARG && i != num_defs.end() && i->second == 1;
+  };
+  if (a == b && single_def(a.get_base_reg()) && (!a.has_index_reg() || single_def(a.get_index_reg())))
+    return a_size == b_size ? MUST_ALIAS : MAY_ALIAS;
+
+  // fixed locations in the stack frame
+  long a_offset, b_offset;
+  if (get_frame_offset(fn_index, a, a_offset) && get_frame_offset(fn_index, b, b_offset)) {
+    if (a_offset + a_size <= b_offset || b_offset + b_size <= a_offset)
+      return NO_ALIAS;
+    return (a_offset == b_offset && a_size == b_size) ? MUST_ALIAS : MAY_ALIAS;
+  }
+
+  int a_target = get_target(fn_index, a.get_base_reg());
+  int b_target = get_target(fn_index, b.get_base_reg());
+  if (a_target < 0 || b_target < 0 || may_overlap(a_target, b_target))
+    return MAY_ALIAS;
+  return NO_ALIAS;
+}
+
+bool AliasAnalysis::may_escape(std::shared_ptr<Function> fn, const Operand &mem) const {
+  int obj_class = get_object_class(fn, mem);
+  return obj_class < 0 || is_escaped_class(obj_class);
+}
+
+int AliasAnalysis::get_object_class(std::shared_ptr<Function> fn, const Operand &mem) const {
+  assert(mem.is_memref());
+
+  auto it = m_function_index.find(fn.get());
+  if (it == m_function_index.end())
+    return -1;
+  return get_target(it->second, mem.get_base_reg());
+}
+
+bool AliasAnalysis::may_overlap(int a_class, int b_class) const {
+  if (a_class == b_class)
+    return true;
+
+  // a pointer to an unknown object may point to any escaped object
+  const Node &a_node = m_nodes[a_class], &b_node = m_nodes[b_class];
+  return (a_node.unknown && (b_node.unknown || b_node.escaped)) || (b_node.unknown && a_node.escaped);
+}
+
+bool AliasAnalysis::is_escaped_class(int obj_class) const {
+  return m_nodes[obj_class].unknown || m_nodes[obj_class].escaped;
+}
+
+bool AliasAnalysis::is_local_class(std::shared_ptr<Function> fn, int obj_class) const {
+  auto it = m_function_index.find(fn.get());
+  return it != m_function_index.end() && !is_escaped_class(obj_class)
+      && m_class_owner[obj_class] == int(it->second);
+}
+
+int AliasAnalysis::new_node() {
+  int n = int(m_nodes.size());
+  m_nodes.push_back({ n, -1, false, false });
+  return n;
+}
+
+int AliasAnalysis::find(int n) const {
+  while (m_nodes[n].parent != n)
+    n = m_nodes[n].parent;
+  return n;
+}
+
+// Get the class of what the members of a node's class may point to
+int AliasAnalysis::get_pointee(int n) {
+  n = find(n);
+  if (m_nodes[n].pointee < 0) {
+    int pointee = new_node();
+    m_nodes[n].pointee = pointee;
+    m_changed = true;
+  }
+  return find(m_nodes[n].pointee);
+}
+
+// Unify two classes, and (recursively) what they point to
+void AliasAnalysis::join(int a, int b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return;
+
+  m_nodes[b].parent = a;
+  m_nodes[a].unknown = m_nodes[a].unknown || m_nodes[b].unknown;
+  m_nodes[a].escaped = m_nodes[a].escaped || m_nodes[b].escaped;
+  m_changed = true;
+
+  int a_pointee = m_nodes[a].pointee, b_pointee = m_nodes[b].pointee;
+  if (a_pointee < 0)
+    m_nodes[a].pointee = b_pointee;
+  else if (b_pointee >= 0)
+    join(a_pointee, b_pointee);
+}
+
+void AliasAnalysis::mark(int n, bool escaped, bool unknown) {
+  n = find(n);
+  if (escaped && !m_nodes[n].escaped) {
+    m_nodes[n].escaped = true;
+    m_changed = true;
+  }
+  if (unknown && !m_nodes[n].unknown) {
+    m_nodes[n].unknown = true;
+    m_changed = true;
+  }
+}
+
+int AliasAnalysis::get_vreg_node(unsigned fn_index, int vreg, bool is_def) {
+  // vr0 is the return value: a def sets this function's return value,
+  // and a use reads the value returned by a callee
+  if (vreg == 0)
+    return is_def ? m_fn_nodes[fn_index].ret : m_fn_nodes[fn_index].call_ret;
+
+  std::map<int, int> &vreg_nodes = m_vreg_nodes[fn_index];
+  auto i = vreg_nodes.find(vreg);
+  if (i != vreg_nodes.end())
+    return i->second;
+  int n = new_node();
+  vreg_nodes[vreg] = n;
+  return n;
+}
+
+int AliasAnalysis::get_local_node(unsigned fn_index, long offset) {
+  auto key = std::make_pair(fn_index, offset);
+  auto i = m_local_objects.find(key);
+  if (i != m_local_objects.end())
+    return i->second;
+  int n = new_node();
+  m_local_objects[key] = n;
+  return n;
+}
+
+int AliasAnalysis::get_global_node(const std::string &label) {
+  auto i = m_global_objects.find(label);
+  if (i != m_global_objects.end())
+    return i->second;
+  int n = new_node();
+  m_global_objects[label] = n;
+  mark(n, true, false);
+  return n;
+}
+
+void AliasAnalysis::add_constraint(ConstraintKind kind, int dest, int src) {
+  m_constraints.push_back({ kind, dest, src });
+}
+
+void AliasAnalysis::gen_constraints(unsigned fn_index) {
+  std::shared_ptr<InstructionSequence> iseq = m_functions[fn_index]->get_hl_iseq();
+
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+
+    if (opcode == HINS_call) {
+      gen_call_constraints(fn_index, ins);
+      continue;
+    }
+    if (opcode == HINS_asm) {
+      // the asm may access (and store any pointer in) whatever its
+      // operands point to, including the slots the outputs pass through
+      for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+        Operand operand = ins->get_operand(j);
+        if (operand.has_base_reg())
+          mark(get_pointee(get_vreg_node(fn_index, operand.get_base_reg(), false)), true, false);
+      }
+      continue;
+    }
+    if (NO_VALUE.count(opcode) > 0)
+      continue;
+
+    // The computed value may point to whatever any of the source
+    // operands point to (pointer arithmetic is assumed to stay within
+    // an object)
+    int value = new_node();
+    for (unsigned j = 1; j < ins->get_num_operands(); j++) {
+      Operand src = ins->get_operand(j);
+      if (opcode == HINS_localaddr)
+        add_constraint(ADDR, value, get_local_node(fn_index, src.get_imm_ival()));
+      else if (src.get_kind() == Operand::IMM_LABEL)
+        add_constraint(ADDR, value, get_global_node(src.get_label()));
+      else if (src.is_memref())
+        add_constraint(LOAD, value, get_vreg_node(fn_index, src.get_base_reg(), false));
+      else if (src.get_kind() == Operand::VREG)
+        add_constraint(COPY, value, get_vreg_node(fn_index, src.get_base_reg(), false));
+    }
+
+    Operand dest = ins->get_operand(0);
+    if (dest.get_kind() == Operand::VREG) {
+      add_constraint(COPY, get_vreg_node(fn_index, dest.get_base_reg(), true), value);
+      m_num_defs[fn_index][dest.get_base_reg()]++;
+    } else if (dest.is_memref()) {
+      add_constraint(STORE, get_vreg_node(fn_index, dest.get_base_reg(), false), value);
+    }
+
+    // an atomic exchange (or fetch and add, or compare and swap) also
+    // stores its value operands in the object it reads
+    if (opcode >= HINS_atomic_xchg_b && opcode <= HINS_atomic_cmpxchg_q)
+      add_constraint(STORE, get_vreg_node(fn_index, ins->get_operand(1).get_base_reg(), false), value);
+  }
+}
+
+void AliasAnalysis::gen_call_constraints(unsigned fn_index, Instruction *ins) {
+  m_num_defs[fn_index][0]++;
+
+  auto callee = m_function_by_name.find(ins->get_operand(0).get_label());
+  if (callee != m_function_by_name.end()) {
+    // arguments are assigned to the callee's parameters, and the
+    // callee's return value to vr0
+    unsigned callee_index = callee->second;
+    for (int vreg = VREG_FIRST_ARG; vreg <= VREG_LAST_ARG; vreg++)
+      add_constraint(COPY, get_vreg_node(callee_index, vreg, false), get_vreg_node(fn_index, vreg, false));
+    add_constraint(COPY, m_fn_nodes[fn_index].call_ret, m_fn_nodes[callee_index].ret);
+  } else {
+    // a function outside the unit
+    for (int vreg = VREG_FIRST_ARG; vreg <= VREG_LAST_ARG; vreg++)
+      mark(get_pointee(get_vreg_node(fn_index, vreg, false)), true, false);
+    mark(get_pointee(m_fn_nodes[fn_index].call_ret), false, true);
+  }
+}
+
+// Find the vregs that always hold the address of the same local
+// variable: every def is a localaddr of the same offset, or a copy of a
+// vreg holding it
+void AliasAnalysis::find_frame_addrs(unsigned fn_index) {
+  const long UNKNOWN = -1;
+  std::map<int, long> addrs;
+  std::shared_ptr<InstructionSequence> iseq = m_functions[fn_index]->get_hl_iseq();
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+      Instruction *ins = *i;
+      if (!HighLevel::is_def(ins))
+        continue;
+      int dest = HighLevel::get_def_vreg(ins);
+
+      long addr = UNKNOWN;
+      Operand src = ins->get_num_operands() > 1 ? ins->get_operand(1) : Operand();
+      if (ins->get_opcode() == HINS_localaddr) {
+        addr = src.get_imm_ival();
+      } else if (ins->get_opcode() == HINS_mov_q && src.get_kind() == Operand::VREG) {
+        auto j = addrs.find(src.get_base_reg());
+        if (j == addrs.end())
+          continue; // nothing known about the source yet
+        addr = j->second;
+      }
+
+      auto j = addrs.find(dest);
+      if (j == addrs.end()) {
+        addrs[dest] = addr;
+        changed = true;
+      } else if (j->second != addr && j->second != UNKNOWN) {
+        j->second = UNKNOWN;
+        changed = true;
+      }
+    }
+  }
+
+  for (auto i = addrs.begin(); i != addrs.end(); ++i) {
+    if (i->second != UNKNOWN && i->first > VREG_LAST_ARG)
+      m_frame_addr[fn_index][i->first] = i->second;
+  }
+}
+
+void AliasAnalysis::solve() {
+  do {
+    m_changed = false;
+
+    for (auto i = m_constraints.begin(); i != m_constraints.end(); ++i) {
+      const Constraint &c = *i;
+      switch (c.kind) {
+      case ADDR:
+        join(get_pointee(c.dest), c.src);
+        break;
+      case COPY:
+        join(get_pointee(c.dest), get_pointee(c.src));
+        break;
+      case LOAD:
+        {
+          // loading from an escaped object may produce a pointer
+          // to any escaped object
+          int cell = get_pointee(c.src);
+          join(get_pointee(c.dest), get_pointee(cell));
+          if (m_nodes[find(cell)].unknown)
+            mark(get_pointee(c.dest), false, true);
+        }
+        break;
+      case STORE:
+        {
+          // a pointer stored in an escaped object escapes
+          int cell = get_pointee(c.dest);
+          join(get_pointee(cell), get_pointee(c.src));
+          if (m_nodes[find(cell)].unknown)
+            mark(get_pointee(c.src), true, false);
+        }
+        break;
+      }
+    }
+
+    // Whatever an escaped object points to escapes as well, and code
+    // outside the unit may store a pointer to any escaped object in it
+    for (unsigned n = 0; n < m_nodes.size(); n++) {
+      if (m_nodes[n].parent == int(n) && m_nodes[n].escaped && m_nodes[n].pointee >= 0)
+        mark(m_nodes[n].pointee, true, true);
+    }
+  } while (m_changed);
+}
+
+// Get the class of what a vreg may point to, or -1 if the vreg
+// wasn't analyzed
+int AliasAnalysis::get_target(unsigned fn_index, int vreg) const {
+  int n;
+  if (vreg == 0) {
+    n = m_fn_nodes[fn_index].call_ret;
+  } else {
+    auto i = m_vreg_nodes[fn_index].find(vreg);
+    if (i == m_vreg_nodes[fn_index].end())
+      return -1;
+    n = i->second;
+  }
+  int pointee = m_nodes[find(n)].pointee;
+  return pointee < 0 ? -1 : find(pointee);
+}
+
+// Get the stack frame offset of a memory operand whose address is
+// always the same local variable address (plus a constant)
+bool AliasAnalysis::get_frame_offset(unsigned fn_index, const Operand &mem, long &offset) const {
+  if (mem.get_kind() != Operand::VREG_MEM && mem.get_kind() != Operand::VREG_MEM_OFF)
+    return false;
+  auto i = m_frame_addr[fn_index].find(mem.get_base_reg());
+  if (i == m_frame_addr[fn_index].end())
+    return false;
+  offset = i->second + (mem.get_kind() == Operand::VREG_MEM_OFF ? mem.get_offset() : 0);
+  return true;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <set>
+#include "highlevel.h"
+#include "cfg_builder.h"
+#include "builtins.h"
+#include "function_attr_inference.h"
+
+namespace {
+
+// C library functions which never return
+const std::set<std::string> LIBC_NORETURN = { "exit", "abort", "_exit", "_Exit" };
+
+}
+
+FunctionAttrInference::FunctionAttrInference(const std::vector<std::shared_ptr<Function> > &functions, const ModRefAnalysis &mod_ref)
+  : m_functions(functions)
+  , m_mod_ref(mod_ref) {
+  for (unsigned i = 0; i < m_functions.size(); i++)
+    m_function_by_name[m_functions[i]->get_name()] = i;
+}
+
+FunctionAttrInference::~FunctionAttrInference() {
+}
+
+void FunctionAttrInference::execute() {
+  for (unsigned i = 0; i < m_functions.size(); i++) {
+    std::shared_ptr<Function> fn = m_functions[i];
+    unsigned attributes = 0;
+
+    const ModRefAnalysis::Summary *summary = m_mod_ref.get_summary(fn->get_name());
+    assert(summary != nullptr);
+    if (!summary->unknown_effects && summary->mod.empty()) {
+      attributes |= Function::ATTR_PURE;
+      if (summary->ref.empty())
+        attributes |= Function::ATTR_CONST;
+    }
+
+    std::shared_ptr<InstructionSequence> iseq = fn->get_hl_iseq();
+    bool has_calls = false;
+    for (auto j = iseq->cbegin(); j != iseq->cend(); ++j) {
+      // a call to a builtin isn't a real call in the low-level code
+      if ((*j)->get_opcode() == HINS_call && find_builtin((*j)->get_operand(0).get_label()) == nullptr)
+        has_calls = true;
+    }
+    if (!has_calls)
+      attributes |= Function::ATTR_LEAF;
+
+    fn->set_attributes(attributes);
+  }
+
+  // a function is noreturn if it can't reach its exit block without
+  // calling a noreturn function (functions are assumed to return
+  // until shown otherwise)
+  std::vector<std::shared_ptr<ControlFlowGraph> > cfgs;
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i) {
+    auto cfg_builder = ::make_highlevel_cfg_builder((*i)->get_hl_iseq());
+    cfgs.push_back(cfg_builder.build());
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (unsigned i = 0; i < m_functions.size(); i++) {
+      std::shared_ptr<Function> fn = m_functions[i];
+      if (fn->has_attribute(Function::ATTR_NORETURN))
+        continue;
+
+      std::vector<bool> reachable = find_reachable_blocks(cfgs[i]);
+      if (!reachable[cfgs[i]->get_exit_block()->get_block_id()]) {
+        fn->set_attributes(fn->get_attributes() | Function::ATTR_NORETURN);
+        changed = true;
+      }
+    }
+  }
+}
+
+unsigned FunctionAttrInference::get_attributes(const std::string &fn_name) const {
+  auto i = m_function_by_name.find(fn_name);
+  if (i != m_function_by_name.end())
+    return m_functions[i->second]->get_attributes();
+  const Builtin *builtin = find_builtin(fn_name);
+  if (builtin != nullptr && builtin->kind == BuiltinKind::UNREACHABLE)
+    return Function::ATTR_NORETURN;
+  return LIBC_NORETURN.count(fn_name) > 0 ? unsigned(Function::ATTR_NORETURN) : 0;
+}
+
+unsigned FunctionAttrInference::get_num_params(const std::string &fn_name) const {
+  auto i = m_function_by_name.find(fn_name);
+  if (i == m_function_by_name.end())
+    return 0;
+  // (specialized clones have no symbol, but share the original's AST)
+  return m_functions[i->second]->get_funcdef_ast()->get_kid(2)->get_num_kids();
+}
+
+std::vector<bool> FunctionAttrInference::find_reachable_blocks(std::shared_ptr<ControlFlowGraph> cfg) const {
+  std::vector<bool> reachable(cfg->get_num_blocks(), false);
+  std::vector<std::shared_ptr<InstructionSequence> > work_list;
+
+  reachable[cfg->get_entry_block()->get_block_id()] = true;
+  work_list.push_back(cfg->get_entry_block());
+  while (!work_list.empty()) {
+    std::shared_ptr<InstructionSequence> bb = work_list.back();
+    work_list.pop_back();
+
+    // control doesn't continue past a call to a noreturn function
+    // (calls always end a basic block)
+    if (bb->get_length() > 0 && is_noreturn_call(bb->get_last_instruction()))
+      continue;
+
+    const ControlFlowGraph::EdgeList &outgoing_edges = cfg->get_outgoing_edges(bb);
+    for (auto i = outgoing_edges.cbegin(); i != outgoing_edges.cend(); ++i) {
+      std::shared_ptr<InstructionSequence> target = (*i)->get_target();
+      if (!reachable[target->get_block_id()]) {
+        reachable[target->get_block_id()] = true;
+        work_list.push_back(target);
+      }
+    }
+  }
+
+  return reachable;
+}
+
+bool FunctionAttrInference::is_noreturn_call(Instruction *ins) const {
+  return ins->get_opcode() == HINS_call
+      && (get_attributes(ins->get_operand(0).get_label()) & Function::ATTR_NORETURN) != 0;
+}
@@ -0,0 +1,270 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "function_specialization.h"
+
+namespace {
+
+// Only functions with at most this many high-level instructions
+// are cloned
+const int MAX_CLONE_SIZE = 200;
+
+// The clones may add this percentage of the unit's high-level code
+// (but at least MIN_BUDGET instructions)
+const int BUDGET_PERCENT = 50;
+const int MIN_BUDGET = 200;
+
+}
+
+FunctionSpecialization::FunctionSpecialization(const std::vector<std::shared_ptr<Function> > &functions)
+  : m_functions(functions)
+  , m_budget(0) {
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i)
+    m_function_by_name[(*i)->get_name()] = *i;
+}
+
+FunctionSpecialization::~FunctionSpecialization() {
+}
+
+void FunctionSpecialization::execute() {
+  int unit_size = 0;
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i)
+    unit_size += (*i)->get_hl_iseq()->get_length();
+  m_budget = std::max(MIN_BUDGET, unit_size * BUDGET_PERCENT / 100);
+
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i)
+    specialize_calls(*i);
+}
+
+std::map<int, long> FunctionSpecialization::find_constant_vregs(std::shared_ptr<InstructionSequence> iseq) {
+  // Count the definitions of each vreg. Calls (and inline assembly)
+  // clobber vr0-vr9 (as far as the low-level code is concerned), so in
+  // a function with calls, those can't be constant.
+  std::map<int, int> num_defs;
+  bool has_calls = false;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    if (ins->get_opcode() == HINS_call || ins->get_opcode() == HINS_asm)
+      has_calls = true;
+    if (HighLevel::is_def(ins))
+      ++num_defs[HighLevel::get_def_vreg(ins)];
+  }
+
+  // A vreg with a single definition computing its value from constants
+  // only is a constant (iterating until nothing changes, since
+  // definitions can use other constant vregs)
+  std::map<int, long> constants;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+      Instruction *ins = *i;
+      if (!HighLevel::is_def(ins) || ins->get_opcode() == HINS_call)
+        continue;
+      int vreg = HighLevel::get_def_vreg(ins);
+      if (vreg == 0 || (has_calls && vreg < 10) || num_defs[vreg] != 1 || constants.count(vreg) > 0)
+        continue;
+
+      std::vector<long> args;
+      bool known = true;
+      for (unsigned j = 1; j < ins->get_num_operands() && known; ++j) {
+        Operand operand = ins->get_operand(j);
+        if (operand.is_imm_ival())
+          args.push_back(operand.get_imm_ival());
+        else if (operand.get_kind() == Operand::VREG && constants.count(operand.get_base_reg()) > 0)
+          args.push_back(constants[operand.get_base_reg()]);
+        else
+          known = false;
+      }
+
+      long value;
+      if (known && !args.empty() && HighLevel::evaluate(ins->get_opcode(), args, value)) {
+        constants[vreg] = value;
+        changed = true;
+      }
+    }
+  }
+
+  return constants;
+}
+
+// Redirect the calls in a function which pass constant arguments
+// to specialized clones of the callees
+void FunctionSpecialization::specialize_calls(std::shared_ptr<Function> fn) {
+  std::shared_ptr<InstructionSequence> iseq = fn->get_hl_iseq();
+  std::map<int, long> constants = find_constant_vregs(iseq);
+
+  // constant values of the argument registers, as set up (in the
+  // same basic block) for the next call
+  std::map<int, long> args;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    if (i.has_label())
+      args.clear();
+
+    if (ins->get_opcode() == HINS_call) {
+      auto callee = m_function_by_name.find(ins->get_operand(0).get_label());
+      if (callee != m_function_by_name.end() && callee->second != fn && !args.empty()) {
+        // only the arguments the callee actually has
+        unsigned num_params = callee->second->get_symbol()->get_type()->get_num_members();
+        std::map<int, long> const_args;
+        for (auto j = args.begin(); j != args.end(); ++j) {
+          if (unsigned(j->first) <= num_params)
+            const_args.insert(*j);
+        }
+        std::shared_ptr<Function> clone = const_args.empty() ? nullptr : get_clone(callee->second, const_args);
+        if (clone)
+          ins->set_operand(0, Operand(Operand::LABEL, clone->get_name()));
+      }
+      args.clear();
+      continue;
+    }
+
+    if (!HighLevel::is_def(ins))
+      continue;
+    int vreg = HighLevel::get_def_vreg(ins);
+    if (vreg < 1 || vreg > 6)
+      continue;
+    Operand src = ins->get_num_operands() == 2 ? ins->get_operand(1) : Operand();
+    bool is_mov = ins->get_opcode() >= HINS_mov_b && ins->get_opcode() <= HINS_mov_q;
+    if (is_mov && src.is_imm_ival())
+      args[vreg] = src.get_imm_ival();
+    else if (is_mov && src.get_kind() == Operand::VREG && constants.count(src.get_base_reg()) > 0)
+      args[vreg] = constants[src.get_base_reg()];
+    else
+      args.erase(vreg);
+  }
+}
+
+std::shared_ptr<Function> FunctionSpecialization::get_clone(std::shared_ptr<Function> callee, const std::map<int, long> &const_args) {
+  auto key = std::make_pair(callee->get_name(), const_args);
+  auto i = m_clones.find(key);
+  if (i != m_clones.end())
+    return i->second;
+
+  std::shared_ptr<Function> clone;
+  int size = callee->get_hl_iseq()->get_length();
+  if (size <= MAX_CLONE_SIZE && size <= m_budget) {
+    clone = create_clone(callee, const_args);
+    if (clone) {
+      m_budget -= size;
+      m_new_functions.push_back(clone);
+    }
+  }
+  m_clones[key] = clone;
+  return clone;
+}
+
+// Create a clone of a function with constants for some of its
+// parameters (or nullptr if it doesn't pay off)
+std::shared_ptr<Function> FunctionSpecialization::create_clone(std::shared_ptr<Function> callee, const std::map<int, long> &const_args) {
+  // the clone's name and labels get a suffix that can't clash with
+  // C identifiers
+  std::string suffix = ".spec" + std::to_string(m_new_functions.size() + 1);
+  std::shared_ptr<InstructionSequence> orig_iseq = callee->get_hl_iseq();
+  std::set<std::string> labels;
+  for (unsigned i = 0; i < orig_iseq->get_length(); ++i) {
+    if (orig_iseq->has_label(i))
+      labels.insert(orig_iseq->get_label_at_index(i));
+  }
+
+  // copy the code, using the constants instead of the parameter
+  // registers where the parameters are copied at the entry (before
+  // the first label or call)
+  std::shared_ptr<InstructionSequence> iseq(new InstructionSequence());
+  bool in_entry = true;
+  for (auto i = orig_iseq->cbegin(); i != orig_iseq->cend(); ++i) {
+    Instruction *ins = (*i)->duplicate();
+    if (i.has_label()) {
+      iseq->define_label(i.get_label() + suffix);
+      in_entry = false;
+    }
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      Operand operand = ins->get_operand(j);
+      if (operand.get_kind() == Operand::LABEL && labels.count(operand.get_label()) > 0)
+        ins->set_operand(j, Operand(Operand::LABEL, operand.get_label() + suffix));
+      else if (in_entry && HighLevel::is_use(ins, j) && operand.get_kind() == Operand::VREG
+               && const_args.count(operand.get_base_reg()) > 0)
+        ins->set_operand(j, Operand(Operand::IMM_IVAL, const_args.at(operand.get_base_reg())));
+    }
+    if (ins->get_opcode() == HINS_call || ins->get_opcode() == HINS_asm)
+      in_entry = false;
+    iseq->append(ins);
+  }
+
+  int num_folded;
+  iseq = fold_constants(iseq, num_folded);
+  if (num_folded == 0)
+    return nullptr;
+
+  // like an outlined function, a clone has no symbol, so it isn't
+  // exported from the unit
+  std::shared_ptr<Function> clone(new Function(callee->get_name() + suffix, callee->get_funcdef_ast(), nullptr));
+  clone->set_hl_iseq(iseq);
+  return clone;
+}
+
+// Replace definitions of constant vregs with moves of the constants,
+// and conditional jumps on constants with unconditional jumps (or
+// nothing, keeping a nop if the jump is labeled).
+// num_folded is set to the number of conditional jumps removed.
+std::shared_ptr<InstructionSequence> FunctionSpecialization::fold_constants(std::shared_ptr<InstructionSequence> iseq, int &num_folded) {
+  std::map<int, long> constants = find_constant_vregs(iseq);
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  num_folded = 0;
+
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+    Instruction *replacement = nullptr;
+
+    if (opcode == HINS_cjmp_t || opcode == HINS_cjmp_f) {
+      Operand cond = ins->get_operand(0);
+      if (cond.get_kind() == Operand::VREG && constants.count(cond.get_base_reg()) > 0) {
+        // the low-level code tests the low byte of the condition
+        bool taken = ((constants[cond.get_base_reg()] & 0xff) != 0) == (opcode == HINS_cjmp_t);
+        ++num_folded;
+        if (!taken && !i.has_label())
+          continue;
+        replacement = taken ? new Instruction(HINS_jmp, ins->get_operand(1)) : new Instruction(HINS_nop);
+      }
+    } else if (HighLevel::is_def(ins) && opcode != HINS_call && constants.count(HighLevel::get_def_vreg(ins)) > 0
+               && !(opcode >= HINS_mov_b && opcode <= HINS_mov_q && ins->get_operand(1).is_imm_ival())) {
+      int size = highlevel_opcode_get_dest_operand_size(opcode);
+      HighLevelOpcode mov_opcode = HighLevelOpcode(HINS_mov_b + (size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3));
+      replacement = new Instruction(mov_opcode, ins->get_operand(0), Operand(Operand::IMM_IVAL, constants[HighLevel::get_def_vreg(ins)]));
+    }
+
+    if (i.has_label())
+      result->define_label(i.get_label());
+    if (replacement) {
+      replacement->set_comment(ins->get_comment());
+      replacement->set_loc(ins->get_loc());
+      result->append(replacement);
+    } else {
+      result->append(ins->duplicate());
+    }
+  }
+
+  return result;
+}
@@ -29,6 +29,8 @@
 #include "local_storage_allocation.h"
 #include "highlevel_codegen.h"
 #include "string_constant.h"
+#include "literal_value.h"
+#include "inline_asm.h"
 
 
 // Adjust an opcode for a basic type
@@ -64,6 +66,23 @@ void HighLevelCodegen::generate(std::shared_ptr<Function> function) {
   visit(function->get_funcdef_ast());
 }
 
+void HighLevelCodegen::visit(Node *n) {
+  std::shared_ptr<InstructionSequence> hl_iseq = get_hl_iseq();
+  unsigned start = hl_iseq->get_length();
+
+  ASTVisitor::visit(n);
+
+  // Descendants are visited first, so instructions that already
+  // have a Location came from a more specific (deeper) node
+  if (!n->get_loc().is_valid())
+    return;
+  for (unsigned i = start; i < hl_iseq->get_length(); ++i) {
+    Instruction *ins = hl_iseq->get_instruction(i);
+    if (!ins->get_loc().is_valid())
+      ins->set_loc(n->get_loc());
+  }
+}
+
 void HighLevelCodegen::visit_function_definition(Node *n) {
   //TODO: SCOPE?????
   // generate the name of the label that return instructions should target
@@ -87,13 +106,27 @@ void HighLevelCodegen::visit_function_definition(Node *n) {
 
     HighLevelOpcode opcode = get_opcode(HINS_mov_b, param->get_type());
 
+    //get source register
+    Operand input_reg = Operand(Operand::VREG, index);
+
+    Symbol *param_sym = param->get_symbol();
+    if (param_sym->get_reg() == -1 && param_sym->get_al() != -1) { //address is taken: store in memory
+      int i_addr = m_function->get_vra()->alloc_local();
+      Operand addr = Operand(Operand::VREG, i_addr);
+      Instruction* inst = new Instruction(HINS_localaddr, addr, Operand(Operand::IMM_IVAL, param_sym->get_al()));
+      inst->set_comment("Store stack memory in a VReg");
+      get_hl_iseq()->append(inst);
+
+      inst = new Instruction(opcode, Operand(Operand::VREG_MEM, i_addr), input_reg);
+      inst->set_comment("Moving Input Parameter " + std::to_string(index) + " to memory");
+      get_hl_iseq()->append(inst);
+      continue;
+    }
+
     //get local input register
     int i_local = m_function->get_vra()->alloc_local();
     Operand local_reg = Operand(Operand::VREG, i_local);
 
-    //get source register
-    Operand input_reg = Operand(Operand::VREG, index);
-
     Instruction* inst = new Instruction(opcode, local_reg, input_reg);
     inst->set_comment("Moving Input Parameter " + std::to_string(index)  + " to local vr" + std::to_string(i_local));
     get_hl_iseq()->append(inst);
@@ -108,7 +141,7 @@ void HighLevelCodegen::visit_function_definition(Node *n) {
 
   m_function->get_vra()->leave_block(mark,reg);
 
-  get_hl_iseq()->define_label(m_return_label_name);
+  define_label(m_return_label_name);
   get_hl_iseq()->append(new Instruction(HINS_leave, Operand(Operand::IMM_IVAL, total_local_storage)));
   get_hl_iseq()->append(new Instruction(HINS_ret));
 }
@@ -130,7 +163,7 @@ void HighLevelCodegen::visit_expression_statement(Node *n) {
 }
 
 void HighLevelCodegen::visit_return_statement(Node *n) {
-  // TODO: implement
+  get_hl_iseq()->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, m_return_label_name)));
 }
 
 void HighLevelCodegen::visit_return_expression_statement(Node *n) {
@@ -155,19 +188,21 @@ void HighLevelCodegen::visit_while_statement(Node *n) {
   std::string m_bottom_label_name = loop_label + "_end_while_loop";
 
   //LOOP:
-  get_hl_iseq()->define_label(m_top_label_name);
+  define_label(m_top_label_name);
   //conditional statement
   Node* condition = n->get_kid(0);
   visit(condition);
   Operand loop = condition->get_operand();
-  get_hl_iseq()->append(new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_bottom_label_name)));
+  Instruction* cjmp_inst = new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_bottom_label_name));
+  hint_conditional_jump(cjmp_inst, condition);
+  get_hl_iseq()->append(cjmp_inst);
 
   //loop body
   Node* body = n->get_kid(1);
   visit(body);
 
   get_hl_iseq()->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, m_top_label_name)));   //continue loop
-  get_hl_iseq()->define_label(m_bottom_label_name);
+  define_label(m_bottom_label_name);
 }
 
 void HighLevelCodegen::visit_do_while_statement(Node *n) {
@@ -177,7 +212,7 @@ void HighLevelCodegen::visit_do_while_statement(Node *n) {
   std::string m_bottom_label_name = loop_label + "_end_do_while_loop";
 
   //LOOP:
-  get_hl_iseq()->define_label(m_top_label_name);
+  define_label(m_top_label_name);
 
   //loop body
   Node* body = n->get_kid(0);
@@ -187,10 +222,12 @@ void HighLevelCodegen::visit_do_while_statement(Node *n) {
   Node* condition = n->get_kid(1);
   visit(condition);
   Operand loop = condition->get_operand();
-  get_hl_iseq()->append(new Instruction(HINS_cjmp_t, loop, Operand(Operand::LABEL, m_top_label_name)));
+  Instruction* cjmp_inst = new Instruction(HINS_cjmp_t, loop, Operand(Operand::LABEL, m_top_label_name));
+  hint_conditional_jump(cjmp_inst, condition);
+  get_hl_iseq()->append(cjmp_inst);
 
   //drop out of loop
-  get_hl_iseq()->define_label(m_bottom_label_name);
+  define_label(m_bottom_label_name);
 }
 
 void HighLevelCodegen::visit_for_statement(Node *n) {
@@ -202,21 +239,23 @@ void HighLevelCodegen::visit_for_statement(Node *n) {
   std::string m_bottom_label_name = if_label + "_end_for_loop";
 
   //LOOP:
-  get_hl_iseq()->define_label(m_top_label_name);
+  define_label(m_top_label_name);
   
   //init conditional statement
   Node* def_loop_it = n->get_kid(0);
   visit(def_loop_it);
-  get_hl_iseq()->define_label(m_comp_label_name);
+  define_label(m_comp_label_name);
 
   //conditional statement
   Node* loop_comp = n->get_kid(1);
   visit(loop_comp);
   Operand comp_res = loop_comp->get_operand();
-  get_hl_iseq()->append(new Instruction(HINS_cjmp_f, comp_res, Operand(Operand::LABEL, m_bottom_label_name)));
+  Instruction* cjmp_inst = new Instruction(HINS_cjmp_f, comp_res, Operand(Operand::LABEL, m_bottom_label_name));
+  hint_conditional_jump(cjmp_inst, loop_comp);
+  get_hl_iseq()->append(cjmp_inst);
 
   //if body
-  get_hl_iseq()->define_label(m_body_label_name);
+  define_label(m_body_label_name);
   Node* body = n->get_kid(3);
   visit(body);
 
@@ -225,7 +264,7 @@ void HighLevelCodegen::visit_for_statement(Node *n) {
   visit(loop_inc);
   get_hl_iseq()->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, m_comp_label_name)));   //continue loop
   
-  get_hl_iseq()->define_label(m_bottom_label_name);
+  define_label(m_bottom_label_name);
 }
 
 void HighLevelCodegen::visit_if_statement(Node *n) {
@@ -236,19 +275,21 @@ void HighLevelCodegen::visit_if_statement(Node *n) {
   std::string m_bottom_label_name = if_label + "_end_if_stmt";
 
   //LOOP:
-  get_hl_iseq()->define_label(m_top_label_name);
+  define_label(m_top_label_name);
   //conditional statement
   Node* condition = n->get_kid(0);
   visit(condition);
   Operand loop = condition->get_operand();
-  get_hl_iseq()->append(new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_bottom_label_name)));
+  Instruction* cjmp_inst = new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_bottom_label_name));
+  hint_conditional_jump(cjmp_inst, condition);
+  get_hl_iseq()->append(cjmp_inst);
 
   //if body
-  get_hl_iseq()->define_label(m_body_label_name);
+  define_label(m_body_label_name);
   Node* body = n->get_kid(1);
   visit(body);
 
-  get_hl_iseq()->define_label(m_bottom_label_name);
+  define_label(m_bottom_label_name);
 }
 
 void HighLevelCodegen::visit_if_else_statement(Node *n) {
@@ -260,26 +301,124 @@ void HighLevelCodegen::visit_if_else_statement(Node *n) {
   std::string m_bottom_label_name = if_label + "_end_if_stmt";
 
   //LOOP:
-  get_hl_iseq()->define_label(m_top_label_name);
+  define_label(m_top_label_name);
   //conditional statement
   Node* condition = n->get_kid(0);
   visit(condition);
   Operand loop = condition->get_operand();
-  get_hl_iseq()->append(new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_body2_label_name))); //skip to else
+  Instruction* cjmp_inst = new Instruction(HINS_cjmp_f, loop, Operand(Operand::LABEL, m_body2_label_name)); //skip to else
+  hint_conditional_jump(cjmp_inst, condition);
+  get_hl_iseq()->append(cjmp_inst);
 
   //if body
-  get_hl_iseq()->define_label(m_body1_label_name);
+  define_label(m_body1_label_name);
   Node* if_body = n->get_kid(1);
   visit(if_body);
   get_hl_iseq()->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, m_bottom_label_name)));//exit if
 
   //else body 
-  get_hl_iseq()->define_label(m_body2_label_name);
+  define_label(m_body2_label_name);
   Node* else_body = n->get_kid(2);
   visit(else_body);  //TODO: ELSE IF IS FAILING
   get_hl_iseq()->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, m_bottom_label_name)));//exit if
 
-  get_hl_iseq()->define_label(m_bottom_label_name);
+  define_label(m_bottom_label_name);
+}
+
+// An asm statement becomes one asm instruction whose operands are the
+// outputs followed by the inputs. Outputs and memory inputs go through
+// the stack slots LocalStorageAllocation reserved for them: the
+// low-level code loads register operands from the slots before the asm
+// and stores register outputs back to them after it, and then the
+// outputs are copied from their slots to their lvalues.
+void HighLevelCodegen::visit_asm_statement(Node *n) {
+  Node *outputs = n->get_kid(1);
+  Node *inputs = n->get_kid(2);
+  Node *clobber_list = n->get_kid(3);
+
+  std::vector<InlineAsm::Constraint> constraints;
+  std::vector<Operand> operands;
+  std::vector<Operand> lvalues;
+  for (Node *operand_list : {outputs, inputs}) {
+    bool is_output = (operand_list == outputs);
+    for (auto i = operand_list->cbegin(); i != operand_list->cend(); ++i) {
+      Node *operand = *i;
+      Node *expr = operand->get_kid(1);
+      InlineAsm::Constraint constraint;
+      InlineAsm::parse_constraint(LiteralValue::from_str_literal(operand->get_kid(0)->get_str(), operand->get_loc()).get_str_value(),
+                                  is_output, constraint);
+      constraint.size = expr->get_type()->get_storage_size();
+
+      if (constraint.kind == InlineAsm::IMM) {
+        constraints.push_back(constraint);
+        operands.push_back(Operand(Operand::IMM_IVAL, LiteralValue::from_int_literal(expr->get_str(), expr->get_loc()).get_int_value()));
+        continue;
+      }
+
+      visit(expr);
+      Operand value = expr->get_operand();
+      HighLevelOpcode mov_opcode = get_opcode(HINS_mov_b, expr->get_type());
+      if (constraint.tied_to >= 0) {
+        //a tied input is loaded into its output's register, so it has the output's size
+        int size = constraints[constraint.tied_to].size;
+        if (constraint.size < size) {
+          value = get_widened_operand(expr, size);
+          mov_opcode = HighLevelOpcode(HINS_mov_b + (size == 2 ? 1 : size == 4 ? 2 : 3));
+        }
+        constraint.size = size;
+      }
+
+      Operand asm_operand;
+      if (operand->get_asm_slot() >= 0) {
+        int i_addr = m_function->get_vra()->alloc_local();
+        Operand addr = Operand(Operand::VREG, i_addr);
+        Instruction* inst = new Instruction(HINS_localaddr, addr, Operand(Operand::IMM_IVAL, operand->get_asm_slot()));
+        inst->set_comment("Store asm operand slot in a VReg");
+        get_hl_iseq()->append(inst);
+        asm_operand = Operand(Operand::VREG_MEM, i_addr);
+
+        if (!is_output || constraint.is_inout) {
+          Instruction* st_inst = new Instruction(mov_opcode, asm_operand, value);
+          st_inst->set_comment("Store asm operand value");
+          get_hl_iseq()->append(st_inst);
+        }
+        if (is_output)
+          lvalues.push_back(value);
+      } else if (value.get_kind() == Operand::VREG && value.get_base_reg() >= LocalStorageAllocation::VREG_FIRST_LOCAL) {
+        asm_operand = value;
+      } else {
+        //the argument and return value registers may be assigned to operands
+        int i_v_temp = m_function->get_vra()->alloc_local();
+        asm_operand = Operand(Operand::VREG, i_v_temp);
+        Instruction* inst = new Instruction(mov_opcode, asm_operand, value);
+        inst->set_comment("Store asm operand value");
+        get_hl_iseq()->append(inst);
+      }
+      constraints.push_back(constraint);
+      operands.push_back(asm_operand);
+    }
+  }
+
+  std::vector<MachineReg> clobbers;
+  for (auto i = clobber_list->cbegin(); i != clobber_list->cend(); ++i) {
+    Node *clobber = *i;
+    InlineAsm::parse_clobber(LiteralValue::from_str_literal(clobber->get_str(), clobber->get_loc()).get_str_value(), clobbers);
+  }
+
+  std::string asm_template = LiteralValue::from_str_literal(n->get_kid(0)->get_str(), n->get_loc()).get_str_value();
+  Instruction* inst = new Instruction(HINS_asm);
+  for (const Operand &asm_operand : operands)
+    inst->append_operand(asm_operand);
+  inst->set_inline_asm(std::make_shared<InlineAsm>(asm_template, constraints, clobbers));
+  inst->set_comment("Inline assembly");
+  get_hl_iseq()->append(inst);
+
+  for (unsigned i = 0; i < lvalues.size(); ++i) {
+    HighLevelOpcode mov_opcode = get_opcode(HINS_mov_b, outputs->get_kid(i)->get_kid(1)->get_type());
+    Instruction* ld_inst = new Instruction(mov_opcode, lvalues[i], operands[i]);
+    ld_inst->set_comment("Move asm output to its destination");
+    get_hl_iseq()->append(ld_inst);
+  }
 }
 
 void HighLevelCodegen::visit_binary_expression(Node *n) {
@@ -297,6 +436,8 @@ void HighLevelCodegen::visit_binary_expression(Node *n) {
 
   if (op == "=") {//assignment
     opcode = get_opcode(HINS_mov_b, n->get_type());
+    if (n->get_type()->is_integral() && rhs->get_type()->is_integral())
+      r_reg = get_widened_operand(rhs, n->get_type()->get_storage_size());
     get_hl_iseq()->append(new Instruction(opcode, l_reg, r_reg));
 
     n->set_operand(l_reg);
@@ -325,6 +466,13 @@ void HighLevelCodegen::visit_binary_expression(Node *n) {
       opcode = get_opcode(HINS_cmpneq_b, n->get_type());
     }
 
+    //narrower operands of a long (or pointer) operation are widened
+    int size = n->get_type()->get_storage_size();
+    if (lhs->get_type()->is_integral())
+      l_reg = get_widened_operand(lhs, size);
+    if (rhs->get_type()->is_integral())
+      r_reg = get_widened_operand(rhs, size);
+
     //setup temp destintation
     int i_v_temp = m_function->get_vra()->alloc_local();
     Operand v_temp = Operand(Operand::VREG, i_v_temp);
@@ -379,6 +527,10 @@ void HighLevelCodegen::visit_unary_expression(Node *n) {
 
 
     n->set_operand(Operand(Operand::VREG_MEM, addr.get_base_reg()));
+  } else if (op == "&" && reg.get_kind() == Operand::VREG_MEM) { //address of a memory lvalue is its base
+    n->set_operand(Operand(Operand::VREG, reg.get_base_reg()));
+  } else if (op == "&" && (value->get_type()->is_array() || value->get_type()->is_struct())) { //already an address
+    n->set_operand(reg);
   } else if (op == "&") {
     int i_addr = m_function->get_vra()->alloc_local();
     Operand addr = Operand(Operand::VREG, i_addr);
@@ -392,8 +544,31 @@ void HighLevelCodegen::visit_unary_expression(Node *n) {
 
 void HighLevelCodegen::visit_function_call_expression(Node *n) {
   std::string fn_name = n->get_kid(0)->get_kid(0)->get_str();
+  const Builtin *builtin = find_builtin(fn_name);
+  if (builtin != nullptr) {
+    visit_builtin_call(n, *builtin);
+    return;
+  }
   Node* arg_list = n->get_kid(1);
   visit(arg_list);
+
+  // Every argument is copied to a temporary before any argument register
+  // is set: the low-level code for a load from memory may use the
+  // argument registers as address temporaries
+  std::vector<Operand> arg_temps;
+  for (auto i = arg_list->cbegin(); i != arg_list->cend(); ++i) {
+    Node *arg = *i;
+
+    //get source register (narrow values are passed widened to 64 bits)
+    Operand s_reg = arg->get_type()->is_integral() ? get_widened_operand(arg, 8) : arg->get_operand();
+
+    int i_v_temp = m_function->get_vra()->alloc_local();
+    Operand v_temp = Operand(Operand::VREG, i_v_temp);
+    Instruction* t_inst = new Instruction(HINS_mov_q, v_temp, s_reg);
+    t_inst->set_comment("Safely Store Input Parameter: " + arg->get_str());
+    get_hl_iseq()->append(t_inst);
+    arg_temps.push_back(v_temp);
+  }
   for (auto i = arg_list->cbegin(); i != arg_list->cend(); ++i) {
     //setup
     Node *arg = *i;
@@ -409,16 +584,7 @@ void HighLevelCodegen::visit_function_call_expression(Node *n) {
     //get fn register
     Operand f_reg = Operand(Operand::VREG, index);
 
-    //get source register
-    Operand s_reg = arg->get_operand();
-
-    int i_v_temp = m_function->get_vra()->alloc_local();
-    Operand v_temp = Operand(Operand::VREG, i_v_temp);
-    Instruction* t_inst = new Instruction(HINS_mov_q, v_temp, s_reg);
-    t_inst->set_comment("Safely Store Input Parameter: " + arg->get_str());
-    get_hl_iseq()->append(t_inst);
-
-    Instruction* inst = new Instruction(HINS_mov_q, f_reg, v_temp);
+    Instruction* inst = new Instruction(HINS_mov_q, f_reg, arg_temps[index - 1]);
     inst->set_comment("Input Parameter: " + arg->get_str());
     get_hl_iseq()->append(inst);
   }
@@ -519,7 +685,8 @@ void HighLevelCodegen::visit_array_element_ref_expression(Node *n) {
 
   Node* index = n->get_kid(1);
   visit(index);
-  Operand index_reg = index->get_operand();
+  //the address arithmetic is 64 bit, so the index must be too
+  Operand index_reg = get_widened_operand(index, 8);
 
   //Store Array Address in VReg
   int i_addr = m_function->get_vra()->alloc_local();
@@ -528,11 +695,6 @@ void HighLevelCodegen::visit_array_element_ref_expression(Node *n) {
   inst->set_comment("Store Array Address");
   get_hl_iseq()->append(inst);
 
-  //fix index:
-  inst = new Instruction(HINS_add_q, index_reg, index_reg, Operand(Operand::IMM_IVAL, 1));
-  inst->set_comment("Shift Index");
-  get_hl_iseq()->append(inst);
-
   //Compute offset = index*size
   int i_IxS = m_function->get_vra()->alloc_local();
   Operand IxS = Operand(Operand::VREG, i_IxS);
@@ -548,11 +710,6 @@ void HighLevelCodegen::visit_array_element_ref_expression(Node *n) {
   inst->set_comment("Compute final address from Array_Base+Computed_Offset");
   get_hl_iseq()->append(inst);
 
-  //re_fix index:
-  inst = new Instruction(HINS_sub_q, index_reg, index_reg, Operand(Operand::IMM_IVAL, 1));
-  inst->set_comment("Unshift Index");
-  get_hl_iseq()->append(inst);
-
   //Pass up (Array+Offset)
   n->set_operand(Operand(Operand::VREG_MEM, new_addr.get_base_reg()));
 }
@@ -561,13 +718,24 @@ void HighLevelCodegen::visit_variable_ref(Node *n) {
   Symbol* s = n->get_symbol();
   if (s->get_reg() != -1) {
     n->set_operand(Operand(Operand::VREG, s->get_reg()));
-  } else if (s->get_al() != -1) {
+  } else if (s->get_al() != -1 || s->is_thread_local()) {
     int i_addr = m_function->get_vra()->alloc_local();
     Operand addr = Operand(Operand::VREG, i_addr);
-    Instruction* inst = new Instruction(HINS_localaddr, addr, Operand(Operand::IMM_IVAL, s->get_al()));
-    inst->set_comment("Store stack memory in a VReg");
+    Instruction* inst;
+    if (s->get_al() != -1) {
+      inst = new Instruction(HINS_localaddr, addr, Operand(Operand::IMM_IVAL, s->get_al()));
+      inst->set_comment("Store stack memory in a VReg");
+    } else {
+      // an extern variable may be defined in a shared library
+      long is_extern = (s->get_storage() == StorageClass::EXTERN);
+      inst = new Instruction(HINS_tlsaddr, addr, Operand(Operand::IMM_LABEL, s->get_name()), Operand(Operand::IMM_IVAL, is_extern));
+      inst->set_comment("Store thread-local storage address in a VReg");
+    }
     get_hl_iseq()->append(inst);
-    n->set_operand(addr);
+    if (s->get_type()->is_array() || s->get_type()->is_struct())
+      n->set_operand(addr);
+    else //scalar in memory (address is taken)
+      n->set_operand(Operand(Operand::VREG_MEM, i_addr));
   } else {
     SemanticError::raise(n->get_loc(), "for some reason owen was very silly and did not allocate virtual storage for this variable");
   }
@@ -580,8 +748,8 @@ void HighLevelCodegen::visit_literal_value(Node *n) {
   Operand dest = Operand(Operand::VREG, vreg);
   HighLevelOpcode mov_opcode = get_opcode(HINS_mov_b, n->get_type());
   LiteralValue val;
-  if (n->get_type()->get_basic_type_kind() == BasicTypeKind::INT) {
-    val = LiteralValue(std::stoi(n->get_kid(0)->get_str()),false,false);
+  if (n->get_type()->get_basic_type_kind() == BasicTypeKind::INT || n->get_type()->get_basic_type_kind() == BasicTypeKind::LONG) {
+    val = LiteralValue::from_int_literal(n->get_kid(0)->get_str(), n->get_loc());
     Instruction* inst = new Instruction(mov_opcode, dest, Operand(Operand::IMM_IVAL, val.get_int_value()));
     inst->set_comment("Initialize literal int");
     get_hl_iseq()->append(inst);
@@ -608,4 +776,214 @@ std::string HighLevelCodegen::next_label() {
   return label;
 }
 
+// Define the label of the next instruction. Two labels in a row (e.g.,
+// the end of an if statement followed by a loop) get a nop in between,
+// since an instruction has only one label.
+void HighLevelCodegen::define_label(const std::string &label) {
+  if (get_hl_iseq()->has_label_at_end())
+    get_hl_iseq()->append(new Instruction(HINS_nop));
+  get_hl_iseq()->define_label(label);
+}
+
 // TODO: additional private member functions
+
+// Builtins are expanded inline: the bit operations become a single
+// high-level instruction, expect evaluates to its first argument, and
+// prefetch becomes a prefetch instruction. Only unreachable remains a
+// call (to a noreturn function, so the code after it is removed when
+// optimizing).
+void HighLevelCodegen::visit_builtin_call(Node *n, const Builtin &builtin) {
+  Node* arg_list = n->get_kid(1);
+  visit(arg_list);
+
+  if (is_atomic_builtin(builtin)) {
+    visit_atomic_builtin_call(n, builtin);
+    return;
+  }
+
+  if (builtin.kind == BuiltinKind::UNREACHABLE) {
+    Instruction* inst = new Instruction(HINS_call, Operand(Operand::LABEL, builtin.name));
+    inst->set_comment("Unreachable");
+    get_hl_iseq()->append(inst);
+    return;
+  }
+
+  Node* arg = arg_list->get_kid(0);
+  if (builtin.kind == BuiltinKind::PREFETCH) {
+    //the rw argument is ignored: the write prefetch instruction isn't
+    //available on every x86-64 processor
+    int locality = 3;
+    if (arg_list->get_num_kids() > 2)
+      locality = LiteralValue::from_int_literal(arg_list->get_kid(2)->get_str(), arg_list->get_kid(2)->get_loc()).get_int_value();
+
+    Operand addr = arg->get_operand();
+    if (addr.get_kind() != Operand::VREG) {
+      int i_v_temp = m_function->get_vra()->alloc_local();
+      Operand v_temp = Operand(Operand::VREG, i_v_temp);
+      Instruction* t_inst = new Instruction(HINS_mov_q, v_temp, addr);
+      t_inst->set_comment("Store prefetch address");
+      get_hl_iseq()->append(t_inst);
+      addr = v_temp;
+    }
+    Instruction* inst = new Instruction(HINS_prefetch, Operand(Operand::IMM_IVAL, locality), addr);
+    inst->set_comment("Prefetch");
+    get_hl_iseq()->append(inst);
+    return;
+  }
+
+  Operand src = get_widened_operand(arg, builtin.size);
+  if (builtin.kind == BuiltinKind::EXPECT) {
+    n->set_operand(src);
+    return;
+  }
+
+  HighLevelOpcode base_opcode;
+  switch (builtin.kind) {
+  case BuiltinKind::POPCOUNT: base_opcode = HINS_popcount_b; break;
+  case BuiltinKind::CLZ:      base_opcode = HINS_clz_b; break;
+  case BuiltinKind::CTZ:      base_opcode = HINS_ctz_b; break;
+  default:                    base_opcode = HINS_bswap_b; break;
+  }
+  BasicTypeKind kind = builtin.size == 8 ? BasicTypeKind::LONG : BasicTypeKind::INT;
+  HighLevelOpcode opcode = get_opcode(base_opcode, std::make_shared<BasicType>(kind, false));
+
+  int i_v_temp = m_function->get_vra()->alloc_local();
+  Operand v_temp = Operand(Operand::VREG, i_v_temp);
+  Instruction* inst = new Instruction(opcode, v_temp, src);
+  inst->set_comment(std::string("Builtin ") + builtin.name);
+  get_hl_iseq()->append(inst);
+  n->set_operand(v_temp);
+}
+
+// The atomic builtins become atomic instructions of the size of the
+// object the first argument points to. The subtracting forms add the
+// negated value, and the forms returning the new value (or whether a
+// compare and swap succeeded) compute it from the old value.
+void HighLevelCodegen::visit_atomic_builtin_call(Node *n, const Builtin &builtin) {
+  Node* arg_list = n->get_kid(1);
+  if (builtin.kind == BuiltinKind::SYNCHRONIZE) {
+    Instruction* inst = new Instruction(HINS_fence);
+    inst->set_comment("Memory barrier");
+    get_hl_iseq()->append(inst);
+    return;
+  }
+
+  Node* addr_arg = arg_list->get_kid(0);
+  std::shared_ptr<Type> type = addr_arg->get_type()->get_base_type();
+  int size = type->get_storage_size();
+  Operand addr = addr_arg->get_operand();
+  if (addr.get_kind() != Operand::VREG) {
+    int i_v_temp = m_function->get_vra()->alloc_local();
+    Operand v_temp = Operand(Operand::VREG, i_v_temp);
+    Instruction* t_inst = new Instruction(HINS_mov_q, v_temp, addr);
+    t_inst->set_comment("Store atomic address");
+    get_hl_iseq()->append(t_inst);
+    addr = v_temp;
+  }
+  Operand mem = Operand(Operand::VREG_MEM, addr.get_base_reg());
+
+  long order = long(MemoryOrder::SEQ_CST);
+  if (builtin.memory_order) {
+    Node *order_arg = arg_list->get_kid(arg_list->get_num_kids() - 1);
+    order = LiteralValue::from_int_literal(order_arg->get_str(), order_arg->get_loc()).get_int_value();
+  }
+
+  if (builtin.kind == BuiltinKind::LOCK_RELEASE || builtin.kind == BuiltinKind::STORE) {
+    Operand value = Operand(Operand::IMM_IVAL, 0);
+    if (builtin.kind == BuiltinKind::LOCK_RELEASE)
+      order = long(MemoryOrder::RELEASE);
+    else
+      value = get_widened_operand(arg_list->get_kid(1), size);
+    Instruction* inst = new Instruction(get_opcode(HINS_atomic_store_b, type), mem, value, Operand(Operand::IMM_IVAL, order));
+    inst->set_comment("Atomic store");
+    get_hl_iseq()->append(inst);
+    return;
+  }
+
+  int i_v_old = m_function->get_vra()->alloc_local();
+  Operand v_old = Operand(Operand::VREG, i_v_old);
+  Operand value;
+  Instruction* inst;
+  if (builtin.kind == BuiltinKind::LOAD) {
+    inst = new Instruction(get_opcode(HINS_atomic_load_b, type), v_old, mem);
+    inst->set_comment("Atomic load");
+  } else if (builtin.kind == BuiltinKind::BOOL_CAS || builtin.kind == BuiltinKind::VAL_CAS) {
+    value = get_widened_operand(arg_list->get_kid(1), size);
+    inst = new Instruction(get_opcode(HINS_atomic_cmpxchg_b, type), v_old, mem, value);
+    inst->append_operand(get_widened_operand(arg_list->get_kid(2), size));
+    inst->set_comment("Atomic compare and swap");
+  } else if (builtin.kind == BuiltinKind::EXCHANGE) {
+    value = get_widened_operand(arg_list->get_kid(1), size);
+    inst = new Instruction(get_opcode(HINS_atomic_xchg_b, type), v_old, mem, value);
+    inst->set_comment("Atomic exchange");
+  } else {
+    value = get_widened_operand(arg_list->get_kid(1), size);
+    if (builtin.kind == BuiltinKind::FETCH_SUB || builtin.kind == BuiltinKind::SUB_FETCH) {
+      int i_v_temp = m_function->get_vra()->alloc_local();
+      Operand v_temp = Operand(Operand::VREG, i_v_temp);
+      Instruction* neg_inst = new Instruction(get_opcode(HINS_neg_b, type), v_temp, value);
+      neg_inst->set_comment("Negate atomic subtrahend");
+      get_hl_iseq()->append(neg_inst);
+      value = v_temp;
+    }
+    inst = new Instruction(get_opcode(HINS_atomic_xadd_b, type), v_old, mem, value);
+    inst->set_comment("Atomic fetch and add");
+  }
+  get_hl_iseq()->append(inst);
+
+  Operand result = v_old;
+  if (builtin.kind == BuiltinKind::ADD_FETCH || builtin.kind == BuiltinKind::SUB_FETCH
+      || builtin.kind == BuiltinKind::BOOL_CAS) {
+    int i_v_result = m_function->get_vra()->alloc_local();
+    result = Operand(Operand::VREG, i_v_result);
+    bool is_cas = builtin.kind == BuiltinKind::BOOL_CAS;
+    Instruction* r_inst = new Instruction(get_opcode(is_cas ? HINS_cmpeq_b : HINS_add_b, type), result, v_old, value);
+    r_inst->set_comment(is_cas ? "Check if swapped" : "Compute new value");
+    get_hl_iseq()->append(r_inst);
+  }
+  n->set_operand(result);
+}
+
+// The operand holding the value of an integer expression, sign or zero
+// extended to size bytes if its type is smaller
+Operand HighLevelCodegen::get_widened_operand(Node *n, int size) {
+  std::shared_ptr<Type> type = n->get_type();
+  int type_size = type->get_storage_size();
+  if (type_size >= size)
+    return n->get_operand();
+
+  HighLevelOpcode opcode;
+  if (size == 2)
+    opcode = HINS_sconv_bw;
+  else if (size == 4)
+    opcode = type_size == 1 ? HINS_sconv_bl : HINS_sconv_wl;
+  else
+    opcode = type_size == 1 ? HINS_sconv_bq : type_size == 2 ? HINS_sconv_wq : HINS_sconv_lq;
+  if (!type->is_signed())
+    opcode = HighLevelOpcode(opcode - HINS_sconv_bw + HINS_uconv_bw);
+
+  int i_v_temp = m_function->get_vra()->alloc_local();
+  Operand v_temp = Operand(Operand::VREG, i_v_temp);
+  Instruction* inst = new Instruction(opcode, v_temp, n->get_operand());
+  inst->set_comment("Widen operand");
+  get_hl_iseq()->append(inst);
+  return v_temp;
+}
+
+// A condition written as __builtin_expect(e, c), with c an integer
+// literal, is expected to be true exactly when c is nonzero: record
+// whether the conditional jump testing it is then expected to be taken
+void HighLevelCodegen::hint_conditional_jump(Instruction *cjmp, Node *condition) {
+  if (condition->get_tag() != AST_FUNCTION_CALL_EXPRESSION)
+    return;
+  const Builtin *builtin = find_builtin(condition->get_kid(0)->get_kid(0)->get_str());
+  if (builtin == nullptr || builtin->kind != BuiltinKind::EXPECT)
+    return;
+  Node* expected = condition->get_kid(1)->get_kid(1);
+  if (!expected->get_literal() || expected->get_type()->get_basic_type_kind() != BasicTypeKind::INT)
+    return;
+
+  bool expect_true = LiteralValue::from_int_literal(expected->get_str(), expected->get_loc()).get_int_value() != 0;
+  bool taken = (cjmp->get_opcode() == HINS_cjmp_t) == expect_true;
+  cjmp->set_branch_hint(taken ? Instruction::HINT_TAKEN : Instruction::HINT_NOT_TAKEN);
+}
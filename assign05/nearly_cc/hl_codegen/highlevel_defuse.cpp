@@ -19,6 +19,7 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cassert>
+#include <climits>
 #include <set>
 #include "instruction.h"
 #include "operand.h"
@@ -36,6 +37,9 @@ const std::set<HighLevelOpcode> NO_DEST = {
   HINS_leave,
   HINS_cjmp_t,
   HINS_cjmp_f,
+  HINS_prefetch,
+  HINS_asm,
+  HINS_fence,
 };
 
 // Does the instruction have a destination operand?
@@ -43,6 +47,16 @@ bool has_dest_operand(HighLevelOpcode hl_opcode) {
   return NO_DEST.count(hl_opcode) == 0;
 }
 
+// Sign-extend the low size bytes of a value
+long truncate_value(long value, int size) {
+  switch (size) {
+  case 1: return static_cast<signed char>(value);
+  case 2: return static_cast<short>(value);
+  case 4: return static_cast<int>(value);
+  default: return value;
+  }
+}
+
 }
 
 namespace HighLevel {
@@ -88,4 +102,66 @@ bool is_use(Instruction *ins, unsigned operand_index) {
   return operand.has_base_reg() || operand.has_index_reg();
 }
 
+bool is_atomic(Instruction *ins) {
+  return ins->get_opcode() >= HINS_atomic_load_b && ins->get_opcode() <= HINS_fence;
+}
+
+bool evaluate(int hl_opcode, const std::vector<long> &args, long &result) {
+  HighLevelOpcode opcode = HighLevelOpcode(hl_opcode);
+  if (opcode >= HINS_sconv_bw && opcode <= HINS_sconv_lq) {
+    result = truncate_value(args[0], highlevel_opcode_get_source_operand_size(opcode));
+    return true;
+  }
+  if (opcode >= HINS_uconv_bw && opcode <= HINS_uconv_lq) {
+    int size = highlevel_opcode_get_source_operand_size(opcode);
+    result = static_cast<long>(static_cast<unsigned long>(args[0]) & ((1UL << (8 * size)) - 1));
+    return true;
+  }
+  if (opcode < HINS_add_b || opcode > HINS_mov_q)
+    return false;
+
+  // opcodes come in groups of b/w/l/q variants
+  int size = highlevel_opcode_get_source_operand_size(opcode);
+  HighLevelOpcode base = HighLevelOpcode(opcode - (opcode - HINS_add_b) % 4);
+  long a = truncate_value(args[0], size);
+  long b = args.size() > 1 ? truncate_value(args[1], size) : 0;
+  unsigned long ua = a, ub = b;
+  unsigned long bits = ua & (~0UL >> (64 - 8 * size));
+  switch (base) {
+  case HINS_add_b: result = long(ua + ub); break;
+  case HINS_sub_b: result = long(ua - ub); break;
+  case HINS_mul_b: result = long(ua * ub); break;
+  case HINS_div_b:
+  case HINS_mod_b:
+    if (b == 0 || (b == -1 && a == LONG_MIN))
+      return false;
+    result = (base == HINS_div_b) ? a / b : a % b;
+    break;
+  case HINS_cmplt_b: result = a < b; break;
+  case HINS_cmplte_b: result = a <= b; break;
+  case HINS_cmpgt_b: result = a > b; break;
+  case HINS_cmpgte_b: result = a >= b; break;
+  case HINS_cmpeq_b: result = a == b; break;
+  case HINS_cmpneq_b: result = a != b; break;
+  case HINS_and_b: result = a & b; break;
+  case HINS_or_b: result = a | b; break;
+  case HINS_xor_b: result = a ^ b; break;
+  case HINS_neg_b: result = long(0UL - ua); break;
+  case HINS_not_b: result = a == 0; break;
+  case HINS_compl_b: result = ~a; break;
+  case HINS_inc_b: result = long(ua + 1); break;
+  case HINS_dec_b: result = long(ua - 1); break;
+  case HINS_mov_b: result = a; break;
+  // the bit counts of 0 are the operand width, as lzcnt and tzcnt compute
+  case HINS_popcount_b: result = __builtin_popcountl(bits); break;
+  case HINS_clz_b: result = bits == 0 ? 8 * size : __builtin_clzl(bits) - (64 - 8 * size); break;
+  case HINS_ctz_b: result = bits == 0 ? 8 * size : __builtin_ctzl(bits); break;
+  case HINS_bswap_b: result = long(__builtin_bswap64(bits) >> (64 - 8 * size)); break;
+  default:
+    return false; // shifts, spills, and restores
+  }
+  result = truncate_value(result, highlevel_opcode_get_dest_operand_size(opcode));
+  return true;
+}
+
 }
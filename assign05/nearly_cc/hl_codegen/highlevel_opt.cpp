@@ -19,10 +19,14 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include "highlevel_opt.h"
+#include "local_storage_allocation.h"
 
 
-HighLevelOpt::HighLevelOpt(const Options &options)
-  : m_options(options) {
+HighLevelOpt::HighLevelOpt(const Options &options, const AliasAnalysis &alias_analysis, const ModRefAnalysis &mod_ref, const FunctionAttrInference &function_attrs)
+  : m_options(options)
+  , m_alias_analysis(alias_analysis)
+  , m_mod_ref(mod_ref)
+  , m_function_attrs(function_attrs) {
 }
 
 HighLevelOpt::~HighLevelOpt() {
@@ -88,16 +92,36 @@ struct LVNKey {
 
 class LVN : public ControlFlowGraphTransform {
   private:
+    // a memory location whose value is known to be held by a value number
+    struct AvailableMem {
+      Operand mem;             // memory operand (as it appeared in the code)
+      int base_value_number;   // value number of its base register
+      int size;                // size of the value in bytes
+      int value_number;        // value number of the value in memory
+    };
+
     LiveVregs m_live_vregs;
-    std::map<int, int> constant_to_value_number;                   // Map constant values to value numbers
-    std::map<int, int> value_number_to_constant;                   // Map value numbers to constants
+    std::shared_ptr<Function> m_function;
+    const AliasAnalysis &m_alias_analysis;
+    const ModRefAnalysis &m_mod_ref;
+    const FunctionAttrInference &m_function_attrs;
+    std::shared_ptr<InstructionSequence> m_prev_bb;                // Previously transformed block
+    std::map<long, int> constant_to_value_number;                  // Map constant values to value numbers
+    std::map<int, long> value_number_to_constant;                  // Map value numbers to constants
+    std::map<std::string, int> label_to_value_number;              // Map immediate labels to value numbers
     std::map<int, int> vreg_to_value_number;                       // Map vregs to value numbers
     std::map<int, std::vector<int>> value_number_to_vregs;         // Map value numbers to vregs
+    std::map<int, int> vreg_def_size;                              // Size of the value each vreg was given in the block
     std::map<LVNKey, int> lvnkey_to_value_number;                  // Map LVNKey to value number
     int next_value_number = 1;                                     // Next value number to assign
+    std::vector<AvailableMem> available_mem;                       // Memory locations with known values
+    std::map<std::pair<std::string, std::vector<int>>, int> const_calls; // Calls of const functions (callee, argument value numbers) -> result value number
+    std::map<std::pair<std::string, std::vector<int>>, int> pure_calls;  // Same for pure functions (until memory may change)
+    int call_value_number = 0;                                     // Value number of vr0 after the call ending the previous block (0 if unknown)
   public:
 
-    LVN(std::shared_ptr<ControlFlowGraph> cfg): ControlFlowGraphTransform(cfg), m_live_vregs(cfg) {
+    LVN(std::shared_ptr<ControlFlowGraph> cfg, std::shared_ptr<Function> function, const AliasAnalysis &alias_analysis, const ModRefAnalysis &mod_ref, const FunctionAttrInference &function_attrs)
+      : ControlFlowGraphTransform(cfg), m_live_vregs(cfg), m_function(function), m_alias_analysis(alias_analysis), m_mod_ref(mod_ref), m_function_attrs(function_attrs) {
       m_live_vregs.execute(); // compute vreg liveness
     }
 
@@ -105,13 +129,82 @@ class LVN : public ControlFlowGraphTransform {
     virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
       //Preform Local Value Numbering
 
-      //clear data for local BB
-      std::map<int, int> constant_to_value_number;                   // Map constant values to value numbers
-      std::map<int, int> value_number_to_constant;                   // Map value numbers to constants
-      std::map<int, int> vreg_to_value_number;                       // Map vregs to value numbers
-      std::map<int, std::vector<int>> value_number_to_vregs;         // Map value numbers to vregs
-      std::map<LVNKey, int> lvnkey_to_value_number;                  // Map LVNKey to value number
-      int next_value_number = 1;                                     // Next value number to assign
+      //A block only entered from the call ending the previous block
+      //keeps the value numbers (and known memory values) from before the
+      //call, except for vr0-vr9, which live in registers the call clobbers
+      //(vr0 holds the call's result, which is known for pure calls)
+      std::shared_ptr<InstructionSequence> prev_bb = m_prev_bb;
+      m_prev_bb = orig_bb;
+      const ControlFlowGraph::EdgeList &incoming = get_orig_cfg()->get_incoming_edges(orig_bb);
+      if (prev_bb && incoming.size() == 1 && incoming[0]->get_source() == prev_bb
+          && prev_bb->get_length() > 0 && prev_bb->get_last_instruction()->get_opcode() == HINS_call) {
+        for (auto i = vreg_to_value_number.begin(); i != vreg_to_value_number.end(); ) {
+          if (i->first < 10)
+            i = vreg_to_value_number.erase(i);
+          else
+            ++i;
+        }
+        for (auto i = value_number_to_vregs.begin(); i != value_number_to_vregs.end(); ++i)
+          i->second.erase(std::remove_if(i->second.begin(), i->second.end(), [](int vreg) { return vreg < 10; }), i->second.end());
+        if (call_value_number > 0) {
+          vreg_to_value_number[0] = call_value_number;
+          value_number_to_vregs[call_value_number].push_back(0);
+        }
+      } else {
+        //clear data for local BB
+        constant_to_value_number.clear();
+        value_number_to_constant.clear();
+        label_to_value_number.clear();
+        vreg_to_value_number.clear();
+        value_number_to_vregs.clear();
+        vreg_def_size.clear();
+        lvnkey_to_value_number.clear();
+        next_value_number = 1;
+        available_mem.clear();
+        const_calls.clear();
+        pure_calls.clear();
+      }
+      call_value_number = 0;
+
+      // value number of a vreg (assigning a new one if it has none yet)
+      auto get_vreg_value_number = [&](int vreg) {
+        if (vreg_to_value_number.count(vreg) == 0) {
+          vreg_to_value_number[vreg] = next_value_number;
+          value_number_to_vregs[next_value_number].push_back(vreg);
+          ++next_value_number;
+        }
+        return vreg_to_value_number[vreg];
+      };
+
+      // an operand which still holds a value number (or a NONE operand)
+      // in at least size bytes: a vreg given the value by a narrower
+      // instruction (e.g. mov_l vr17, $-3 for the value of
+      // mov_q vr18, $-3) can't stand in for a wider use
+      auto find_holder = [&](int value_number, int size) {
+        for (int vreg : value_number_to_vregs[value_number]) {
+          if (vreg_to_value_number[vreg] == value_number
+              && (vreg_def_size.count(vreg) == 0 || vreg_def_size[vreg] >= size))
+            return Operand(Operand::VREG, vreg);
+        }
+        if (value_number_to_constant.count(value_number) > 0)
+          return Operand(Operand::IMM_IVAL, value_number_to_constant[value_number]);
+        return Operand();
+      };
+
+      // index into available_mem of a memory operand's known value (or -1)
+      auto find_available = [&](Operand mem, int size) {
+        if (mem.get_kind() != Operand::VREG_MEM && mem.get_kind() != Operand::VREG_MEM_OFF)
+          return -1;
+        int base_value_number = get_vreg_value_number(mem.get_base_reg());
+        for (unsigned j = 0; j < available_mem.size(); ++j) {
+          const AvailableMem &avail = available_mem[j];
+          if (avail.base_value_number == base_value_number && avail.size == size
+              && avail.mem.get_kind() == mem.get_kind()
+              && (mem.get_kind() != Operand::VREG_MEM_OFF || avail.mem.get_offset() == mem.get_offset()))
+            return int(j);
+        }
+        return -1;
+      };
 
       //Create clean BB to return
       std::shared_ptr<InstructionSequence> new_bb(new InstructionSequence());
@@ -120,8 +213,72 @@ class LVN : public ControlFlowGraphTransform {
       for (auto it = orig_bb->cbegin(); it != orig_bb->cend(); ++it) {
         const auto& inst = *it;
 
+        // inline assembly may change any memory, and any of the
+        // registers holding vr0-vr9
+        if (inst->get_opcode() == HINS_asm) {
+          available_mem.clear();
+          pure_calls.clear();
+          for (auto i = vreg_to_value_number.begin(); i != vreg_to_value_number.end(); ) {
+            if (i->first < 10)
+              i = vreg_to_value_number.erase(i);
+            else
+              ++i;
+          }
+          new_bb->append(inst->duplicate());
+          continue;
+        }
+
+        // other threads may change memory at an atomic access (or
+        // fence), and the value an atomic access reads is never known
+        if (HighLevel::is_atomic(inst)) {
+          available_mem.clear();
+          pure_calls.clear();
+          if (HighLevel::is_def(inst)) {
+            int vreg = HighLevel::get_def_vreg(inst);
+            vreg_to_value_number[vreg] = next_value_number;
+            value_number_to_vregs[next_value_number].push_back(vreg);
+            ++next_value_number;
+          }
+          new_bb->append(inst->duplicate());
+          continue;
+        }
+
         //Skip
         if (inst->get_num_operands() <= 0 || inst->get_operand(0).is_label() || (inst->get_num_operands() > 2 && inst->get_operand(1).is_label()) || inst->get_operand(0).is_imm_ival()) {
+          // forget memory values the callee may change
+          if (inst->get_opcode() == HINS_call) {
+            for (unsigned j = 0; j < available_mem.size(); ) {
+              if (m_mod_ref.may_mod(m_function, inst, available_mem[j].mem))
+                available_mem.erase(available_mem.begin() + j);
+              else
+                ++j;
+            }
+
+            // a call of a pure or const function with the same arguments
+            // as an earlier one returns the same value, so if that value
+            // is still held by a vreg, it replaces the call
+            std::string callee = inst->get_operand(0).get_label();
+            unsigned attributes = m_function_attrs.get_attributes(callee);
+            if ((attributes & (Function::ATTR_PURE | Function::ATTR_CONST)) == 0) {
+              pure_calls.clear();
+            } else {
+              std::vector<int> args;
+              for (unsigned j = 1; j <= m_function_attrs.get_num_params(callee); ++j)
+                args.push_back(get_vreg_value_number(j));
+              auto &calls = (attributes & Function::ATTR_CONST) ? const_calls : pure_calls;
+              auto key = std::make_pair(callee, args);
+              Operand holder = calls.count(key) > 0 ? find_holder(calls[key], 8) : Operand();
+              if (holder.get_kind() == Operand::VREG || holder.is_imm_ival()) {
+                call_value_number = calls[key];
+                Instruction *mov_inst = new Instruction(HINS_mov_q, Operand(Operand::VREG, 0), holder);
+                mov_inst->set_comment("Reuse result of earlier call");
+                new_bb->append(mov_inst);
+                continue;
+              }
+              calls[key] = call_value_number = next_value_number;
+              ++next_value_number;
+            }
+          }
           new_bb->append(inst->duplicate());
           continue;
         }
@@ -129,6 +286,9 @@ class LVN : public ControlFlowGraphTransform {
         // Extract operands and opcode
         int num_ops = inst->get_num_operands();
         auto opcode = inst->get_opcode();
+        bool is_mov = (opcode == HINS_mov_b || opcode == HINS_mov_w || opcode == HINS_mov_l || opcode == HINS_mov_q);
+        int mem_size = highlevel_opcode_get_source_operand_size(HighLevelOpcode(opcode));
+        std::map<int, Operand> forwarded;                              // replacements for redundant loads
 
         // Track value numbers for operands
         std::vector<int> operand_value_numbers;
@@ -145,13 +305,39 @@ class LVN : public ControlFlowGraphTransform {
 
             if (operand.is_imm_ival()) {
                 // Assign or retrieve value number for constant
-                int i_val = operand.get_imm_ival();
+                long i_val = operand.get_imm_ival();
                 if (constant_to_value_number.count(i_val) == 0) {
                     constant_to_value_number[i_val] = next_value_number;
                     value_number_to_constant[next_value_number] = i_val;
                     ++next_value_number;
                 }
                 operand_value_number = constant_to_value_number[i_val];
+            } else if (operand.is_imm_label()) {
+                // Assign or retrieve value number for an immediate label
+                std::string label = operand.get_label();
+                if (label_to_value_number.count(label) == 0) {
+                    label_to_value_number[label] = next_value_number;
+                    ++next_value_number;
+                }
+                operand_value_number = label_to_value_number[label];
+            } else if (operand.is_memref()) {
+                // a load of a value that was loaded or stored earlier
+                // in the block (with nothing in between that could
+                // change it) is redundant
+                // (constants only replace the source of a mov)
+                int avail = find_available(operand, mem_size);
+                Operand holder = avail >= 0 ? find_holder(available_mem[avail].value_number, mem_size) : Operand();
+                if (holder.get_kind() == Operand::VREG || (is_mov && holder.is_imm_ival())) {
+                  operand_value_number = available_mem[avail].value_number;
+                  forwarded[i] = holder;
+                } else {
+                  operand_value_number = next_value_number;
+                  ++next_value_number;
+                  if (avail >= 0)
+                    available_mem[avail].value_number = operand_value_number;
+                  else if (is_mov && (operand.get_kind() == Operand::VREG_MEM || operand.get_kind() == Operand::VREG_MEM_OFF))
+                    available_mem.push_back({ operand, get_vreg_value_number(operand.get_base_reg()), mem_size, operand_value_number });
+                }
             } else if (!operand.is_imm_label() && operand.get_kind() != Operand::LABEL){
                 // Assign or retrieve value number for virtual register
                 auto vreg = operand.get_base_reg();
@@ -183,22 +369,44 @@ class LVN : public ControlFlowGraphTransform {
         }
         result_value_number = lvnkey_to_value_number[key];
 
-        auto vreg = operand.get_base_reg();
-        vreg_to_value_number[vreg] = result_value_number;
-        value_number_to_vregs[result_value_number].push_back(vreg);
-        operand.set_val_num(result_value_number);
+        // a store kills the known values of memory it may overwrite,
+        // and makes the stored value known
+        if (operand.is_memref()) {
+          pure_calls.clear();
+          int store_size = highlevel_opcode_get_dest_operand_size(HighLevelOpcode(opcode));
+          for (unsigned j = 0; j < available_mem.size(); ) {
+            if (m_alias_analysis.alias(m_function, available_mem[j].mem, available_mem[j].size, operand, store_size) != AliasAnalysis::NO_ALIAS)
+              available_mem.erase(available_mem.begin() + j);
+            else
+              ++j;
+          }
+          if (is_mov && (operand.get_kind() == Operand::VREG_MEM || operand.get_kind() == Operand::VREG_MEM_OFF))
+            available_mem.push_back({ operand, get_vreg_value_number(operand.get_base_reg()), store_size, result_value_number });
+        }
+
+        // a store through a pointer doesn't change the value of the pointer vreg
+        if (!operand.is_memref()) {
+          auto vreg = operand.get_base_reg();
+          vreg_to_value_number[vreg] = result_value_number;
+          value_number_to_vregs[result_value_number].push_back(vreg);
+          vreg_def_size[vreg] = highlevel_opcode_get_dest_operand_size(HighLevelOpcode(opcode));
+          operand.set_val_num(result_value_number);
+        }
 
         //DO COPY PROPOGATION
         auto new_inst = inst->duplicate();
         for (int i = 1; i < num_ops; ++i) {
           auto operand = new_inst->get_operand(i);
-          if (!operand.is_imm_ival() && !operand.is_label()) {
+          if (!operand.is_non_reg() && !operand.is_memref()) {
             int original_reg = operand.get_base_reg();
             int target_value = vreg_to_value_number[original_reg];
-            int target_reg = value_number_to_vregs[target_value][0];
+            Operand holder = find_holder(target_value, mem_size);
+            int target_reg = holder.get_kind() == Operand::VREG ? holder.get_base_reg() : original_reg;
             new_inst->set_operand(i,Operand(operand.get_kind(),target_reg));
           }
         }
+        for (auto i = forwarded.begin(); i != forwarded.end(); ++i)
+          new_inst->set_operand(i->first, i->second);
 
         // Append the instruction to the new basic block
         new_bb->append(new_inst);
@@ -208,6 +416,384 @@ class LVN : public ControlFlowGraphTransform {
 };
 
 
+// Algebraic simplification (instruction combining) within basic blocks.
+// Rewrites are table-driven: each table entry names the b variant of an
+// opcode group and applies to all four widths. Constants are the
+// immediate operands and the vregs defined in the block from constants
+// only (which are folded). A conditional jump on a constant becomes a
+// jmp or is dropped, and the CFG is rebuilt so the edge it no longer
+// takes is gone.
+namespace {
+
+enum OperandPattern {
+  RHS_ZERO,            // second source operand is 0
+  LHS_ZERO,            // first source operand is 0
+  RHS_ONE,             // second source operand is 1
+  LHS_ONE,             // first source operand is 1
+  RHS_ALL_ONES,        // second source operand is -1
+  LHS_ALL_ONES,        // first source operand is -1
+  SAME_OPERANDS,       // both source operands hold the same value
+};
+
+enum RewriteResult {
+  RESULT_LHS,          // the first source operand
+  RESULT_RHS,          // the second source operand
+  RESULT_ZERO,
+  RESULT_ONE,
+  RESULT_ALL_ONES,
+};
+
+struct Identity {
+  HighLevelOpcode opcode;
+  OperandPattern pattern;
+  RewriteResult result;
+};
+
+const Identity IDENTITIES[] = {
+  { HINS_add_b, RHS_ZERO, RESULT_LHS },
+  { HINS_add_b, LHS_ZERO, RESULT_RHS },
+  { HINS_sub_b, RHS_ZERO, RESULT_LHS },
+  { HINS_sub_b, SAME_OPERANDS, RESULT_ZERO },
+  { HINS_mul_b, RHS_ONE, RESULT_LHS },
+  { HINS_mul_b, LHS_ONE, RESULT_RHS },
+  { HINS_mul_b, RHS_ZERO, RESULT_ZERO },
+  { HINS_mul_b, LHS_ZERO, RESULT_ZERO },
+  { HINS_div_b, RHS_ONE, RESULT_LHS },
+  { HINS_mod_b, RHS_ONE, RESULT_ZERO },
+  { HINS_mod_b, RHS_ALL_ONES, RESULT_ZERO },
+  { HINS_lshift_b, RHS_ZERO, RESULT_LHS },
+  { HINS_lshift_b, LHS_ZERO, RESULT_ZERO },
+  { HINS_rshift_b, RHS_ZERO, RESULT_LHS },
+  { HINS_rshift_b, LHS_ZERO, RESULT_ZERO },
+  { HINS_and_b, SAME_OPERANDS, RESULT_LHS },
+  { HINS_and_b, RHS_ZERO, RESULT_ZERO },
+  { HINS_and_b, LHS_ZERO, RESULT_ZERO },
+  { HINS_and_b, RHS_ALL_ONES, RESULT_LHS },
+  { HINS_and_b, LHS_ALL_ONES, RESULT_RHS },
+  { HINS_or_b, SAME_OPERANDS, RESULT_LHS },
+  { HINS_or_b, RHS_ZERO, RESULT_LHS },
+  { HINS_or_b, LHS_ZERO, RESULT_RHS },
+  { HINS_or_b, RHS_ALL_ONES, RESULT_ALL_ONES },
+  { HINS_or_b, LHS_ALL_ONES, RESULT_ALL_ONES },
+  { HINS_xor_b, SAME_OPERANDS, RESULT_ZERO },
+  { HINS_xor_b, RHS_ZERO, RESULT_LHS },
+  { HINS_xor_b, LHS_ZERO, RESULT_RHS },
+  { HINS_cmplt_b, SAME_OPERANDS, RESULT_ZERO },
+  { HINS_cmplte_b, SAME_OPERANDS, RESULT_ONE },
+  { HINS_cmpgt_b, SAME_OPERANDS, RESULT_ZERO },
+  { HINS_cmpgte_b, SAME_OPERANDS, RESULT_ONE },
+  { HINS_cmpeq_b, SAME_OPERANDS, RESULT_ONE },
+  { HINS_cmpneq_b, SAME_OPERANDS, RESULT_ZERO },
+};
+
+// (y inner c1) outer c2 == y result (c1 combine c2)
+struct Reassociation {
+  HighLevelOpcode outer;
+  HighLevelOpcode inner;
+  HighLevelOpcode combine;
+  HighLevelOpcode result;
+};
+
+const Reassociation REASSOCIATIONS[] = {
+  { HINS_add_b, HINS_add_b, HINS_add_b, HINS_add_b },
+  { HINS_sub_b, HINS_add_b, HINS_sub_b, HINS_add_b },
+  { HINS_add_b, HINS_sub_b, HINS_sub_b, HINS_sub_b },
+  { HINS_sub_b, HINS_sub_b, HINS_add_b, HINS_sub_b },
+  { HINS_mul_b, HINS_mul_b, HINS_mul_b, HINS_mul_b },
+  { HINS_and_b, HINS_and_b, HINS_and_b, HINS_and_b },
+  { HINS_or_b, HINS_or_b, HINS_or_b, HINS_or_b },
+  { HINS_xor_b, HINS_xor_b, HINS_xor_b, HINS_xor_b },
+  { HINS_lshift_b, HINS_lshift_b, HINS_add_b, HINS_lshift_b },
+  { HINS_rshift_b, HINS_rshift_b, HINS_add_b, HINS_rshift_b },
+};
+
+// Unary operations which undo themselves
+const HighLevelOpcode INVOLUTIONS[] = { HINS_neg_b, HINS_compl_b };
+
+// Binary operations whose operands can be swapped, and the operation
+// to use when they are
+const std::pair<HighLevelOpcode, HighLevelOpcode> SWAPPABLE[] = {
+  { HINS_add_b, HINS_add_b },
+  { HINS_mul_b, HINS_mul_b },
+  { HINS_and_b, HINS_and_b },
+  { HINS_or_b, HINS_or_b },
+  { HINS_xor_b, HINS_xor_b },
+  { HINS_cmpeq_b, HINS_cmpeq_b },
+  { HINS_cmpneq_b, HINS_cmpneq_b },
+  { HINS_cmplt_b, HINS_cmpgt_b },
+  { HINS_cmpgt_b, HINS_cmplt_b },
+  { HINS_cmplte_b, HINS_cmpgte_b },
+  { HINS_cmpgte_b, HINS_cmplte_b },
+};
+
+}
+
+class InstCombine : public ControlFlowGraphTransform {
+  private:
+    std::map<int, long> m_constants;               // vreg -> constant value it holds
+    std::map<int, Instruction *> m_defs;           // vreg -> (rewritten) def whose operands are unchanged
+    bool m_folded_branch;                          // whether a conditional jump was folded
+
+  public:
+
+    InstCombine(std::shared_ptr<ControlFlowGraph> cfg)
+      : ControlFlowGraphTransform(merge_blocks(cfg)), m_folded_branch(false) {
+    }
+
+
+    virtual std::shared_ptr<ControlFlowGraph> transform_cfg() {
+      std::shared_ptr<ControlFlowGraph> result = ControlFlowGraphTransform::transform_cfg();
+      if (!m_folded_branch)
+        return result;
+      // the edges of folded jumps are gone, rebuild the CFG
+      auto cfg_builder = ::make_highlevel_cfg_builder(result->create_instruction_sequence());
+      return cfg_builder.build();
+    }
+
+
+    virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
+      std::shared_ptr<InstructionSequence> new_bb(new InstructionSequence());
+      m_constants.clear();
+      m_defs.clear();
+
+      for (auto it = orig_bb->cbegin(); it != orig_bb->cend(); ++it) {
+        // conditional jumps on a constant either always or never jump
+        long value;
+        int opcode = (*it)->get_opcode();
+        if ((opcode == HINS_cjmp_t || opcode == HINS_cjmp_f) && get_constant((*it)->get_operand(0), 8, value)) {
+          m_folded_branch = true;
+          if ((value != 0) == (opcode == HINS_cjmp_t)) {
+            Instruction *jump = new Instruction(HINS_jmp, (*it)->get_operand(1));
+            jump->set_comment((*it)->get_comment());
+            jump->set_loc((*it)->get_loc());
+            new_bb->append(jump);
+          }
+          continue;
+        }
+
+        Instruction *inst = (*it)->duplicate();
+        if (HighLevel::is_def(inst) && inst->get_opcode() != HINS_call && inst->get_operand(0).get_kind() == Operand::VREG) {
+          Instruction *combined = combine(inst);
+          if (combined != inst) {
+            combined->set_comment(inst->get_comment());
+            combined->set_loc(inst->get_loc());
+            delete inst;
+            inst = combined;
+          }
+        }
+        new_bb->append(inst);
+        if (HighLevel::is_def(inst))
+          record_def(new_bb->get_last_instruction());
+      }
+      if (new_bb->get_length() == 0 && orig_bb->has_block_label())
+        new_bb->append(new Instruction(HINS_nop));
+      return new_bb;
+    }
+
+  private:
+    // Converting to an InstructionSequence and back drops the labels
+    // nothing jumps to, so blocks which are only fallen into are merged
+    // into their predecessor (and the constants defined there are known)
+    static std::shared_ptr<ControlFlowGraph> merge_blocks(std::shared_ptr<ControlFlowGraph> cfg) {
+      auto cfg_builder = ::make_highlevel_cfg_builder(cfg->create_instruction_sequence());
+      auto merged_cfg_builder = ::make_highlevel_cfg_builder(cfg_builder.build()->create_instruction_sequence());
+      return merged_cfg_builder.build();
+    }
+
+    static HighLevelOpcode get_base_opcode(int opcode) {
+      return HighLevelOpcode(opcode - (opcode - HINS_add_b) % 4);
+    }
+
+    static HighLevelOpcode get_mov_opcode(int size) {
+      return HighLevelOpcode(HINS_mov_b + (size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3));
+    }
+
+    // the constant value of an operand (truncated to size bytes)
+    bool get_constant(Operand operand, int size, long &value) const {
+      if (operand.is_imm_ival()) {
+        value = operand.get_imm_ival();
+      } else if (operand.get_kind() == Operand::VREG && m_constants.count(operand.get_base_reg()) > 0) {
+        value = m_constants.at(operand.get_base_reg());
+      } else {
+        return false;
+      }
+      return HighLevel::evaluate(get_mov_opcode(size), { value }, value);
+    }
+
+    bool is_constant(Operand operand, int size, long expected) const {
+      long value;
+      return get_constant(operand, size, value) && value == expected;
+    }
+
+    bool same_value(Operand a, Operand b, int size) const {
+      long va, vb;
+      if (a.get_kind() == Operand::VREG && b.get_kind() == Operand::VREG && a.get_base_reg() == b.get_base_reg())
+        return true;
+      return get_constant(a, size, va) && get_constant(b, size, vb) && va == vb;
+    }
+
+    // The def of a vreg earlier in the block, if its operands still
+    // hold the same values (looking through copies which keep at least
+    // the given width)
+    Instruction *get_def(Operand operand, int width) const {
+      Instruction *def = nullptr;
+      while (operand.get_kind() == Operand::VREG) {
+        auto i = m_defs.find(operand.get_base_reg());
+        if (i == m_defs.end())
+          return nullptr;
+        def = i->second;
+        if (def->get_opcode() < HINS_mov_b + width || def->get_opcode() > HINS_mov_q)
+          break;
+        operand = def->get_operand(1);
+      }
+      return def;
+    }
+
+    void record_def(Instruction *inst) {
+      int vreg = HighLevel::get_def_vreg(inst);
+
+      // earlier defs using the vreg no longer describe its value
+      for (auto i = m_defs.begin(); i != m_defs.end(); ) {
+        bool uses = false;
+        for (unsigned j = 1; j < i->second->get_num_operands(); ++j) {
+          if (HighLevel::is_use(i->second, j) && i->second->get_operand(j).get_base_reg() == vreg)
+            uses = true;
+        }
+        if (uses || i->first == vreg)
+          i = m_defs.erase(i);
+        else
+          ++i;
+      }
+      m_constants.erase(vreg);
+      if (inst->get_opcode() == HINS_call || inst->get_operand(0).get_kind() != Operand::VREG)
+        return;
+
+      bool self_use = false;
+      std::vector<long> args;
+      for (unsigned j = 1; j < inst->get_num_operands(); ++j) {
+        Operand operand = inst->get_operand(j);
+        long value;
+        if (HighLevel::is_use(inst, j) && operand.get_base_reg() == vreg)
+          self_use = true;
+        if (operand.is_memref() || !get_constant(operand, highlevel_opcode_get_source_operand_size(HighLevelOpcode(inst->get_opcode())), value)) {
+          args.clear();
+          break;
+        }
+        args.push_back(value);
+      }
+      long result;
+      if (args.size() + 1 == inst->get_num_operands() && !args.empty() && HighLevel::evaluate(inst->get_opcode(), args, result))
+        m_constants[vreg] = result;
+      if (!self_use)
+        m_defs[vreg] = inst;
+    }
+
+    // Return a simpler instruction computing the same value as inst
+    // (or inst itself)
+    Instruction *combine(Instruction *inst) {
+      HighLevelOpcode opcode = HighLevelOpcode(inst->get_opcode());
+      Operand dest = inst->get_operand(0);
+      int dest_size = highlevel_opcode_get_dest_operand_size(opcode);
+      for (unsigned j = 1; j < inst->get_num_operands(); ++j) {
+        Operand operand = inst->get_operand(j);
+        if (operand.get_kind() != Operand::VREG && !operand.is_imm_ival())
+          return inst;
+      }
+
+      // constant folding
+      std::vector<long> args;
+      for (unsigned j = 1; j < inst->get_num_operands(); ++j) {
+        long value;
+        if (get_constant(inst->get_operand(j), 8, value))
+          args.push_back(value);
+      }
+      long result;
+      bool is_mov = opcode >= HINS_mov_b && opcode <= HINS_mov_q;
+      if (!(is_mov && inst->get_operand(1).is_imm_ival()) && !args.empty() && args.size() + 1 == inst->get_num_operands()
+          && HighLevel::evaluate(opcode, args, result))
+        return new Instruction(get_mov_opcode(dest_size), dest, Operand(Operand::IMM_IVAL, result));
+
+      if (opcode < HINS_add_b || opcode > HINS_mov_q)
+        return inst;
+      HighLevelOpcode base = get_base_opcode(opcode);
+      int width = opcode - base;
+      int size = highlevel_opcode_get_source_operand_size(opcode);
+
+      // double negation and complement
+      for (HighLevelOpcode involution : INVOLUTIONS) {
+        Instruction *def = get_def(inst->get_operand(1), width);
+        if (base == involution && def && def->get_opcode() == opcode)
+          return new Instruction(get_mov_opcode(dest_size), dest, def->get_operand(1));
+      }
+      if (inst->get_num_operands() != 3)
+        return inst;
+      Operand lhs = inst->get_operand(1), rhs = inst->get_operand(2);
+
+      for (const Identity &identity : IDENTITIES) {
+        if (identity.opcode != base)
+          continue;
+        bool matches = false;
+        switch (identity.pattern) {
+        case RHS_ZERO:      matches = is_constant(rhs, size, 0); break;
+        case LHS_ZERO:      matches = is_constant(lhs, size, 0); break;
+        case RHS_ONE:       matches = is_constant(rhs, size, 1); break;
+        case LHS_ONE:       matches = is_constant(lhs, size, 1); break;
+        case RHS_ALL_ONES:  matches = is_constant(rhs, size, -1); break;
+        case LHS_ALL_ONES:  matches = is_constant(lhs, size, -1); break;
+        case SAME_OPERANDS: matches = same_value(lhs, rhs, size); break;
+        }
+        if (!matches)
+          continue;
+        Operand value;
+        switch (identity.result) {
+        case RESULT_LHS:       value = lhs; break;
+        case RESULT_RHS:       value = rhs; break;
+        case RESULT_ZERO:      value = Operand(Operand::IMM_IVAL, 0); break;
+        case RESULT_ONE:       value = Operand(Operand::IMM_IVAL, 1); break;
+        case RESULT_ALL_ONES:  value = Operand(Operand::IMM_IVAL, -1); break;
+        }
+        return new Instruction(get_mov_opcode(dest_size), dest, value);
+      }
+
+      // constants go second
+      long value;
+      for (auto &swappable : SWAPPABLE) {
+        if (swappable.first == base && get_constant(lhs, size, value) && !get_constant(rhs, size, value)) {
+          std::swap(lhs, rhs);
+          base = swappable.second;
+          opcode = HighLevelOpcode(base + width);
+          break;
+        }
+      }
+
+      // combine the constants of a chain of operations
+      long c2;
+      Instruction *def = get_def(lhs, width);
+      if (def && get_constant(rhs, size, c2) && def->get_num_operands() == 3
+          && def->get_opcode() - get_base_opcode(def->get_opcode()) == width) {
+        long c1;
+        HighLevelOpcode inner = get_base_opcode(def->get_opcode());
+        for (const Reassociation &reassociation : REASSOCIATIONS) {
+          if (reassociation.outer != base || reassociation.inner != inner
+              || def->get_operand(1).get_kind() != Operand::VREG || !get_constant(def->get_operand(2), size, c1))
+            continue;
+          long combined;
+          if (!HighLevel::evaluate(reassociation.combine + width, { c1, c2 }, combined))
+            continue;
+          // shifting by the width or more is undefined
+          if ((inner == HINS_lshift_b || inner == HINS_rshift_b) && (c1 < 0 || c2 < 0 || combined >= 8 * size))
+            continue;
+          return new Instruction(reassociation.result + width, dest, def->get_operand(1), Operand(Operand::IMM_IVAL, combined));
+        }
+      }
+
+      if (lhs == inst->get_operand(1) && rhs == inst->get_operand(2))
+        return inst;
+      return new Instruction(opcode, dest, lhs, rhs);
+    }
+};
+
+
 class DSE : public ControlFlowGraphTransform {
   private:
     LiveVregs m_live_vregs;
@@ -224,7 +810,8 @@ class DSE : public ControlFlowGraphTransform {
       for (auto it = orig_bb->cbegin(); it != orig_bb->cend(); ++it) {
         Instruction* inst = *it;
 
-        if (inst->get_num_operands() <= 0 || inst->get_operand(0).is_label() || inst->get_operand(0).is_imm_ival() || (inst->get_num_operands() >= 2 && inst->get_operand(1).is_label())) {
+        if (inst->get_num_operands() <= 0 || inst->get_operand(0).is_label() || inst->get_operand(0).is_imm_ival() || (inst->get_num_operands() >= 2 && inst->get_operand(1).is_label())
+            || inst->get_opcode() == HINS_asm || HighLevel::is_atomic(inst)) {
           new_bb->append(inst->duplicate());
           continue;
         }
@@ -259,6 +846,311 @@ class DSE : public ControlFlowGraphTransform {
 };
 
 
+// Removal of code that can't be executed because every path to it goes
+// through a call to a noreturn function. The blocks stay in the CFG (so
+// their labels and edges remain valid), but only the function epilogue
+// is kept; a labeled block that would become empty keeps a nop for its
+// label.
+class UnreachableCode : public ControlFlowGraphTransform {
+  private:
+    std::vector<bool> m_reachable;                 // block id -> whether it can be executed
+
+  public:
+
+    UnreachableCode(std::shared_ptr<ControlFlowGraph> cfg, const FunctionAttrInference &function_attrs)
+      : ControlFlowGraphTransform(cfg), m_reachable(function_attrs.find_reachable_blocks(cfg)) {
+    }
+
+
+    virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
+      std::shared_ptr<InstructionSequence> new_bb(new InstructionSequence());
+      bool reachable = m_reachable[orig_bb->get_block_id()];
+      for (auto it = orig_bb->cbegin(); it != orig_bb->cend(); ++it) {
+        Instruction* inst = *it;
+        if (reachable || inst->get_opcode() == HINS_leave || inst->get_opcode() == HINS_ret)
+          new_bb->append(inst->duplicate());
+      }
+      if (new_bb->get_length() == 0 && orig_bb->has_block_label())
+        new_bb->append(new Instruction(HINS_nop));
+      return new_bb;
+    }
+};
+
+
+// Memory-to-register promotion of locals whose address is taken.
+// LocalStorageAllocation puts such variables in memory, and every access
+// goes through a localaddr'ed vreg. If the address never escapes, i.e.
+// every vreg holding it (the localaddr result and copies of it) is only
+// used as the base of plain loads and stores of one size, the variable
+// becomes a vreg again: the loads and stores are rewritten to use the
+// vreg, and the localaddr and the copies are dropped.
+//
+// A variable whose address is also passed to calls stays in memory, but
+// lives in a fresh vreg in between: the vreg is written back before each
+// call that may read the variable and reloaded after each call that may
+// write it (according to the mod/ref summaries). A callee that keeps the
+// pointer makes the alias analysis merge the variable with whatever the
+// pointer was stored into, so the later calls' mod/ref results and the
+// alias check of the function's other memory accesses stay sound.
+class MemToReg : public ControlFlowGraphTransform {
+  private:
+    static const long UNKNOWN = -1;                // vreg may hold anything
+    std::shared_ptr<Function> m_function;
+    const AliasAnalysis &m_alias_analysis;
+    const ModRefAnalysis &m_mod_ref;
+    std::map<int, long> m_points_to;               // vreg -> localaddr offset it holds
+    std::map<long, int> m_promoted;                // promoted offset -> vreg holding the variable
+    std::map<long, int> m_synced;                  // promoted offset passed to calls -> access size
+    std::map<long, int> m_address_vreg;            // promoted offset -> a vreg holding its address
+    int m_max_vreg;
+
+  public:
+
+    MemToReg(std::shared_ptr<ControlFlowGraph> cfg, std::shared_ptr<Function> function, const AliasAnalysis &alias_analysis, const ModRefAnalysis &mod_ref)
+      : ControlFlowGraphTransform(cfg), m_function(function), m_alias_analysis(alias_analysis), m_mod_ref(mod_ref), m_max_vreg(LocalStorageAllocation::VREG_FIRST_LOCAL - 1) {
+      find_address_vregs();
+      find_promotable();
+    }
+
+
+    virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
+      std::shared_ptr<InstructionSequence> new_bb(new InstructionSequence());
+
+      // the write-backs for a call go before the moves of its arguments
+      // (the low-level code for a memory access may use the argument
+      // registers as temporaries)
+      std::map<unsigned, Instruction*> write_backs;
+      for (unsigned j = 0; j < orig_bb->get_length(); j++) {
+        if (orig_bb->get_instruction(j)->get_opcode() != HINS_call)
+          continue;
+        unsigned start = j;
+        while (start > 0 && only_defines_vreg(orig_bb->get_instruction(start - 1)))
+          --start;
+        write_backs[start] = orig_bb->get_instruction(j);
+      }
+
+      for (unsigned j = 0; j < orig_bb->get_length(); j++) {
+        Instruction* inst = orig_bb->get_instruction(j);
+        if (write_backs.count(j) > 0)
+          sync(new_bb, write_backs[j], true);
+
+        // the localaddr and copies of the address are no longer needed,
+        // unless the address is passed to calls
+        if (HighLevel::is_def(inst) && promoted_vreg(HighLevel::get_def_vreg(inst)) >= 0
+            && m_synced.count(address_of(HighLevel::get_def_vreg(inst))) == 0)
+          continue;
+
+        Instruction* new_inst = inst->duplicate();
+        for (unsigned i = 0; i < new_inst->get_num_operands(); i++) {
+          Operand op = new_inst->get_operand(i);
+          if (op.get_kind() == Operand::VREG_MEM && promoted_vreg(op.get_base_reg()) >= 0)
+            new_inst->set_operand(i, Operand(Operand::VREG, promoted_vreg(op.get_base_reg())));
+        }
+        new_bb->append(new_inst);
+
+        if (inst->get_opcode() == HINS_call)
+          sync(new_bb, inst, false);
+      }
+      return new_bb;
+    }
+
+  private:
+    // vreg now holding the variable whose address vreg holds, or -1
+    int promoted_vreg(int vreg) const {
+      auto pt = m_points_to.find(vreg);
+      if (pt == m_points_to.end() || pt->second == UNKNOWN)
+        return -1;
+      auto promoted = m_promoted.find(pt->second);
+      return promoted == m_promoted.end() ? -1 : promoted->second;
+    }
+
+    // an instruction that only writes a vreg (e.g., computing or moving
+    // an argument), so the variable's memory stays the same
+    static bool only_defines_vreg(Instruction* inst) {
+      return HighLevel::is_def(inst) && inst->get_opcode() != HINS_call && !HighLevel::is_atomic(inst);
+    }
+
+    static bool is_arg_def(Instruction* inst) {
+      if (!HighLevel::is_def(inst))
+        return false;
+      int vreg = HighLevel::get_def_vreg(inst);
+      return vreg >= LocalStorageAllocation::VREG_FIRST_ARG && vreg < LocalStorageAllocation::VREG_FIRST_LOCAL;
+    }
+
+    // Store the variables passed to calls that the call may read (before it),
+    // or load the ones it may write (after it)
+    void sync(std::shared_ptr<InstructionSequence> bb, Instruction* call, bool before) {
+      for (auto i = m_synced.begin(); i != m_synced.end(); ++i) {
+        Operand addr(Operand::VREG, m_address_vreg[i->first]);
+        Operand mem(Operand::VREG_MEM, addr.get_base_reg());
+        Operand value(Operand::VREG, m_promoted[i->first]);
+        HighLevelOpcode mov = HighLevelOpcode(HINS_mov_b + (i->second == 1 ? 0 : i->second == 2 ? 1 : i->second == 4 ? 2 : 3));
+        if (before ? !m_mod_ref.may_ref(m_function, call, mem) : !m_mod_ref.may_mod(m_function, call, mem))
+          continue;
+
+        // the address vreg only ever holds this address, so it can be set again
+        bb->append(new Instruction(HINS_localaddr, addr, Operand(Operand::IMM_IVAL, i->first)));
+        Instruction* mov_inst = before ? new Instruction(mov, mem, value) : new Instruction(mov, value, mem);
+        mov_inst->set_comment(before ? "Write back variable the callee may read" : "Reload variable the callee may write");
+        bb->append(mov_inst);
+      }
+    }
+
+    // Find the local variable address (localaddr offset) each vreg holds:
+    // a vreg holds one if all of its defs are localaddrs of that offset or
+    // copies of vregs holding it
+    void find_address_vregs() {
+      std::shared_ptr<ControlFlowGraph> cfg = get_orig_cfg();
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        for (auto bb = cfg->bb_begin(); bb != cfg->bb_end(); ++bb) {
+          for (auto it = (*bb)->cbegin(); it != (*bb)->cend(); ++it) {
+            Instruction* inst = *it;
+            for (unsigned i = 0; i < inst->get_num_operands(); i++) {
+              if (inst->get_operand(i).has_base_reg())
+                m_max_vreg = std::max(m_max_vreg, inst->get_operand(i).get_base_reg());
+              if (inst->get_operand(i).has_index_reg())
+                m_max_vreg = std::max(m_max_vreg, inst->get_operand(i).get_index_reg());
+            }
+            if (!HighLevel::is_def(inst))
+              continue;
+            int dest = HighLevel::get_def_vreg(inst);
+            if (dest < LocalStorageAllocation::VREG_FIRST_LOCAL)
+              continue;
+
+            long value = UNKNOWN;
+            Operand src = inst->get_num_operands() > 1 ? inst->get_operand(1) : Operand();
+            if (inst->get_opcode() == HINS_localaddr && src.is_imm_ival()) {
+              value = src.get_imm_ival();
+            } else if (inst->get_opcode() == HINS_mov_q && src.get_kind() == Operand::VREG && src.get_base_reg() >= LocalStorageAllocation::VREG_FIRST_LOCAL) {
+              auto pt = m_points_to.find(src.get_base_reg());
+              if (pt == m_points_to.end())
+                continue; // nothing known about the source yet
+              value = pt->second;
+            }
+
+            auto pt = m_points_to.find(dest);
+            if (pt == m_points_to.end()) {
+              m_points_to[dest] = value;
+              changed = true;
+            } else if (pt->second != value && pt->second != UNKNOWN) {
+              pt->second = UNKNOWN;
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+
+    // Find the variables whose address doesn't escape, and pick one of the
+    // vregs that held the address as the vreg for the variable (or a fresh
+    // vreg, if the address is passed to calls)
+    void find_promotable() {
+      std::shared_ptr<ControlFlowGraph> cfg = get_orig_cfg();
+      std::set<long> escaped;
+      std::set<long> passed;
+      std::map<long, std::set<int>> store_sizes;
+      std::map<long, std::set<int>> access_sizes;
+      bool has_asm = false;
+
+      for (auto bb = cfg->bb_begin(); bb != cfg->bb_end(); ++bb) {
+        for (auto it = (*bb)->cbegin(); it != (*bb)->cend(); ++it) {
+          Instruction* inst = *it;
+          HighLevelOpcode opcode = HighLevelOpcode(inst->get_opcode());
+          if (opcode == HINS_asm)
+            has_asm = true;
+
+          // a localaddr whose result may also hold something else
+          if (opcode == HINS_localaddr && inst->get_operand(1).is_imm_ival()
+              && m_points_to[inst->get_operand(0).get_base_reg()] == UNKNOWN)
+            escaped.insert(inst->get_operand(1).get_imm_ival());
+
+          for (unsigned i = 0; i < inst->get_num_operands(); i++) {
+            if (!HighLevel::is_use(inst, i))
+              continue;
+            Operand op = inst->get_operand(i);
+            if (op.has_index_reg() && address_of(op.get_index_reg()) != UNKNOWN)
+              escaped.insert(address_of(op.get_index_reg()));
+            long addr = address_of(op.get_base_reg());
+            if (addr == UNKNOWN)
+              continue;
+
+            if (op.get_kind() == Operand::VREG_MEM && (opcode == HINS_asm || HighLevel::is_atomic(inst))) {
+              // an asm operand or atomic object must stay in memory
+              escaped.insert(addr);
+            } else if (op.get_kind() == Operand::VREG_MEM) {
+              // a load or store of the variable
+              if (i == 0 && HighLevel::is_def(inst) == false && opcode != HINS_cjmp_t && opcode != HINS_cjmp_f) {
+                store_sizes[addr].insert(highlevel_opcode_get_dest_operand_size(opcode));
+                access_sizes[addr].insert(highlevel_opcode_get_dest_operand_size(opcode));
+              } else {
+                access_sizes[addr].insert(highlevel_opcode_get_source_operand_size(opcode));
+              }
+            } else if (op.get_kind() == Operand::VREG && opcode == HINS_mov_q && i == 1
+                       && address_of(inst->get_operand(0).get_base_reg()) == addr) {
+              // copying the address to another vreg holding only this address
+            } else if (op.get_kind() == Operand::VREG && opcode == HINS_mov_q && i == 1 && is_arg_def(inst)) {
+              // passing the address to a call
+              passed.insert(addr);
+            } else {
+              escaped.insert(addr);
+            }
+          }
+        }
+      }
+
+      for (auto i = m_points_to.begin(); i != m_points_to.end(); ++i) {
+        long addr = i->second;
+        if (addr == UNKNOWN || escaped.count(addr) > 0 || store_sizes[addr].size() > 1 || m_promoted.count(addr) > 0)
+          continue;
+        if (passed.count(addr) == 0) {
+          m_promoted[addr] = i->first; // lowest numbered vreg that held the address
+          continue;
+        }
+
+        // the memory is written back and reloaded in the size of the
+        // stores (or the smallest load), and no other memory access
+        // (e.g., through a pointer a callee kept) may refer to the variable
+        if (has_asm || access_sizes[addr].empty() || m_max_vreg + 1 >= int(LiveVregsAnalysis::MAX_VREGS))
+          continue;
+        int size = store_sizes[addr].empty() ? *access_sizes[addr].begin() : *store_sizes[addr].begin();
+        if (!accessed_only_through(addr, Operand(Operand::VREG_MEM, i->first), size))
+          continue;
+        m_promoted[addr] = ++m_max_vreg;
+        m_synced[addr] = size;
+        m_address_vreg[addr] = i->first;
+      }
+    }
+
+    // check that no memory access other than the ones through vregs
+    // holding addr may refer to the variable
+    bool accessed_only_through(long addr, const Operand &var, int size) {
+      std::shared_ptr<ControlFlowGraph> cfg = get_orig_cfg();
+      for (auto bb = cfg->bb_begin(); bb != cfg->bb_end(); ++bb) {
+        for (auto it = (*bb)->cbegin(); it != (*bb)->cend(); ++it) {
+          Instruction* inst = *it;
+          HighLevelOpcode opcode = HighLevelOpcode(inst->get_opcode());
+          for (unsigned i = 0; i < inst->get_num_operands(); i++) {
+            Operand op = inst->get_operand(i);
+            if (!op.is_memref() || !op.has_base_reg() || address_of(op.get_base_reg()) == addr)
+              continue;
+            int op_size = i == 0 ? highlevel_opcode_get_dest_operand_size(opcode) : highlevel_opcode_get_source_operand_size(opcode);
+            if (m_alias_analysis.alias(m_function, op, op_size, var, size) != AliasAnalysis::NO_ALIAS)
+              return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    long address_of(int vreg) const {
+      auto pt = m_points_to.find(vreg);
+      return pt == m_points_to.end() ? UNKNOWN : pt->second;
+    }
+};
+
+
 void HighLevelOpt::optimize(std::shared_ptr<Function> function) {
   assert(m_options.has_option(Options::OPTIMIZE));
 
@@ -296,14 +1188,57 @@ void HighLevelOpt::optimize(std::shared_ptr<Function> function) {
   std::shared_ptr<ControlFlowGraph> hl_cfg = hl_cfg_builder.build();
 
 
+  //Promote address-taken locals whose address doesn't escape to vregs
+  MemToReg mem_to_reg(hl_cfg, m_function, m_alias_analysis, m_mod_ref);
+  hl_cfg = mem_to_reg.transform_cfg();
+
+  //Move loop-invariant conditional branches out of loops
+  LoopUnswitch loop_unswitch(hl_cfg);
+  hl_cfg = loop_unswitch.transform_cfg();
+
+  //Turn top-tested loops into guarded bottom-tested loops
+  LoopRotation loop_rotation(hl_cfg);
+  hl_cfg = loop_rotation.transform_cfg();
+
+  //Route edges along which a branch's outcome is known past the branch
+  JumpThreading jump_threading(hl_cfg);
+  hl_cfg = jump_threading.transform_cfg();
+
+  //Tail-duplicate join blocks into the likely trace
+  SuperblockFormation superblock_formation(hl_cfg, m_function_attrs);
+  hl_cfg = superblock_formation.transform_cfg();
+
+  //Remove code following calls to noreturn functions (and the
+  //code unswitching, jump threading and tail duplication made dead)
+  UnreachableCode unreachable_code(hl_cfg, m_function_attrs);
+  hl_cfg = unreachable_code.transform_cfg();
+
+  //Algebraic simplification, constant folding and reassociation
+  InstCombine inst_combine(hl_cfg);
+  hl_cfg = inst_combine.transform_cfg();
+
+  //Remove the code made dead by the conditional jumps InstCombine folded
+  UnreachableCode unreachable_folded(hl_cfg, m_function_attrs);
+  hl_cfg = unreachable_folded.transform_cfg();
+
   //Local Value Numbering (and copy propogation)
-  LVN lvn(hl_cfg);
+  LVN lvn(hl_cfg, m_function, m_alias_analysis, m_mod_ref, m_function_attrs);
   hl_cfg = lvn.transform_cfg();
 
   //Dead Store Elimination
   DSE dse(hl_cfg);
   hl_cfg = dse.transform_cfg();
 
+  //Overlap the iterations of counted single-block loops
+  ModuloScheduling modulo_scheduling(hl_cfg, m_function, m_alias_analysis);
+  hl_cfg = modulo_scheduling.transform_cfg();
+
+  //Prefetch the data of strided accesses in loops
+  int latency = m_options.has_option(Options::PREFETCH) ? std::stoi(m_options.get_arg(Options::PREFETCH))
+                                                        : SoftwarePrefetch::DEFAULT_LATENCY;
+  SoftwarePrefetch software_prefetch(hl_cfg, m_function_attrs, latency);
+  hl_cfg = software_prefetch.transform_cfg();
+
 
   hl_iseq = hl_cfg->create_instruction_sequence();
   m_function->set_hl_iseq(hl_iseq);
@@ -0,0 +1,331 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <set>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "cfg_builder.h"
+#include "jump_threading.h"
+
+namespace {
+
+// Only blocks with at most this many high-level instructions
+// are duplicated
+const unsigned MAX_BLOCK_SIZE = 10;
+
+// The copies may add this percentage of the function's high-level code
+// (but at least MIN_BUDGET instructions)
+const int BUDGET_PERCENT = 25;
+const int MIN_BUDGET = 40;
+
+// What an instruction computes: its opcode, and for each source operand,
+// either a constant (true, value) or the contents of a vreg (false, vreg)
+typedef std::vector<std::pair<bool, long> > Computation;
+
+bool get_computation(Instruction *ins, const std::map<int, long> &constants, Computation &computation) {
+  computation.clear();
+  computation.push_back(std::make_pair(true, long(ins->get_opcode())));
+  for (unsigned j = 1; j < ins->get_num_operands(); ++j) {
+    Operand operand = ins->get_operand(j);
+    if (operand.is_imm_ival()) {
+      computation.push_back(std::make_pair(true, operand.get_imm_ival()));
+    } else if (operand.get_kind() == Operand::VREG) {
+      auto i = constants.find(operand.get_base_reg());
+      if (i != constants.end())
+        computation.push_back(std::make_pair(true, i->second));
+      else
+        computation.push_back(std::make_pair(false, long(operand.get_base_reg())));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool uses_vreg(const Computation &computation, int vreg) {
+  for (auto i = computation.begin() + 1; i != computation.end(); ++i) {
+    if (!i->first && i->second == vreg)
+      return true;
+  }
+  return false;
+}
+
+// Update the constant vregs for a def instruction
+void update_constants(Instruction *ins, std::map<int, long> &constants) {
+  int vreg = HighLevel::get_def_vreg(ins);
+  std::vector<long> args;
+  bool known = ins->get_opcode() != HINS_call;
+  for (unsigned j = 1; j < ins->get_num_operands() && known; ++j) {
+    Operand operand = ins->get_operand(j);
+    if (operand.is_imm_ival())
+      args.push_back(operand.get_imm_ival());
+    else if (operand.get_kind() == Operand::VREG && constants.count(operand.get_base_reg()) > 0)
+      args.push_back(constants[operand.get_base_reg()]);
+    else
+      known = false;
+  }
+
+  long value;
+  if (known && !args.empty() && HighLevel::evaluate(ins->get_opcode(), args, value))
+    constants[vreg] = value;
+  else
+    constants.erase(vreg);
+}
+
+}
+
+JumpThreading::JumpThreading(std::shared_ptr<ControlFlowGraph> cfg)
+  : m_cfg(cfg)
+  , m_budget(0)
+  , m_num_copies(0) {
+}
+
+JumpThreading::~JumpThreading() {
+}
+
+std::shared_ptr<ControlFlowGraph> JumpThreading::transform_cfg() {
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+  m_budget = std::max(MIN_BUDGET, int(iseq->get_length()) * BUDGET_PERCENT / 100);
+
+  // every copy uses up some of the budget, so this terminates
+  bool changed = false;
+  while (std::shared_ptr<InstructionSequence> result = thread_one(iseq)) {
+    iseq = result;
+    changed = true;
+  }
+
+  if (!changed)
+    return m_cfg;
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  return cfg_builder.build();
+}
+
+int JumpThreading::get_known_outcome(const Edge *edge) {
+  std::shared_ptr<InstructionSequence> pred = edge->get_source();
+  std::shared_ptr<InstructionSequence> bb = edge->get_target();
+  Instruction *jump = bb->get_last_instruction();
+  if ((jump->get_opcode() != HINS_cjmp_t && jump->get_opcode() != HINS_cjmp_f)
+      || jump->get_operand(0).get_kind() != Operand::VREG)
+    return -1;
+
+  // If the predecessor ends in a conditional jump, its condition's
+  // truth value is known along the edge
+  int pred_cond = -1;
+  bool pred_truth = false;
+  Instruction *pred_jump = pred->get_last_instruction();
+  if ((pred_jump->get_opcode() == HINS_cjmp_t || pred_jump->get_opcode() == HINS_cjmp_f)
+      && pred_jump->get_operand(0).get_kind() == Operand::VREG) {
+    pred_cond = pred_jump->get_operand(0).get_base_reg();
+    pred_truth = (edge->get_kind() == EDGE_BRANCH) == (pred_jump->get_opcode() == HINS_cjmp_t);
+  }
+
+  // Find the constant vregs at the end of the predecessor, and how its
+  // condition is computed (as long as the values it's computed
+  // from don't change)
+  std::map<int, long> constants;
+  Computation pred_computation;
+  bool have_computation = false;
+  for (auto i = pred->cbegin(); i != pred->cend(); ++i) {
+    Instruction *ins = *i;
+    if (ins->get_opcode() == HINS_call || ins->get_opcode() == HINS_asm) {
+      // calls (and inline assembly) clobber vr0-vr9
+      for (int vreg = 0; vreg < 10; ++vreg) {
+        constants.erase(vreg);
+        if (have_computation && uses_vreg(pred_computation, vreg))
+          have_computation = false;
+      }
+      continue;
+    }
+    if (!HighLevel::is_def(ins))
+      continue;
+    int vreg = HighLevel::get_def_vreg(ins);
+    Computation computation;
+    bool computed = get_computation(ins, constants, computation);
+    update_constants(ins, constants);
+    if (vreg == pred_cond) {
+      pred_computation = computation;
+      have_computation = computed && !uses_vreg(computation, vreg);
+    } else if (have_computation && uses_vreg(pred_computation, vreg)) {
+      have_computation = false;
+    }
+  }
+
+  // Go through the block: the vregs in same_truth have the truth
+  // value of the predecessor's condition
+  std::set<int> same_truth;
+  if (pred_cond >= 0)
+    same_truth.insert(pred_cond);
+  for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+    Instruction *ins = *i;
+    if (ins == jump || !HighLevel::is_def(ins))
+      continue;
+    int vreg = HighLevel::get_def_vreg(ins);
+    Computation computation;
+    bool computed = get_computation(ins, constants, computation);
+    update_constants(ins, constants);
+    if (have_computation && computed && computation == pred_computation && !uses_vreg(computation, vreg))
+      same_truth.insert(vreg);
+    else
+      same_truth.erase(vreg);
+    if (have_computation && uses_vreg(pred_computation, vreg))
+      have_computation = false;
+  }
+
+  // the low-level code tests the low byte of the condition
+  int cond = jump->get_operand(0).get_base_reg();
+  bool truth;
+  if (constants.count(cond) > 0)
+    truth = (constants[cond] & 0xff) != 0;
+  else if (same_truth.count(cond) > 0)
+    truth = pred_truth;
+  else
+    return -1;
+  return truth == (jump->get_opcode() == HINS_cjmp_t) ? 1 : 0;
+}
+
+// Find an edge whose target's conditional jump has a known outcome,
+// and thread it. Returns the transformed code, or nullptr if there is
+// no such edge.
+std::shared_ptr<InstructionSequence> JumpThreading::thread_one(std::shared_ptr<InstructionSequence> iseq) {
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  LoopInfo loop_info(cfg);
+  loop_info.execute();
+  std::set<unsigned> loop_headers;
+  for (auto i = loop_info.get_loops().begin(); i != loop_info.get_loops().end(); ++i)
+    loop_headers.insert(i->header->get_block_id());
+
+  for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = *i;
+    if (bb->get_kind() != BASICBLOCK_INTERIOR || !bb->has_block_label()
+        || bb->get_length() > MAX_BLOCK_SIZE || int(bb->get_length()) > m_budget
+        || loop_headers.count(bb->get_block_id()) > 0)
+      continue;
+    Instruction *jump = bb->get_last_instruction();
+    if (jump->get_opcode() != HINS_cjmp_t && jump->get_opcode() != HINS_cjmp_f)
+      continue;
+    unsigned end = unsigned(bb->get_code_order()) + bb->get_length();
+    const ControlFlowGraph::EdgeList &incoming = cfg->get_incoming_edges(bb);
+    if (incoming.size() < 2)
+      continue;
+
+    for (auto j = incoming.begin(); j != incoming.end(); ++j) {
+      const Edge *edge = *j;
+      std::shared_ptr<InstructionSequence> pred = edge->get_source();
+      if (pred->get_kind() != BASICBLOCK_INTERIOR || pred == bb)
+        continue;
+      unsigned num_edges = 0;
+      for (auto k = incoming.begin(); k != incoming.end(); ++k) {
+        if ((*k)->get_source() == pred)
+          ++num_edges;
+      }
+      if (num_edges > 1)
+        continue;
+
+      int outcome = get_known_outcome(edge);
+      if (outcome < 0 || (outcome == 0 && end >= iseq->get_length()))
+        continue;
+
+      // The copy goes right before the block if it is entered by falling
+      // through from the predecessor. Otherwise, it goes after an
+      // unconditional jump (preferably the first one after the predecessor).
+      unsigned pred_end = unsigned(pred->get_code_order()) + pred->get_length();
+      unsigned insert_at = 0;
+      if (edge->get_kind() == EDGE_FALLTHROUGH) {
+        insert_at = unsigned(bb->get_code_order());
+      } else {
+        for (unsigned k = 0; k < iseq->get_length(); ++k) {
+          if (iseq->get_instruction(k)->get_opcode() == HINS_jmp) {
+            insert_at = k + 1;
+            if (insert_at >= pred_end)
+              break;
+          }
+        }
+        if (insert_at == 0)
+          continue;
+      }
+
+      m_budget -= int(bb->get_length());
+      return thread(iseq, edge, outcome == 1, insert_at);
+    }
+  }
+
+  return nullptr;
+}
+
+// Route an edge to the successor its target's conditional jump is known
+// to lead to, through a copy of the target inserted before the
+// instruction at index insert_at
+std::shared_ptr<InstructionSequence> JumpThreading::thread(std::shared_ptr<InstructionSequence> iseq, const Edge *edge,
+                                                           bool taken, unsigned insert_at) {
+  std::shared_ptr<InstructionSequence> pred = edge->get_source();
+  std::shared_ptr<InstructionSequence> bb = edge->get_target();
+  unsigned end = unsigned(bb->get_code_order()) + bb->get_length();
+  std::string suffix = ".jt" + std::to_string(++m_num_copies);
+  std::string copy_label = bb->get_block_label() + suffix;
+
+  // label the successor if it is only reached by falling through
+  Instruction *jump = bb->get_last_instruction();
+  std::string succ_label;
+  if (taken)
+    succ_label = jump->get_operand(1).get_label();
+  else
+    succ_label = iseq->has_label(end) ? iseq->get_label_at_index(end) : copy_label + ".next";
+
+  unsigned pred_jump = unsigned(pred->get_code_order()) + pred->get_length() - 1;
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned j = 0; j <= iseq->get_length(); ++j) {
+    if (j == insert_at) {
+      result->define_label(copy_label);
+      for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+        if (*i != jump)
+          result->append((*i)->duplicate());
+      }
+      Instruction *threaded = new Instruction(HINS_jmp, Operand(Operand::LABEL, succ_label));
+      threaded->set_comment("threaded jump");
+      result->append(threaded);
+    }
+    if (j == iseq->get_length())
+      break;
+
+    // a jump to the copy right after it isn't needed
+    if (j == pred_jump && insert_at == j + 1 && iseq->get_instruction(j)->get_opcode() == HINS_jmp
+        && !iseq->has_label(j))
+      continue;
+
+    Instruction *ins = iseq->get_instruction(j)->duplicate();
+    if (j == pred_jump && edge->get_kind() == EDGE_BRANCH) {
+      unsigned num_operands = ins->get_num_operands();
+      assert(ins->get_operand(num_operands - 1).get_label() == bb->get_block_label());
+      ins->set_operand(num_operands - 1, Operand(Operand::LABEL, copy_label));
+    }
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    else if (j == end && !taken)
+      result->define_label(succ_label);
+    result->append(ins);
+  }
+
+  return result;
+}
@@ -20,7 +20,10 @@
 
 #include <cassert>
 #include "node.h"
+#include "ast.h"
 #include "symtab.h"
+#include "literal_value.h"
+#include "inline_asm.h"
 #include "local_storage_allocation.h"
 
 LocalStorageAllocation::LocalStorageAllocation()
@@ -42,6 +45,8 @@ void LocalStorageAllocation::allocate_storage(std::shared_ptr<Function> function
 void LocalStorageAllocation::visit_function_definition(Node *n) {
   Symbol *fn_id = n->get_kid(1)->get_symbol();
   SymbolTable *l_symtab = fn_id->get_symtab_k();
+  m_address_taken.clear();
+  find_address_taken(n->get_kid(3));
   m_function->get_vra()->alloc_local(); //burn return register
   int allocated = VREG_FIRST_ARG;
   assert(l_symtab->get_num_parameters()<VREG_FIRST_LOCAL);//ensures we do not have more inputs that input parameters
@@ -53,8 +58,7 @@ void LocalStorageAllocation::visit_function_definition(Node *n) {
         allocated = m_function->get_vra()->alloc_local();
       }
     }
-    if (s->get_type()->is_array() || s->get_type()->is_struct()){ //needs mem_alloc
-      //TODO: OR ITS ADDRESS IS TAKEN???
+    if (needs_memory(s)){ //needs mem_alloc
       s->set_al(m_storage_calc.add_field(s->get_type())); 
     } else { //can be stored in register
       s->set_reg(m_function->get_vra()->alloc_local());
@@ -63,6 +67,10 @@ void LocalStorageAllocation::visit_function_definition(Node *n) {
     
     // printf("Register: %d, Offset: %d\n",s->get_reg(),s->get_al());
   }
+  while (allocated < VREG_FIRST_LOCAL) { //no locals: temps must still start after the arg registers
+    allocated = m_function->get_vra()->alloc_local();
+  }
+  allocate_asm_slots(n->get_kid(3));
   m_storage_calc.finish();
   n->set_total_local_storage(m_storage_calc.get_size());
   n->set_reg_used(allocated);
@@ -74,8 +82,7 @@ void LocalStorageAllocation::visit_statement_list(Node *n) {
   int allocated = VREG_FIRST_LOCAL;
   for (auto i = l_symtab->cbegin(); i != l_symtab->cend(); ++i) {
     Symbol *s = *i;
-    if (s->get_type()->is_array() || s->get_type()->is_struct()){ //needs mem_alloc
-      //TODO: OR ITS ADDRESS IS TAKEN???
+    if (needs_memory(s)){ //needs mem_alloc
       m_storage_calc.add_field(s->get_type());
       s->set_al(m_storage_calc.get_align()); 
     } else { //can be stored in register
@@ -88,4 +95,43 @@ void LocalStorageAllocation::visit_statement_list(Node *n) {
   }
 }
 
-// TODO: implement private member functions
+// Find the variables whose address is taken with the unary & operator
+void LocalStorageAllocation::find_address_taken(Node *n) {
+  if (n->get_tag() == AST_UNARY_EXPRESSION && n->get_kid(0)->get_str() == "&"
+      && n->get_kid(1)->get_tag() == AST_VARIABLE_REF)
+    m_address_taken.insert(n->get_kid(1)->get_symbol());
+
+  for (auto i = n->cbegin(); i != n->cend(); ++i)
+    find_address_taken(*i);
+}
+
+// Outputs and memory inputs of asm statements are passed through
+// stack slots: the low-level code loads and stores them around the
+// asm instruction, so the value can live in a register while the
+// asm executes
+void LocalStorageAllocation::allocate_asm_slots(Node *n) {
+  if (n->get_tag() == AST_ASM_STATEMENT) {
+    for (unsigned list = 1; list <= 2; ++list) {
+      Node *operands = n->get_kid(list);
+      for (auto i = operands->cbegin(); i != operands->cend(); ++i) {
+        Node *operand = *i;
+        std::string text = LiteralValue::from_str_literal(operand->get_kid(0)->get_str(), operand->get_loc()).get_str_value();
+        InlineAsm::Constraint constraint;
+        InlineAsm::parse_constraint(text, list == 1, constraint);
+        if (list == 1 || constraint.kind == InlineAsm::MEM)
+          operand->set_asm_slot(m_storage_calc.add_field(operand->get_kid(1)->get_type()));
+      }
+    }
+    return;
+  }
+
+  for (auto i = n->cbegin(); i != n->cend(); ++i)
+    allocate_asm_slots(*i);
+}
+
+// Arrays, structs, and variables whose address is taken live in memory.
+// (HighLevelOpt promotes the address-taken ones back to vregs when
+// their address doesn't escape.)
+bool LocalStorageAllocation::needs_memory(Symbol *s) {
+  return s->get_type()->is_array() || s->get_type()->is_struct() || m_address_taken.count(s) > 0;
+}
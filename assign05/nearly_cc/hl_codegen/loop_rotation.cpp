@@ -0,0 +1,190 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <climits>
+#include <algorithm>
+#include "highlevel.h"
+#include "cfg_builder.h"
+#include "loop_rotation.h"
+
+namespace {
+
+// The test is only duplicated if its basic block has at most
+// this many high-level instructions
+const unsigned MAX_HEADER_SIZE = 12;
+
+}
+
+LoopRotation::LoopRotation(std::shared_ptr<ControlFlowGraph> cfg)
+  : m_cfg(cfg) {
+}
+
+LoopRotation::~LoopRotation() {
+}
+
+std::shared_ptr<ControlFlowGraph> LoopRotation::transform_cfg() {
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+
+  // a rotated loop no longer ends with an unconditional jump,
+  // so it isn't found again
+  bool changed = false;
+  while (std::shared_ptr<InstructionSequence> result = rotate_one(iseq)) {
+    iseq = result;
+    changed = true;
+  }
+
+  if (!changed)
+    return m_cfg;
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  return cfg_builder.build();
+}
+
+// Find a top-tested loop and rotate it.
+// Returns the transformed code, or nullptr if no loop can be rotated.
+std::shared_ptr<InstructionSequence> LoopRotation::rotate_one(std::shared_ptr<InstructionSequence> iseq) {
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  LoopInfo loop_info(cfg);
+  loop_info.execute();
+  const std::vector<LoopInfo::Loop> &loops = loop_info.get_loops();
+
+  for (auto i = loops.rbegin(); i != loops.rend(); ++i) {
+    const LoopInfo::Loop &loop = *i;
+    std::string header_label = loop.header->get_block_label();
+    if (header_label.empty() || loop.latches.size() != 1)
+      continue;
+
+    // The loop's blocks must occupy a contiguous range of instructions
+    // (the code order of a block is the index of its first instruction),
+    // starting with the header
+    unsigned begin = UINT_MAX, end = 0, num_instructions = 0;
+    bool contiguous = true;
+    for (auto j = loop.blocks.begin(); j != loop.blocks.end(); ++j) {
+      std::shared_ptr<InstructionSequence> bb = cfg->get_block(*j);
+      if (bb->get_kind() != BASICBLOCK_INTERIOR) {
+        contiguous = false;
+        break;
+      }
+      unsigned start = unsigned(bb->get_code_order());
+      begin = std::min(begin, start);
+      end = std::max(end, start + bb->get_length());
+      num_instructions += bb->get_length();
+    }
+    if (!contiguous || begin == 0 || num_instructions != end - begin
+        || unsigned(loop.header->get_code_order()) != begin)
+      continue;
+
+    // the header is the test, which leaves the loop, and there must be
+    // a body after it
+    unsigned header_end = begin + loop.header->get_length();
+    if (loop.header->get_length() > MAX_HEADER_SIZE || header_end >= end - 1)
+      continue;
+    Instruction *test = iseq->get_instruction(header_end - 1);
+    if (test->get_opcode() != HINS_cjmp_t && test->get_opcode() != HINS_cjmp_f)
+      continue;
+    bool exits = true;
+    for (unsigned j = begin; j < end; ++j) {
+      if (iseq->has_label(j) && iseq->get_label_at_index(j) == test->get_operand(1).get_label())
+        exits = false;
+    }
+    if (!exits)
+      continue;
+
+    // the only jump to the header is the one at the end of the loop,
+    // and the header is entered from outside by falling through
+    Instruction *back = iseq->get_instruction(end - 1);
+    if (back->get_opcode() != HINS_jmp || back->get_operand(0).get_label() != header_label)
+      continue;
+    unsigned num_refs = 0;
+    for (auto j = iseq->cbegin(); j != iseq->cend(); ++j) {
+      Instruction *ins = *j;
+      for (unsigned k = 0; k < ins->get_num_operands(); ++k) {
+        if (ins->get_operand(k).get_kind() == Operand::LABEL && ins->get_operand(k).get_label() == header_label)
+          ++num_refs;
+      }
+    }
+    bool entered_by_fallthrough = true;
+    const ControlFlowGraph::EdgeList &incoming = cfg->get_incoming_edges(loop.header);
+    for (auto j = incoming.begin(); j != incoming.end(); ++j) {
+      if (!loop.contains((*j)->get_source()) && (*j)->get_kind() != EDGE_FALLTHROUGH)
+        entered_by_fallthrough = false;
+    }
+    if (num_refs != 1 || !entered_by_fallthrough)
+      continue;
+
+    return rotate(iseq, begin, header_end, end);
+  }
+
+  return nullptr;
+}
+
+// Rotate the loop occupying instructions [begin, end), whose test
+// occupies [begin, header_end)
+std::shared_ptr<InstructionSequence> LoopRotation::rotate(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned header_end, unsigned end) {
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned j = 0; j < header_end; ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  // the original test is now the guard, which falls through
+  // to the preheader
+  Instruction *preheader = new Instruction(HINS_nop);
+  preheader->set_comment("loop preheader");
+  result->append(preheader);
+
+  std::string body_label = iseq->has_label(header_end) ? iseq->get_label_at_index(header_end)
+                                                       : iseq->get_label_at_index(begin) + ".body";
+  result->define_label(body_label);
+  for (unsigned j = header_end; j < end - 1; ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  // the latch (replacing the jump back to the header) repeats the test,
+  // branching back to the body if the loop continues
+  if (iseq->has_label(end - 1))
+    result->define_label(iseq->get_label_at_index(end - 1));
+  for (unsigned j = begin; j < header_end - 1; ++j)
+    result->append(iseq->get_instruction(j)->duplicate());
+  Instruction *test = iseq->get_instruction(header_end - 1);
+  HighLevelOpcode inverse = test->get_opcode() == HINS_cjmp_t ? HINS_cjmp_f : HINS_cjmp_t;
+  Instruction *latch = new Instruction(inverse, test->get_operand(0), Operand(Operand::LABEL, body_label));
+  latch->set_comment(test->get_comment());
+  latch->set_loc(test->get_loc());
+  if (test->get_branch_hint() != Instruction::HINT_NONE)
+    latch->set_branch_hint(test->get_branch_hint() == Instruction::HINT_TAKEN ? Instruction::HINT_NOT_TAKEN : Instruction::HINT_TAKEN);
+  result->append(latch);
+
+  std::string exit_label = test->get_operand(1).get_label();
+  if (end >= iseq->get_length() || !iseq->has_label(end) || iseq->get_label_at_index(end) != exit_label)
+    result->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, exit_label)));
+
+  for (unsigned j = end; j < iseq->get_length(); ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  return result;
+}
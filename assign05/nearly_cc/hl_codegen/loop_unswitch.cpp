@@ -0,0 +1,305 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <climits>
+#include <algorithm>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "cfg_builder.h"
+#include "live_vregs.h"
+#include "loop_unswitch.h"
+
+namespace {
+
+// Only loops with at most this many high-level instructions
+// are unswitched
+const int MAX_LOOP_SIZE = 100;
+
+// The copies may add this percentage of the function's high-level code
+// (but at least MIN_BUDGET instructions)
+const int BUDGET_PERCENT = 100;
+const int MIN_BUDGET = 100;
+
+// Maximum number of times a loop (and its copies) is unswitched
+const int MAX_UNSWITCH_LEVEL = 2;
+
+// Check whether an instruction computing part of a loop-invariant
+// condition can be executed before the loop: it must not access
+// memory, call a function, or possibly trap
+bool is_hoistable(Instruction *ins) {
+  HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+  if (opcode >= HINS_div_b && opcode <= HINS_mod_q)
+    return false;
+  if (!((opcode >= HINS_add_b && opcode <= HINS_mov_q) || (opcode >= HINS_sconv_bw && opcode <= HINS_uconv_lq)))
+    return false;
+  for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+    Operand operand = ins->get_operand(j);
+    if (operand.get_kind() != Operand::VREG && !operand.is_imm_ival())
+      return false;
+  }
+  return true;
+}
+
+int get_max_vreg(std::shared_ptr<InstructionSequence> iseq) {
+  int max_vreg = -1;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      Operand operand = ins->get_operand(j);
+      if (operand.has_base_reg())
+        max_vreg = std::max(max_vreg, operand.get_base_reg());
+      if (operand.has_index_reg())
+        max_vreg = std::max(max_vreg, operand.get_index_reg());
+    }
+  }
+  return max_vreg;
+}
+
+// Append a copy of the loop occupying instructions [begin, end) to
+// result, replacing the conditional jump at index branch with the
+// outcome it has when its condition is cond_value. Labels defined in the
+// loop get the suffix (in the copy, and in jumps to them).
+void copy_loop(std::shared_ptr<InstructionSequence> result, std::shared_ptr<InstructionSequence> iseq,
+               unsigned begin, unsigned end, unsigned branch, const std::set<std::string> &labels,
+               bool cond_value, const std::string &suffix) {
+  for (unsigned j = begin; j < end; ++j) {
+    Instruction *ins = iseq->get_instruction(j);
+    Instruction *copy;
+    if (j == branch) {
+      bool taken = cond_value == (ins->get_opcode() == HINS_cjmp_t);
+      if (!taken && !iseq->has_label(j))
+        continue;
+      copy = taken ? new Instruction(HINS_jmp, ins->get_operand(1)) : new Instruction(HINS_nop);
+      copy->set_comment(ins->get_comment());
+      copy->set_loc(ins->get_loc());
+    } else {
+      copy = ins->duplicate();
+    }
+
+    for (unsigned k = 0; k < copy->get_num_operands(); ++k) {
+      Operand operand = copy->get_operand(k);
+      if (operand.get_kind() == Operand::LABEL && labels.count(operand.get_label()) > 0)
+        copy->set_operand(k, Operand(Operand::LABEL, operand.get_label() + suffix));
+    }
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j) + suffix);
+    result->append(copy);
+  }
+}
+
+}
+
+LoopUnswitch::LoopUnswitch(std::shared_ptr<ControlFlowGraph> cfg)
+  : m_cfg(cfg)
+  , m_budget(0)
+  , m_num_copies(0) {
+}
+
+LoopUnswitch::~LoopUnswitch() {
+}
+
+std::shared_ptr<ControlFlowGraph> LoopUnswitch::transform_cfg() {
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+  m_budget = std::max(MIN_BUDGET, int(iseq->get_length()) * BUDGET_PERCENT / 100);
+
+  // Each level unswitches every loop at most once (the copies of a
+  // loop unswitched at this level are done as well)
+  bool changed = false;
+  for (int level = 0; level < MAX_UNSWITCH_LEVEL; ++level) {
+    std::set<std::string> unswitched;
+    while (std::shared_ptr<InstructionSequence> result = unswitch_one(iseq, unswitched)) {
+      iseq = result;
+      changed = true;
+    }
+  }
+
+  if (!changed)
+    return m_cfg;
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  return cfg_builder.build();
+}
+
+// Find a loop with an invariant conditional branch, and unswitch it.
+// Returns the transformed code, or nullptr if no loop can be unswitched.
+std::shared_ptr<InstructionSequence> LoopUnswitch::unswitch_one(std::shared_ptr<InstructionSequence> iseq, std::set<std::string> &unswitched) {
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  LoopInfo loop_info(cfg);
+  loop_info.execute();
+  const std::vector<LoopInfo::Loop> &loops = loop_info.get_loops();
+
+  // nested loops first
+  for (auto i = loops.rbegin(); i != loops.rend(); ++i) {
+    const LoopInfo::Loop &loop = *i;
+    std::string header_label = loop.header->get_block_label();
+    if (header_label.empty() || unswitched.count(header_label) > 0)
+      continue;
+
+    // The loop's blocks must occupy a contiguous range of instructions
+    // (the code order of a block is the index of its first instruction),
+    // starting with the header
+    unsigned begin = UINT_MAX, end = 0, num_instructions = 0;
+    bool contiguous = true;
+    for (auto j = loop.blocks.begin(); j != loop.blocks.end(); ++j) {
+      std::shared_ptr<InstructionSequence> bb = cfg->get_block(*j);
+      if (bb->get_kind() != BASICBLOCK_INTERIOR) {
+        contiguous = false;
+        break;
+      }
+      unsigned start = unsigned(bb->get_code_order());
+      begin = std::min(begin, start);
+      end = std::max(end, start + bb->get_length());
+      num_instructions += bb->get_length();
+    }
+    if (!contiguous || begin == 0 || num_instructions != end - begin
+        || unsigned(loop.header->get_code_order()) != begin)
+      continue;
+    int size = int(end - begin);
+    if (size > MAX_LOOP_SIZE || size > m_budget)
+      continue;
+
+    // the copies can't fall through out of the loop, and the
+    // hoisted condition goes right before the header
+    if (iseq->get_instruction(end - 1)->get_opcode() != HINS_jmp)
+      continue;
+    bool entered_by_fallthrough = true;
+    const ControlFlowGraph::EdgeList &incoming = cfg->get_incoming_edges(loop.header);
+    for (auto j = incoming.begin(); j != incoming.end(); ++j) {
+      if (!loop.contains((*j)->get_source()) && (*j)->get_kind() != EDGE_FALLTHROUGH)
+        entered_by_fallthrough = false;
+    }
+    if (!entered_by_fallthrough)
+      continue;
+
+    std::set<int> loop_defs;
+    bool has_calls = false;
+    for (unsigned j = begin; j < end; ++j) {
+      Instruction *ins = iseq->get_instruction(j);
+      if (ins->get_opcode() == HINS_call || ins->get_opcode() == HINS_asm)
+        has_calls = true;
+      if (HighLevel::is_def(ins))
+        loop_defs.insert(HighLevel::get_def_vreg(ins));
+    }
+
+    for (unsigned branch = begin; branch < end; ++branch) {
+      Instruction *ins = iseq->get_instruction(branch);
+      if ((ins->get_opcode() != HINS_cjmp_t && ins->get_opcode() != HINS_cjmp_f)
+          || ins->get_operand(0).get_kind() != Operand::VREG)
+        continue;
+
+      // Find the instructions computing the condition in the branch's
+      // basic block, and the values they depend on
+      std::set<int> needed;
+      needed.insert(ins->get_operand(0).get_base_reg());
+      std::vector<unsigned> slice;
+      bool ok = true;
+      for (unsigned j = branch; ok && j > begin && !iseq->has_label(j); ) {
+        --j;
+        Instruction *def = iseq->get_instruction(j);
+        HighLevelOpcode opcode = HighLevelOpcode(def->get_opcode());
+        if (opcode == HINS_jmp || opcode == HINS_cjmp_t || opcode == HINS_cjmp_f || opcode == HINS_call || opcode == HINS_asm)
+          break;
+        if (!HighLevel::is_def(def) || needed.count(HighLevel::get_def_vreg(def)) == 0)
+          continue;
+        if (!is_hoistable(def)) {
+          ok = false;
+          break;
+        }
+        needed.erase(HighLevel::get_def_vreg(def));
+        slice.insert(slice.begin(), j);
+        for (unsigned k = 1; k < def->get_num_operands(); ++k) {
+          if (def->get_operand(k).get_kind() == Operand::VREG)
+            needed.insert(def->get_operand(k).get_base_reg());
+        }
+      }
+
+      // those values must be the same in every iteration (calls
+      // clobber vr0-vr9)
+      for (auto j = needed.begin(); ok && j != needed.end(); ++j) {
+        if (loop_defs.count(*j) > 0 || *j == 0 || (has_calls && *j < 10))
+          ok = false;
+      }
+      if (!ok || std::max(get_max_vreg(iseq), 9) + int(slice.size()) >= int(LiveVregsAnalysis::MAX_VREGS))
+        continue;
+
+      std::string suffix = ".u" + std::to_string(++m_num_copies);
+      m_budget -= size;
+      unswitched.insert(header_label);
+      unswitched.insert(header_label + suffix);
+      return unswitch(iseq, begin, end, branch, slice, suffix);
+    }
+  }
+
+  return nullptr;
+}
+
+// Unswitch the loop occupying instructions [begin, end) on the
+// conditional jump at index branch, whose condition is computed by the
+// instructions at the indices in slice
+std::shared_ptr<InstructionSequence> LoopUnswitch::unswitch(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned end,
+                                                            unsigned branch, const std::vector<unsigned> &slice, const std::string &suffix) {
+  std::set<std::string> labels;
+  for (unsigned j = begin; j < end; ++j) {
+    if (iseq->has_label(j))
+      labels.insert(iseq->get_label_at_index(j));
+  }
+
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned j = 0; j < begin; ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  // compute the condition before the loop, in fresh vregs
+  int next_vreg = std::max(get_max_vreg(iseq), 9) + 1;
+  std::map<int, int> renamed;
+  for (auto j = slice.begin(); j != slice.end(); ++j) {
+    Instruction *ins = iseq->get_instruction(*j)->duplicate();
+    for (unsigned k = 1; k < ins->get_num_operands(); ++k) {
+      Operand operand = ins->get_operand(k);
+      if (operand.get_kind() == Operand::VREG && renamed.count(operand.get_base_reg()) > 0)
+        ins->set_operand(k, Operand(Operand::VREG, renamed[operand.get_base_reg()]));
+    }
+    renamed[ins->get_operand(0).get_base_reg()] = next_vreg;
+    ins->set_operand(0, Operand(Operand::VREG, next_vreg++));
+    result->append(ins);
+  }
+  int cond = iseq->get_instruction(branch)->get_operand(0).get_base_reg();
+  if (renamed.count(cond) > 0)
+    cond = renamed[cond];
+  Instruction *select = new Instruction(HINS_cjmp_f, Operand(Operand::VREG, cond),
+                                        Operand(Operand::LABEL, iseq->get_label_at_index(begin) + suffix));
+  select->set_comment("unswitched loop");
+  result->append(select);
+
+  // the copy for a true condition keeps the original labels
+  copy_loop(result, iseq, begin, end, branch, labels, true, "");
+  copy_loop(result, iseq, begin, end, branch, labels, false, suffix);
+
+  for (unsigned j = end; j < iseq->get_length(); ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  return result;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "builtins.h"
+#include "mod_ref_analysis.h"
+
+ModRefAnalysis::ModRefAnalysis(const std::vector<std::shared_ptr<Function> > &functions, const AliasAnalysis &alias_analysis)
+  : m_functions(functions)
+  , m_alias_analysis(alias_analysis) {
+  for (unsigned i = 0; i < m_functions.size(); i++)
+    m_function_by_name[m_functions[i]->get_name()] = i;
+}
+
+ModRefAnalysis::~ModRefAnalysis() {
+}
+
+void ModRefAnalysis::execute() {
+  m_summaries.assign(m_functions.size(), Summary());
+  for (unsigned i = 0; i < m_functions.size(); i++) {
+    m_summaries[i].unknown_effects = false;
+    find_direct_effects(i);
+  }
+
+  // add the effects of callees until nothing changes
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (unsigned i = 0; i < m_functions.size(); i++) {
+      std::shared_ptr<InstructionSequence> iseq = m_functions[i]->get_hl_iseq();
+      for (auto j = iseq->cbegin(); j != iseq->cend(); ++j) {
+        Instruction *ins = *j;
+        // a call to a builtin doesn't access memory
+        if (ins->get_opcode() != HINS_call || find_builtin(ins->get_operand(0).get_label()) != nullptr)
+          continue;
+
+        const Summary *callee = get_summary(ins->get_operand(0).get_label());
+        if (callee == nullptr) {
+          // a function outside the unit
+          if (!m_summaries[i].unknown_effects) {
+            m_summaries[i].unknown_effects = true;
+            changed = true;
+          }
+        } else if (add_callee_effects(i, *callee)) {
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+const ModRefAnalysis::Summary *ModRefAnalysis::get_summary(const std::string &fn_name) const {
+  auto i = m_function_by_name.find(fn_name);
+  return i == m_function_by_name.end() ? nullptr : &m_summaries[i->second];
+}
+
+bool ModRefAnalysis::may_mod(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem) const {
+  return may_access(fn, call, mem, true);
+}
+
+bool ModRefAnalysis::may_ref(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem) const {
+  return may_access(fn, call, mem, false);
+}
+
+// Find the memory read and written by the instructions of a function
+void ModRefAnalysis::find_direct_effects(unsigned fn_index) {
+  std::shared_ptr<Function> fn = m_functions[fn_index];
+  Summary &summary = m_summaries[fn_index];
+
+  std::shared_ptr<InstructionSequence> iseq = fn->get_hl_iseq();
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    // inline assembly may access any memory, and after an atomic
+    // access (or fence), other threads may have changed any memory
+    if (ins->get_opcode() == HINS_asm || HighLevel::is_atomic(ins))
+      summary.unknown_effects = true;
+    for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+      Operand op = ins->get_operand(j);
+      if (!op.is_memref())
+        continue;
+
+      int obj_class = m_alias_analysis.get_object_class(fn, op);
+      if (obj_class < 0)
+        summary.unknown_effects = true;
+      else if (m_alias_analysis.is_local_class(fn, obj_class))
+        continue;
+      else if (j == 0 && ins->get_opcode() != HINS_cjmp_t && ins->get_opcode() != HINS_cjmp_f)
+        summary.mod.insert(obj_class);
+      else {
+        summary.ref.insert(obj_class);
+        // an atomic exchange (or fetch and add, or compare and swap)
+        // also writes the object it reads
+        if (ins->get_opcode() >= HINS_atomic_xchg_b && ins->get_opcode() <= HINS_atomic_cmpxchg_q)
+          summary.mod.insert(obj_class);
+      }
+    }
+  }
+}
+
+bool ModRefAnalysis::add_callee_effects(unsigned fn_index, const Summary &callee) {
+  Summary &summary = m_summaries[fn_index];
+  unsigned size = summary.mod.size() + summary.ref.size();
+  bool unknown_effects = summary.unknown_effects;
+
+  // the callee's effects on the caller's own local variables don't
+  // make it into the caller's summary
+  std::shared_ptr<Function> fn = m_functions[fn_index];
+  for (int obj_class : callee.mod) {
+    if (!m_alias_analysis.is_local_class(fn, obj_class))
+      summary.mod.insert(obj_class);
+  }
+  for (int obj_class : callee.ref) {
+    if (!m_alias_analysis.is_local_class(fn, obj_class))
+      summary.ref.insert(obj_class);
+  }
+  summary.unknown_effects = summary.unknown_effects || callee.unknown_effects;
+
+  return summary.mod.size() + summary.ref.size() != size || summary.unknown_effects != unknown_effects;
+}
+
+bool ModRefAnalysis::may_access(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem, bool is_write) const {
+  assert(call->get_opcode() == HINS_call);
+
+  if (find_builtin(call->get_operand(0).get_label()) != nullptr)
+    return false;
+
+  int obj_class = m_alias_analysis.get_object_class(fn, mem);
+  if (obj_class < 0)
+    return true;
+
+  const Summary *callee = get_summary(call->get_operand(0).get_label());
+  if (callee == nullptr || callee->unknown_effects) {
+    if (m_alias_analysis.is_escaped_class(obj_class))
+      return true;
+    if (callee == nullptr)
+      return false;
+  }
+
+  const std::set<int> &effects = is_write ? callee->mod : callee->ref;
+  for (int effect_class : effects) {
+    if (m_alias_analysis.may_overlap(effect_class, obj_class))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,865 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include <map>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "cfg_builder.h"
+#include "loop_info.h"
+#include "local_storage_allocation.h"
+#include "modulo_scheduling.h"
+
+namespace {
+
+// Only loops whose body has at most this many high-level instructions
+// are pipelined
+const unsigned MAX_LOOP_SIZE = 32;
+
+// Maximum number of iterations in flight at the same time
+const int MAX_STAGES = 4;
+
+// Maximum number of values (including loop invariants) live at the same
+// time in the kernel: the registers LiveRangeSplit can keep vreg slots in
+const int MAX_LIVE = 12;
+
+// The scheduler gives up on an initiation interval after scheduling
+// this many instructions per instruction of the body
+const int BUDGET_FACTOR = 4;
+
+// Functional units of the modeled x86-64 core, and how many of each
+// kind there are
+enum FunctionalUnit {
+  UNIT_ALU,
+  UNIT_LOAD,
+  UNIT_STORE,
+  UNIT_MUL,
+  UNIT_DIV,
+  NUM_UNITS,
+};
+const int UNIT_COUNT[NUM_UNITS] = { 4, 2, 1, 1, 1 };
+
+// Latencies (in cycles) of the modeled core. The divider isn't
+// pipelined: it is busy for DIV_OCCUPANCY cycles.
+const int ALU_LATENCY = 1;
+const int LOAD_LATENCY = 4;
+const int STORE_LATENCY = 1;
+const int MUL_LATENCY = 3;
+const int DIV_LATENCY = 26;
+const int DIV_OCCUPANCY = 6;
+
+// Determine the latency of a high-level instruction, and the functional
+// units it uses. Returns false if the instruction can't be scheduled.
+bool get_machine_model(Instruction *ins, int &latency, std::vector<std::pair<int, int> > &reservations) {
+  HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+  bool loads = false, stores = false;
+  for (unsigned i = 0; i < ins->get_num_operands(); ++i) {
+    if (!ins->get_operand(i).is_memref())
+      continue;
+    if (i == 0)
+      stores = true;
+    else
+      loads = true;
+  }
+
+  latency = loads ? LOAD_LATENCY : 0;
+  if (loads)
+    reservations.push_back({ 0, UNIT_LOAD });
+  if (stores)
+    reservations.push_back({ 0, UNIT_STORE });
+
+  if (opcode >= HINS_mov_b && opcode <= HINS_mov_q) {
+    // a load or store is all the work a move to or from memory does
+    if (!loads && !stores) {
+      latency = ALU_LATENCY;
+      reservations.push_back({ 0, UNIT_ALU });
+    } else if (!loads) {
+      latency = STORE_LATENCY;
+    }
+  } else if ((opcode >= HINS_mul_b && opcode <= HINS_mul_q)
+             || (opcode >= HINS_popcount_b && opcode <= HINS_ctz_q)) {
+    // the bit counts are executed by the multiplier's port
+    latency += MUL_LATENCY;
+    reservations.push_back({ 0, UNIT_MUL });
+  } else if (opcode >= HINS_div_b && opcode <= HINS_mod_q) {
+    latency += DIV_LATENCY;
+    for (int i = 0; i < DIV_OCCUPANCY; ++i)
+      reservations.push_back({ i, UNIT_DIV });
+  } else if ((opcode >= HINS_add_b && opcode <= HINS_sub_q)
+             || (opcode >= HINS_cmplt_b && opcode <= HINS_cmpneq_q)
+             || (opcode >= HINS_neg_b && opcode <= HINS_not_q)
+             || (opcode >= HINS_bswap_b && opcode <= HINS_bswap_q)
+             || (opcode >= HINS_sconv_bw && opcode <= HINS_uconv_lq)
+             || opcode == HINS_localaddr) {
+    latency += ALU_LATENCY;
+    reservations.push_back({ 0, UNIT_ALU });
+  } else if (opcode == HINS_prefetch) {
+    reservations.push_back({ 0, UNIT_LOAD });
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// A value of the form base + coef * iv + offset, where base is a vreg
+// which doesn't change in the loop (FRAME_BASE for the address of the
+// stack frame, or -1), and iv is the value an induction variable has at
+// the start of the iteration (or -1)
+const int FRAME_BASE = LiveVregsAnalysis::MAX_VREGS;
+
+struct Affine {
+  bool known;
+  int base;
+  int iv;
+  long coef;
+  long offset;
+};
+
+Affine unknown_value() {
+  return { false, -1, -1, 0, 0 };
+}
+
+Affine constant_value(long value) {
+  return { true, -1, -1, 0, value };
+}
+
+// a + sign * b
+Affine add_values(const Affine &a, const Affine &b, long sign) {
+  if (!a.known || !b.known || (a.base >= 0 && b.base >= 0) || (b.base >= 0 && sign < 0))
+    return unknown_value();
+  if (a.iv >= 0 && b.iv >= 0 && a.iv != b.iv)
+    return unknown_value();
+  long coef = a.coef + sign * b.coef;
+  int iv = coef == 0 ? -1 : std::max(a.iv, b.iv);
+  return { true, std::max(a.base, b.base), iv, coef, a.offset + sign * b.offset };
+}
+
+Affine scale_value(const Affine &a, long factor) {
+  if (!a.known || (a.base >= 0 && factor != 1))
+    return unknown_value();
+  long coef = a.coef * factor;
+  return { true, a.base, coef == 0 ? -1 : a.iv, coef, a.offset * factor };
+}
+
+bool is_constant(const Affine &a) {
+  return a.known && a.base < 0 && a.iv < 0;
+}
+
+// Do accesses of first_size bytes at address a and second_size bytes at
+// address a + diff overlap?
+bool overlaps(long diff, int first_size, int second_size) {
+  return diff < first_size && -diff < second_size;
+}
+
+int get_max_vreg(std::shared_ptr<InstructionSequence> iseq) {
+  int max_vreg = -1;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      Operand operand = ins->get_operand(j);
+      if (operand.has_base_reg())
+        max_vreg = std::max(max_vreg, operand.get_base_reg());
+      if (operand.has_index_reg())
+        max_vreg = std::max(max_vreg, operand.get_index_reg());
+    }
+  }
+  return max_vreg;
+}
+
+// Make the jumps of an instruction to one label go to another label
+void retarget(Instruction *ins, const std::string &from, const std::string &to) {
+  for (unsigned i = 0; i < ins->get_num_operands(); ++i) {
+    if (ins->get_operand(i).get_kind() == Operand::LABEL && ins->get_operand(i).get_label() == from)
+      ins->set_operand(i, Operand(Operand::LABEL, to));
+  }
+}
+
+// A memory access by an instruction of the loop body
+struct Access {
+  unsigned op;
+  Operand mem;
+  int size;
+  bool store;
+  Affine address;
+};
+
+}
+
+ModuloScheduling::ModuloScheduling(std::shared_ptr<ControlFlowGraph> cfg, std::shared_ptr<Function> function, const AliasAnalysis &alias_analysis)
+  : m_cfg(cfg)
+  , m_function(function)
+  , m_alias_analysis(alias_analysis)
+  , m_num_loops(0) {
+}
+
+ModuloScheduling::~ModuloScheduling() {
+}
+
+std::shared_ptr<ControlFlowGraph> ModuloScheduling::transform_cfg() {
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+
+  // each loop (including the kernels and the original loops that
+  // pipelining leaves behind) is only considered once
+  bool changed = false;
+  while (std::shared_ptr<InstructionSequence> result = pipeline_one(iseq)) {
+    iseq = result;
+    changed = true;
+  }
+
+  if (!changed)
+    return m_cfg;
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  return cfg_builder.build();
+}
+
+// Find a loop which can be pipelined, and pipeline it.
+// Returns the transformed code, or nullptr if no loop can be pipelined.
+std::shared_ptr<InstructionSequence> ModuloScheduling::pipeline_one(std::shared_ptr<InstructionSequence> iseq) {
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  LoopInfo loop_info(cfg);
+  loop_info.execute();
+  LiveVregs live_vregs(cfg);
+  live_vregs.execute();
+
+  const std::vector<LoopInfo::Loop> &loops = loop_info.get_loops();
+  for (auto i = loops.begin(); i != loops.end(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = i->header;
+    std::string label = bb->get_block_label();
+    if (i->blocks.size() != 1 || label.empty() || m_visited.count(label) > 0)
+      continue;
+    m_visited.insert(label);
+
+    // the body must end with a conditional branch back to its start,
+    // and fall through out of the loop
+    unsigned begin = unsigned(bb->get_code_order()), end = begin + bb->get_length();
+    if (bb->get_kind() != BASICBLOCK_INTERIOR || begin == 0 || end >= iseq->get_length()
+        || bb->get_length() > MAX_LOOP_SIZE + 1)
+      continue;
+    Instruction *branch = iseq->get_instruction(end - 1);
+    if ((branch->get_opcode() != HINS_cjmp_t && branch->get_opcode() != HINS_cjmp_f)
+        || branch->get_operand(1).get_label() != label)
+      continue;
+
+    Loop loop;
+    bool ok = true;
+    for (unsigned j = begin; j < end - 1 && ok; ++j) {
+      Instruction *ins = iseq->get_instruction(j);
+      if (ins->get_opcode() == HINS_nop)
+        continue;
+      Op op;
+      op.ins = ins;
+      op.def_vreg = HighLevel::is_def(ins) ? HighLevel::get_def_vreg(ins) : -1;
+      op.carried = false;
+      ok = get_machine_model(ins, op.latency, op.reservations)
+           && (op.def_vreg < 0 || op.def_vreg >= LocalStorageAllocation::VREG_FIRST_LOCAL);
+      loop.ops.push_back(op);
+    }
+    if (!ok || loop.ops.empty() || !analyze(loop, branch))
+      continue;
+
+    // lower bound on the initiation interval from the functional units,
+    // and the length of a single iteration (pipelining is pointless
+    // unless iterations start more often than that)
+    std::vector<int> demand(NUM_UNITS, 0);
+    std::vector<int> earliest(loop.ops.size(), 0);
+    int length = 0;
+    for (unsigned j = 0; j < loop.ops.size(); ++j) {
+      const Op &op = loop.ops[j];
+      for (auto k = op.reservations.begin(); k != op.reservations.end(); ++k)
+        ++demand[k->second];
+      for (auto k = loop.deps.begin(); k != loop.deps.end(); ++k) {
+        if (k->to == j && k->distance == 0)
+          earliest[j] = std::max(earliest[j], earliest[k->from] + k->latency);
+      }
+      length = std::max(length, earliest[j] + op.latency);
+    }
+    int min_ii = 1;
+    for (int j = 0; j < NUM_UNITS; ++j)
+      min_ii = std::max(min_ii, (demand[j] + UNIT_COUNT[j] - 1) / UNIT_COUNT[j]);
+
+    // a larger initiation interval needs fewer stages and registers
+    bool found = false;
+    for (int ii = min_ii; ii < length && !found; ++ii) {
+      if (!schedule(loop, ii))
+        continue;
+      if (loop.num_stages < 2)
+        break;
+      found = loop.num_stages <= MAX_STAGES && get_max_live(loop) <= MAX_LIVE;
+    }
+    if (!found)
+      continue;
+
+    // the vregs live after the loop get their values from the pipelined
+    // loop when it exits
+    std::shared_ptr<InstructionSequence> exit_bb;
+    const ControlFlowGraph::EdgeList &outgoing_edges = cfg->get_outgoing_edges(bb);
+    for (auto j = outgoing_edges.begin(); j != outgoing_edges.end(); ++j) {
+      if ((*j)->get_kind() == EDGE_FALLTHROUGH)
+        exit_bb = (*j)->get_target();
+    }
+    if (!exit_bb)
+      continue;
+
+    std::shared_ptr<InstructionSequence> result = pipeline(iseq, begin, end, loop, live_vregs.get_fact_at_beginning_of_block(exit_bb));
+    if (result)
+      return result;
+  }
+
+  return nullptr;
+}
+
+// Find the dependences between the instructions of the loop body, and
+// check that the loop is counted by an induction variable.
+// Returns false if the loop can't be pipelined.
+bool ModuloScheduling::analyze(Loop &loop, Instruction *branch) {
+  unsigned n = loop.ops.size();
+
+  // the value each op assigns, in terms of the values of the
+  // induction variables at the start of the iteration
+  std::vector<Affine> values(n, unknown_value());
+  std::set<int> ivs;
+  for (unsigned i = 0; i < n; ++i) {
+    if (loop.ops[i].def_vreg >= 0)
+      ivs.insert(loop.ops[i].def_vreg);
+  }
+
+  auto vreg_value = [&](unsigned index, int vreg) {
+    int distance;
+    int def = get_reaching_def(loop, index, vreg, distance);
+    if (def < 0)
+      return Affine{ true, vreg, -1, 0, 0 };
+    if (distance == 0)
+      return values[def];
+    return ivs.count(vreg) > 0 ? Affine{ true, -1, vreg, 1, 0 } : unknown_value();
+  };
+  auto operand_value = [&](unsigned index, const Operand &operand) {
+    if (operand.is_imm_ival())
+      return constant_value(operand.get_imm_ival());
+    if (operand.get_kind() == Operand::VREG)
+      return vreg_value(index, operand.get_base_reg());
+    return unknown_value();
+  };
+
+  // the induction variables are the vregs whose value at the end of the
+  // iteration is their value at the start plus a (nonzero) constant
+  std::map<int, long> steps;
+  while (true) {
+    for (unsigned i = 0; i < n; ++i) {
+      Instruction *ins = loop.ops[i].ins;
+      HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+      Affine value = unknown_value();
+      if (loop.ops[i].def_vreg >= 0 && ins->get_num_operands() > 1) {
+        Affine a = operand_value(i, ins->get_operand(1));
+        Affine b = ins->get_num_operands() > 2 ? operand_value(i, ins->get_operand(2)) : unknown_value();
+        if (opcode == HINS_mov_l || opcode == HINS_mov_q || opcode == HINS_sconv_lq)
+          value = a;
+        else if (opcode == HINS_add_l || opcode == HINS_add_q)
+          value = add_values(a, b, 1);
+        else if (opcode == HINS_sub_l || opcode == HINS_sub_q)
+          value = add_values(a, b, -1);
+        else if ((opcode == HINS_mul_l || opcode == HINS_mul_q) && is_constant(b))
+          value = scale_value(a, b.offset);
+        else if ((opcode == HINS_mul_l || opcode == HINS_mul_q) && is_constant(a))
+          value = scale_value(b, a.offset);
+        else if (opcode == HINS_localaddr)
+          value = Affine{ true, FRAME_BASE, -1, 0, a.offset };
+      }
+      values[i] = value;
+    }
+
+    std::set<int> remaining;
+    steps.clear();
+    for (auto i = ivs.begin(); i != ivs.end(); ++i) {
+      int distance;
+      const Affine &value = values[get_reaching_def(loop, n, *i, distance)];
+      if (value.known && value.base < 0 && value.iv == *i && value.coef == 1 && value.offset != 0) {
+        remaining.insert(*i);
+        steps[*i] = value.offset;
+      }
+    }
+    if (remaining == ivs)
+      break;
+    ivs = remaining;
+  }
+
+  // dependences through vregs
+  std::set<int> invariants;
+  for (unsigned i = 0; i < n; ++i) {
+    Instruction *ins = loop.ops[i].ins;
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      if (!HighLevel::is_use(ins, j))
+        continue;
+      int vreg = ins->get_operand(j).get_base_reg();
+      int distance;
+      int def = get_reaching_def(loop, i, vreg, distance);
+      if (def < 0) {
+        invariants.insert(vreg);
+        continue;
+      }
+      loop.deps.push_back({ unsigned(def), i, loop.ops[def].latency, distance, true });
+      if (distance > 0)
+        loop.ops[def].carried = true;
+    }
+  }
+  loop.num_invariants = int(invariants.size());
+
+  // The loop continues while a signed comparison of an induction
+  // variable (plus a constant) with a loop invariant holds
+  int distance;
+  int compare = get_reaching_def(loop, n, branch->get_operand(0).get_base_reg(), distance);
+  if (compare < 0)
+    return false;
+  Instruction *cmp = loop.ops[compare].ins;
+  int kind = cmp->get_opcode() - HINS_cmplt_b;
+  if (kind < 0 || cmp->get_opcode() > HINS_cmpgte_q || kind % 4 < 2)
+    return false;
+  loop.compare = unsigned(compare);
+  loop.compare_size = kind % 4 == 2 ? 4 : 8;
+
+  // relations: <, <=, >, >=
+  static const int SWAPPED[] = { 2, 3, 0, 1 };
+  static const int INVERSE[] = { 3, 2, 1, 0 };
+  int relation = kind / 4;
+  // the limit is a constant (possibly loaded into a vreg in the loop),
+  // or a vreg the loop doesn't assign
+  auto get_limit = [&](const Operand &operand, Operand &limit) {
+    Affine value = operand_value(compare, operand);
+    if (is_constant(value))
+      limit = Operand(Operand::IMM_IVAL, value.offset);
+    else if (value.known && value.base >= 0 && value.base != FRAME_BASE && value.iv < 0 && value.offset == 0)
+      limit = Operand(Operand::VREG, value.base);
+    else
+      return false;
+    return true;
+  };
+  Affine counter;
+  if (get_limit(cmp->get_operand(2), loop.limit)) {
+    counter = operand_value(compare, cmp->get_operand(1));
+  } else if (get_limit(cmp->get_operand(1), loop.limit)) {
+    counter = operand_value(compare, cmp->get_operand(2));
+    relation = SWAPPED[relation];
+  } else {
+    return false;
+  }
+  if (branch->get_opcode() == HINS_cjmp_f)
+    relation = INVERSE[relation];
+  if (!counter.known || counter.base >= 0 || counter.iv < 0 || counter.coef != 1)
+    return false;
+
+  // once the comparison fails, it must fail in every later iteration
+  // (and the offset can't make the counter wrap around when the
+  // induction variable doesn't)
+  loop.iv_vreg = counter.iv;
+  loop.iv_step = steps[counter.iv];
+  loop.iv_offset = counter.offset;
+  if ((relation <= 1) != (loop.iv_step > 0) || loop.iv_offset * loop.iv_step < 0)
+    return false;
+  loop.guard_opcode = HINS_cmplt_b + 4 * relation + kind % 4;
+
+  // dependences through memory
+  std::vector<Access> accesses;
+  for (unsigned i = 0; i < n; ++i) {
+    Instruction *ins = loop.ops[i].ins;
+    HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      Operand operand = ins->get_operand(j);
+      if (!operand.is_memref())
+        continue;
+      Access access;
+      access.op = i;
+      access.mem = operand;
+      access.store = j == 0;
+      access.size = access.store ? highlevel_opcode_get_dest_operand_size(opcode)
+                                 : highlevel_opcode_get_source_operand_size(opcode);
+      long offset = operand.get_kind() == Operand::VREG_MEM_OFF ? operand.get_offset() : 0;
+      access.address = add_values(vreg_value(i, operand.get_base_reg()), constant_value(offset), 1);
+      accesses.push_back(access);
+    }
+  }
+
+  for (unsigned i = 0; i < accesses.size(); ++i) {
+    for (unsigned j = i + 1; j < accesses.size(); ++j) {
+      const Access &a = accesses[i], &b = accesses[j];
+      if (a.op == b.op || (!a.store && !b.store))
+        continue;
+
+      // accesses to distinct objects are independent
+      int a_class = m_alias_analysis.get_object_class(m_function, a.mem);
+      int b_class = m_alias_analysis.get_object_class(m_function, b.mem);
+      if (a_class >= 0 && b_class >= 0 && !m_alias_analysis.may_overlap(a_class, b_class))
+        continue;
+
+      const Affine &a_addr = a.address, &b_addr = b.address;
+      if (a_addr.known && b_addr.known && a_addr.base == b_addr.base && a_addr.iv == b_addr.iv && a_addr.coef == b_addr.coef) {
+        // the addresses differ by a known amount in every pair of
+        // iterations (only iterations which can be in flight together
+        // need to be checked)
+        long stride = a_addr.iv < 0 ? 0 : a_addr.coef * steps[a_addr.iv];
+        long diff = b_addr.offset - a_addr.offset;
+        for (int distance = 0; distance < MAX_STAGES; ++distance) {
+          if (overlaps(diff + distance * stride, a.size, b.size))
+            loop.deps.push_back({ a.op, b.op, STORE_LATENCY, distance, false });
+          if (distance > 0 && overlaps(-diff + distance * stride, b.size, a.size))
+            loop.deps.push_back({ b.op, a.op, STORE_LATENCY, distance, false });
+        }
+      } else {
+        // keep the order of the accesses within and across iterations
+        loop.deps.push_back({ a.op, b.op, STORE_LATENCY, 0, false });
+        loop.deps.push_back({ b.op, a.op, STORE_LATENCY, 1, false });
+      }
+    }
+  }
+
+  return true;
+}
+
+// Schedule the loop body with initiation interval ii, using iterative
+// modulo scheduling. Returns false if no schedule was found.
+bool ModuloScheduling::schedule(Loop &loop, int ii) {
+  unsigned n = loop.ops.size();
+
+  // Priority: the height of each instruction, i.e., the number of cycles
+  // from its issue until the instructions depending on it (in this and
+  // later iterations) are done. If a recurrence takes more than ii cycles
+  // per iteration, the heights grow without bound.
+  std::vector<int> height(n);
+  for (unsigned i = 0; i < n; ++i)
+    height[i] = loop.ops[i].latency;
+  for (unsigned round = 0; ; ++round) {
+    bool changed = false;
+    for (auto i = loop.deps.begin(); i != loop.deps.end(); ++i) {
+      int h = height[i->to] + i->latency - ii * i->distance;
+      if (h > height[i->from]) {
+        height[i->from] = h;
+        changed = true;
+      }
+    }
+    if (!changed)
+      break;
+    if (round == n)
+      return false;
+  }
+
+  // modulo reservation table: the functional units in use in each
+  // cycle of the kernel
+  std::vector<std::vector<int> > usage(ii, std::vector<int>(NUM_UNITS, 0));
+  std::vector<int> &time = loop.time;
+  time.assign(n, -1);
+  std::vector<int> prev_time(n, -1);
+  unsigned num_scheduled = 0;
+
+  auto reserve = [&](unsigned op, int t, int amount) {
+    const std::vector<std::pair<int, int> > &reservations = loop.ops[op].reservations;
+    for (auto i = reservations.begin(); i != reservations.end(); ++i)
+      usage[(t + i->first) % ii][i->second] += amount;
+  };
+  auto overloaded = [&](unsigned op, int t) {
+    const std::vector<std::pair<int, int> > &reservations = loop.ops[op].reservations;
+    for (auto i = reservations.begin(); i != reservations.end(); ++i) {
+      if (usage[(t + i->first) % ii][i->second] > UNIT_COUNT[i->second])
+        return true;
+    }
+    return false;
+  };
+  auto unschedule = [&](unsigned op) {
+    reserve(op, time[op], -1);
+    time[op] = -1;
+    --num_scheduled;
+  };
+
+  int budget = BUDGET_FACTOR * int(n);
+  while (num_scheduled < n) {
+    if (budget-- == 0)
+      return false;
+
+    unsigned op = n;
+    for (unsigned i = 0; i < n; ++i) {
+      if (time[i] < 0 && (op == n || height[i] > height[op]))
+        op = i;
+    }
+
+    // earliest time allowed by the scheduled instructions it depends on
+    int estart = 0;
+    for (auto i = loop.deps.begin(); i != loop.deps.end(); ++i) {
+      if (i->to == op && i->from != op && time[i->from] >= 0)
+        estart = std::max(estart, time[i->from] + i->latency - ii * i->distance);
+    }
+
+    // the first time the units it needs are free; if there is none,
+    // it displaces the instructions using them
+    int slot = -1;
+    for (int t = estart; t < estart + ii && slot < 0; ++t) {
+      reserve(op, t, 1);
+      if (!overloaded(op, t))
+        slot = t;
+      reserve(op, t, -1);
+    }
+    if (slot < 0)
+      slot = (prev_time[op] < 0 || estart > prev_time[op]) ? estart : prev_time[op] + 1;
+    reserve(op, slot, 1);
+    while (overloaded(op, slot)) {
+      unsigned victim = n;
+      for (unsigned i = 0; i < n && victim == n; ++i) {
+        if (i != op && time[i] >= 0 && overloaded(i, time[i]))
+          victim = i;
+      }
+      if (victim == n) {
+        // the instruction needs more units than there are by itself
+        return false;
+      }
+      unschedule(victim);
+    }
+    time[op] = prev_time[op] = slot;
+    ++num_scheduled;
+
+    // instructions depending on it which are now too early are displaced
+    for (auto i = loop.deps.begin(); i != loop.deps.end(); ++i) {
+      if (i->from == op && i->to != op && time[i->to] >= 0 && time[i->to] < slot + i->latency - ii * i->distance)
+        unschedule(i->to);
+    }
+  }
+
+  // the comparison must be in the first stage, so the branch at the end
+  // of the kernel decides whether the next iteration starts
+  if (time[loop.compare] >= ii)
+    return false;
+
+  loop.ii = ii;
+  loop.num_stages = *std::max_element(time.begin(), time.end()) / ii + 1;
+  return true;
+}
+
+// Generate the pipelined loop for the loop occupying instructions
+// [begin, end), whose schedule is known. The original loop is kept for
+// when the loop doesn't iterate often enough.
+// Returns nullptr if there aren't enough vregs.
+std::shared_ptr<InstructionSequence> ModuloScheduling::pipeline(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned end,
+                                                                Loop &loop, const LiveVregs::FactType &live_out) {
+  unsigned n = loop.ops.size();
+
+  // each value needs a vreg for its own stage, and one for each later
+  // stage it is still used in
+  std::vector<unsigned> num_names(n, 0);
+  for (unsigned i = 0; i < n; ++i) {
+    if (loop.ops[i].def_vreg >= 0)
+      num_names[i] = 1;
+  }
+  for (auto i = loop.deps.begin(); i != loop.deps.end(); ++i) {
+    if (i->value) {
+      int stages = i->distance + loop.time[i->to] / loop.ii - loop.time[i->from] / loop.ii;
+      num_names[i->from] = std::max(num_names[i->from], unsigned(stages + 1));
+    }
+  }
+
+  int next_vreg = std::max(get_max_vreg(iseq), LocalStorageAllocation::VREG_FIRST_LOCAL - 1) + 1;
+  int num_vregs = 3;
+  for (unsigned i = 0; i < n; ++i)
+    num_vregs += int(num_names[i]);
+  if (next_vreg + num_vregs > int(LiveVregsAnalysis::MAX_VREGS))
+    return nullptr;
+  loop.names.assign(n, std::vector<int>());
+  for (unsigned i = 0; i < n; ++i) {
+    for (unsigned j = 0; j < num_names[i]; ++j)
+      loop.names[i].push_back(next_vreg++);
+  }
+
+  std::string label = iseq->get_label_at_index(begin);
+  std::string kernel_label = label + ".ms" + std::to_string(++m_num_loops);
+  std::string exit_label = iseq->has_label(end) ? iseq->get_label_at_index(end) : kernel_label + ".exit";
+  m_visited.insert(kernel_label);
+
+  // jumps into the loop from elsewhere (other than its own branch) now
+  // go to the guard
+  std::string entry_label = kernel_label + ".entry";
+  bool has_entry_jumps = false;
+  for (unsigned i = 0; i < iseq->get_length(); ++i) {
+    Instruction *ins = iseq->get_instruction(i);
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      if (i != end - 1 && ins->get_operand(j).get_kind() == Operand::LABEL && ins->get_operand(j).get_label() == label)
+        has_entry_jumps = true;
+    }
+  }
+
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned i = 0; i < begin; ++i) {
+    if (iseq->has_label(i))
+      result->define_label(iseq->get_label_at_index(i));
+    Instruction *ins = iseq->get_instruction(i)->duplicate();
+    retarget(ins, label, entry_label);
+    result->append(ins);
+  }
+  if (has_entry_jumps)
+    result->define_label(entry_label);
+
+  // The guard runs the original loop unless there are at least as many
+  // iterations as stages, i.e., unless the comparison in iteration
+  // num_stages - 2 finds that the loop continues. If computing the value
+  // compared would overflow, the loop doesn't get that far.
+  Operand counter(Operand::VREG, next_vreg++);
+  Operand overflow(Operand::VREG, next_vreg++);
+  Operand cond(Operand::VREG, next_vreg++);
+  Operand iv(Operand::VREG, loop.iv_vreg);
+  bool wide = loop.compare_size == 8;
+  long offset = loop.iv_offset + loop.iv_step * (loop.num_stages - 2);
+  result->append(new Instruction(wide ? HINS_add_q : HINS_add_l, counter, iv, Operand(Operand::IMM_IVAL, offset)));
+  if (offset != 0) {
+    HighLevelOpcode check = offset > 0 ? (wide ? HINS_cmplt_q : HINS_cmplt_l) : (wide ? HINS_cmpgt_q : HINS_cmpgt_l);
+    result->append(new Instruction(check, overflow, counter, iv));
+    result->append(new Instruction(HINS_cjmp_t, overflow, Operand(Operand::LABEL, label)));
+  }
+  result->append(new Instruction(loop.guard_opcode, cond, counter, loop.limit));
+  Instruction *guard = new Instruction(HINS_cjmp_f, cond, Operand(Operand::LABEL, label));
+  guard->set_comment("too few iterations to pipeline");
+  result->append(guard);
+
+  // prologue: the values the first iteration uses from before the loop,
+  // and the first stages of the first iterations
+  for (int stage = -1; stage < loop.num_stages - 1; ++stage)
+    emit_stages(result, loop, 0, stage, stage + 1);
+
+  // kernel: one stage of each iteration in flight
+  result->define_label(kernel_label);
+  emit_stages(result, loop, 0, loop.num_stages - 1, -1);
+  Instruction *orig_branch = iseq->get_instruction(end - 1);
+  Instruction *branch = new Instruction(orig_branch->get_opcode(), Operand(Operand::VREG, loop.names[loop.compare][0]),
+                                        Operand(Operand::LABEL, kernel_label));
+  branch->set_comment(orig_branch->get_comment());
+  branch->set_loc(orig_branch->get_loc());
+  branch->set_branch_hint(orig_branch->get_branch_hint());
+  result->append(branch);
+
+  // epilogue: the remaining stages of the last iterations
+  for (int stage = 1; stage < loop.num_stages; ++stage)
+    emit_stages(result, loop, stage, loop.num_stages - 1, -1);
+
+  // the vregs used after the loop get the values of the last iteration
+  for (unsigned i = 0; i < n; ++i) {
+    int vreg = loop.ops[i].def_vreg, distance;
+    if (vreg >= 0 && live_out.test(vreg) && get_reaching_def(loop, n, vreg, distance) == int(i))
+      result->append(new Instruction(HINS_mov_q, Operand(Operand::VREG, vreg), Operand(Operand::VREG, loop.names[i][0])));
+  }
+  result->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, exit_label)));
+
+  // the original loop, and the rest of the code
+  for (unsigned i = begin; i < iseq->get_length(); ++i) {
+    if (iseq->has_label(i))
+      result->define_label(iseq->get_label_at_index(i));
+    else if (i == end)
+      result->define_label(exit_label);
+    Instruction *ins = iseq->get_instruction(i)->duplicate();
+    if (i != end - 1)
+      retarget(ins, label, entry_label);
+    result->append(ins);
+  }
+
+  return result;
+}
+
+// Append the instructions of stages [first_stage, last_stage] of the
+// iterations in flight, in the order of their issue times in the kernel.
+// Instead of the instructions in init_stage, which belong to the
+// iteration before the first one, the values they carry to the first
+// iteration are copied from before the loop. Then, the values used in
+// later stages move along to the vregs for the next stage.
+void ModuloScheduling::emit_stages(std::shared_ptr<InstructionSequence> result, const Loop &loop,
+                                   int first_stage, int last_stage, int init_stage) {
+  std::vector<unsigned> order;
+  for (unsigned i = 0; i < loop.ops.size(); ++i)
+    order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&loop](unsigned a, unsigned b) {
+    return loop.time[a] % loop.ii < loop.time[b] % loop.ii;
+  });
+
+  for (auto i = order.begin(); i != order.end(); ++i) {
+    const Op &op = loop.ops[*i];
+    int stage = loop.time[*i] / loop.ii;
+    if (stage >= first_stage && stage <= last_stage)
+      result->append(rename(loop, *i));
+    else if (stage == init_stage && op.carried)
+      result->append(new Instruction(HINS_mov_q, Operand(Operand::VREG, loop.names[*i][0]), Operand(Operand::VREG, op.def_vreg)));
+  }
+
+  for (auto i = loop.names.begin(); i != loop.names.end(); ++i) {
+    for (unsigned j = i->size(); j > 1; --j)
+      result->append(new Instruction(HINS_mov_q, Operand(Operand::VREG, (*i)[j - 1]), Operand(Operand::VREG, (*i)[j - 2])));
+  }
+}
+
+// Copy an instruction of the loop body, using the vregs holding the
+// values of the iterations it refers to
+Instruction *ModuloScheduling::rename(const Loop &loop, unsigned index) const {
+  const Op &op = loop.ops[index];
+  Instruction *ins = op.ins->duplicate();
+  int stage = loop.time[index] / loop.ii;
+  for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+    Operand operand = ins->get_operand(j);
+    if (j == 0 && op.def_vreg >= 0) {
+      operand.set_base_reg(loop.names[index][0]);
+    } else if (HighLevel::is_use(op.ins, j)) {
+      int distance;
+      int def = get_reaching_def(loop, index, operand.get_base_reg(), distance);
+      if (def >= 0)
+        operand.set_base_reg(loop.names[def][distance + stage - loop.time[def] / loop.ii]);
+    }
+    ins->set_operand(j, operand);
+  }
+  return ins;
+}
+
+// Find the op assigning the value of a vreg used by the op at index
+// (loop.ops.size() for the branch), and whether it is assigned in the
+// same iteration (distance 0) or in the previous one (distance 1).
+// Returns -1 if the vreg isn't assigned in the loop.
+int ModuloScheduling::get_reaching_def(const Loop &loop, unsigned index, int vreg, int &distance) {
+  distance = 0;
+  for (unsigned i = index; i > 0; --i) {
+    if (loop.ops[i - 1].def_vreg == vreg)
+      return int(i - 1);
+  }
+  distance = 1;
+  for (unsigned i = unsigned(loop.ops.size()); i > index; --i) {
+    if (loop.ops[i - 1].def_vreg == vreg)
+      return int(i - 1);
+  }
+  distance = 0;
+  return -1;
+}
+
+// Number of registers needed to hold the values live at the same time
+// in the kernel (including the loop invariants)
+int ModuloScheduling::get_max_live(const Loop &loop) {
+  std::vector<int> live(loop.ii, 0);
+  for (unsigned i = 0; i < loop.ops.size(); ++i) {
+    if (loop.ops[i].def_vreg < 0)
+      continue;
+    int start = loop.time[i], end = start + 1;
+    if (i == loop.compare)
+      end = std::max(end, loop.ii);
+    for (auto j = loop.deps.begin(); j != loop.deps.end(); ++j) {
+      if (j->value && j->from == i)
+        end = std::max(end, loop.time[j->to] + j->distance * loop.ii);
+    }
+    for (int t = start; t < end; ++t)
+      ++live[t % loop.ii];
+  }
+  return *std::max_element(live.begin(), live.end()) + loop.num_invariants;
+}
@@ -0,0 +1,330 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "cfg_builder.h"
+#include "software_prefetch.h"
+
+namespace {
+
+// Estimated cycles taken by a high-level instruction (which becomes a
+// few low-level instructions moving values through the stack frame),
+// and by a call
+const double INSTRUCTION_CYCLES = 2.0;
+const double CALL_CYCLES = 20.0;
+
+// Prefetches are issued at most this many iterations ahead
+const int MAX_DISTANCE = 32;
+
+// Accesses less than this many bytes apart share a prefetch (and a
+// prefetch is issued at least this many bytes ahead)
+const long CACHE_LINE_SIZE = 64;
+
+// prefetcht0: fetch into all levels of the cache
+const long LOCALITY_T0 = 3;
+
+int get_max_vreg(std::shared_ptr<InstructionSequence> iseq) {
+  int max_vreg = -1;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) {
+    Instruction *ins = *i;
+    for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+      Operand operand = ins->get_operand(j);
+      if (operand.has_base_reg())
+        max_vreg = std::max(max_vreg, operand.get_base_reg());
+      if (operand.has_index_reg())
+        max_vreg = std::max(max_vreg, operand.get_index_reg());
+    }
+  }
+  return max_vreg;
+}
+
+}
+
+SoftwarePrefetch::SoftwarePrefetch(std::shared_ptr<ControlFlowGraph> cfg, const FunctionAttrInference &function_attrs, int latency)
+  : m_cfg(cfg)
+  , m_function_attrs(function_attrs)
+  , m_latency(latency) {
+}
+
+SoftwarePrefetch::~SoftwarePrefetch() {
+}
+
+std::shared_ptr<ControlFlowGraph> SoftwarePrefetch::transform_cfg() {
+  if (m_latency <= 0)
+    return m_cfg;
+
+  // the code order of a block is the index of its first instruction
+  // in iseq
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  BlockFrequency block_frequency(cfg, true, &m_function_attrs);
+  block_frequency.execute();
+  const LoopInfo &loop_info = block_frequency.get_loop_info();
+
+  // code to insert before the instruction at each index
+  std::map<unsigned, std::vector<Prefetch> > prefetches;
+  int next_vreg = get_max_vreg(iseq) + 1;
+  int num_labels = 0;
+
+  const std::vector<LoopInfo::Loop> &loops = loop_info.get_loops();
+  for (auto i = loops.begin(); i != loops.end(); ++i) {
+    if (!i->innermost)
+      continue;
+    std::vector<Access> accesses;
+    find_accesses(cfg, loop_info, *i, accesses);
+    if (accesses.empty())
+      continue;
+    int distance = get_distance(cfg, block_frequency, *i);
+
+    // the first access to a cache line (in code order) gets the prefetch
+    std::sort(accesses.begin(), accesses.end(),
+              [](const Access &a, const Access &b) { return a.index < b.index; });
+    std::vector<Access> prefetched;
+    for (auto j = accesses.begin(); j != accesses.end(); ++j) {
+      bool covered = false;
+      for (auto k = prefetched.begin(); k != prefetched.end() && !covered; ++k) {
+        covered = k->address.base == j->address.base && k->address.iv == j->address.iv
+                  && k->stride == j->stride && std::labs(k->address.offset - j->address.offset) < CACHE_LINE_SIZE;
+      }
+      if (covered)
+        continue;
+      prefetched.push_back(*j);
+
+      // prefetching less than a cache line ahead only fetches the
+      // line being accessed
+      long stride = std::labs(j->stride);
+      int ahead = std::max(distance, int((CACHE_LINE_SIZE + stride - 1) / stride));
+
+      Prefetch prefetch;
+      Operand addr(Operand::VREG, next_vreg++);
+      Instruction *add_ins = new Instruction(HINS_add_q, addr, Operand(Operand::VREG, j->addr_vreg),
+                                             Operand(Operand::IMM_IVAL, j->addr_offset + ahead * j->stride));
+      add_ins->set_comment("Address " + std::to_string(ahead) + " iterations ahead");
+      prefetch.code.push_back(add_ins);
+
+      // with a stride of less than a cache line, only the iteration
+      // whose address is the first one in its line prefetches it: the
+      // offset of the address in the line is less than the stride
+      // (or, going down, at least the line size minus the stride)
+      if (stride < CACHE_LINE_SIZE) {
+        Operand line_offset(Operand::VREG, next_vreg++), first(Operand::VREG, next_vreg++);
+        prefetch.code.push_back(new Instruction(HINS_and_q, line_offset, addr, Operand(Operand::IMM_IVAL, CACHE_LINE_SIZE - 1)));
+        if (j->stride > 0)
+          prefetch.code.push_back(new Instruction(HINS_cmplt_q, first, line_offset, Operand(Operand::IMM_IVAL, stride)));
+        else
+          prefetch.code.push_back(new Instruction(HINS_cmpgte_q, first, line_offset, Operand(Operand::IMM_IVAL, CACHE_LINE_SIZE - stride)));
+        prefetch.skip_label = i->header->get_block_label() + ".pf" + std::to_string(++num_labels);
+        Instruction *cjmp_ins = new Instruction(HINS_cjmp_f, first, Operand(Operand::LABEL, prefetch.skip_label));
+        cjmp_ins->set_comment("Prefetch once per cache line");
+        prefetch.code.push_back(cjmp_ins);
+      }
+
+      Instruction *prefetch_ins = new Instruction(HINS_prefetch, Operand(Operand::IMM_IVAL, LOCALITY_T0), addr);
+      prefetch_ins->set_comment("Prefetch");
+      prefetch.code.push_back(prefetch_ins);
+      for (auto k = prefetch.code.begin(); k != prefetch.code.end(); ++k)
+        (*k)->set_loc(iseq->get_instruction(j->index)->get_loc());
+      prefetches[j->index].push_back(prefetch);
+    }
+  }
+
+  if (prefetches.empty())
+    return m_cfg;
+
+  // a skipped prefetch continues at the next inserted one (or the
+  // accessing instruction)
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned j = 0; j < iseq->get_length(); ++j) {
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    auto inserted = prefetches.find(j);
+    if (inserted != prefetches.end()) {
+      for (auto k = inserted->second.begin(); k != inserted->second.end(); ++k) {
+        for (auto l = k->code.begin(); l != k->code.end(); ++l)
+          result->append(*l);
+        if (!k->skip_label.empty())
+          result->define_label(k->skip_label);
+      }
+    }
+    result->append(iseq->get_instruction(j)->duplicate());
+  }
+
+  auto result_builder = ::make_highlevel_cfg_builder(result);
+  return result_builder.build();
+}
+
+// Find the accesses of a loop whose addresses advance by a constant
+// stride in each iteration.
+void SoftwarePrefetch::find_accesses(std::shared_ptr<ControlFlowGraph> cfg, const LoopInfo &loop_info, const LoopInfo::Loop &loop,
+                                     std::vector<Access> &accesses) {
+  std::set<int> loop_defs;
+  std::vector<std::shared_ptr<InstructionSequence> > blocks;
+  for (auto i = loop.blocks.begin(); i != loop.blocks.end(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = cfg->get_block(*i);
+    if (bb->get_kind() != BASICBLOCK_INTERIOR)
+      return;
+    blocks.push_back(bb);
+    for (auto j = bb->cbegin(); j != bb->cend(); ++j) {
+      if (HighLevel::is_def(*j))
+        loop_defs.insert(HighLevel::get_def_vreg(*j));
+    }
+  }
+
+  // the induction variables: each block assigning one adds a constant
+  // to it, and is executed in every iteration
+  std::map<int, long> steps;
+  std::set<int> not_ivs;
+  std::map<int, Affine> end_values;
+  for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+    bool every_iteration = true;
+    for (auto j = loop.latches.begin(); j != loop.latches.end(); ++j)
+      every_iteration = every_iteration && loop_info.dominates(*i, *j);
+
+    std::map<int, Affine> values;
+    for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) {
+      if (HighLevel::is_def(*j))
+        values[HighLevel::get_def_vreg(*j)] = evaluate(*j, values, loop_defs);
+    }
+    for (auto j = values.begin(); j != values.end(); ++j) {
+      const Affine &value = j->second;
+      if (every_iteration && value.known && value.base < 0 && value.iv == j->first && value.coef == 1)
+        steps[j->first] += value.offset;
+      else
+        not_ivs.insert(j->first);
+    }
+    if (blocks.size() == 1)
+      end_values = values;
+  }
+  for (auto i = not_ivs.begin(); i != not_ivs.end(); ++i)
+    steps.erase(*i);
+
+  // In a single block loop (such as a pipelined kernel, which passes
+  // addresses on in copies), a vreg holds the value the previous
+  // iteration left in it until it is assigned: if that is
+  // base + coef * iv + offset, it is one step of iv less in this one
+  std::map<int, Affine> carried;
+  for (auto i = end_values.begin(); i != end_values.end(); ++i) {
+    const Affine &value = i->second;
+    auto step = steps.find(value.iv);
+    if (value.known && step != steps.end() && steps.count(i->first) == 0)
+      carried[i->first] = { true, value.base, value.iv, value.coef, value.offset - value.coef * step->second };
+  }
+
+  for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+    std::map<int, Affine> values = carried;
+    unsigned index = unsigned((*i)->get_code_order());
+    for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j, ++index) {
+      Instruction *ins = *j;
+      for (unsigned k = 0; k < ins->get_num_operands(); ++k) {
+        Operand operand = ins->get_operand(k);
+        if (operand.get_kind() != Operand::VREG_MEM && operand.get_kind() != Operand::VREG_MEM_OFF)
+          continue;
+        Affine address = get_value(Operand(Operand::VREG, operand.get_base_reg()), values, loop_defs);
+        auto step = steps.find(address.iv);
+        if (!address.known || step == steps.end() || step->second == 0)
+          continue;
+        long offset = operand.get_kind() == Operand::VREG_MEM_OFF ? operand.get_offset() : 0;
+        address.offset += offset;
+        accesses.push_back({ index, operand.get_base_reg(), offset, address, address.coef * step->second });
+      }
+      if (HighLevel::is_def(ins))
+        values[HighLevel::get_def_vreg(ins)] = evaluate(ins, values, loop_defs);
+    }
+  }
+}
+
+// Determine how many iterations ahead of an access its prefetch
+// is issued.
+int SoftwarePrefetch::get_distance(std::shared_ptr<ControlFlowGraph> cfg, const BlockFrequency &block_frequency,
+                                   const LoopInfo::Loop &loop) const {
+  double header_frequency = block_frequency.get_frequency(loop.header);
+  double cycles = 0.0;
+  for (auto i = loop.blocks.begin(); i != loop.blocks.end(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = cfg->get_block(*i);
+    double weight = header_frequency > 0.0 ? block_frequency.get_frequency(bb) / header_frequency : 1.0;
+    for (auto j = bb->cbegin(); j != bb->cend(); ++j)
+      cycles += weight * ((*j)->get_opcode() == HINS_call ? CALL_CYCLES : INSTRUCTION_CYCLES);
+  }
+
+  int distance = int(std::ceil(m_latency / std::max(cycles, 1.0)));
+  return std::clamp(distance, 1, MAX_DISTANCE);
+}
+
+// Determine the value an instruction assigns.
+SoftwarePrefetch::Affine SoftwarePrefetch::evaluate(Instruction *ins, const std::map<int, Affine> &values, const std::set<int> &loop_defs) {
+  const Affine unknown = { false, -1, -1, 0, 0 };
+  if (ins->get_num_operands() < 2 || ins->get_operand(0).get_kind() != Operand::VREG)
+    return unknown;
+  HighLevelOpcode opcode = HighLevelOpcode(ins->get_opcode());
+  Affine a = get_value(ins->get_operand(1), values, loop_defs);
+  Affine b = ins->get_num_operands() > 2 ? get_value(ins->get_operand(2), values, loop_defs) : unknown;
+  if (!a.known)
+    return unknown;
+
+  if (opcode == HINS_mov_l || opcode == HINS_mov_q || opcode == HINS_sconv_lq || opcode == HINS_uconv_lq)
+    return a;
+
+  if (opcode == HINS_add_l || opcode == HINS_add_q || opcode == HINS_sub_l || opcode == HINS_sub_q) {
+    long sign = (opcode == HINS_sub_l || opcode == HINS_sub_q) ? -1 : 1;
+    if (!b.known || (a.base >= 0 && b.base >= 0) || (b.base >= 0 && sign < 0)
+        || (a.iv >= 0 && b.iv >= 0 && a.iv != b.iv))
+      return unknown;
+    long coef = a.coef + sign * b.coef;
+    return { true, std::max(a.base, b.base), coef == 0 ? -1 : std::max(a.iv, b.iv), coef, a.offset + sign * b.offset };
+  }
+
+  if (opcode == HINS_mul_l || opcode == HINS_mul_q) {
+    // one of the factors must be a constant
+    if (!b.known)
+      return unknown;
+    if (b.base < 0 && b.iv < 0)
+      std::swap(a, b);
+    if (a.base >= 0 || a.iv >= 0 || b.base >= 0)
+      return unknown;
+    long coef = b.coef * a.offset;
+    return { true, -1, coef == 0 ? -1 : b.iv, coef, b.offset * a.offset };
+  }
+
+  return unknown;
+}
+
+// Determine the value of a source operand: a vreg assigned earlier in
+// the block has the value it was assigned, and any other vreg assigned
+// in the loop is an induction variable candidate.
+SoftwarePrefetch::Affine SoftwarePrefetch::get_value(const Operand &operand, const std::map<int, Affine> &values,
+                                                     const std::set<int> &loop_defs) {
+  if (operand.is_imm_ival())
+    return { true, -1, -1, 0, operand.get_imm_ival() };
+  if (operand.get_kind() != Operand::VREG)
+    return { false, -1, -1, 0, 0 };
+  int vreg = operand.get_base_reg();
+  auto i = values.find(vreg);
+  if (i != values.end())
+    return i->second;
+  if (loop_defs.count(vreg) > 0)
+    return { true, -1, vreg, 1, 0 };
+  return { true, vreg, -1, 0, 0 };
+}
@@ -0,0 +1,228 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include <set>
+#include "highlevel.h"
+#include "cfg_builder.h"
+#include "block_frequency.h"
+#include "superblock_formation.h"
+
+namespace {
+
+// Only blocks with at most this many high-level instructions
+// are duplicated
+const unsigned MAX_TAIL_SIZE = 12;
+
+// The copies may add this percentage of the function's high-level code
+// (but at least enough for one copy of the largest tail)
+const int BUDGET_PERCENT = 25;
+const int MIN_BUDGET = MAX_TAIL_SIZE;
+
+// Edges whose estimated frequencies differ by less than this
+// are equally likely
+const double EPSILON = 1e-9;
+
+}
+
+SuperblockFormation::SuperblockFormation(std::shared_ptr<ControlFlowGraph> cfg, const FunctionAttrInference &function_attrs)
+  : m_cfg(cfg)
+  , m_function_attrs(function_attrs)
+  , m_budget(0)
+  , m_num_copies(0) {
+}
+
+SuperblockFormation::~SuperblockFormation() {
+}
+
+std::shared_ptr<ControlFlowGraph> SuperblockFormation::transform_cfg() {
+  std::shared_ptr<InstructionSequence> iseq = m_cfg->create_instruction_sequence();
+  m_budget = std::max(MIN_BUDGET, int(iseq->get_length()) * BUDGET_PERCENT / 100);
+  m_is_copy.assign(iseq->get_length(), false);
+
+  // every copy uses up some of the budget, so this terminates
+  bool changed = false;
+  while (std::shared_ptr<InstructionSequence> result = duplicate_one(iseq)) {
+    iseq = result;
+    changed = true;
+  }
+
+  if (!changed)
+    return m_cfg;
+
+  // Converting to a ControlFlowGraph and back drops the labels nothing
+  // jumps to any more, so a predecessor and the join block it now falls
+  // through to become a single basic block
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  iseq = cfg_builder.build()->create_instruction_sequence();
+  auto merged_cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  return merged_cfg_builder.build();
+}
+
+// Find a join block whose likely predecessor can get its own copy of
+// it, and duplicate it. Returns the transformed code, or nullptr if
+// there is no such block.
+std::shared_ptr<InstructionSequence> SuperblockFormation::duplicate_one(std::shared_ptr<InstructionSequence> iseq) {
+  auto cfg_builder = ::make_highlevel_cfg_builder(iseq);
+  std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+  BlockFrequency block_frequency(cfg, true, &m_function_attrs);
+  block_frequency.execute();
+  const LoopInfo &loop_info = block_frequency.get_loop_info();
+  std::set<unsigned> headers;
+  for (auto i = loop_info.get_loops().begin(); i != loop_info.get_loops().end(); ++i)
+    headers.insert(i->header->get_block_id());
+
+  for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = *i;
+    if (bb->get_kind() != BASICBLOCK_INTERIOR || bb->get_length() > MAX_TAIL_SIZE
+        || int(bb->get_length()) > m_budget || headers.count(bb->get_block_id()) > 0)
+      continue;
+    // copies made by this pass aren't copied again
+    unsigned begin = unsigned(bb->get_code_order());
+    unsigned end = begin + bb->get_length();
+    if (std::find(m_is_copy.begin() + begin, m_is_copy.begin() + end, true) != m_is_copy.begin() + end)
+      continue;
+    const ControlFlowGraph::EdgeList &incoming = cfg->get_incoming_edges(bb);
+    const ControlFlowGraph::EdgeList &outgoing = cfg->get_outgoing_edges(bb);
+    if (incoming.size() < 2)
+      continue;
+    bool has_back_edge = false;
+    for (auto j = outgoing.cbegin(); j != outgoing.cend(); ++j) {
+      if (loop_info.is_back_edge(*j))
+        has_back_edge = true;
+    }
+    // A copy which falls through needs a successor to jump to. The
+    // function epilogue isn't copied: a ret counts as falling through in
+    // a ControlFlowGraph, so the code following a copy of it would seem
+    // reachable.
+    int last_opcode = bb->get_last_instruction()->get_opcode();
+    if (has_back_edge || last_opcode == HINS_ret || (last_opcode != HINS_jmp && end >= iseq->get_length()))
+      continue;
+
+    // Pick the likely predecessor (preferring one that jumps to the block:
+    // then both it and the block's fall-through predecessor end up
+    // with straight-line code). A join only reached along edges that are
+    // never taken isn't on a trace.
+    double max_weight = 0.0;
+    for (auto j = incoming.cbegin(); j != incoming.cend(); ++j)
+      max_weight = std::max(max_weight, block_frequency.get_frequency(*j));
+    const Edge *trace_edge = nullptr;
+    for (auto j = incoming.cbegin(); j != incoming.cend(); ++j) {
+      const Edge *edge = *j;
+      std::shared_ptr<InstructionSequence> pred = edge->get_source();
+      double weight = block_frequency.get_frequency(edge);
+      if (weight <= EPSILON || weight < max_weight - EPSILON || pred->get_kind() != BASICBLOCK_INTERIOR || pred == bb)
+        continue;
+      bool jumps = edge->get_kind() == EDGE_BRANCH && pred->get_last_instruction()->get_opcode() == HINS_jmp;
+      if (!jumps && edge->get_kind() != EDGE_FALLTHROUGH)
+        continue;
+      if (jumps || !trace_edge)
+        trace_edge = edge;
+      if (jumps)
+        break;
+    }
+    if (!trace_edge)
+      continue;
+
+    // The other predecessors of a block the trace falls through to go
+    // to the copy, which is placed after an unconditional jump (preferably
+    // the first one after the block)
+    unsigned insert_at = 0;
+    if (trace_edge->get_kind() == EDGE_FALLTHROUGH) {
+      for (unsigned k = 0; k < iseq->get_length(); ++k) {
+        if (iseq->get_instruction(k)->get_opcode() == HINS_jmp) {
+          insert_at = k + 1;
+          if (insert_at >= end)
+            break;
+        }
+      }
+      if (insert_at == 0)
+        continue;
+    }
+
+    m_budget -= int(bb->get_length());
+    return duplicate_tail(iseq, trace_edge, insert_at);
+  }
+
+  return nullptr;
+}
+
+// Give the source of an edge its own copy of the edge's target: if the
+// source jumps to the target, the copy replaces the jump, otherwise the
+// other predecessors are redirected to a copy inserted before the
+// instruction at index insert_at
+std::shared_ptr<InstructionSequence> SuperblockFormation::duplicate_tail(std::shared_ptr<InstructionSequence> iseq, const Edge *edge, unsigned insert_at) {
+  std::shared_ptr<InstructionSequence> pred = edge->get_source();
+  std::shared_ptr<InstructionSequence> bb = edge->get_target();
+  unsigned end = unsigned(bb->get_code_order()) + bb->get_length();
+  std::string label = bb->get_block_label();
+  std::string copy_label = label + ".sb" + std::to_string(++m_num_copies);
+
+  // the copy continues at the block's fall-through successor
+  // (labeling it if necessary)
+  int last_opcode = bb->get_last_instruction()->get_opcode();
+  std::string succ_label;
+  if (last_opcode != HINS_jmp && last_opcode != HINS_ret)
+    succ_label = iseq->has_label(end) ? iseq->get_label_at_index(end) : copy_label + ".next";
+
+  std::vector<bool> is_copy;
+  auto append_copy = [&](std::shared_ptr<InstructionSequence> result) {
+    for (auto i = bb->cbegin(); i != bb->cend(); ++i)
+      result->append((*i)->duplicate());
+    if (!succ_label.empty())
+      result->append(new Instruction(HINS_jmp, Operand(Operand::LABEL, succ_label)));
+    is_copy.resize(result->get_length(), true);
+  };
+
+  bool jumps = edge->get_kind() == EDGE_BRANCH;
+  unsigned pred_jump = unsigned(pred->get_code_order()) + pred->get_length() - 1;
+  std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+  for (unsigned j = 0; j <= iseq->get_length(); ++j) {
+    if (!jumps && j == insert_at) {
+      result->define_label(copy_label);
+      append_copy(result);
+    }
+    if (j == iseq->get_length())
+      break;
+
+    if (iseq->has_label(j))
+      result->define_label(iseq->get_label_at_index(j));
+    else if (j == end && !succ_label.empty())
+      result->define_label(succ_label);
+    if (jumps && j == pred_jump) {
+      append_copy(result);
+      continue;
+    }
+
+    Instruction *ins = iseq->get_instruction(j)->duplicate();
+    if (!jumps) {
+      for (unsigned k = 0; k < ins->get_num_operands(); ++k) {
+        if (ins->get_operand(k).get_kind() == Operand::LABEL && ins->get_operand(k).get_label() == label)
+          ins->set_operand(k, Operand(Operand::LABEL, copy_label));
+      }
+    }
+    result->append(ins);
+    is_copy.push_back(m_is_copy[j]);
+  }
+
+  m_is_copy = is_copy;
+  return result;
+}
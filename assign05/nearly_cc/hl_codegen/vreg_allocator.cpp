@@ -8,7 +8,8 @@ VregAllocator::VregAllocator()
   , m_top(0)
   , m_first_temp(0)
   , m_params_ended(false)
-  , m_temps_active(false) {
+  , m_temps_active(false)
+  , m_reg_count(0) {
 }
 
 VregAllocator::~VregAllocator() {
@@ -20,6 +21,7 @@ void VregAllocator::reset() {
   m_first_temp = 0;
   m_params_ended = false;
   m_temps_active = false;
+  m_reg_count = 0;
 }
 
 
@@ -0,0 +1,180 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef ALIAS_ANALYSIS_H
+#define ALIAS_ANALYSIS_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include "operand.h"
+#include "instruction.h"
+#include "function.h"
+
+//! @file
+//! Interprocedural points-to analysis of high-level code.
+
+//! AliasAnalysis computes a flow-insensitive, unification-based
+//! (Steensgaard-style) points-to graph for all of the functions of a
+//! unit, based on their high-level code, and answers alias queries
+//! about memory operands.
+//!
+//! The memory objects are the local variables stored in memory (one
+//! object per `localaddr` offset, so each array or struct is a single
+//! object) and the objects named by immediate labels (global variables
+//! and string constants). A pointer computed from integers that were
+//! never addresses is not tracked.
+//!
+//! An object "escapes" if code outside the unit may access it.
+//! Every function may be called from outside the unit, so its
+//! parameters may point to any escaped object, and whatever it returns
+//! escapes. Likewise, whatever is passed to a function not defined in
+//! the unit escapes, and whatever such a function returns may point to
+//! any escaped object.
+class AliasAnalysis {
+public:
+  //! Result of an alias query.
+  enum AliasResult {
+    NO_ALIAS,    //!< the accesses never overlap
+    MAY_ALIAS,   //!< the accesses might overlap
+    MUST_ALIAS,  //!< the accesses are always to the same bytes
+  };
+
+private:
+  // An equivalence class of vregs and memory objects: all vregs
+  // in the class may point to the same objects.
+  struct Node {
+    int parent;    // union-find parent, or the node itself
+    int pointee;   // class of what the members may point to, or -1
+    bool unknown;  // the class also contains every escaped object
+    bool escaped;  // the objects in the class may be accessed from outside the unit
+  };
+
+  enum ConstraintKind { ADDR, COPY, LOAD, STORE };
+
+  // a constraint on the points-to graph: for ADDR, dest = &src;
+  // for COPY, dest = src; for LOAD, dest = *src; for STORE, *dest = src
+  struct Constraint {
+    ConstraintKind kind;
+    int dest, src;
+  };
+
+  // nodes for the values returned by a function
+  struct FunctionNodes {
+    int ret;        // value returned (defs of vr0)
+    int call_ret;   // value returned by callees (uses of vr0)
+  };
+
+  std::vector<std::shared_ptr<Function> > m_functions;
+  std::map<const Function *, unsigned> m_function_index;
+  std::map<std::string, unsigned> m_function_by_name;
+  std::vector<Node> m_nodes;
+  std::vector<Constraint> m_constraints;
+  std::vector<FunctionNodes> m_fn_nodes;
+  std::vector<std::map<int, int> > m_vreg_nodes;    // per function: vreg -> node
+  std::vector<std::map<int, unsigned> > m_num_defs; // per function: vreg -> number of defs
+  std::vector<std::map<int, long> > m_frame_addr;   // per function: vreg -> localaddr offset it always holds
+  std::map<std::pair<unsigned, long>, int> m_local_objects;
+  std::map<std::string, int> m_global_objects;
+  std::vector<int> m_class_owner;  // class -> function owning all of its objects (-1 if none, -2 if several)
+  bool m_changed;
+
+  // no value semantics
+  AliasAnalysis(const AliasAnalysis &);
+  AliasAnalysis &operator=(const AliasAnalysis &);
+
+public:
+  //! Constructor.
+  //! @param functions all of the Functions of the unit, with their
+  //!                  high-level code generated
+  AliasAnalysis(const std::vector<std::shared_ptr<Function> > &functions);
+  ~AliasAnalysis();
+
+  //! Build and solve the points-to graph.
+  void execute();
+
+  //! Check whether two memory accesses in the high-level code of a
+  //! Function can refer to the same bytes. Vregs the analysis didn't
+  //! see (e.g., ones allocated by an optimization) are handled
+  //! conservatively.
+  //! @param fn the Function containing both accesses
+  //! @param a the first memory operand
+  //! @param a_size the number of bytes accessed through a
+  //! @param b the second memory operand
+  //! @param b_size the number of bytes accessed through b
+  //! @return NO_ALIAS, MAY_ALIAS, or MUST_ALIAS
+  AliasResult alias(std::shared_ptr<Function> fn, const Operand &a, int a_size, const Operand &b, int b_size) const;
+
+  //! Check whether the object a pointer refers to might be accessed
+  //! outside of the function (through a callee, or by code outside the
+  //! unit).
+  //! @param fn the Function
+  //! @param mem a memory operand in fn's high-level code
+  //! @return true if the object mem refers to may be accessed by any
+  //!         called function
+  bool may_escape(std::shared_ptr<Function> fn, const Operand &mem) const;
+
+  //! Get the class of the objects a memory operand may refer to.
+  //! Accesses whose classes don't overlap (see may_overlap())
+  //! never alias.
+  //! @param fn the Function
+  //! @param mem a memory operand in fn's high-level code
+  //! @return the class, or -1 if nothing is known about mem
+  int get_object_class(std::shared_ptr<Function> fn, const Operand &mem) const;
+
+  //! Check whether two object classes may have an object in common.
+  //! @param a_class an object class (not -1)
+  //! @param b_class another object class (not -1)
+  //! @return true if the classes may overlap
+  bool may_overlap(int a_class, int b_class) const;
+
+  //! Check whether the objects of a class might be accessed by any
+  //! called function.
+  //! @param obj_class an object class (not -1)
+  //! @return true if the objects may escape
+  bool is_escaped_class(int obj_class) const;
+
+  //! Check whether a class consists only of local variables of one
+  //! Function which no other function can access.
+  //! @param fn the Function
+  //! @param obj_class an object class (not -1)
+  //! @return true if only fn can access the objects of the class
+  bool is_local_class(std::shared_ptr<Function> fn, int obj_class) const;
+
+private:
+  int new_node();
+  int find(int n) const;
+  int get_pointee(int n);
+  void join(int a, int b);
+  void mark(int n, bool escaped, bool unknown);
+  int get_vreg_node(unsigned fn_index, int vreg, bool is_def);
+  int get_local_node(unsigned fn_index, long offset);
+  int get_global_node(const std::string &label);
+  void add_constraint(ConstraintKind kind, int dest, int src);
+  void gen_constraints(unsigned fn_index);
+  void gen_call_constraints(unsigned fn_index, Instruction *ins);
+  void find_frame_addrs(unsigned fn_index);
+  void solve();
+  int get_target(unsigned fn_index, int vreg) const;
+  bool get_frame_offset(unsigned fn_index, const Operand &mem, long &offset) const;
+};
+
+#endif // ALIAS_ANALYSIS_H
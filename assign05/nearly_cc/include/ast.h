@@ -69,6 +69,10 @@ enum ASTNodeTag {
   AST_VARIABLE_REF,
   AST_LITERAL_VALUE,
   AST_IMPLICIT_CONVERSION, // semantic analysis can add these to mark locations of implicit type conversions
+  AST_ASM_STATEMENT,
+  AST_ASM_OPERAND_LIST,
+  AST_ASM_OPERAND,
+  AST_ASM_CLOBBER_LIST,
 };
 
 //! Support for printing a text representation of an AST.
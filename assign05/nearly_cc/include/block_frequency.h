@@ -0,0 +1,125 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef BLOCK_FREQUENCY_H
+#define BLOCK_FREQUENCY_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include "cfg.h"
+#include "loop_info.h"
+
+class FunctionAttrInference;
+
+//! @file
+//! Static branch probabilities and basic block frequencies.
+
+//! BlockFrequency estimates, without a profile, how likely each edge
+//! of a ControlFlowGraph (high-level or low-level) is to be taken, and
+//! how often each basic block executes per call of the function.
+//!
+//! Both ways out of a conditional branch start out equally likely, and
+//! the Ball–Larus heuristics that apply to the branch adjust that,
+//! combined as independent evidence (Wu and Larus):
+//!   - loop branch: the loop continues rather than exits
+//!   - loop header: control enters a loop rather than skips it
+//!   - call: the successor that makes a call is avoided
+//!   - return: the successor that returns from the function is avoided
+//!   - pointer (high-level code only): a pointer-sized value compared
+//!     with 0 (a null test) is nonzero
+//!   - opcode (high-level code only): a value is not negative, and not
+//!     equal to a given constant
+//!
+//! A successor which calls a noreturn function (according to the
+//! FunctionAttrInference, if one is provided) is almost never taken,
+//! and a branch hint (see Instruction::BranchHint) overrides all of the
+//! heuristics.
+//!
+//! Frequencies are propagated through the loops from the innermost
+//! outward: the probability of getting back to a loop's header from
+//! the header determines how many times the loop iterates.
+class BlockFrequency {
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  bool m_highlevel;
+  const FunctionAttrInference *m_function_attrs;
+  LoopInfo m_loop_info;
+  std::map<const Edge *, double> m_probability;
+  std::vector<double> m_frequency;        // block id -> frequency
+  std::vector<double> m_cyclic;           // block id -> probability of returning to a loop header
+
+  // no value semantics
+  BlockFrequency(const BlockFrequency &);
+  BlockFrequency &operator=(const BlockFrequency &);
+
+public:
+  //! Constructor.
+  //! @param cfg the ControlFlowGraph to analyze
+  //! @param highlevel true if cfg has high-level code, false if it has
+  //!                  low-level code
+  //! @param function_attrs the (executed) FunctionAttrInference of the
+  //!                       unit, or nullptr if the attributes of called
+  //!                       functions are not known
+  BlockFrequency(std::shared_ptr<ControlFlowGraph> cfg, bool highlevel, const FunctionAttrInference *function_attrs = nullptr);
+  ~BlockFrequency();
+
+  //! Estimate the branch probabilities and block frequencies.
+  void execute();
+
+  //! Get the loops of the ControlFlowGraph.
+  //! @return the (executed) LoopInfo
+  const LoopInfo &get_loop_info() const { return m_loop_info; }
+
+  //! Get the probability that control leaves a basic block
+  //! through an edge.
+  //! @param edge an Edge of the ControlFlowGraph
+  //! @return the probability (the probabilities of the outgoing edges
+  //!         of a block add up to 1)
+  double get_probability(const Edge *edge) const;
+
+  //! Get the estimated number of times a basic block executes per
+  //! call of the function.
+  //! @param bb the basic block
+  //! @return the frequency (1 for the entry block, 0 for unreachable
+  //!         blocks)
+  double get_frequency(std::shared_ptr<InstructionSequence> bb) const;
+
+  //! Get the estimated number of times an edge is taken per call of
+  //! the function.
+  //! @param edge an Edge of the ControlFlowGraph
+  //! @return the frequency of the edge's source times the edge's
+  //!         probability
+  double get_frequency(const Edge *edge) const;
+
+private:
+  void compute_probabilities(std::shared_ptr<InstructionSequence> bb);
+  bool predict_condition(std::shared_ptr<InstructionSequence> bb, double &probability) const;
+  bool is_call(Instruction *ins) const;
+  bool is_conditional_branch(Instruction *ins) const;
+  bool has_call(std::shared_ptr<InstructionSequence> bb) const;
+  bool has_noreturn_call(std::shared_ptr<InstructionSequence> bb) const;
+  bool returns(std::shared_ptr<InstructionSequence> bb) const;
+  bool enters_loop(std::shared_ptr<InstructionSequence> from, std::shared_ptr<InstructionSequence> bb) const;
+  bool stays_in_loop(const Edge *edge) const;
+  void propagate(std::shared_ptr<InstructionSequence> head, const std::vector<bool> &region);
+};
+
+#endif // BLOCK_FREQUENCY_H
@@ -0,0 +1,92 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <string>
+
+//! @file
+//! Compiler builtin functions.
+
+//! Kinds of builtin functions.
+enum class BuiltinKind {
+  POPCOUNT,    // number of 1 bits
+  CLZ,         // number of leading 0 bits
+  CTZ,         // number of trailing 0 bits
+  BSWAP,       // reverse the byte order
+  EXPECT,      // value of the first argument, expected to equal the second
+  UNREACHABLE, // control never reaches the call
+  PREFETCH,    // fetch the memory at an address into the cache
+
+  // atomic operations (the first argument is the address of the object)
+  FETCH_ADD,   // add to the object, returning its old value
+  FETCH_SUB,   // subtract from the object, returning its old value
+  ADD_FETCH,   // add to the object, returning its new value
+  SUB_FETCH,   // subtract from the object, returning its new value
+  BOOL_CAS,    // compare and swap, returning whether the swap happened
+  VAL_CAS,     // compare and swap, returning the old value
+  EXCHANGE,    // store to the object, returning its old value
+  LOCK_RELEASE, // store 0 to the object (with release semantics)
+  LOAD,        // load the object
+  STORE,       // store to the object
+  SYNCHRONIZE, // full memory barrier
+};
+
+//! Memory orders of the `__atomic` builtins. The values are those of
+//! GCC's predefined `__ATOMIC_RELAXED` etc. macros, so preprocessed
+//! code passes them as integer constants.
+enum class MemoryOrder {
+  RELAXED,
+  CONSUME,
+  ACQUIRE,
+  RELEASE,
+  ACQ_REL,
+  SEQ_CST,
+};
+
+//! A builtin function, such as `__builtin_popcount`. Calls to builtins
+//! are checked by SemanticAnalysis and expanded by HighLevelCodegen
+//! instead of being compiled as calls, except for `__builtin_unreachable`,
+//! which stays a call (to a noreturn function) until LowLevelCodeGen
+//! turns it into a trap.
+//!
+//! The atomic builtins (`__sync_*` and `__atomic_*`) are lowered to
+//! atomic high-level instructions, which the optimizer treats as
+//! memory barriers. The size of the atomic operation is the size
+//! of the object the first argument points to.
+struct Builtin {
+  const char *name;
+  BuiltinKind kind;
+  int size;  // size in bytes of the integer argument (0 if there is none)
+  bool memory_order = false;  // true if the last argument is a memory order
+};
+
+//! Look up a builtin function.
+//! @param name the name of a called function
+//! @return pointer to the Builtin, or nullptr if name isn't a builtin
+const Builtin *find_builtin(const std::string &name);
+
+//! Check whether a builtin function is an atomic operation.
+//! @param builtin a Builtin
+//! @return true if builtin is one of the `__sync` or `__atomic` builtins
+bool is_atomic_builtin(const Builtin &builtin);
+
+#endif // BUILTINS_H
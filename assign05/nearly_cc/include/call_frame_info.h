@@ -0,0 +1,86 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CALL_FRAME_INFO_H
+#define CALL_FRAME_INFO_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include "lowlevel.h"
+#include "instruction_seq.h"
+
+//! @file
+//! Call-frame information (CFI) for low-level code.
+
+//! CallFrameInfo computes the `.cfi_*` directives describing how to
+//! unwind the stack at every instruction of a function's low-level code,
+//! from which the assembler generates the function's `.eh_frame` entry.
+//!
+//! The frame is tracked through the instructions that change it: pushes
+//! and pops, immediate adjustments of %rsp, and the copy of %rsp into
+//! %rbp that sets up the frame pointer. The canonical frame address (CFA)
+//! is the value of %rsp before the call, and is described relative to
+//! %rsp until the frame pointer is set up, and relative to %rbp after.
+//! The first push of each callee-saved register records where it is
+//! saved, and popping that word back into the register restores it.
+//!
+//! The frame is propagated along the control flow, so code reached
+//! only by a jump (for example, code following an epilogue) gets the
+//! frame of the jump, and the directives needed to re-establish it.
+class CallFrameInfo {
+private:
+  // the frame at an instruction boundary
+  struct Frame {
+    MachineReg cfa_reg;              // the CFA is cfa_reg + cfa_offset
+    long cfa_offset;
+    long depth;                      // CFA - %rsp
+    std::map<MachineReg, long> saved; // callee-saved registers, and their offsets from the CFA
+    std::vector<int> pushed;         // the value of each word pushed (see get_frame_after())
+  };
+
+  std::shared_ptr<InstructionSequence> m_iseq;
+  std::vector<std::vector<std::string> > m_directives;
+
+  // no value semantics
+  CallFrameInfo(const CallFrameInfo &);
+  CallFrameInfo &operator=(const CallFrameInfo &);
+
+public:
+  //! Constructor.
+  //! @param iseq the low-level code of a function
+  CallFrameInfo(std::shared_ptr<InstructionSequence> iseq);
+  ~CallFrameInfo();
+
+  //! Compute the directives.
+  void execute();
+
+  //! Get the directives computed by execute().
+  //! @return for each instruction, the directives to emit before it
+  const std::vector<std::vector<std::string> > &get_directives() const { return m_directives; }
+
+private:
+  static Frame get_entry_frame();
+  static Frame get_frame_after(const Frame &frame, Instruction *ins);
+  static void describe_change(const Frame &from, const Frame &to, std::vector<std::string> &directives);
+};
+
+#endif // CALL_FRAME_INFO_H
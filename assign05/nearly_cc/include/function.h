@@ -38,6 +38,23 @@
 //! phases, such as storage allocation decisions, can also be collected in
 //! the Function object.
 class Function {
+public:
+  //! Attributes of a function, inferred by FunctionAttrInference
+  //! (they can be combined as a bit mask).
+  enum Attribute {
+    //! the function doesn't write memory its caller can observe, so
+    //! calls with the same arguments (and no intervening writes to
+    //! memory) return the same value
+    ATTR_PURE = 1,
+    //! the function is pure and doesn't read memory its caller can
+    //! observe either, so its result depends only on its arguments
+    ATTR_CONST = 2,
+    //! the function never returns to its caller
+    ATTR_NORETURN = 4,
+    //! the function doesn't call any other function
+    ATTR_LEAF = 8,
+  };
+
 private:
   std::string m_name;
   Node *m_funcdef_ast; // function definition AST node
@@ -45,6 +62,8 @@ private:
   std::shared_ptr<InstructionSequence> m_hl_iseq; // high-level code
   std::shared_ptr<InstructionSequence> m_ll_iseq; // low-level code
   VregAllocator *m_vr_alloc;
+  int m_vreg_slot_offset; // %rbp offset of the first vreg stack slot
+  unsigned m_attributes; // bit mask of Attribute values
 
 public:
   //! Constructor.
@@ -85,6 +104,32 @@ public:
   //! @param shared pointer to the low-level InstructionSequence
   void set_ll_iseq(std::shared_ptr<InstructionSequence> ll_iseq);
 
+  //! Get the %rbp-relative offset of the stack slot of the first
+  //! virtual register stored in memory (vr10). Slots of later vregs are
+  //! at successively lower offsets. A vreg slot is only accessed through
+  //! a pointer if a `leaq` takes its address.
+  //! @return the offset of the first vreg slot (0 if low-level code
+  //!         has not been generated)
+  int get_vreg_slot_offset() const { return m_vreg_slot_offset; }
+
+  //! Set the %rbp-relative offset of the first vreg stack slot.
+  //! @param offset the offset of the first vreg slot
+  void set_vreg_slot_offset(int offset) { m_vreg_slot_offset = offset; }
+
+  //! Get the inferred attributes of the function.
+  //! @return bit mask of Attribute values (0 if attributes have
+  //!         not been inferred)
+  unsigned get_attributes() const { return m_attributes; }
+
+  //! Check whether the function has an attribute.
+  //! @param attr the Attribute
+  //! @return true if the function has the attribute
+  bool has_attribute(Attribute attr) const { return (m_attributes & attr) != 0; }
+
+  //! Set the inferred attributes of the function.
+  //! @param attributes bit mask of Attribute values
+  void set_attributes(unsigned attributes) { m_attributes = attributes; }
+
 };
 
 #endif // FUNCTION_H
@@ -0,0 +1,90 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FUNCTION_ATTR_INFERENCE_H
+#define FUNCTION_ATTR_INFERENCE_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include "function.h"
+#include "cfg.h"
+#include "mod_ref_analysis.h"
+
+//! @file
+//! Inference of function attributes (pure, const, noreturn, leaf).
+
+//! FunctionAttrInference infers the Function::Attribute values of
+//! each Function of a unit from its high-level code and the mod/ref
+//! summaries of the unit, and stores them in the Function objects.
+//!
+//! A function is pure if its summary has no writes (and it calls
+//! nothing outside the unit), and const if it has no reads either.
+//! A function is noreturn if its exit block can't be reached once
+//! calls to noreturn functions (including the C library's `exit` and
+//! `abort`, and `__builtin_unreachable`) are known not to return; this
+//! is iterated to a fixed point over the call graph. A function is a
+//! leaf if it has no calls (other than to builtins).
+class FunctionAttrInference {
+private:
+  std::vector<std::shared_ptr<Function> > m_functions;
+  const ModRefAnalysis &m_mod_ref;
+  std::map<std::string, unsigned> m_function_by_name;
+
+  // no value semantics
+  FunctionAttrInference(const FunctionAttrInference &);
+  FunctionAttrInference &operator=(const FunctionAttrInference &);
+
+public:
+  //! Constructor.
+  //! @param functions all of the Functions of the unit, with their
+  //!                  high-level code generated
+  //! @param mod_ref the (executed) ModRefAnalysis of the unit
+  FunctionAttrInference(const std::vector<std::shared_ptr<Function> > &functions, const ModRefAnalysis &mod_ref);
+  ~FunctionAttrInference();
+
+  //! Infer the attributes of every Function.
+  void execute();
+
+  //! Get the attributes of a function called by name.
+  //! @param fn_name the name of the function
+  //! @return bit mask of Function::Attribute values (functions outside
+  //!         the unit have none, except for known noreturn functions)
+  unsigned get_attributes(const std::string &fn_name) const;
+
+  //! Get the number of parameters of a function defined in the unit.
+  //! @param fn_name the name of the function
+  //! @return the number of parameters (0 if the function is not
+  //!         defined in the unit)
+  unsigned get_num_params(const std::string &fn_name) const;
+
+  //! Find the basic blocks that can be reached from the entry block
+  //! of a high-level control-flow graph, given that calls to noreturn
+  //! functions don't return.
+  //! @param cfg the control-flow graph
+  //! @return vector indexed by block id, true for reachable blocks
+  std::vector<bool> find_reachable_blocks(std::shared_ptr<ControlFlowGraph> cfg) const;
+
+private:
+  bool is_noreturn_call(Instruction *ins) const;
+};
+
+#endif // FUNCTION_ATTR_INFERENCE_H
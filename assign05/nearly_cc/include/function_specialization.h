@@ -0,0 +1,92 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FUNCTION_SPECIALIZATION_H
+#define FUNCTION_SPECIALIZATION_H
+
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <memory>
+#include "instruction_seq.h"
+#include "function.h"
+
+//! @file
+//! Specialization of functions for constant arguments.
+
+//! FunctionSpecialization clones a function for a call site that passes
+//! constants for some of its parameters, propagates the constants through
+//! the clone, and redirects the call to the clone. There is one clone per
+//! distinct (function, constant arguments) pair, and it is only kept if
+//! the constants decide at least one of its conditional branches.
+//!
+//! A vreg is known to be constant if it has a single definition, and
+//! that definition computes a value from constants only (so every
+//! execution of it produces the same value). In a clone, the constant
+//! parameters are defined once, at the entry.
+//!
+//! Code growth is bounded: only functions up to a maximum size are
+//! cloned, and the clones together may only add a limited fraction of
+//! the unit's high-level code.
+class FunctionSpecialization {
+private:
+  std::vector<std::shared_ptr<Function> > m_functions;
+  std::map<std::string, std::shared_ptr<Function> > m_function_by_name;
+
+  // clones created (or rejected, as nullptr) for each function and
+  // constant argument tuple
+  std::map<std::pair<std::string, std::map<int, long> >, std::shared_ptr<Function> > m_clones;
+  std::vector<std::shared_ptr<Function> > m_new_functions;
+  int m_budget;
+
+  // no value semantics
+  FunctionSpecialization(const FunctionSpecialization &);
+  FunctionSpecialization &operator=(const FunctionSpecialization &);
+
+public:
+  //! Constructor.
+  //! @param functions all of the Functions of the unit, with their
+  //!                  high-level code generated
+  FunctionSpecialization(const std::vector<std::shared_ptr<Function> > &functions);
+  ~FunctionSpecialization();
+
+  //! Create the clones, and redirect calls to them.
+  void execute();
+
+  //! Get the clones created by execute().
+  //! They need to be added to the unit.
+  //! @return the new Functions
+  const std::vector<std::shared_ptr<Function> > &get_new_functions() const { return m_new_functions; }
+
+  //! Find the vregs of high-level code that always hold the same
+  //! constant value (when they are used).
+  //! @param iseq the high-level InstructionSequence of a function
+  //! @return map of vreg numbers to their constant values
+  static std::map<int, long> find_constant_vregs(std::shared_ptr<InstructionSequence> iseq);
+
+private:
+  void specialize_calls(std::shared_ptr<Function> fn);
+  std::shared_ptr<Function> get_clone(std::shared_ptr<Function> callee, const std::map<int, long> &const_args);
+  std::shared_ptr<Function> create_clone(std::shared_ptr<Function> callee, const std::map<int, long> &const_args);
+  static std::shared_ptr<InstructionSequence> fold_constants(std::shared_ptr<InstructionSequence> iseq, int &num_folded);
+};
+
+#endif // FUNCTION_SPECIALIZATION_H
@@ -23,22 +23,30 @@
 
 #include <memory>
 #include "type.h"
+#include "symtab.h"
 
 //! A GlobalVariable represents a global variable, and specifies its
-//! name and data type. Each global variable in the program should
-//! be added to the Module (and thus made available when target code
-//! is printed.) Note that this type has value semantics (copying
-//! and assignment are allowed.)
+//! name, data type, and storage class. Each global variable in the
+//! program should be added to the Module (and thus made available
+//! when target code is printed.) Note that this type has value
+//! semantics (copying and assignment are allowed.)
 class GlobalVariable {
 private:
   std::string m_name;
   std::shared_ptr<Type> m_type;
+  StorageClass m_storage;
+  bool m_is_thread_local;
 
 public:
   //! Constructor.
   //! @param name the name of the global variable
   //! @param type shared pointer to the Type of the global variable
-  GlobalVariable(const std::string &name, std::shared_ptr<Type> type);
+  //! @param storage the StorageClass of the global variable
+  //! @param is_thread_local true if each thread has its own instance
+  //!        of the global variable
+  GlobalVariable(const std::string &name, std::shared_ptr<Type> type,
+                 StorageClass storage = StorageClass::UNSPECIFIED,
+                 bool is_thread_local = false);
   ~GlobalVariable();
 
   //! Get the name of the global variable.
@@ -48,6 +56,14 @@ public:
   //! Get the Type of the global variable.
   //! @return shared pointer to the Type of the global variable
   std::shared_ptr<Type> get_type() const { return m_type; }
+
+  //! Get the StorageClass of the global variable.
+  //! @return the StorageClass of the global variable
+  StorageClass get_storage() const { return m_storage; }
+
+  //! Check whether the global variable is thread-local.
+  //! @return true if the global variable is thread-local, false otherwise
+  bool is_thread_local() const { return m_is_thread_local; }
 };
 
 
@@ -26,6 +26,7 @@
 #include "options.h"
 #include "function.h"
 #include "vreg_allocator.h"
+#include "builtins.h"
 
 //! A HighLevelCodegen visitor generates high-level IR code for
 //! a single function definition AST. Code generation is initiated by
@@ -63,6 +64,12 @@ public:
   //! @return the next unused control-flow label number
   int get_next_label_num() const { return m_next_label_num; }
 
+  //! Visit a node, and record the node's source Location on
+  //! every instruction generated for it that doesn't already have
+  //! a more specific Location from a descendant node.
+  //! @param n the node to visit
+  virtual void visit(Node *n);
+
   virtual void visit_function_definition(Node *n);
   virtual void visit_statement_list(Node *n);
   virtual void visit_expression_statement(Node *n);
@@ -73,6 +80,7 @@ public:
   virtual void visit_for_statement(Node *n);
   virtual void visit_if_statement(Node *n);
   virtual void visit_if_else_statement(Node *n);
+  virtual void visit_asm_statement(Node *n);
   virtual void visit_binary_expression(Node *n);
   virtual void visit_unary_expression(Node *n);
   virtual void visit_function_call_expression(Node *n);
@@ -85,5 +93,10 @@ public:
 
 private:
   std::string next_label();
+  void define_label(const std::string &label);
   // TODO: additional private member functions
+  void visit_builtin_call(Node *n, const Builtin &builtin);
+  void visit_atomic_builtin_call(Node *n, const Builtin &builtin);
+  Operand get_widened_operand(Node *n, int size);
+  void hint_conditional_jump(Instruction *cjmp, Node *condition);
 };
@@ -21,6 +21,8 @@
 #ifndef HIGHLEVEL_DEFUSE_H
 #define HIGHLEVEL_DEFUSE_H
 
+#include <vector>
+
 class Instruction;
 
 namespace HighLevel {
@@ -53,6 +55,27 @@ int get_def_vreg(Instruction *ins);
 //! @return true if the specified operand is a use, false if not
 bool is_use(Instruction *ins, unsigned operand_index);
 
+//! Check whether a high-level Instruction is an atomic memory access
+//! or a fence. These are memory barriers: memory values known before
+//! one aren't known after it, and it is never removed, even if it
+//! defines a vreg which isn't used.
+//!
+//! @param ins a high-level Instruction
+//! @return true if the Instruction is an atomic access or a fence
+bool is_atomic(Instruction *ins);
+
+//! Compute the result of a high-level arithmetic, comparison, move,
+//! or conversion instruction from the values of its source operands.
+//! The operands are truncated to the instruction's source operand size,
+//! and the result is sign-extended from its destination operand size.
+//!
+//! @param hl_opcode a high-level opcode
+//! @param args the values of the source operands
+//! @param result set to the result (if the function returns true)
+//! @return false if the instruction can't be evaluated at compile time
+//!         (because of its opcode, or because it would trap)
+bool evaluate(int hl_opcode, const std::vector<long> &args, long &result);
+
 };
 
 #endif // HIGHLEVEL_DEFUSE_H
@@ -23,6 +23,8 @@
 
 #include <memory>
 #include <vector>
+#include <map>
+#include <set>
 #include <algorithm>
 #include <functional>
 #include <stdexcept>
@@ -33,6 +35,15 @@
 #include "cfg_printer.h"
 #include "cfg_transform.h"
 #include "live_vregs.h"
+#include "alias_analysis.h"
+#include "mod_ref_analysis.h"
+#include "function_attr_inference.h"
+#include "loop_unswitch.h"
+#include "loop_rotation.h"
+#include "jump_threading.h"
+#include "superblock_formation.h"
+#include "software_prefetch.h"
+#include "modulo_scheduling.h"
 
 //! HighLevelOpt is responsible for doing optimizations
 //! on the high-level IR for a Function.
@@ -41,6 +52,12 @@ private:
   // command line options
   const Options &m_options;
 
+  // points-to information, mod/ref summaries, and inferred attributes
+  // for all of the functions in the unit
+  const AliasAnalysis &m_alias_analysis;
+  const ModRefAnalysis &m_mod_ref;
+  const FunctionAttrInference &m_function_attrs;
+
   // helper functions can use this to access the Function
   std::shared_ptr<Function> m_function;
 
@@ -51,7 +68,10 @@ private:
 public:
   //! Constructor.
   //! @param options Reference to the command-line Options
-  HighLevelOpt(const Options &options);
+  //! @param alias_analysis the (executed) AliasAnalysis of the unit
+  //! @param mod_ref the (executed) ModRefAnalysis of the unit
+  //! @param function_attrs the (executed) FunctionAttrInference of the unit
+  HighLevelOpt(const Options &options, const AliasAnalysis &alias_analysis, const ModRefAnalysis &mod_ref, const FunctionAttrInference &function_attrs);
   ~HighLevelOpt();
 
   //! Optimize the high-level IR for given Function.
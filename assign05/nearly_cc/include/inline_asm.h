@@ -0,0 +1,148 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef INLINE_ASM_H
+#define INLINE_ASM_H
+
+#include <string>
+#include <vector>
+#include "lowlevel.h"
+
+//! @file
+//! Support for GCC-style extended inline assembly statements.
+
+//! The properties of an inline assembly statement, which the high-level
+//! and low-level `asm` instructions carry along with their operands.
+//! The instructions are opaque to the optimizer: they are assumed to read
+//! and write any memory (i.e., every asm statement is volatile and
+//! clobbers "memory"), and the values of the outputs are stored in
+//! stack slots, from which the code following the statement loads them.
+//!
+//! Operands are numbered from 0 in the order they appear, outputs
+//! first, and the template refers to them as `%0`, `%1`, etc.
+//! The supported constraints are
+//!   - `r`: any register
+//!   - `a`, `b`, `c`, `d`, `S`, `D`: %rax, %rbx, %rcx, %rdx, %rsi, %rdi
+//!   - `m`: a memory operand
+//!   - `i`: an integer constant (inputs only)
+//!   - a digit: the register of the output with that number (inputs only)
+//!
+//! Outputs are written with `=` or (if they are also read) `+`, and
+//! may be marked early-clobber with `&` (which is always satisfied, since
+//! an input never shares the register of an output it isn't tied to.)
+//! In the template, `%%` is a literal `%`, and `%bN`, `%wN`, `%kN`,
+//! and `%qN` name the 8, 16, 32, and 64 bit variants of a register
+//! operand, while `%cN` is a constant operand without the `$`.
+class InlineAsm {
+public:
+  //! Kinds of operands.
+  enum Kind {
+    REG,
+    MEM,
+    IMM,
+  };
+
+  //! The constraint of an operand.
+  struct Constraint {
+    Kind kind;
+    bool is_output;
+    bool is_inout;  // an output whose value is also read ("+")
+    int mreg;       // the MachineReg a fixed register constraint names, or -1
+    int tied_to;    // the output an input shares a register with, or -1
+    int size;       // size in bytes of the operand's value
+  };
+
+  //! A part of the template: either literal text, or a reference
+  //! to an operand (with an optional modifier character).
+  struct Piece {
+    std::string text;
+    int operand;    // -1 for literal text
+    char modifier;  // 0 if there is none
+  };
+
+private:
+  std::vector<Piece> m_pieces;
+  std::vector<Constraint> m_constraints;
+  std::vector<MachineReg> m_clobbers;
+
+public:
+  //! Constructor.
+  //! @param asm_template the (valid) assembler template
+  //! @param constraints the constraints of the operands, outputs first
+  //! @param clobbers the registers the statement modifies (other than outputs)
+  InlineAsm(const std::string &asm_template, const std::vector<Constraint> &constraints,
+            const std::vector<MachineReg> &clobbers);
+  ~InlineAsm();
+
+  //! Get the parts of the template.
+  //! @return the template's Pieces
+  const std::vector<Piece> &get_pieces() const { return m_pieces; }
+
+  //! Get the number of operands.
+  //! @return the number of operands
+  unsigned get_num_operands() const { return unsigned(m_constraints.size()); }
+
+  //! Get the constraint of an operand.
+  //! @param index the operand number
+  //! @return the operand's Constraint
+  const Constraint &get_constraint(unsigned index) const { return m_constraints.at(index); }
+
+  //! Get the registers the statement modifies besides its outputs.
+  //! @return the clobbered registers
+  const std::vector<MachineReg> &get_clobbers() const { return m_clobbers; }
+
+  //! Check whether there are enough registers for the operands
+  //! needing one: those with a REG constraint which isn't a fixed or
+  //! tied register, and the MEM operands, whose address may have to be
+  //! loaded into a register.
+  //! @return true if there are enough registers, false if not
+  bool has_enough_regs() const;
+
+  //! Get the registers which operands with a non-fixed register
+  //! constraint can be assigned, in order of preference.
+  //! @return the assignable registers
+  static const std::vector<MachineReg> &get_assignable_regs();
+
+  //! Parse an operand constraint.
+  //! @param text the constraint string
+  //! @param is_output true if the operand is an output
+  //! @param constraint the Constraint to fill in (its size is set to 0)
+  //! @return true if the constraint is supported, false if not
+  static bool parse_constraint(const std::string &text, bool is_output, Constraint &constraint);
+
+  //! Parse a clobber. Besides register names (with or without `%`, of
+  //! any size), "memory" and "cc" are accepted; these don't add
+  //! anything, since every statement is assumed to access memory and
+  //! the condition codes are never live across a statement.
+  //! @param text the clobber string
+  //! @param clobbers the clobbered registers, to which the register is added
+  //! @return true if the clobber is valid, false if not
+  static bool parse_clobber(const std::string &text, std::vector<MachineReg> &clobbers);
+
+  //! Split a template into literal text and operand references.
+  //! @param text the template
+  //! @param num_operands the number of operands
+  //! @param pieces the resulting Pieces
+  //! @return true if the template is valid, false if it has a malformed
+  //!         operand reference or refers to a nonexistent operand
+  static bool parse_template(const std::string &text, unsigned num_operands, std::vector<Piece> &pieces);
+};
+
+#endif // INLINE_ASM_H
@@ -23,18 +23,37 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include "symtab.h"
 #include "operand.h"
+#include "location.h"
+
+class InlineAsm;
 
 //! Instruction object type.
 //! This is a traditional "quad"-style instruction representation.
 //! Can be used for either high-level or low-level code.
 class Instruction {
+public:
+  //! The direction a conditional branch is expected to go,
+  //! from a hint in the source code (such as `__builtin_expect`).
+  enum BranchHint {
+    //! no hint
+    HINT_NONE,
+    //! the branch is expected to be taken
+    HINT_TAKEN,
+    //! the branch is expected to fall through
+    HINT_NOT_TAKEN,
+  };
+
 private:
   int m_opcode;
   std::vector<Operand> m_operands;
   std::string m_comment;
   Symbol *m_symbol;
+  BranchHint m_branch_hint;
+  Location m_loc;
+  std::shared_ptr<InlineAsm> m_inline_asm;
 
 public:
   //! Contructor from opcode.
@@ -89,6 +108,12 @@ public:
   //! @param operand the value to copy to the specified Operand of the Instruction
   void set_operand(unsigned index, const Operand &operand);
 
+  //! Add an Operand after the existing Operands.
+  //! This is only needed for instructions (such as inline assembly)
+  //! which can have an arbitrary number of operands.
+  //! @param operand the Operand to add
+  void append_operand(const Operand &operand);
+
   //! Return a copy of the last (rightmost) Operand.
   //! @return a copy of the last (rightmost) Operand
   Operand get_last_operand() const;
@@ -122,6 +147,34 @@ public:
   //! @return a pointer to the symbol table entry (Symbol), or a null pointer
   //!         if the Instruction doesn't have a symbol table entry set
   Symbol *get_symbol() const { return m_symbol; }
+
+  //! Set the expected direction of a conditional branch.
+  //! @param hint the BranchHint
+  void set_branch_hint(BranchHint hint) { m_branch_hint = hint; }
+
+  //! Get the expected direction of a conditional branch.
+  //! @return the BranchHint (HINT_NONE if there is no hint)
+  BranchHint get_branch_hint() const { return m_branch_hint; }
+
+  //! Set the source Location this Instruction was generated from.
+  //! The Location is carried from the AST through high-level and
+  //! low-level code so that line table directives (`.loc`) can be
+  //! emitted in the generated assembly.
+  //! @param loc the source Location
+  void set_loc(const Location &loc) { m_loc = loc; }
+
+  //! Get the source Location this Instruction was generated from.
+  //! @return the source Location (invalid if none was set)
+  const Location &get_loc() const { return m_loc; }
+
+  //! Set the InlineAsm object describing the template, operand
+  //! constraints, and clobbers of an inline assembly instruction.
+  //! @param inline_asm the InlineAsm object
+  void set_inline_asm(std::shared_ptr<InlineAsm> inline_asm) { m_inline_asm = inline_asm; }
+
+  //! Get the InlineAsm object of an inline assembly instruction.
+  //! @return the InlineAsm object (null if this isn't an inline assembly instruction)
+  std::shared_ptr<InlineAsm> get_inline_asm() const { return m_inline_asm; }
 };
 
 #endif // INSTRUCTION_H
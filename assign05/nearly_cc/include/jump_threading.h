@@ -0,0 +1,81 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef JUMP_THREADING_H
+#define JUMP_THREADING_H
+
+#include <memory>
+#include "cfg.h"
+#include "loop_info.h"
+
+//! @file
+//! Jump threading of high-level code.
+
+//! JumpThreading finds edges into a basic block ending in a conditional
+//! jump along which the outcome of the jump is already known, and routes
+//! them straight to the known successor. The block (without its
+//! conditional jump) is duplicated for the edge, followed by a jump to
+//! the successor.
+//!
+//! The outcome is known along an edge from a predecessor block if
+//!   - the condition is a constant, computed in the predecessor and the
+//!     block from constants only, or
+//!   - the condition is the predecessor's branch condition, or is
+//!     computed the same way from the same values (e.g. a chain of tests
+//!     on the same comparison)
+//!
+//! Code growth is bounded: only blocks up to a maximum size are
+//! duplicated, and the copies together may only add a limited fraction
+//! of the function's code. Edges into loop headers aren't threaded
+//! (that would create loops with more than one entry).
+class JumpThreading {
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  int m_budget;
+  int m_num_copies;
+
+  // no value semantics
+  JumpThreading(const JumpThreading &);
+  JumpThreading &operator=(const JumpThreading &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  JumpThreading(std::shared_ptr<ControlFlowGraph> cfg);
+  ~JumpThreading();
+
+  //! Thread the jumps of the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+  //! Find out whether the conditional jump ending the target of an edge
+  //! is known to be taken when the target is entered through the edge.
+  //! @param edge an Edge of a high-level ControlFlowGraph
+  //! @return 1 if the jump is taken, 0 if it isn't, and -1 if the
+  //!         outcome isn't known
+  static int get_known_outcome(const Edge *edge);
+
+private:
+  std::shared_ptr<InstructionSequence> thread_one(std::shared_ptr<InstructionSequence> iseq);
+  std::shared_ptr<InstructionSequence> thread(std::shared_ptr<InstructionSequence> iseq, const Edge *edge,
+                                              bool taken, unsigned insert_at);
+};
+
+#endif // JUMP_THREADING_H
@@ -21,6 +21,7 @@
 #ifndef LOCAL_STORAGE_ALLOCATION_H
 #define LOCAL_STORAGE_ALLOCATION_H
 
+#include <set>
 #include "storage.h"
 #include "ast_visitor.h"
 #include "function.h"
@@ -48,6 +49,7 @@ private:
   StorageCalculator m_storage_calc;
   unsigned m_total_local_storage;
   int m_next_vreg;
+  std::set<Symbol *> m_address_taken;
 
 public:
   LocalStorageAllocation();
@@ -77,7 +79,9 @@ public:
   // TODO: override any other AST visitor member functions you need to
 
 private:
-  // TODO: add private member functions
+  void find_address_taken(Node *n);
+  void allocate_asm_slots(Node *n);
+  bool needs_memory(Symbol *s);
 };
 
 #endif // LOCAL_STORAGE_ALLOCATION_H
@@ -0,0 +1,136 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef LOOP_INFO_H
+#define LOOP_INFO_H
+
+#include <vector>
+#include <set>
+#include <memory>
+#include "cfg.h"
+
+//! @file
+//! Dominators and natural loops of a ControlFlowGraph.
+
+//! LoopInfo computes the dominator tree of a ControlFlowGraph
+//! (high-level or low-level) and finds its natural loops.
+//! All back edges to the same header are merged into a single loop.
+class LoopInfo {
+public:
+  //! A natural loop.
+  struct Loop {
+    //! the loop header, which dominates every block in the loop
+    std::shared_ptr<InstructionSequence> header;
+
+    //! ids of the blocks in the loop (including the header)
+    std::set<unsigned> blocks;
+
+    //! blocks in the loop with a back edge to the header
+    ControlFlowGraph::BlockList latches;
+
+    //! index of the immediately enclosing loop, or -1 if there is none
+    int parent;
+
+    //! loop nesting depth (1 for an outermost loop)
+    unsigned depth;
+
+    //! true if no other loop is nested in this one
+    bool innermost;
+
+    //! Check whether a basic block is part of the loop.
+    //! @param bb the basic block
+    //! @return true if bb is in the loop
+    bool contains(std::shared_ptr<InstructionSequence> bb) const {
+      return blocks.count(bb->get_block_id()) > 0;
+    }
+  };
+
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  ControlFlowGraph::BlockList m_blocks;   // indexed by block id
+  ControlFlowGraph::BlockList m_rpo;      // reachable blocks, reverse postorder
+  std::vector<int> m_rpo_index;           // block id -> index in m_rpo, or -1
+  std::vector<int> m_idom;                // block id -> immediate dominator id, or -1
+  std::vector<Loop> m_loops;              // enclosing loops precede nested loops
+  std::vector<int> m_block_loop;          // block id -> innermost loop index, or -1
+
+  // no value semantics
+  LoopInfo(const LoopInfo &);
+  LoopInfo &operator=(const LoopInfo &);
+
+public:
+  //! Constructor.
+  //! @param cfg the ControlFlowGraph to analyze
+  LoopInfo(std::shared_ptr<ControlFlowGraph> cfg);
+  ~LoopInfo();
+
+  //! Compute dominators and find loops.
+  void execute();
+
+  //! Get the reachable basic blocks in reverse postorder.
+  //! Ignoring back edges, every block appears after all of its
+  //! predecessors.
+  //! @return the reachable basic blocks in reverse postorder
+  const ControlFlowGraph::BlockList &get_reverse_postorder() const { return m_rpo; }
+
+  //! Check whether one basic block dominates another.
+  //! A block dominates itself. Unreachable blocks are dominated by
+  //! nothing and dominate nothing.
+  //! @param a a basic block
+  //! @param b another basic block
+  //! @return true if every path from the entry block to b goes through a
+  bool dominates(std::shared_ptr<InstructionSequence> a, std::shared_ptr<InstructionSequence> b) const;
+
+  //! Get the immediate dominator of a basic block.
+  //! @param bb the basic block
+  //! @return the immediate dominator, or nullptr for the entry block
+  //!         and for unreachable blocks
+  std::shared_ptr<InstructionSequence> get_idom(std::shared_ptr<InstructionSequence> bb) const;
+
+  //! Get all of the natural loops, with enclosing loops preceding
+  //! the loops nested in them.
+  //! @return the natural loops
+  const std::vector<Loop> &get_loops() const { return m_loops; }
+
+  //! Get the innermost loop containing a basic block.
+  //! @param bb the basic block
+  //! @return index of the innermost loop containing bb, or -1 if
+  //!         bb is not in a loop
+  int get_loop_index(std::shared_ptr<InstructionSequence> bb) const;
+
+  //! Get the loop nesting depth of a basic block.
+  //! @param bb the basic block
+  //! @return number of loops containing bb (0 if it is not in a loop)
+  unsigned get_loop_depth(std::shared_ptr<InstructionSequence> bb) const;
+
+  //! Check whether an edge is a loop back edge (its target
+  //! dominates its source).
+  //! @param edge the Edge
+  //! @return true if edge is a back edge
+  bool is_back_edge(const Edge *edge) const;
+
+private:
+  void compute_reverse_postorder();
+  void compute_dominators();
+  void find_loops();
+  int intersect(int a, int b) const;
+};
+
+#endif // LOOP_INFO_H
@@ -0,0 +1,70 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef LOOP_ROTATION_H
+#define LOOP_ROTATION_H
+
+#include <memory>
+#include "cfg.h"
+#include "loop_info.h"
+
+//! @file
+//! Loop rotation of high-level code.
+
+//! LoopRotation converts top-tested loops into bottom-tested loops.
+//! The high-level code generator emits `while` and `for` loops with the
+//! test in the header and an unconditional jump back to it at the end, so
+//! every iteration executes two branches. After rotation, the test is
+//! duplicated: a copy before the loop (the guard) skips the loop if it
+//! doesn't execute at all, and a copy at the end (the single latch)
+//! branches back to the start of the body while the test holds.
+//!
+//! The guard falls through to an otherwise empty preheader block, which
+//! is the only block outside the loop that enters it. This gives later
+//! loop passes (such as LiveRangeSplit) a place for code executed once
+//! before the loop.
+//!
+//! Only loops laid out the way the high-level code generator emits them
+//! are rotated, and only if the header (the test) is a single basic block
+//! of at most a maximum size.
+class LoopRotation {
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+
+  // no value semantics
+  LoopRotation(const LoopRotation &);
+  LoopRotation &operator=(const LoopRotation &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  LoopRotation(std::shared_ptr<ControlFlowGraph> cfg);
+  ~LoopRotation();
+
+  //! Rotate the loops of the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+private:
+  std::shared_ptr<InstructionSequence> rotate_one(std::shared_ptr<InstructionSequence> iseq);
+  std::shared_ptr<InstructionSequence> rotate(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned header_end, unsigned end);
+};
+
+#endif // LOOP_ROTATION_H
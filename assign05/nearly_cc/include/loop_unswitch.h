@@ -0,0 +1,76 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef LOOP_UNSWITCH_H
+#define LOOP_UNSWITCH_H
+
+#include <vector>
+#include <set>
+#include <string>
+#include <memory>
+#include "cfg.h"
+#include "loop_info.h"
+
+//! @file
+//! Loop unswitching of high-level code.
+
+//! LoopUnswitch moves a loop-invariant conditional branch out of a loop.
+//! The condition is computed once, before the loop, and selects one of
+//! two copies of the loop: in each copy, the branch is replaced by the
+//! outcome it always has there (an unconditional jump, or nothing).
+//!
+//! Only loops laid out the way the high-level code generator emits
+//! `while` and `for` loops are unswitched: their blocks are contiguous,
+//! they end with the jump back to the top, and the header is only entered
+//! by falling through from the block before it. The condition must be
+//! computed (in the same basic block as the branch) from values which
+//! aren't modified by the loop, using arithmetic which can't trap.
+//!
+//! Code growth is bounded: only loops up to a maximum size are unswitched,
+//! all copies together may only add a limited fraction of the function's
+//! code, and a loop is unswitched at most MAX_UNSWITCH_LEVEL times
+//! (yielding at most 2^MAX_UNSWITCH_LEVEL versions of it).
+class LoopUnswitch {
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  int m_budget;
+  int m_num_copies;
+
+  // no value semantics
+  LoopUnswitch(const LoopUnswitch &);
+  LoopUnswitch &operator=(const LoopUnswitch &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  LoopUnswitch(std::shared_ptr<ControlFlowGraph> cfg);
+  ~LoopUnswitch();
+
+  //! Unswitch the loops of the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+private:
+  std::shared_ptr<InstructionSequence> unswitch_one(std::shared_ptr<InstructionSequence> iseq, std::set<std::string> &unswitched);
+  std::shared_ptr<InstructionSequence> unswitch(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned end,
+                                                unsigned branch, const std::vector<unsigned> &slice, const std::string &suffix);
+};
+
+#endif // LOOP_UNSWITCH_H
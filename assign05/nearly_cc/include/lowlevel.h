@@ -126,6 +126,10 @@ enum LowLevelOpcode {
   MINS_SETGE,
   MINS_SETE,
   MINS_SETNE,
+  MINS_ANDB,
+  MINS_ANDW,
+  MINS_ANDL,
+  MINS_ANDQ,
   MINS_XORB,
   MINS_XORW,
   MINS_XORL,
@@ -138,6 +142,33 @@ enum LowLevelOpcode {
   MINS_DECW,
   MINS_DECL,
   MINS_DECQ,
+  MINS_POPCNTL,
+  MINS_POPCNTQ,
+  MINS_LZCNTL,
+  MINS_LZCNTQ,
+  MINS_TZCNTL,
+  MINS_TZCNTQ,
+  MINS_BSWAPL,
+  MINS_BSWAPQ,
+  MINS_PREFETCHNTA, // these are in the order of the temporal locality (0-3)
+  MINS_PREFETCHT2,
+  MINS_PREFETCHT1,
+  MINS_PREFETCHT0,
+  MINS_UD2,
+  MINS_LOCK_XADDB,
+  MINS_LOCK_XADDW,
+  MINS_LOCK_XADDL,
+  MINS_LOCK_XADDQ,
+  MINS_XCHGB, // an exchange with memory is locked without a prefix
+  MINS_XCHGW,
+  MINS_XCHGL,
+  MINS_XCHGQ,
+  MINS_LOCK_CMPXCHGB,
+  MINS_LOCK_CMPXCHGW,
+  MINS_LOCK_CMPXCHGL,
+  MINS_LOCK_CMPXCHGQ,
+  MINS_MFENCE,
+  MINS_ASM, // inline assembly (the Instruction has an InlineAsm object)
 };
 
 //! Convert a LowLevelOpcode to a string containing its assembler mnemonic.
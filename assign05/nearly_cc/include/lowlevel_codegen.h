@@ -21,6 +21,7 @@
 #ifndef LOWLEVEL_CODEGEN_H
 #define LOWLEVEL_CODEGEN_H
 
+#include <map>
 #include <memory>
 #include "options.h"
 #include "operand.h"
@@ -45,6 +46,20 @@ private:
   std::vector<MachineReg> m_spare_regs = {MREG_R9, MREG_R8, MREG_RCX, MREG_RDX, MREG_RSI, MREG_RDI};
   int m_spare_reg = 0;
 
+  //! A virtual register whose only definition is cheap enough to recompute
+  //! at each use (an integer constant, a string constant label, or the
+  //! address of a local variable), so its stack slot is never written.
+  //! `value` is the immediate, immediate label, or `%rbp`-relative memory
+  //! reference the register holds; `def_size` is the size of the definition.
+  struct RematInfo {
+    int def_size;
+    Operand value;
+  };
+  std::map<int, RematInfo> m_remat;
+  std::vector<MachineReg> m_remat_regs = {MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+  int m_remat_reg = 0;
+  int m_bit_loop_num = 0;
+
 public:
   LowLevelCodeGen(const Options &options);
   virtual ~LowLevelCodeGen();
@@ -59,6 +74,13 @@ private:
   std::shared_ptr<InstructionSequence> translate_hl_to_ll(std::shared_ptr<InstructionSequence> hl_iseq);
   void translate_instruction(Instruction *hl_ins, std::shared_ptr<InstructionSequence> ll_iseq);
   Operand get_ll_operand(Operand hl_opcode, int size, std::shared_ptr<InstructionSequence> ll_iseq);
+  void find_remat_candidates(std::shared_ptr<InstructionSequence> hl_iseq);
+  std::vector<MachineReg> get_saved_regs() const;
+  Operand rematerialize(const RematInfo &remat, Operand hl_opcode, int size, std::shared_ptr<InstructionSequence> ll_iseq);
+  void translate_bit_loop(HighLevelOpcode hl_opcode, Operand value, Operand count, std::shared_ptr<InstructionSequence> ll_iseq);
+  void translate_inline_asm(Instruction *hl_ins, std::shared_ptr<InstructionSequence> ll_iseq);
+  void translate_atomic(Instruction *hl_ins, std::shared_ptr<InstructionSequence> ll_iseq);
+  Operand get_asm_slot(Operand hl_operand, MachineReg addr_reg, std::shared_ptr<InstructionSequence> ll_iseq);
 };
 
 #endif // LOWLEVEL_CODEGEN_H
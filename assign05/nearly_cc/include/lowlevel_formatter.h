@@ -40,6 +40,9 @@ public:
   //! @param ins the low-level Instruction to format
   //! @return the string formatted from the Instruction
   virtual std::string format_instruction(const Instruction *ins) const;
+
+private:
+  std::string format_inline_asm(const Instruction *ins) const;
 };
 
 #endif // LOWLEVEL_FORMATTER_H
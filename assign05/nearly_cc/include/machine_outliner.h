@@ -0,0 +1,108 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef MACHINE_OUTLINER_H
+#define MACHINE_OUTLINER_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include "instruction_seq.h"
+#include "function.h"
+
+//! @file
+//! Outlining of repeated low-level code.
+
+//! MachineOutliner reduces code size by replacing sequences of low-level
+//! instructions which occur several times in the unit with calls to a
+//! single copy of the sequence, placed in a new (local) function ending
+//! with `ret`.
+//!
+//! The instructions of all of the functions are numbered so that equal
+//! instructions get the same number, and the repeated sequences are found
+//! with a suffix tree over the numbers (truncated at the length of the
+//! longest sequence outlined). A sequence is outlined if the bytes of its
+//! copies exceed the bytes of the calls replacing them plus the outlined
+//! function; the most profitable sequences are outlined first.
+//!
+//! Only sequences within a basic block that are safe to execute with the
+//! return address pushed are outlined: they don't refer to %rsp, and
+//! don't push, pop, call, return, or branch. (The code generator only
+//! addresses the stack frame through %rbp, and nothing is stored below
+//! %rsp.) The condition codes are preserved by `call` and `ret`, so a
+//! sequence may end with a comparison used by a branch after it.
+//!
+//! Only cold code is outlined: blocks which BlockFrequency estimates to
+//! execute at most once per call of their function (so no loops).
+class MachineOutliner {
+private:
+  // an instruction of the unit
+  struct Position {
+    unsigned function;   // index of the function (in m_functions)
+    unsigned index;      // index of the instruction in the function's code
+  };
+
+  // a node of the suffix tree: a sequence of instruction numbers,
+  // and the positions (in m_positions) where it starts
+  struct Node {
+    std::map<int, unsigned> children;
+    std::vector<unsigned> starts;
+    unsigned length;
+  };
+
+  std::vector<std::shared_ptr<Function> > m_functions;
+  std::vector<Position> m_positions;
+  std::vector<int> m_numbers;           // instruction number of each position, or -1
+  std::vector<bool> m_labeled;          // is a label defined at each position?
+  std::vector<unsigned> m_sizes;        // estimated size (in bytes) at each position
+  std::vector<Node> m_nodes;
+  std::vector<std::shared_ptr<Function> > m_new_functions;
+
+  // no value semantics
+  MachineOutliner(const MachineOutliner &);
+  MachineOutliner &operator=(const MachineOutliner &);
+
+public:
+  //! Constructor.
+  //! @param functions all of the Functions of the unit, with their
+  //!                  low-level code generated
+  MachineOutliner(const std::vector<std::shared_ptr<Function> > &functions);
+  ~MachineOutliner();
+
+  //! Outline the repeated sequences.
+  void execute();
+
+  //! Get the outlined functions created by execute().
+  //! They need to be added to the unit.
+  //! @return the new Functions
+  const std::vector<std::shared_ptr<Function> > &get_new_functions() const { return m_new_functions; }
+
+private:
+  void number_instructions();
+  void build_suffix_tree();
+  std::vector<unsigned> select_starts(const Node &node, const std::vector<bool> &outlined) const;
+  long get_benefit(const Node &node, unsigned num_starts) const;
+  void rewrite(const std::map<unsigned, std::pair<unsigned, std::string> > &calls);
+  static bool is_outlinable(Instruction *ins);
+  static unsigned estimate_size(Instruction *ins);
+};
+
+#endif // MACHINE_OUTLINER_H
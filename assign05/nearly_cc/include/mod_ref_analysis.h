@@ -0,0 +1,107 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef MOD_REF_ANALYSIS_H
+#define MOD_REF_ANALYSIS_H
+
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <memory>
+#include "operand.h"
+#include "instruction.h"
+#include "function.h"
+#include "alias_analysis.h"
+
+//! @file
+//! Interprocedural mod/ref summaries of high-level code.
+
+//! ModRefAnalysis summarizes, for each Function of a unit, which memory
+//! it (or anything it calls) may read and write, as object classes of
+//! an AliasAnalysis. A function's own local variables that no other
+//! function can access are left out of its summary.
+//! Summaries are propagated bottom-up over the call graph (iterating
+//! to a fixed point, so recursion is handled).
+class ModRefAnalysis {
+public:
+  //! Memory effects of a function.
+  struct Summary {
+    //! object classes the function may write
+    std::set<int> mod;
+
+    //! object classes the function may read
+    std::set<int> ref;
+
+    //! true if the function may also read and write any escaped object
+    //! (because it calls a function outside the unit)
+    bool unknown_effects;
+  };
+
+private:
+  std::vector<std::shared_ptr<Function> > m_functions;
+  const AliasAnalysis &m_alias_analysis;
+  std::map<std::string, unsigned> m_function_by_name;
+  std::vector<Summary> m_summaries;
+
+  // no value semantics
+  ModRefAnalysis(const ModRefAnalysis &);
+  ModRefAnalysis &operator=(const ModRefAnalysis &);
+
+public:
+  //! Constructor.
+  //! @param functions all of the Functions of the unit, with their
+  //!                  high-level code generated
+  //! @param alias_analysis the (executed) AliasAnalysis of the unit
+  ModRefAnalysis(const std::vector<std::shared_ptr<Function> > &functions, const AliasAnalysis &alias_analysis);
+  ~ModRefAnalysis();
+
+  //! Compute the summaries.
+  void execute();
+
+  //! Get the summary of a function defined in the unit.
+  //! @param fn_name the name of the function
+  //! @return pointer to the Summary, or nullptr if the function is
+  //!         not defined in the unit
+  const Summary *get_summary(const std::string &fn_name) const;
+
+  //! Check whether a call may write memory accessed through
+  //! a memory operand.
+  //! @param fn the Function containing the call
+  //! @param call the call instruction
+  //! @param mem a memory operand in fn's high-level code
+  //! @return true if the callee may write the memory mem refers to
+  bool may_mod(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem) const;
+
+  //! Check whether a call may read memory accessed through
+  //! a memory operand.
+  //! @param fn the Function containing the call
+  //! @param call the call instruction
+  //! @param mem a memory operand in fn's high-level code
+  //! @return true if the callee may read the memory mem refers to
+  bool may_ref(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem) const;
+
+private:
+  void find_direct_effects(unsigned fn_index);
+  bool add_callee_effects(unsigned fn_index, const Summary &callee);
+  bool may_access(std::shared_ptr<Function> fn, Instruction *call, const Operand &mem, bool is_write) const;
+};
+
+#endif // MOD_REF_ANALYSIS_H
@@ -0,0 +1,149 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef MODULO_SCHEDULING_H
+#define MODULO_SCHEDULING_H
+
+#include <vector>
+#include <utility>
+#include <set>
+#include <string>
+#include <memory>
+#include "cfg.h"
+#include "function.h"
+#include "alias_analysis.h"
+#include "live_vregs.h"
+
+//! @file
+//! Software pipelining (iterative modulo scheduling) of high-level code.
+
+//! ModuloScheduling overlaps the iterations of counted loops whose body
+//! is a single basic block (such as a rotated `for` loop over an array),
+//! so that an iteration doesn't have to wait for the latencies of the
+//! previous one before its own loads and arithmetic can start.
+//!
+//! The body is scheduled with Rau's iterative modulo scheduling: a new
+//! iteration starts every II ("initiation interval") cycles, and an
+//! instruction scheduled at time t runs in stage t / II of its iteration.
+//! The latencies and the functional units used by each instruction come
+//! from a simple model of an x86-64 core. The smallest II allowed by the
+//! units and by the recurrences through registers and memory is tried
+//! first, and II is increased until a schedule is found whose register
+//! pressure (the number of values live at the same time) stays within
+//! the registers available for keeping them.
+//!
+//! The pipelined loop is a prologue, which starts the first iterations,
+//! a kernel, which runs one stage of each of the iterations in flight,
+//! and an epilogue, which finishes the last ones. Values that live longer
+//! than II cycles get one vreg per stage, copied along at the end of each
+//! stage (modulo variable expansion). The pipelined loop only runs if the
+//! loop will execute at least as many iterations as there are stages;
+//! otherwise, the original loop runs.
+//!
+//! Only loops counted by an induction variable (incremented by a constant
+//! each iteration, and compared with a loop-invariant value to decide
+//! whether the loop continues) are pipelined. Accesses to objects the
+//! AliasAnalysis proves distinct are independent, and so are accesses
+//! through the same pointer (or into the same local array) at offsets
+//! that move with the induction variable and never overlap.
+class ModuloScheduling {
+private:
+  // a dependence of an instruction of the loop body on another, which
+  // must issue at least `latency` cycles earlier, `distance` iterations
+  // before (0 for the same iteration); `value` is true if the
+  // instruction uses the vreg the other one assigns
+  struct Dependence {
+    unsigned from, to;
+    int latency;
+    int distance;
+    bool value;
+  };
+
+  // an instruction of the loop body
+  struct Op {
+    Instruction *ins;                                   // the original instruction
+    int def_vreg;                                       // vreg it assigns, or -1
+    int latency;                                        // cycles until its result is available
+    std::vector<std::pair<int, int> > reservations;     // (cycle after issue, functional unit) pairs
+    bool carried;                                       // its value is used by the next iteration
+  };
+
+  // a single-block loop being pipelined
+  struct Loop {
+    std::vector<Op> ops;
+    std::vector<Dependence> deps;
+    unsigned compare;             // the op deciding whether the loop continues
+    int num_invariants;           // number of loop-invariant vregs used
+
+    // the comparison checks iv_vreg (at the start of the iteration) plus
+    // iv_offset against limit, and iv_vreg increases by iv_step in each
+    // iteration; guard_opcode is the comparison (of compare_size bytes)
+    // which is true if the loop continues
+    int iv_vreg;
+    long iv_step;
+    long iv_offset;
+    Operand limit;
+    int compare_size;
+    int guard_opcode;
+
+    std::vector<int> time;        // issue time of each op
+    int ii;                       // initiation interval
+    int num_stages;
+
+    // vregs holding the value each op assigns, in the iteration in its
+    // stage and (if the value lives longer) in the iterations before it
+    std::vector<std::vector<int> > names;
+  };
+
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  std::shared_ptr<Function> m_function;
+  const AliasAnalysis &m_alias_analysis;
+  std::set<std::string> m_visited;
+  int m_num_loops;
+
+  // no value semantics
+  ModuloScheduling(const ModuloScheduling &);
+  ModuloScheduling &operator=(const ModuloScheduling &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  //! @param function the Function the ControlFlowGraph belongs to
+  //! @param alias_analysis the (executed) AliasAnalysis of the unit
+  ModuloScheduling(std::shared_ptr<ControlFlowGraph> cfg, std::shared_ptr<Function> function, const AliasAnalysis &alias_analysis);
+  ~ModuloScheduling();
+
+  //! Pipeline the loops of the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+private:
+  std::shared_ptr<InstructionSequence> pipeline_one(std::shared_ptr<InstructionSequence> iseq);
+  bool analyze(Loop &loop, Instruction *branch);
+  bool schedule(Loop &loop, int ii);
+  std::shared_ptr<InstructionSequence> pipeline(std::shared_ptr<InstructionSequence> iseq, unsigned begin, unsigned end,
+                                                Loop &loop, const LiveVregs::FactType &live_out);
+  void emit_stages(std::shared_ptr<InstructionSequence> result, const Loop &loop, int first_stage, int last_stage, int init_stage);
+  Instruction *rename(const Loop &loop, unsigned index) const;
+  static int get_reaching_def(const Loop &loop, unsigned index, int vreg, int &distance);
+  static int get_max_live(const Loop &loop);
+};
+
+#endif // MODULO_SCHEDULING_H
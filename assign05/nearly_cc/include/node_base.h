@@ -51,6 +51,7 @@ private:
   int m_ru;
   StringConstant m_str_const;
   bool m_has_str_const;
+  int m_asm_slot;
 
 public:
   NodeBase();
@@ -71,6 +72,9 @@ public:
   StringConstant get_str_const() {return m_str_const;}
   bool has_str_const() {return m_has_str_const;}
   void add_str_const(StringConstant str_const) {m_str_const=str_const; m_has_str_const = true;}
+  // offset of the local storage an asm operand is passed through (-1 if none)
+  void set_asm_slot(int offset) {m_asm_slot = offset;}
+  int get_asm_slot() {return m_asm_slot;}
 
 };
 
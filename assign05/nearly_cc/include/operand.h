@@ -66,6 +66,8 @@ public:
     MREG64_MEM_IDX,  // memref using mreg ptr+index       (%rax,%rsi)
     MREG64_MEM_OFF,  // memref using mreg ptr+imm offset  8(%rax)
     MREG64_MEM_IDX_SCALE, // memref mreg ptr+(index*scale) (%r13,%r9,4)
+    LABEL_MEM_FS,    // memref %fs+label+imm offset       %fs:x@tpoff+8
+    LABEL_MEM_RIP,   // memref %rip+label                 x@gottpoff(%rip)
 
     // Immediate integer operands (used for both high-level and
     // low-level code)
@@ -104,10 +106,11 @@ public:
   //! @param scale the scaling factor (must be 1, 2, 4, or 8)
   Operand(Kind kind, int basereg, int indexreg, int scale);
 
-  //! Constructor for label or immediate label operands.
+  //! Constructor for label, immediate label, or label memref operands.
   //! @param kind the operand Kind
   //! @param label the label
-  Operand(Kind kind, const std::string &label);
+  //! @param offset the offset (only for LABEL_MEM_FS operands)
+  Operand(Kind kind, const std::string &label, long offset = 0);
 
   ~Operand();
 
@@ -165,7 +168,8 @@ public:
   bool has_imm_ival() const;
 
   //! Does the operand have a label?
-  //! (Either because it is a label, or is an immediate label.)
+  //! (Either because it is a label, an immediate label, or a memory
+  //! reference at a label.)
   //! @return true if the operand has a label, false otherwise
   bool has_label() const;
 
@@ -57,9 +57,14 @@ public:
   static constexpr const char *PRINT_AST      = "-p";
   static constexpr const char *PRINT_SYMTAB   = "-a";
   static constexpr const char *OPTIMIZE       = "-o";
+  static constexpr const char *OPTIMIZE_SIZE  = "-s";
   static constexpr const char *PRINT_CFG      = "-C";
   static constexpr const char *HIGHLEVEL      = "-h";
   static constexpr const char *PRINT_DATAFLOW = "-D";
+  static constexpr const char *BISON_PARSER   = "-B";
+  static constexpr const char *BASELINE_ISA   = "-m";
+  static constexpr const char *PREFETCH       = "-P";
+  static constexpr const char *LINE_TABLES    = "-g";
 
   Options();
   ~Options();
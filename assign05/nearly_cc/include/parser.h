@@ -0,0 +1,144 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <string>
+#include <vector>
+#include "location.h"
+class Node;
+struct ParserState;
+
+//! @file
+//! Hand-written recursive descent parser.
+
+//! Recursive descent parser building the same AST as the
+//! bison grammar in parse_buildast.y. Expressions are parsed
+//! using precedence climbing. Tokens are read into a small
+//! lookahead buffer, and a Node is only allocated for a token
+//! when it becomes part of the AST (so punctuation such as
+//! parentheses, braces, and semicolons never gets a Node.)
+//!
+//! If lazy body parsing is enabled, function bodies are first only
+//! skimmed by brace matching, and their tokens are saved. Once the
+//! whole unit has been read, only the bodies of functions that are
+//! exported (not static) or referenced from another parsed body are
+//! actually parsed; definitions of the remaining functions are
+//! dropped from the AST, so semantic analysis and code generation
+//! never see them. Since the saved tokens keep their source
+//! positions, diagnostics from a lazily parsed body are the same
+//! as if it had been parsed immediately.
+class Parser {
+private:
+  //! A token read from the lexer. Only the line and column are
+  //! kept, since every token comes from the same source file.
+  struct Token {
+    int tag;
+    std::string lexeme;
+    int line, col;
+  };
+
+  //! A function definition whose body was skimmed but not yet parsed.
+  struct DeferredBody {
+    Node *fn_def;              // AST_FUNCTION_DEFINITION with no body yet
+    bool is_static;
+    bool needed;
+    std::vector<Token> tokens; // from the opening to the closing brace
+  };
+
+  // The grammar never needs to look more than this many tokens ahead
+  static const unsigned MAX_LOOKAHEAD = 4;
+
+  ParserState *m_pp;
+  std::string m_srcfile;
+  Token m_lookahead[MAX_LOOKAHEAD];
+  unsigned m_head, m_count;
+
+  bool m_lazy_bodies;
+  std::vector<DeferredBody> m_deferred;
+
+  // when non-null, tokens are read from here rather than from the lexer
+  const std::vector<Token> *m_replay;
+  unsigned m_replay_pos;
+
+  // value semantics prohibited
+  Parser(const Parser &);
+  Parser &operator=(const Parser &);
+
+public:
+  //! Constructor.
+  //! @param pp the ParserState, whose lexer must be initialized
+  //! @param lazy_bodies true if function bodies should be parsed lazily
+  Parser(ParserState *pp, bool lazy_bodies = false);
+  ~Parser();
+
+  //! Parse the entire translation unit.
+  //! @return the root of the AST (an AST_UNIT node)
+  Node *parse();
+
+private:
+  // Token buffer access
+  const Token &peek(unsigned k = 0);
+  bool at(int tag, unsigned k = 0) { return peek(k).tag == tag; }
+  Token next();
+  void read_token(Token &tok);
+  Token expect(int tag);
+  [[noreturn]] void syntax_error();
+  Location token_loc(const Token &tok) const;
+  Node *token_node(const Token &tok);
+
+  // Declarations
+  Node *parse_top_level_declaration();
+  Node *parse_function_or_variable_declaration(bool is_static);
+  Node *parse_simple_variable_declaration();
+  Node *finish_variable_declaration(Node *type);
+  Node *finish_function(Node *type, bool is_static);
+  Node *parse_function_body();
+  void skim_function_body(DeferredBody &deferred);
+  void parse_deferred_bodies();
+  Node *parse_declarator_list();
+  Node *parse_declarator();
+  Node *parse_function_parameter_list();
+  Node *parse_type();
+  Node *parse_struct_or_union_definition();
+  Node *parse_storage_class();
+  Node *apply_storage_class(Node *storage, Node *decl);
+  bool at_type_start(unsigned k = 0);
+  bool at_storage_class();
+
+  // Statements
+  Node *parse_statement();
+  Node *parse_statement_list();
+  Node *parse_asm_statement();
+  Node *parse_asm_operand_list();
+
+  // Expressions
+  Node *parse_assignment_expression();
+  Node *parse_conditional_expression(Node *cond);
+  Node *parse_binary_expression(Node *lhs, int min_prec);
+  Node *parse_cast_expression();
+  Node *parse_unary_expression();
+  Node *parse_postfix_expression();
+  Node *parse_primary_expression();
+  bool at_cast();
+};
+
+#endif // PARSER_H
@@ -22,6 +22,7 @@
 #define PARSER_STATE_H
 
 #include <vector>
+#include <string>
 #include "location.h"
 class Node;
 
@@ -41,7 +42,18 @@ struct ParserState {
   // into the tree built by the parser.
   std::vector<Node *> tokens;
 
-  ParserState() : scan_info(nullptr), parse_tree(nullptr) { }
+  // If true, the lexer does not create a Node for each token.
+  // Instead, the lexeme and position of the most recently scanned
+  // token are left in last_lexeme, last_line, and last_col, and
+  // the (recursive descent) parser creates Nodes only for the
+  // tokens that become part of the AST.
+  bool lazy_tokens;
+  std::string last_lexeme;
+  int last_line, last_col;
+
+  ParserState()
+    : scan_info(nullptr), parse_tree(nullptr)
+    , lazy_tokens(false), last_line(0), last_col(0) { }
 };
 
 #endif // PARSER_STATE_H
@@ -21,6 +21,8 @@
 #ifndef PRINT_INSTRUCTION_SEQ_H
 #define PRINT_INSTRUCTION_SEQ_H
 
+#include <vector>
+#include <string>
 #include "instruction.h"
 #include "instruction_seq.h"
 
@@ -44,18 +46,30 @@ class PrintInstructionSequence {
 private:
   Formatter m_formatter;
   Annotator m_annotator;
+  bool m_emit_locs;
+  std::vector<std::vector<std::string> > m_directives;
 
 public:
   PrintInstructionSequence(Formatter formatter = Formatter(), Annotator annotator = Annotator());
   ~PrintInstructionSequence();
 
+  // Emit a .loc directive (for file number 1) before each instruction
+  // whose source Location differs from the previous one.
+  void set_emit_locs(bool emit_locs) { m_emit_locs = emit_locs; }
+
+  // Assembler directives (such as call-frame information) to print
+  // before each instruction (and its label), indexed by the position of
+  // the instruction.
+  void set_directives(const std::vector<std::vector<std::string> > &directives) { m_directives = directives; }
+
   void print(std::shared_ptr<InstructionSequence> iseq);
 };
 
 template<typename Formatter, typename Annotator>
 PrintInstructionSequence<Formatter, Annotator>::PrintInstructionSequence(Formatter formatter, Annotator annotator)
   : m_formatter(formatter)
-  , m_annotator(annotator) {
+  , m_annotator(annotator)
+  , m_emit_locs(false) {
 }
 
 template<typename Formatter, typename Annotator>
@@ -64,12 +78,31 @@ PrintInstructionSequence<Formatter, Annotator>::~PrintInstructionSequence() {
 
 template<typename Formatter, typename Annotator>
 void PrintInstructionSequence<Formatter, Annotator>::print(std::shared_ptr<InstructionSequence> iseq) {
-  for (auto i = iseq->cbegin(); i != iseq->cend(); i++) {
+  Location last_loc;
+  unsigned index = 0;
+  for (auto i = iseq->cbegin(); i != iseq->cend(); i++, index++) {
+    // the directives describe the effect of the previous instruction
+    // (or the state reached by a jump), so they go right after it,
+    // before the label and .loc of this one
+    if (index < m_directives.size()) {
+      for (auto j = m_directives[index].begin(); j != m_directives[index].end(); ++j)
+        printf("\t%s\n", j->c_str());
+    }
+
     // print label if there is one
     if (i.has_label()) {
       printf("%s:\n", i.get_label().c_str());
     }
 
+    // instructions without a Location are attributed to the
+    // previous instruction's line
+    const Location &loc = (*i)->get_loc();
+    if (m_emit_locs && loc.is_valid()
+        && (loc.get_line() != last_loc.get_line() || loc.get_col() != last_loc.get_col())) {
+      printf("\t.loc 1 %d %d\n", loc.get_line(), loc.get_col());
+      last_loc = loc;
+    }
+
     // print formatted instruction
     std::string formatted_ins = m_formatter.format_instruction(*i);
     printf("\t%s", formatted_ins.c_str());
@@ -28,6 +28,7 @@
 #include "options.h"
 #include "symtab.h"
 #include "ast_visitor.h"
+#include "builtins.h"
 
 enum class SymbolKind;
 
@@ -36,9 +37,24 @@ public:
   typedef std::vector<SymbolTable *> SymbolTableList;
 
 private:
+  // A function body whose analysis is deferred until all
+  // file-scope declarations have been processed
+  struct DeferredBody {
+    Node *fn_def;
+    SymbolTable *fn_symtab;
+    unsigned symtab_pos;  // where the body's block scopes go in m_all_symtabs
+    unsigned num_globals; // global entries declared before the definition
+  };
+
   const Options &m_options;
   SymbolTable *m_global_symtab, *m_cur_symtab;
   SymbolTableList m_all_symtabs;
+  unsigned m_num_visible_globals;
+
+  // Constructor for a worker analyzing a single function body.
+  // The global symbol table is shared (and must not be modified),
+  // while every scope the worker creates is recorded in its own list.
+  SemanticAnalysis(const SemanticAnalysis &parent, const DeferredBody &body);
 
 public:
   SemanticAnalysis(const Options &options);
@@ -50,6 +66,13 @@ public:
   SymbolTableList::const_iterator symtab_cbegin() const { return m_all_symtabs.cbegin(); }
   SymbolTableList::const_iterator symtab_cend() const { return m_all_symtabs.cend(); }
 
+  //! Analyze the translation unit in two phases: file-scope declarations
+  //! (structs, globals, prototypes, function signatures) are processed
+  //! sequentially, then function bodies are type-checked in parallel,
+  //! each with its own scope chain rooted at the (now read-only)
+  //! global symbol table.
+  virtual void visit_unit(Node *n);
+
   virtual void visit_struct_type(Node *n);
   virtual void visit_union_type(Node *n);
   virtual void visit_variable_declaration(Node *n);
@@ -63,6 +86,7 @@ public:
   virtual void visit_function_parameter(Node *n);
   virtual void visit_statement_list(Node *n);
   virtual void visit_return_expression_statement(Node *n);
+  virtual void visit_asm_statement(Node *n);
   virtual void visit_struct_type_definition(Node *n);
   virtual void visit_binary_expression(Node *n);
   virtual void visit_unary_expression(Node *n);
@@ -86,7 +110,34 @@ private:
   void leave_scope();
 
   // TODO: add helper functions
+  //! Look up a name starting from the current scope. Globals declared
+  //! after the function being analyzed are not visible.
+  //! @param name the name to look up
+  //! @return the Symbol, or nullptr if the name is not visible
+  Symbol *lookup(const std::string &name) const;
+
   SymbolTable* find_symbol_table_by_name(const std::string& name);
+
+  //! Type-check the statements of a function definition whose
+  //! signature has already been processed.
+  //! @param n the AST_FUNCTION_DEFINITION node
+  //! @param fn_symtab the function's parameter scope
+  void analyze_function_body(Node *n, SymbolTable *fn_symtab);
+
+  //! Analyze the deferred function bodies (in parallel when
+  //! there is more than one), then splice the scopes they created
+  //! into m_all_symtabs in source order.
+  void analyze_deferred_bodies(const std::vector<DeferredBody> &bodies);
+
+  //! Type-check a call to a builtin function.
+  //! @param n the AST_FUNCTION_CALL_EXPRESSION node
+  //! @param builtin the called Builtin
+  void visit_builtin_call(Node *n, const Builtin &builtin);
+
+  //! Type-check a call to an atomic builtin function.
+  //! @param n the AST_FUNCTION_CALL_EXPRESSION node
+  //! @param builtin the called Builtin
+  void visit_atomic_builtin_call(Node *n, const Builtin &builtin);
 };
 
 void test_assignment(Node* n, std::shared_ptr<Type> lhs, std::shared_ptr<Type> rhs);
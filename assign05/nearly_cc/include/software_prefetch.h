@@ -0,0 +1,120 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOFTWARE_PREFETCH_H
+#define SOFTWARE_PREFETCH_H
+
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include "cfg.h"
+#include "loop_info.h"
+#include "block_frequency.h"
+#include "function_attr_inference.h"
+
+//! @file
+//! Software prefetch insertion for strided loops.
+
+//! SoftwarePrefetch inserts `prefetch` instructions (prefetcht0) for
+//! the memory accesses of innermost loops whose addresses advance by
+//! a constant stride in each iteration, such as `a[i]` (or `a[i * 16]`)
+//! in a loop counted by `i`, or `*p` in a loop incrementing `p`.
+//!
+//! An induction variable is a vreg whose definitions in the loop each
+//! add a constant to it, in blocks executed in every iteration (which
+//! dominate the latches). The address of an access is found by
+//! evaluating the code of its basic block symbolically, as a
+//! loop-invariant base plus a multiple of an induction variable plus a
+//! constant; the stride is the multiple times the induction variable's
+//! step.
+//!
+//! A prefetch is issued enough iterations ahead of the access to hide
+//! the memory latency, estimated from the number of instructions in an
+//! iteration (weighted with the BlockFrequency of their blocks), and at
+//! least a cache line ahead. Accesses with the same base and stride
+//! whose offsets are less than a cache line apart share a single
+//! prefetch. If the stride is less than a cache line, the prefetch is
+//! skipped unless its address is the first one in a new cache line, so
+//! each line is prefetched once.
+class SoftwarePrefetch {
+public:
+  //! Memory latency (in cycles) hidden if no other is specified.
+  static const int DEFAULT_LATENCY = 200;
+
+private:
+  // a value of the form base + coef * iv + offset, where base is a vreg
+  // which doesn't change in the loop (or -1), and iv is the value of a
+  // vreg at the start of the basic block (or -1)
+  struct Affine {
+    bool known;
+    int base;
+    int iv;
+    long coef;
+    long offset;
+  };
+
+  // a memory access of a loop with a constant stride
+  struct Access {
+    unsigned index;   // index of the accessing instruction
+    int addr_vreg;    // vreg holding the address
+    long addr_offset; // constant offset of the memory reference
+    Affine address;
+    long stride;
+  };
+
+  // the code of a prefetch, which jumps to the skip label (if it has
+  // one) in the iterations not prefetching a new cache line
+  struct Prefetch {
+    std::vector<Instruction *> code;
+    std::string skip_label;
+  };
+
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  const FunctionAttrInference &m_function_attrs;
+  int m_latency;
+
+  // no value semantics
+  SoftwarePrefetch(const SoftwarePrefetch &);
+  SoftwarePrefetch &operator=(const SoftwarePrefetch &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  //! @param function_attrs the (executed) FunctionAttrInference of the unit
+  //! @param latency the memory latency (in cycles) to prefetch ahead of,
+  //!                or 0 to not insert prefetches
+  SoftwarePrefetch(std::shared_ptr<ControlFlowGraph> cfg, const FunctionAttrInference &function_attrs, int latency);
+  ~SoftwarePrefetch();
+
+  //! Insert prefetches into the loops of the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+private:
+  void find_accesses(std::shared_ptr<ControlFlowGraph> cfg, const LoopInfo &loop_info, const LoopInfo::Loop &loop,
+                     std::vector<Access> &accesses);
+  int get_distance(std::shared_ptr<ControlFlowGraph> cfg, const BlockFrequency &block_frequency, const LoopInfo::Loop &loop) const;
+  static Affine evaluate(Instruction *ins, const std::map<int, Affine> &values, const std::set<int> &loop_defs);
+  static Affine get_value(const Operand &operand, const std::map<int, Affine> &values, const std::set<int> &loop_defs);
+};
+
+#endif // SOFTWARE_PREFETCH_H
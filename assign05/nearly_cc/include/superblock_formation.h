@@ -0,0 +1,82 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SUPERBLOCK_FORMATION_H
+#define SUPERBLOCK_FORMATION_H
+
+#include <memory>
+#include <vector>
+#include "cfg.h"
+#include "function_attr_inference.h"
+
+//! @file
+//! Superblock formation of high-level code.
+
+//! SuperblockFormation enlarges the straight-line regions seen by the
+//! block-local optimizations (LVN, InstCombine) by tail duplication.
+//! For a join block, it picks the predecessor on the likely trace, and
+//! gives it its own copy of the join block, so the trace through the
+//! join has no side entrance:
+//!   - if the predecessor ends with a jump to the join block, the jump is
+//!     replaced by a copy of the block
+//!   - if the predecessor falls through into the join block, the other
+//!     predecessors are redirected to a copy of the block
+//!
+//! In both cases, the join block's code becomes part of the same basic
+//! block as the predecessor's.
+//!
+//! The likely trace is chosen using the static edge frequencies of
+//! BlockFrequency.
+//!
+//! Code growth is bounded: only blocks up to a maximum size are
+//! duplicated, and the copies together may only add a limited fraction
+//! of the function's code. Copies are never copied again, and a join
+//! is only duplicated along an edge with a nonzero frequency. Loop
+//! headers, and blocks with a loop back edge, aren't duplicated (so loops
+//! keep a single entry and latch), and neither is the function epilogue.
+class SuperblockFormation {
+private:
+  std::shared_ptr<ControlFlowGraph> m_cfg;
+  const FunctionAttrInference &m_function_attrs;
+  int m_budget;
+  int m_num_copies;
+  std::vector<bool> m_is_copy; // instruction index -> whether it was copied by this pass
+
+  // no value semantics
+  SuperblockFormation(const SuperblockFormation &);
+  SuperblockFormation &operator=(const SuperblockFormation &);
+
+public:
+  //! Constructor.
+  //! @param cfg a high-level ControlFlowGraph
+  //! @param function_attrs the (executed) FunctionAttrInference of the unit
+  SuperblockFormation(std::shared_ptr<ControlFlowGraph> cfg, const FunctionAttrInference &function_attrs);
+  ~SuperblockFormation();
+
+  //! Form superblocks in the ControlFlowGraph.
+  //! @return the transformed ControlFlowGraph
+  std::shared_ptr<ControlFlowGraph> transform_cfg();
+
+private:
+  std::shared_ptr<InstructionSequence> duplicate_one(std::shared_ptr<InstructionSequence> iseq);
+  std::shared_ptr<InstructionSequence> duplicate_tail(std::shared_ptr<InstructionSequence> iseq, const Edge *edge, unsigned insert_at);
+};
+
+#endif // SUPERBLOCK_FORMATION_H
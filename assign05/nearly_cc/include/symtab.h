@@ -36,6 +36,12 @@ enum class SymbolKind {
   TYPE,
 };
 
+enum class StorageClass {
+  UNSPECIFIED,
+  STATIC,
+  EXTERN,
+};
+
 class Symbol {
 private:
   SymbolKind m_kind;
@@ -45,6 +51,8 @@ private:
   SymbolTable *m_kid_symtab;
   int m_reg = -1;
   int m_al = -1;
+  StorageClass m_storage = StorageClass::UNSPECIFIED;
+  bool m_is_thread_local = false;
 
   // value semantics prohibited
   Symbol(const Symbol &);
@@ -64,6 +72,10 @@ public:
   void set_reg(int reg) {m_reg = reg;};
   int get_al() {return m_al;};
   void set_al(int al) {m_al = al;};
+  StorageClass get_storage() const {return m_storage;};
+  void set_storage(StorageClass storage) {m_storage = storage;};
+  bool is_thread_local() const {return m_is_thread_local;};
+  void set_thread_local(bool is_thread_local) {m_is_thread_local = is_thread_local;};
 };
 
 class SymbolTable {
@@ -110,6 +122,9 @@ public:
   // function parameters.
   Symbol *get_entry(unsigned index) const;
 
+  // Get the position of a symbol table entry (the inverse of get_entry)
+  unsigned get_entry_index(const Symbol *sym) const;
+
   // For a symbol table representing a function declaration or definition,
   // return the number of parameters
   unsigned get_num_parameters() const;
@@ -0,0 +1,74 @@
+// bit-manipulation builtins and branch/prefetch hints
+//
+// expected output (one number per line):
+// 8 4 31 55 5 56 1 72057594037927936 192 84 42 -1 -1 0 1
+
+void print_i32(int n);
+void print_i64(long n);
+void print_nl(void);
+
+int count_bits(int n) {
+  int i, total;
+  total = 0;
+  for (i = 0; i < n; i = i + 1) {
+    total = total + __builtin_popcount(i);
+  }
+  return total;
+}
+
+long sum_array(long *arr, int n) {
+  int i;
+  long sum;
+  sum = 0L;
+  for (i = 0; i < n; i = i + 1) {
+    __builtin_prefetch(arr + i + 8, 0, 3);
+    sum = sum + arr[i];
+  }
+  return sum;
+}
+
+int checked_scale(int a, int b) {
+  if (__builtin_expect(b == 0, 0))
+    return -1;
+  return a * b;
+}
+
+int sign(int x) {
+  int s;
+  s = 0;
+  if (x > 0)
+    s = 1;
+  if (x < 0)
+    s = -1;
+  if (x > 1000000)
+    __builtin_unreachable();
+  return s;
+}
+
+int main(void) {
+  long arr[16];
+  int i;
+
+  print_i32(__builtin_popcount(255)); print_nl();
+  print_i32(__builtin_popcountl(0x100000000000007L)); print_nl();
+  print_i32(__builtin_clz(1)); print_nl();
+  print_i32(__builtin_clzl(256L)); print_nl();
+  print_i32(__builtin_ctz(96)); print_nl();
+  print_i32(__builtin_ctzll(0x100000000000000L)); print_nl();
+  print_i32(__builtin_bswap32(16777216)); print_nl();
+  print_i64(__builtin_bswap64(1L)); print_nl();
+  print_i32(count_bits(64)); print_nl();
+
+  for (i = 0; i < 16; i = i + 1) {
+    arr[i] = i * 3;
+  }
+  __builtin_prefetch(arr, 0x1, 0x2);
+  print_i64(sum_array(arr, 8)); print_nl();
+
+  print_i32(checked_scale(7, 6)); print_nl();
+  print_i32(checked_scale(42, 0)); print_nl();
+  print_i32(sign(-5)); print_nl();
+  print_i32(sign(0)); print_nl();
+  print_i32(sign(9)); print_nl();
+  return 0;
+}
@@ -0,0 +1,91 @@
+// GCC-style inline assembly statements
+//
+// expected output (one number per line):
+// 42 42 42 42 77 15 99 45 92 65
+
+void print_i32(int n);
+void print_nl(void);
+
+int add(int a, int b) {
+  int r;
+  asm("movl %1, %0\n\taddl %2, %0" : "=r"(r) : "r"(a), "r"(b));
+  return r;
+}
+
+int twice(int x) {
+  int y;
+  y = x;
+  asm("addl %0, %0" : "+r"(y));
+  return y;
+}
+
+int tied(int x) {
+  int y;
+  asm("imull $3, %0" : "=r"(y) : "0"(x));
+  return y;
+}
+
+int offset(int x) {
+  int y;
+  asm("leal %c2(%1), %0" : "=r"(y) : "r"(x), "i"(0x11));
+  return y;
+}
+
+int from_memory(int x) {
+  int y;
+  int arr[4];
+  arr[2] = x;
+  asm("movl %1, %0" : "=r"(y) : "m"(arr[2]));
+  asm("" : : : "memory");
+  return y;
+}
+
+int clobbers(int x) {
+  int y;
+  asm("movl %1, %%ebx\n\tleal 5(%%rbx), %0" : "=r"(y) : "r"(x) : "rbx", "cc");
+  return y;
+}
+
+int store(int *p, int v) {
+  asm("movl %1, %0" : "=m"(*p) : "r"(v));
+  return 0;
+}
+
+int spin(int n) {
+  int i, s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    asm volatile("pause");
+    s = s + i;
+  }
+  return s;
+}
+
+int fixed_regs(int a, int b) {
+  int q, r;
+  asm("cltd\n\tidivl %3" : "=a"(q), "=d"(r) : "a"(a), "c"(b));
+  return q * 10 + r;
+}
+
+char low_byte(long v) {
+  char c;
+  asm("movb %b1, %0" : "=r"(c) : "r"(v));
+  return c;
+}
+
+int main(void) {
+  int w;
+
+  print_i32(add(40, 2)); print_nl();
+  print_i32(twice(21)); print_nl();
+  print_i32(tied(14)); print_nl();
+  print_i32(offset(25)); print_nl();
+  print_i32(from_memory(77)); print_nl();
+  print_i32(clobbers(10)); print_nl();
+  store(&w, 99);
+  print_i32(w); print_nl();
+  print_i32(spin(10)); print_nl();
+  print_i32(fixed_regs(47, 5)); print_nl();
+  print_i32(low_byte(65 + 256)); print_nl();
+  return 0;
+}
@@ -0,0 +1,78 @@
+// atomic builtins (the memory orders are the values of gcc's
+// __ATOMIC_RELAXED through __ATOMIC_SEQ_CST, 0 to 5)
+//
+// expected output (one number per line):
+// 10 15 12 12 110 1 0 7 9 5000000001 42 17 3 127 29999 4 3 100 11 0
+
+void print_i32(int n);
+void print_i64(long n);
+void print_nl(void);
+
+int count_up(int n) {
+  int c, i;
+  c = 0;
+  for (i = 0; i < n; i = i + 1) {
+    __sync_fetch_and_add(&c, 2);
+  }
+  return c;
+}
+
+int locked_add(int *lock, int *total, int n) {
+  int result;
+  while (__sync_lock_test_and_set(lock, 1) != 0) {
+  }
+  *total = *total + n;
+  result = *total;
+  __sync_lock_release(lock);
+  return result;
+}
+
+int main(void) {
+  int x, old, ok, lock, total;
+  long y;
+  char c;
+  short s;
+  int arr[4];
+
+  x = 10;
+  old = __sync_fetch_and_add(&x, 5);
+  print_i32(old); print_nl();
+  print_i32(x); print_nl();
+  print_i32(__sync_sub_and_fetch(&x, 3)); print_nl();
+  print_i32(__sync_fetch_and_sub(&x, 2)); print_nl();
+  print_i32(__sync_add_and_fetch(&x, 100)); print_nl();
+
+  ok = __sync_bool_compare_and_swap(&x, 110, 7);
+  print_i32(ok); print_nl();
+  ok = __sync_bool_compare_and_swap(&x, 110, 8);
+  print_i32(ok); print_nl();
+  print_i32(__sync_val_compare_and_swap(&x, 7, 9)); print_nl();
+  print_i32(x); print_nl();
+  __sync_synchronize();
+
+  y = 5000000000L;
+  print_i64(__atomic_add_fetch(&y, 1L, 5)); print_nl();
+  __atomic_store_n(&y, 42L, 3);
+  print_i64(__atomic_load_n(&y, 0x2)); print_nl();
+  __atomic_store_n(&x, 17, 0x5);
+  print_i32(__atomic_exchange_n(&x, 3, 4)); print_nl();
+  print_i32(x); print_nl();
+
+  // narrow operands use the byte and word forms of the instructions
+  c = 120;
+  __atomic_fetch_add(&c, 7, 0);
+  print_i32(c); print_nl();
+  s = 30000;
+  print_i32(__atomic_sub_fetch(&s, 1, 5)); print_nl();
+  arr[2] = 4;
+  print_i32(__atomic_fetch_sub(&arr[2], 1, 5)); print_nl();
+  print_i32(arr[2]); print_nl();
+
+  print_i32(count_up(50)); print_nl();
+  lock = 0;
+  total = 0;
+  locked_add(&lock, &total, 5);
+  print_i32(locked_add(&lock, &total, 6)); print_nl();
+  print_i32(lock); print_nl();
+  return 0;
+}
@@ -0,0 +1,55 @@
+// thread-local global variables
+//
+// expected output (one number per line):
+// 0 10 15 55 1015 15 30 45
+
+void print_i32(int n);
+void print_i64(long n);
+void print_nl(void);
+
+__thread int counter;
+static __thread long total;
+_Thread_local int hist[4];
+
+int bump(int n) {
+  int i;
+  long li;
+  for (i = 0; i < n; i = i + 1) {
+    counter = counter + 1;
+    li = i;
+    total = total + li;
+    hist[0] = hist[0] + 1;
+    hist[2] = hist[2] + 2;
+    hist[3] = hist[3] + 3;
+  }
+  return counter;
+}
+
+int add_through_pointer(int n) {
+  int *p;
+  p = &counter;
+  *p = *p + n;
+  return counter;
+}
+
+long get_total(void) {
+  return total;
+}
+
+int get_hist(int i) {
+  return hist[i];
+}
+
+int main(void) {
+  int r;
+  r = 0;
+  print_i32(counter); print_nl();
+  print_i32(bump(10)); print_nl();
+  print_i32(bump(5)); print_nl();
+  print_i64(get_total()); print_nl();
+  print_i32(add_through_pointer(1000)); print_nl();
+  print_i32(get_hist(0)); print_nl();
+  print_i32(get_hist(2)); print_nl();
+  print_i32(get_hist(3)); print_nl();
+  return r;
+}
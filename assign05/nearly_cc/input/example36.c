@@ -0,0 +1,55 @@
+// address-taken locals that can live in registers: the address
+// is only dereferenced locally, or only passed to callees
+//
+// expected output (one number per line):
+// 45 350 46 205 3
+
+void print_i32(int n);
+void print_nl(void);
+
+void set(int *p, int v) {
+  *p = v;
+}
+
+int get(int *p) {
+  return *p;
+}
+
+void bump(int *p) {
+  *p = *p + 100;
+}
+
+int sum_through_pointer(int n) {
+  int s, i;
+  int *p;
+  p = &s;
+  *p = 0;
+  for (i = 0; i < n; i = i + 1) {
+    *p = *p + i;
+  }
+  return s;
+}
+
+int main(void) {
+  int x, y, z, i, s;
+
+  print_i32(sum_through_pointer(10)); print_nl();
+
+  s = 0;
+  x = 1;
+  for (i = 0; i < 10; i = i + 1) {
+    set(&x, x + i);
+    s = s + x + x;
+  }
+  print_i32(s); print_nl();
+  print_i32(get(&x)); print_nl();
+
+  y = 2;
+  z = 3;
+  bump(&y);
+  y = y + z;
+  bump(&y);
+  print_i32(y); print_nl();
+  print_i32(z); print_nl();
+  return 0;
+}
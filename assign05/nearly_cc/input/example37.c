@@ -0,0 +1,48 @@
+// loads and stores through pointers and into different arrays:
+// stored values can only be forwarded to later loads when the
+// accesses between them can't refer to the same memory
+//
+// expected output (one number per line):
+// 29 120 18 9
+
+void print_i64(long n);
+void print_nl(void);
+
+void fill(long *a, long n) {
+  long i;
+  i = 0;
+  while (i < n) {
+    a[i] = i * 3;
+    i = i + 1;
+  }
+}
+
+long sum2(long *p, long *q) {
+  long s;
+  s = *p;
+  *q = 100;
+  s = s + *p;
+  return s;
+}
+
+int main(void) {
+  long a[10];
+  long b[4];
+  long x;
+  long y;
+  long *p;
+
+  fill(a, 10);
+  b[0] = 5;
+  b[1] = a[2] + b[0];
+  x = a[3];
+  y = a[3] + b[1];
+  print_i64(x + y); print_nl();
+
+  p = &x;
+  *p = 9;
+  print_i64(sum2(&y, &y)); print_nl();
+  print_i64(sum2(p, &y)); print_nl();
+  print_i64(x); print_nl();
+  return 0;
+}
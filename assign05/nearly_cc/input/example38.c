@@ -0,0 +1,54 @@
+// calls only invalidate the memory their callees may write:
+// b[0] and c[0] stay known across calls that don't touch them
+//
+// expected output (one number per line):
+// 63 1 6 30
+
+void print_i64(long n);
+void print_nl(void);
+
+long get(long *a) {
+  return *a;
+}
+
+void put(long *a) {
+  *a = 1;
+}
+
+long sq(long v) {
+  long r;
+  r = v * v;
+  return r;
+}
+
+void add(long *a, long v) {
+  a[0] = a[0] + v;
+}
+
+int main(void) {
+  long a[4];
+  long b[4];
+  long s;
+  long c[2];
+  long t;
+
+  b[0] = 7;
+  put(a);
+  s = b[0];
+  t = sq(s);
+  s = s + b[0] + t;
+  a[0] = s;
+  print_i64(get(a)); print_nl();
+
+  put(b);
+  s = b[0];
+  print_i64(s); print_nl();
+
+  c[0] = 5;
+  add(b, 4);
+  add(c, s);
+  print_i64(c[0]); print_nl();
+  t = sq(c[0]);
+  print_i64(t + b[0] - c[0] - 5); print_nl();
+  return 0;
+}
@@ -0,0 +1,51 @@
+// calls to const and pure functions with the same arguments are
+// computed once, and code after a call to a function that never
+// returns is dropped
+//
+// expected output (one number per line, then exit status 4):
+// 50 8 10
+
+void print_i64(long n);
+void print_nl(void);
+void exit(int code);
+
+long sq(long v) {
+  return v * v;
+}
+
+long rd(long *p) {
+  return p[0];
+}
+
+void die(long c) {
+  exit(c);
+}
+
+int main(void) {
+  long a;
+  long x;
+  long y;
+  long g[2];
+
+  a = 5;
+  x = sq(a);
+  y = sq(a);
+  print_i64(x + y); print_nl();
+
+  g[0] = 4;
+  x = rd(g);
+  y = rd(g);
+  print_i64(x + y); print_nl();
+
+  g[0] = 6;
+  y = rd(g);
+  print_i64(x + y); print_nl();
+
+  if (x > 100) {
+    die(1);
+    print_i64(99);
+  }
+  die(x);
+  print_i64(77);
+  return 0;
+}
@@ -0,0 +1,48 @@
+// calls with constant arguments that decide a branch in the callee
+// go to copies of the callee specialized for those arguments
+//
+// expected output (one number per line):
+// 10 105 210 15 -3
+
+void print_i64(long n);
+void print_nl(void);
+
+long scale(long x, long mode) {
+  long r;
+  if (mode == 1) {
+    r = x * 2;
+  } else {
+    r = x + 100;
+  }
+  return r;
+}
+
+long sum_step(long n, long down) {
+  long i, s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    if (down) {
+      s = s - 1;
+    } else {
+      s = s + i;
+    }
+  }
+  return s;
+}
+
+int main(void) {
+  long a;
+  long s;
+
+  a = 5;
+  s = scale(a, 1);
+  print_i64(s); print_nl();
+  s = scale(a, 2);
+  print_i64(s); print_nl();
+  s = scale(s, 1);
+  print_i64(s); print_nl();
+
+  print_i64(sum_step(6, 0)); print_nl();
+  print_i64(sum_step(3, 1)); print_nl();
+  return 0;
+}
@@ -0,0 +1,53 @@
+// loops containing branches on values the loop doesn't change are
+// split into one copy of the loop per outcome of the branch
+//
+// expected output (one number per line):
+// 45 90 83
+
+void print_i64(long n);
+void print_nl(void);
+
+long sum(long n, long mode) {
+  long i;
+  long s;
+  s = 0;
+  i = 0;
+  while (i < n) {
+    if (mode == 1) {
+      s = s + i;
+    } else {
+      s = s + 2 * i;
+    }
+    i = i + 1;
+  }
+  return s;
+}
+
+int main(void) {
+  long modes[2];
+  long a;
+  long b;
+  long k;
+  long t;
+
+  modes[0] = 1;
+  modes[1] = 3;
+  a = sum(10, modes[0]);
+  b = sum(10, modes[1]);
+  print_i64(a); print_nl();
+  print_i64(b); print_nl();
+
+  t = 0;
+  for (k = 0; k < 5; k = k + 1) {
+    if (a > 40) {
+      t = t + k;
+    }
+    t = t * 2;
+    if (b > 100) {
+      t = t + 100;
+    }
+    t = t + 1;
+  }
+  print_i64(t); print_nl();
+  return 0;
+}
@@ -0,0 +1,44 @@
+// top-tested loops become bottom-tested loops behind a guard,
+// including loops that run zero times and nested loops
+//
+// expected output (one number per line):
+// -2 0 45 0 4
+
+void print_i32(int n);
+void print_nl(void);
+
+int count_down(int n) {
+  while (n > 0) {
+    n = n - 3;
+  }
+  return n;
+}
+
+int sum_to(int n) {
+  int i, s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    s = s + i;
+  }
+  return s;
+}
+
+int triangle(int n) {
+  int i, j, s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    for (j = 0; j < i; j = j + 1) {
+      s = s + j;
+    }
+  }
+  return s;
+}
+
+int main(void) {
+  print_i32(count_down(10)); print_nl();
+  print_i32(count_down(0)); print_nl();
+  print_i32(sum_to(10)); print_nl();
+  print_i32(sum_to(0)); print_nl();
+  print_i32(triangle(4)); print_nl();
+  return 0;
+}
@@ -0,0 +1,44 @@
+// branches whose outcome is already decided by an earlier branch
+// on the same path: the flag and the repeated x > 0 test are
+// resolved on each path through classify()
+//
+// expected output (one number per line):
+// 126 6 270
+
+void print_i64(long n);
+void print_nl(void);
+
+long classify(long x) {
+  long flag;
+  long r;
+  r = 0;
+  if (x > 0) {
+    flag = 1;
+  } else {
+    flag = 0;
+  }
+  r = r + 3;
+  if (flag) {
+    r = r + 10;
+  }
+  r = r * 2;
+  if (x > 0) {
+    r = r + 100;
+  }
+  return r;
+}
+
+int main(void) {
+  long x;
+  long s;
+
+  print_i64(classify(5)); print_nl();
+  print_i64(classify(0 - 5)); print_nl();
+
+  s = 0;
+  for (x = 0 - 2; x <= 2; x = x + 1) {
+    s = s + classify(x);
+  }
+  print_i64(s); print_nl();
+  return 0;
+}
@@ -0,0 +1,42 @@
+// arithmetic identities, constant chains and double negation
+// that instruction combining simplifies
+//
+// expected output (one number per line):
+// 90 36 15 -24
+
+void print_i64(long n);
+void print_nl(void);
+
+long f(long x, long y) {
+  long a;
+  long b;
+  a = x + 0;
+  a = a * 1;
+  b = (a + 3) + 4;
+  b = b - 2;
+  b = b + (y - y);
+  if (x == x) {
+    b = b * 2;
+  }
+  a = 0 + b;
+  a = -(-a);
+  return a * 3 + 0;
+}
+
+long g(long x) {
+  return ((x * 3) * 4) - 5 - 6 + x * 1 + (x - x);
+}
+
+int main(void) {
+  long v[4];
+
+  v[0] = 10;
+  v[1] = 7;
+  v[2] = 1;
+  v[3] = 2;
+  print_i64(f(v[0], v[1])); print_nl();
+  print_i64(f(v[2], v[3])); print_nl();
+  print_i64(g(v[3])); print_nl();
+  print_i64(g(0 - v[2])); print_nl();
+  return 0;
+}
@@ -0,0 +1,54 @@
+// join blocks after if/else statements are copied into the more
+// likely path through a function, so that it runs straight through
+//
+// expected output (one number per line):
+// 5713 16
+
+void print_i32(int n);
+void print_nl(void);
+
+int classify(int x) {
+  int r;
+  r = 0;
+  if (x < 10) {
+    r = 1;
+  } else {
+    r = 2;
+  }
+  r = r * 3;
+  if (x > 20) {
+    r = r + 100;
+  } else {
+    r = r + 200;
+  }
+  r = r + x;
+  if (x == 15) {
+    r = r - 1;
+  } else {
+    r = r + 1;
+  }
+  return r;
+}
+
+int clamp(int x) {
+  int r;
+  r = x;
+  if (x < 0) {
+    return 0;
+  } else {
+    r = r + 1;
+  }
+  r = r * 2;
+  return r;
+}
+
+int main(void) {
+  int i, t;
+  t = 0;
+  for (i = 0; i < 30; i = i + 1) {
+    t = t + classify(i);
+  }
+  print_i32(t); print_nl();
+  print_i32(clamp(-5) + clamp(7)); print_nl();
+  return 0;
+}
@@ -0,0 +1,46 @@
+// counted loops whose iterations are overlapped by software
+// pipelining, including trip counts too short for the pipelined loop
+//
+// expected output (one number per line):
+// 1998 2035 0 3 1998
+
+void print_i32(int n);
+void print_nl(void);
+
+int sum(int *a, int n) {
+  int i, s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    s = s + a[i];
+  }
+  return s;
+}
+
+int main(void) {
+  int a[40];
+  int b[40];
+  int i, n, s;
+  int t;
+  n = 37;
+  for (i = 0; i < n; i = i + 1) {
+    a[i] = i * 3;
+  }
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    s = s + a[i];
+  }
+  print_i32(s); print_nl();
+  for (i = 0; i < n; i = i + 1) {
+    b[i] = a[i] + 1;
+  }
+  t = 0;
+  for (i = 0; i < n; i = i + 1) {
+    t = t + b[i];
+  }
+  print_i32(t); print_nl();
+
+  print_i32(sum(a, 0)); print_nl();
+  print_i32(sum(a, 2)); print_nl();
+  print_i32(sum(a, n)); print_nl();
+  return 0;
+}
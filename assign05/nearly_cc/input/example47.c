@@ -0,0 +1,52 @@
+// branches whose likely direction is estimated statically: a null
+// pointer test leading to exit() is unlikely, loop branches are
+// likely, and __builtin_expect overrides the estimate; with -o the
+// join blocks are copied into the likelier paths
+//
+// expected output (one number per line):
+// 10 100 12
+
+void print_i32(int n);
+void print_nl(void);
+void exit(int n);
+
+int abs_sum(int *p, int n) {
+  int i;
+  int s;
+  if (p == 0)
+    exit(1);
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    if (p[i] < 0)
+      s = s - p[i];
+    else
+      s = s + p[i];
+  }
+  return s;
+}
+
+int adjust(int x) {
+  int r;
+  if (__builtin_expect(x > 100, 1)) {
+    r = x - 100;
+  } else {
+    r = x + 1;
+  }
+  r = r * 2;
+  return r;
+}
+
+int main(void) {
+  int a[4];
+  int v[2];
+  a[0] = 1;
+  a[1] = -2;
+  a[2] = 3;
+  a[3] = -4;
+  v[0] = 150;
+  v[1] = 5;
+  print_i32(abs_sum(a, 4)); print_nl();
+  print_i32(adjust(v[0])); print_nl();
+  print_i32(adjust(v[1])); print_nl();
+  return 0;
+}
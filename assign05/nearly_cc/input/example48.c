@@ -0,0 +1,58 @@
+// loops walking arrays with a constant stride: with -o, each
+// access gets a prefetch of the address it will use some
+// iterations later (addresses past the end are harmless, since
+// prefetches never fault)
+//
+// expected output (one number per line):
+// 499500 499500 249500
+
+void print_i32(int n);
+void print_nl(void);
+
+int sum(int *a, int n) {
+  int i;
+  int s;
+  s = 0;
+  i = 0;
+  while (i < n) {
+    s = s + a[i];
+    i = i + 1;
+  }
+  return s;
+}
+
+int sumdown(int *a, int n) {
+  int i;
+  int s;
+  s = 0;
+  i = n - 1;
+  while (i >= 0) {
+    s = s + a[i];
+    i = i - 1;
+  }
+  return s;
+}
+
+int sum_even(int *a, int n) {
+  int i;
+  int s;
+  s = 0;
+  for (i = 0; i < n; i = i + 2) {
+    s = s + a[i];
+  }
+  return s;
+}
+
+int main(void) {
+  int a[1000];
+  int i;
+  i = 0;
+  while (i < 1000) {
+    a[i] = i;
+    i = i + 1;
+  }
+  print_i32(sum(a, 1000)); print_nl();
+  print_i32(sumdown(a, 1000)); print_nl();
+  print_i32(sum_even(a, 1000)); print_nl();
+  return 0;
+}
@@ -0,0 +1,40 @@
+// straight-line code that repeats across functions: with -s, the
+// repeated instruction sequences are outlined into shared functions
+//
+// expected output (one number per line):
+// 52 63 54 18
+
+void print_i32(int n);
+void print_nl(void);
+
+int mix1(int a, int b) {
+  int t;
+  t = a * 3 + b;
+  t = t * 2 - a;
+  return t + 1;
+}
+
+int mix2(int a, int b) {
+  int t;
+  t = a * 3 + b;
+  t = t * 2 - a;
+  return t + 12;
+}
+
+int mix3(int a, int b) {
+  int t;
+  t = b * 3 + a;
+  t = t * 2 - b;
+  return t;
+}
+
+int main(void) {
+  int x, y;
+  x = 7;
+  y = 8;
+  print_i32(mix1(x, y)); print_nl();
+  print_i32(mix2(x, y)); print_nl();
+  print_i32(mix3(x, y)); print_nl();
+  print_i32(mix1(y, x) - mix2(x, x) + mix3(1, 2) + 12); print_nl();
+  return 0;
+}
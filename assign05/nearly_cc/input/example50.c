@@ -0,0 +1,32 @@
+// a loop and a call spread over several source lines: with -g, the
+// code of each statement is attributed to its line, e.g. the two
+// statements of the loop body in weigh() to lines 17 and 18, and
+// the first call to weigh() in main() to line 27
+//
+// expected output (one number per line):
+// 285 200
+
+void print_i32(int n);
+void print_nl(void);
+
+int weigh(int n, int w) {
+  int i, s;
+  s = 0;
+  i = 0;
+  while (i < n) {
+    s = s + i * w;
+    i = i + 1;
+  }
+  return s;
+}
+
+int main(void) {
+  int total;
+  total = 0;
+  total = total +
+          weigh(10,
+                3) + 150;
+  print_i32(total); print_nl();
+  print_i32(weigh(5, 20)); print_nl();
+  return 0;
+}
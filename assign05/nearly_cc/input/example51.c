@@ -0,0 +1,43 @@
+// functions with different frame shapes: a leaf, a recursive
+// function, and one keeping several values live across calls in
+// callee-saved registers (with -o); every function is bracketed by
+// .cfi_startproc/.cfi_endproc, and the .cfi directives in between
+// let a debugger or unwinder walk the stack at any instruction
+//
+// expected output (one number per line):
+// 720 55 441
+
+void print_i32(int n);
+void print_nl(void);
+
+int twice(int a) {
+  return a * 2;
+}
+
+int fact(int n) {
+  if (n <= 1)
+    return 1;
+  return n * fact(n - 1);
+}
+
+int fib(int n) {
+  if (n < 2)
+    return n;
+  return fib(n - 1) + fib(n - 2);
+}
+
+int spread(int a, int b, int c) {
+  int p, q, r, s;
+  p = twice(a);
+  q = twice(b);
+  r = twice(c);
+  s = twice(p + q + r);
+  return p + q + r + s + a * b * c;
+}
+
+int main(void) {
+  print_i32(fact(6)); print_nl();
+  print_i32(fib(10)); print_nl();
+  print_i32(spread(5, 7, 9)); print_nl();
+  return 0;
+}
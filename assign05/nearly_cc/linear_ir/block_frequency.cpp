@@ -0,0 +1,328 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include "highlevel.h"
+#include "highlevel_defuse.h"
+#include "lowlevel.h"
+#include "function.h"
+#include "function_attr_inference.h"
+#include "block_frequency.h"
+
+namespace {
+
+// Probabilities of the Ball–Larus heuristics predicting correctly,
+// as measured by Wu and Larus
+const double LOOP_BRANCH_PROBABILITY = 0.88;
+const double LOOP_HEADER_PROBABILITY = 0.75;
+const double CALL_PROBABILITY = 0.78;
+const double RETURN_PROBABILITY = 0.72;
+const double POINTER_PROBABILITY = 0.60;
+const double OPCODE_PROBABILITY = 0.84;
+
+// Probability of a path leading to a call to a noreturn function
+const double NORETURN_PROBABILITY = 1.0 / 1024;
+
+// Probability of the direction a branch hint expects
+// (the same as GCC's default for __builtin_expect)
+const double HINT_PROBABILITY = 0.9;
+
+// Loops are assumed to iterate at most this many times
+const double MAX_ITERATIONS = 1000.0;
+
+// Update the probability of an outcome with independent evidence
+// that its probability is p
+double combine(double probability, double p) {
+  double yes = probability * p, no = (1.0 - probability) * (1.0 - p);
+  return yes / (yes + no);
+}
+
+// Find the value of an operand used by the instruction at index in a
+// high-level basic block, if it is an integer constant (possibly
+// assigned to a vreg earlier in the block)
+bool get_constant(std::shared_ptr<InstructionSequence> bb, unsigned index, const Operand &operand, long &value) {
+  if (operand.get_kind() == Operand::IMM_IVAL) {
+    value = operand.get_imm_ival();
+    return true;
+  }
+  if (operand.get_kind() != Operand::VREG)
+    return false;
+  for (unsigned i = index; i > 0; --i) {
+    Instruction *ins = bb->get_instruction(i - 1);
+    if (!HighLevel::is_def(ins) || HighLevel::get_def_vreg(ins) != operand.get_base_reg())
+      continue;
+    int opcode = ins->get_opcode();
+    if (opcode < HINS_mov_b || opcode > HINS_mov_q || ins->get_operand(1).get_kind() != Operand::IMM_IVAL)
+      return false;
+    value = ins->get_operand(1).get_imm_ival();
+    return true;
+  }
+  return false;
+}
+
+}
+
+BlockFrequency::BlockFrequency(std::shared_ptr<ControlFlowGraph> cfg, bool highlevel, const FunctionAttrInference *function_attrs)
+  : m_cfg(cfg)
+  , m_highlevel(highlevel)
+  , m_function_attrs(function_attrs)
+  , m_loop_info(cfg) {
+}
+
+BlockFrequency::~BlockFrequency() {
+}
+
+void BlockFrequency::execute() {
+  m_loop_info.execute();
+
+  unsigned num_blocks = m_cfg->get_num_blocks();
+  m_frequency.assign(num_blocks, 0.0);
+  m_cyclic.assign(num_blocks, 0.0);
+  for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i)
+    compute_probabilities(*i);
+
+  // each loop (innermost first), then the whole function
+  const std::vector<LoopInfo::Loop> &loops = m_loop_info.get_loops();
+  for (auto i = loops.rbegin(); i != loops.rend(); ++i) {
+    std::vector<bool> region(num_blocks, false);
+    for (auto j = i->blocks.begin(); j != i->blocks.end(); ++j)
+      region[*j] = true;
+    propagate(i->header, region);
+  }
+  propagate(m_cfg->get_entry_block(), std::vector<bool>(num_blocks, true));
+}
+
+double BlockFrequency::get_probability(const Edge *edge) const {
+  auto i = m_probability.find(edge);
+  assert(i != m_probability.end());
+  return i->second;
+}
+
+double BlockFrequency::get_frequency(std::shared_ptr<InstructionSequence> bb) const {
+  return m_frequency.at(bb->get_block_id());
+}
+
+double BlockFrequency::get_frequency(const Edge *edge) const {
+  return get_frequency(edge->get_source()) * get_probability(edge);
+}
+
+// Predict the probabilities of the outgoing edges of a block
+void BlockFrequency::compute_probabilities(std::shared_ptr<InstructionSequence> bb) {
+  const ControlFlowGraph::EdgeList &outgoing_edges = m_cfg->get_outgoing_edges(bb);
+  if (outgoing_edges.size() != 2) {
+    for (auto i = outgoing_edges.cbegin(); i != outgoing_edges.cend(); ++i)
+      m_probability[*i] = 1.0 / outgoing_edges.size();
+    return;
+  }
+
+  // the probability of taking the first edge, updated by each heuristic
+  // which favors one of the edges
+  const Edge *first = outgoing_edges[0], *second = outgoing_edges[1];
+  double probability = 0.5;
+  auto apply = [&probability](bool first_likely, bool second_likely, double p) {
+    if (first_likely != second_likely)
+      probability = combine(probability, first_likely ? p : 1.0 - p);
+  };
+
+  apply(stays_in_loop(first), stays_in_loop(second), LOOP_BRANCH_PROBABILITY);
+  apply(enters_loop(bb, first->get_target()), enters_loop(bb, second->get_target()), LOOP_HEADER_PROBABILITY);
+  apply(!has_call(first->get_target()), !has_call(second->get_target()), CALL_PROBABILITY);
+  apply(!returns(first->get_target()), !returns(second->get_target()), RETURN_PROBABILITY);
+
+  // the prediction for a condition applies to the branch edge
+  // of cjmp_t, and to the fall-through edge of cjmp_f
+  Instruction *branch = bb->get_last_instruction();
+  double p;
+  if (predict_condition(bb, p)) {
+    bool first_if_true = (first->get_kind() == EDGE_BRANCH) == (branch->get_opcode() == HINS_cjmp_t);
+    probability = combine(probability, first_if_true ? p : 1.0 - p);
+  }
+
+  apply(!has_noreturn_call(first->get_target()), !has_noreturn_call(second->get_target()), 1.0 - NORETURN_PROBABILITY);
+
+  if (is_conditional_branch(branch) && branch->get_branch_hint() != Instruction::HINT_NONE) {
+    bool first_expected = (first->get_kind() == EDGE_BRANCH) == (branch->get_branch_hint() == Instruction::HINT_TAKEN);
+    probability = first_expected ? HINT_PROBABILITY : 1.0 - HINT_PROBABILITY;
+  }
+
+  m_probability[first] = probability;
+  m_probability[second] = 1.0 - probability;
+}
+
+// Apply the pointer and opcode heuristics to the comparison deciding
+// the conditional branch at the end of a high-level block.
+// Returns true (and the probability that the condition is true)
+// if one of them applies.
+bool BlockFrequency::predict_condition(std::shared_ptr<InstructionSequence> bb, double &probability) const {
+  Instruction *branch = bb->get_last_instruction();
+  if (!m_highlevel || (branch->get_opcode() != HINS_cjmp_t && branch->get_opcode() != HINS_cjmp_f)
+      || branch->get_operand(0).get_kind() != Operand::VREG)
+    return false;
+
+  // the comparison assigning the condition
+  int vreg = branch->get_operand(0).get_base_reg();
+  unsigned index = bb->get_length() - 1;
+  while (index > 0) {
+    Instruction *ins = bb->get_instruction(--index);
+    if (HighLevel::is_def(ins) && HighLevel::get_def_vreg(ins) == vreg)
+      break;
+  }
+  Instruction *cmp = bb->get_instruction(index);
+  int opcode = cmp->get_opcode();
+  if (index == bb->get_length() - 1 || !HighLevel::is_def(cmp) || HighLevel::get_def_vreg(cmp) != vreg
+      || opcode < HINS_cmplt_b || opcode > HINS_cmpneq_q)
+    return false;
+
+  // relations: <, <=, >, >=, ==, !=, with the constant on the right
+  const int SWAPPED[] = { 2, 3, 0, 1, 4, 5 };
+  int relation = (opcode - HINS_cmplt_b) / 4;
+  long value;
+  if (!get_constant(bb, index, cmp->get_operand(2), value)) {
+    if (!get_constant(bb, index, cmp->get_operand(1), value))
+      return false;
+    relation = SWAPPED[relation];
+  }
+
+  if (relation >= 4) {
+    // comparing a pointer with 0 is a null test; otherwise, a value
+    // is unlikely to be equal to a particular constant
+    bool null_test = value == 0 && highlevel_opcode_get_source_operand_size(HighLevelOpcode(opcode)) == 8;
+    double p = null_test ? POINTER_PROBABILITY : OPCODE_PROBABILITY;
+    probability = relation == 5 ? p : 1.0 - p;
+    return true;
+  }
+
+  // values are rarely negative
+  if (value != 0)
+    return false;
+  probability = relation >= 2 ? OPCODE_PROBABILITY : 1.0 - OPCODE_PROBABILITY;
+  return true;
+}
+
+bool BlockFrequency::is_call(Instruction *ins) const {
+  return m_highlevel ? HighLevelInstructionProperties().is_function_call(ins)
+                     : LowLevelInstructionProperties().is_function_call(ins);
+}
+
+bool BlockFrequency::is_conditional_branch(Instruction *ins) const {
+  int opcode = ins->get_opcode();
+  return m_highlevel ? (opcode == HINS_cjmp_t || opcode == HINS_cjmp_f)
+                     : (opcode >= MINS_JL && opcode <= MINS_JAE);
+}
+
+bool BlockFrequency::has_call(std::shared_ptr<InstructionSequence> bb) const {
+  for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+    if (is_call(*i))
+      return true;
+  }
+  return false;
+}
+
+bool BlockFrequency::has_noreturn_call(std::shared_ptr<InstructionSequence> bb) const {
+  if (!m_function_attrs)
+    return false;
+  for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+    Instruction *ins = *i;
+    if (is_call(ins) && ins->get_num_operands() > 0 && ins->get_operand(0).get_kind() == Operand::LABEL
+        && (m_function_attrs->get_attributes(ins->get_operand(0).get_label()) & Function::ATTR_NORETURN) != 0)
+      return true;
+  }
+  return false;
+}
+
+// Does a block return from the function, or go straight to a
+// block that does?
+bool BlockFrequency::returns(std::shared_ptr<InstructionSequence> bb) const {
+  std::shared_ptr<InstructionSequence> exit = m_cfg->get_exit_block();
+  for (unsigned i = 0; i < 2; ++i) {
+    const ControlFlowGraph::EdgeList &outgoing_edges = m_cfg->get_outgoing_edges(bb);
+    if (outgoing_edges.size() != 1)
+      return false;
+    if (outgoing_edges[0]->get_target() == exit)
+      return true;
+    bb = outgoing_edges[0]->get_target();
+  }
+  return false;
+}
+
+// Is a block (or the block it goes straight to) the header of a loop
+// which doesn't contain the block branching to it?
+bool BlockFrequency::enters_loop(std::shared_ptr<InstructionSequence> from, std::shared_ptr<InstructionSequence> bb) const {
+  const std::vector<LoopInfo::Loop> &loops = m_loop_info.get_loops();
+  for (unsigned i = 0; i < 2; ++i) {
+    for (auto j = loops.cbegin(); j != loops.cend(); ++j) {
+      if (j->header == bb && !j->contains(from))
+        return true;
+    }
+    const ControlFlowGraph::EdgeList &outgoing_edges = m_cfg->get_outgoing_edges(bb);
+    if (outgoing_edges.size() != 1)
+      return false;
+    bb = outgoing_edges[0]->get_target();
+  }
+  return false;
+}
+
+// Does an edge stay in the innermost loop containing its source?
+bool BlockFrequency::stays_in_loop(const Edge *edge) const {
+  int index = m_loop_info.get_loop_index(edge->get_source());
+  return index >= 0 && m_loop_info.get_loops()[index].contains(edge->get_target());
+}
+
+// Compute the frequencies of the blocks of a region (a loop or the
+// whole function) relative to its head, ignoring the back edges. The
+// header of a nested loop executes 1 / (1 - p) times per entry, where p
+// is the probability of getting back to it, which is found for the head
+// of each region once the frequencies are known.
+void BlockFrequency::propagate(std::shared_ptr<InstructionSequence> head, const std::vector<bool> &region) {
+  const ControlFlowGraph::BlockList &rpo = m_loop_info.get_reverse_postorder();
+  for (auto i = rpo.cbegin(); i != rpo.cend(); ++i) {
+    if (region[(*i)->get_block_id()])
+      m_frequency[(*i)->get_block_id()] = 0.0;
+  }
+
+  for (auto i = rpo.cbegin(); i != rpo.cend(); ++i) {
+    std::shared_ptr<InstructionSequence> bb = *i;
+    unsigned id = bb->get_block_id();
+    if (!region[id])
+      continue;
+    if (bb == head) {
+      m_frequency[id] = 1.0;
+      continue;
+    }
+    double frequency = 0.0;
+    const ControlFlowGraph::EdgeList &incoming_edges = m_cfg->get_incoming_edges(bb);
+    for (auto j = incoming_edges.cbegin(); j != incoming_edges.cend(); ++j) {
+      unsigned pred = (*j)->get_source()->get_block_id();
+      if (region[pred] && !m_loop_info.is_back_edge(*j))
+        frequency += m_frequency[pred] * get_probability(*j);
+    }
+    m_frequency[id] = frequency / (1.0 - m_cyclic[id]);
+  }
+
+  double cyclic = 0.0;
+  const ControlFlowGraph::EdgeList &incoming_edges = m_cfg->get_incoming_edges(head);
+  for (auto i = incoming_edges.cbegin(); i != incoming_edges.cend(); ++i) {
+    unsigned pred = (*i)->get_source()->get_block_id();
+    if (region[pred] && m_loop_info.is_back_edge(*i))
+      cyclic += m_frequency[pred] * get_probability(*i);
+  }
+  m_cyclic[head->get_block_id()] = std::min(cyclic, 1.0 - 1.0 / MAX_ITERATIONS);
+}
@@ -0,0 +1,199 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <cctype>
+#include <algorithm>
+#include "inline_asm.h"
+
+namespace {
+
+// names of the machine registers, as in LowLevelFormatter
+// (64, 32, 16, and 8 bit variants)
+const char *MREG_NAMES[][4] = {
+  { "rax", "eax",  "ax",   "al" },
+  { "rbx", "ebx",  "bx",   "bl" },
+  { "rcx", "ecx",  "cx",   "cl" },
+  { "rdx", "edx",  "dx",   "dl" },
+  { "rsi", "esi",  "si",   "sil" },
+  { "rdi", "edi",  "di",   "dil" },
+  { "rsp", "esp",  "sp",   "spl" },
+  { "rbp", "ebp",  "bp",   "bpl" },
+  { "r8",  "r8d",  "r8w",  "r8b" },
+  { "r9",  "r9d",  "r9w",  "r9b" },
+  { "r10", "r10d", "r10w", "r10b" },
+  { "r11", "r11d", "r11w", "r11b" },
+  { "r12", "r12d", "r12w", "r12b" },
+  { "r13", "r13d", "r13w", "r13b" },
+  { "r14", "r14d", "r14w", "r14b" },
+  { "r15", "r15d", "r15w", "r15b" },
+};
+
+// registers named by the fixed register constraints
+const std::pair<char, MachineReg> FIXED_REGS[] = {
+  { 'a', MREG_RAX },
+  { 'b', MREG_RBX },
+  { 'c', MREG_RCX },
+  { 'd', MREG_RDX },
+  { 'S', MREG_RSI },
+  { 'D', MREG_RDI },
+};
+
+// Registers operands can be assigned. These are the registers
+// LowLevelCodeGen doesn't keep values in across instructions (other
+// than %r11, which it needs for storing the outputs, and the registers
+// holding rematerialized values.)
+const std::vector<MachineReg> ASSIGNABLE_REGS = {
+  MREG_RAX, MREG_RCX, MREG_RDX, MREG_RSI, MREG_RDI, MREG_R8, MREG_R9, MREG_R10,
+};
+
+}
+
+InlineAsm::InlineAsm(const std::string &asm_template, const std::vector<Constraint> &constraints,
+                     const std::vector<MachineReg> &clobbers)
+  : m_constraints(constraints)
+  , m_clobbers(clobbers) {
+  bool valid = parse_template(asm_template, unsigned(constraints.size()), m_pieces);
+  assert(valid);
+  (void) valid;
+}
+
+InlineAsm::~InlineAsm() {
+}
+
+bool InlineAsm::has_enough_regs() const {
+  std::vector<MachineReg> available = ASSIGNABLE_REGS;
+  auto remove = [&](int mreg) {
+    available.erase(std::remove(available.begin(), available.end(), MachineReg(mreg)), available.end());
+  };
+  for (MachineReg mreg : m_clobbers)
+    remove(mreg);
+  unsigned needed = 0;
+  for (const Constraint &constraint : m_constraints) {
+    if (constraint.mreg >= 0)
+      remove(constraint.mreg);
+    else if (constraint.kind == MEM || (constraint.kind == REG && constraint.tied_to < 0))
+      ++needed;
+  }
+  return needed <= available.size();
+}
+
+const std::vector<MachineReg> &InlineAsm::get_assignable_regs() {
+  return ASSIGNABLE_REGS;
+}
+
+bool InlineAsm::parse_constraint(const std::string &text, bool is_output, Constraint &constraint) {
+  constraint = { REG, is_output, false, -1, -1, 0 };
+
+  size_t pos = 0;
+  if (is_output) {
+    if (pos == text.size() || (text[pos] != '=' && text[pos] != '+'))
+      return false;
+    constraint.is_inout = (text[pos] == '+');
+    ++pos;
+    if (pos < text.size() && text[pos] == '&')
+      ++pos;
+  }
+
+  // exactly one constraint letter (or an output number)
+  if (pos == text.size())
+    return false;
+  std::string letter = text.substr(pos);
+  if (letter == "r")
+    return true;
+  if (letter == "m") {
+    constraint.kind = MEM;
+    return true;
+  }
+  for (const auto &fixed : FIXED_REGS) {
+    if (letter.size() == 1 && letter[0] == fixed.first) {
+      constraint.mreg = fixed.second;
+      return true;
+    }
+  }
+  if (is_output)
+    return false;
+  if (letter == "i") {
+    constraint.kind = IMM;
+    return true;
+  }
+  if (std::all_of(letter.begin(), letter.end(), [](char c) { return isdigit(c); }) && letter.size() <= 2) {
+    constraint.tied_to = std::stoi(letter);
+    return true;
+  }
+  return false;
+}
+
+bool InlineAsm::parse_clobber(const std::string &text, std::vector<MachineReg> &clobbers) {
+  if (text == "memory" || text == "cc")
+    return true;
+
+  std::string name = (!text.empty() && text[0] == '%') ? text.substr(1) : text;
+  for (int mreg = 0; mreg < MREG_END; ++mreg) {
+    for (const char *reg_name : MREG_NAMES[mreg]) {
+      if (name != reg_name)
+        continue;
+      // the stack and frame pointers can't be given up
+      if (mreg == MREG_RSP || mreg == MREG_RBP)
+        return false;
+      if (std::find(clobbers.begin(), clobbers.end(), MachineReg(mreg)) == clobbers.end())
+        clobbers.push_back(MachineReg(mreg));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool InlineAsm::parse_template(const std::string &text, unsigned num_operands, std::vector<Piece> &pieces) {
+  pieces.clear();
+  std::string literal;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    char c = text[pos++];
+    if (c != '%') {
+      literal += c;
+      continue;
+    }
+    if (pos < text.size() && text[pos] == '%') {
+      literal += '%';
+      ++pos;
+      continue;
+    }
+
+    char modifier = 0;
+    if (pos < text.size() && std::string("bwkqc").find(text[pos]) != std::string::npos)
+      modifier = text[pos++];
+    if (pos == text.size() || !isdigit(text[pos]))
+      return false;
+    unsigned operand = 0;
+    while (pos < text.size() && isdigit(text[pos]) && operand < num_operands)
+      operand = operand * 10 + (text[pos++] - '0');
+    if (operand >= num_operands)
+      return false;
+
+    if (!literal.empty())
+      pieces.push_back({ literal, -1, 0 });
+    literal.clear();
+    pieces.push_back({ "", int(operand), modifier });
+  }
+  if (!literal.empty())
+    pieces.push_back({ literal, -1, 0 });
+  return true;
+}
@@ -35,7 +35,8 @@ Instruction::Instruction(int opcode, const Operand &op1, const Operand &op2)
 
 Instruction::Instruction(int opcode, const Operand &op1, const Operand &op2, const Operand &op3)
   : m_opcode(opcode)
-  , m_symbol(nullptr) {
+  , m_symbol(nullptr)
+  , m_branch_hint(HINT_NONE) {
   // Don't allow a "real" Operand to follow an Operand marked
   // as kind Operand::NONE
 
@@ -74,6 +75,10 @@ void Instruction::set_operand(unsigned index, const Operand &operand) {
   m_operands[index] = operand;
 }
 
+void Instruction::append_operand(const Operand &operand) {
+  m_operands.push_back(operand);
+}
+
 Operand Instruction::get_last_operand() const {
   assert(get_num_operands() > 0);
   return m_operands[get_num_operands() - 1];
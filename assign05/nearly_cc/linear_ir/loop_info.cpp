@@ -0,0 +1,213 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include <utility>
+#include "loop_info.h"
+
+LoopInfo::LoopInfo(std::shared_ptr<ControlFlowGraph> cfg)
+  : m_cfg(cfg) {
+}
+
+LoopInfo::~LoopInfo() {
+}
+
+void LoopInfo::execute() {
+  m_blocks.assign(m_cfg->bb_begin(), m_cfg->bb_end());
+
+  compute_reverse_postorder();
+  compute_dominators();
+  find_loops();
+}
+
+bool LoopInfo::dominates(std::shared_ptr<InstructionSequence> a, std::shared_ptr<InstructionSequence> b) const {
+  int a_id = int(a->get_block_id()), b_id = int(b->get_block_id());
+  if (m_rpo_index[a_id] < 0 || m_rpo_index[b_id] < 0)
+    return false;
+
+  // walk up the dominator tree from b
+  while (b_id != a_id && b_id >= 0)
+    b_id = m_idom[b_id];
+  return b_id == a_id;
+}
+
+std::shared_ptr<InstructionSequence> LoopInfo::get_idom(std::shared_ptr<InstructionSequence> bb) const {
+  int idom = m_idom[bb->get_block_id()];
+  return idom < 0 ? nullptr : m_blocks[idom];
+}
+
+int LoopInfo::get_loop_index(std::shared_ptr<InstructionSequence> bb) const {
+  return m_block_loop[bb->get_block_id()];
+}
+
+unsigned LoopInfo::get_loop_depth(std::shared_ptr<InstructionSequence> bb) const {
+  int index = get_loop_index(bb);
+  return index < 0 ? 0 : m_loops[index].depth;
+}
+
+bool LoopInfo::is_back_edge(const Edge *edge) const {
+  return dominates(edge->get_target(), edge->get_source());
+}
+
+void LoopInfo::compute_reverse_postorder() {
+  m_rpo.clear();
+  m_rpo_index.assign(m_blocks.size(), -1);
+
+  // iterative depth-first search from the entry block
+  std::vector<bool> visited(m_blocks.size(), false);
+  std::vector<std::pair<std::shared_ptr<InstructionSequence>, unsigned> > stack;
+  ControlFlowGraph::BlockList postorder;
+
+  std::shared_ptr<InstructionSequence> entry = m_cfg->get_entry_block();
+  visited[entry->get_block_id()] = true;
+  stack.push_back({ entry, 0 });
+
+  while (!stack.empty()) {
+    std::shared_ptr<InstructionSequence> bb = stack.back().first;
+    unsigned next = stack.back().second;
+    const ControlFlowGraph::EdgeList &outgoing_edges = m_cfg->get_outgoing_edges(bb);
+
+    if (next < outgoing_edges.size()) {
+      stack.back().second++;
+      std::shared_ptr<InstructionSequence> succ = outgoing_edges[next]->get_target();
+      if (!visited[succ->get_block_id()]) {
+        visited[succ->get_block_id()] = true;
+        stack.push_back({ succ, 0 });
+      }
+    } else {
+      postorder.push_back(bb);
+      stack.pop_back();
+    }
+  }
+
+  m_rpo.assign(postorder.rbegin(), postorder.rend());
+  for (unsigned i = 0; i < m_rpo.size(); ++i)
+    m_rpo_index[m_rpo[i]->get_block_id()] = int(i);
+}
+
+// Find the nearest common dominator of two blocks (Cooper, Harvey,
+// and Kennedy, "A Simple, Fast Dominance Algorithm")
+int LoopInfo::intersect(int a, int b) const {
+  while (a != b) {
+    while (m_rpo_index[a] > m_rpo_index[b])
+      a = m_idom[a];
+    while (m_rpo_index[b] > m_rpo_index[a])
+      b = m_idom[b];
+  }
+  return a;
+}
+
+void LoopInfo::compute_dominators() {
+  m_idom.assign(m_blocks.size(), -1);
+  if (m_rpo.empty())
+    return;
+
+  int entry_id = int(m_rpo[0]->get_block_id());
+  m_idom[entry_id] = entry_id;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (unsigned i = 1; i < m_rpo.size(); ++i) {
+      std::shared_ptr<InstructionSequence> bb = m_rpo[i];
+      int new_idom = -1;
+
+      const ControlFlowGraph::EdgeList &incoming_edges = m_cfg->get_incoming_edges(bb);
+      for (auto j = incoming_edges.cbegin(); j != incoming_edges.cend(); ++j) {
+        int pred = int((*j)->get_source()->get_block_id());
+        if (m_idom[pred] < 0)
+          continue; // not processed yet (or unreachable)
+        new_idom = (new_idom < 0) ? pred : intersect(pred, new_idom);
+      }
+
+      if (m_idom[bb->get_block_id()] != new_idom) {
+        m_idom[bb->get_block_id()] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // the entry block has no immediate dominator
+  m_idom[entry_id] = -1;
+}
+
+void LoopInfo::find_loops() {
+  m_loops.clear();
+  m_block_loop.assign(m_blocks.size(), -1);
+
+  // Each header (in reverse postorder, so results are deterministic)
+  // gets one loop, containing every block that reaches one of the
+  // header's back edges without passing through the header
+  for (auto i = m_rpo.cbegin(); i != m_rpo.cend(); ++i) {
+    std::shared_ptr<InstructionSequence> header = *i;
+    Loop loop;
+    loop.header = header;
+    loop.blocks.insert(header->get_block_id());
+
+    std::vector<std::shared_ptr<InstructionSequence> > work_list;
+    const ControlFlowGraph::EdgeList &incoming_edges = m_cfg->get_incoming_edges(header);
+    for (auto j = incoming_edges.cbegin(); j != incoming_edges.cend(); ++j) {
+      if (is_back_edge(*j)) {
+        loop.latches.push_back((*j)->get_source());
+        work_list.push_back((*j)->get_source());
+      }
+    }
+    if (loop.latches.empty())
+      continue;
+
+    while (!work_list.empty()) {
+      std::shared_ptr<InstructionSequence> bb = work_list.back();
+      work_list.pop_back();
+      if (!loop.blocks.insert(bb->get_block_id()).second)
+        continue;
+      const ControlFlowGraph::EdgeList &preds = m_cfg->get_incoming_edges(bb);
+      for (auto j = preds.cbegin(); j != preds.cend(); ++j) {
+        if (m_rpo_index[(*j)->get_source()->get_block_id()] >= 0)
+          work_list.push_back((*j)->get_source());
+      }
+    }
+
+    loop.parent = -1;
+    loop.depth = 1;
+    loop.innermost = true;
+    m_loops.push_back(loop);
+  }
+
+  // Natural loops with different headers are either disjoint or nested,
+  // so ordering by size puts each enclosing loop before the loops it contains
+  std::stable_sort(m_loops.begin(), m_loops.end(), [](const Loop &a, const Loop &b) {
+    return a.blocks.size() > b.blocks.size();
+  });
+
+  for (unsigned i = 0; i < m_loops.size(); ++i) {
+    Loop &loop = m_loops[i];
+    for (int j = int(i) - 1; j >= 0; --j) {
+      if (m_loops[j].contains(loop.header)) {
+        loop.parent = j;
+        loop.depth = m_loops[j].depth + 1;
+        m_loops[j].innermost = false;
+        break;
+      }
+    }
+    for (auto j = loop.blocks.cbegin(); j != loop.blocks.cend(); ++j)
+      m_block_loop[*j] = int(i);
+  }
+}
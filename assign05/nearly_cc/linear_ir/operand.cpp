@@ -36,6 +36,7 @@ enum {
   HAS_INDEX  = (1 << 7),  // has index register
   HAS_OFFSET = (1 << 8),  // memory reference with imm offset
   HAS_SCALE  = (1 << 9),  // memory reference with index scaling factor
+  MEM_LABEL  = (1 << 10), // memory reference at a label (no registers)
 };
 
 struct OperandProperties {
@@ -47,10 +48,11 @@ struct OperandProperties {
   bool has_index_reg() const   { return (flags & HAS_INDEX) != 0; }
   bool has_offset() const      { return (flags & HAS_OFFSET) != 0; }
   bool has_scale() const       { return (flags & HAS_SCALE) != 0; }
-  bool is_non_reg() const      { return is_imm_ival() || is_label() || is_imm_label(); }
+  bool is_mem_label() const    { return (flags & MEM_LABEL) != 0; }
+  bool is_non_reg() const      { return is_imm_ival() || is_label() || is_imm_label() || is_mem_label(); }
   bool is_memref() const       { return (flags & MEMREF) != 0; }
   bool has_imm_ival() const    { return is_imm_ival() || has_offset(); }
-  bool has_label() const       { return is_label() || is_imm_label(); }
+  bool has_label() const       { return is_label() || is_imm_label() || is_mem_label(); }
 };
 
 const std::map<Operand::Kind, OperandProperties> s_operand_props = {
@@ -69,6 +71,8 @@ const std::map<Operand::Kind, OperandProperties> s_operand_props = {
   { Operand::MREG64_MEM_IDX,   { .flags = LL|MEMREF|HAS_INDEX } },
   { Operand::MREG64_MEM_OFF,   { .flags = LL|MEMREF|HAS_OFFSET } },
   { Operand::MREG64_MEM_IDX_SCALE, { .flags = LL|MEMREF|HAS_INDEX|HAS_SCALE } },
+  { Operand::LABEL_MEM_FS,     { .flags = LL|MEMREF|MEM_LABEL|HAS_OFFSET } },
+  { Operand::LABEL_MEM_RIP,    { .flags = LL|MEMREF|MEM_LABEL } },
   { Operand::IMM_IVAL,         { .flags = HL|LL|IMM_IVAL } },
   { Operand::LABEL,            { .flags = HL|LL|LABEL } },
   { Operand::IMM_LABEL,        { .flags = HL|LL|IMM_LABEL } },
@@ -127,12 +131,15 @@ Operand::Operand(Kind kind, int basereg, int indexreg, int scale)
   assert(kind == Operand::MREG64_MEM_IDX_SCALE);
 }
 
-// for label or immediate label operands
-Operand::Operand(Kind kind, const std::string &label)
+// for label, immediate label, or label memref operands
+Operand::Operand(Kind kind, const std::string &label, long offset)
   : Operand(kind) {
   const OperandProperties &props = oprops(kind);
-  assert(props.is_label() || props.is_imm_label());
+  assert(props.has_label());
+  assert(offset == 0 || props.has_offset());
   m_label = label;
+  if (props.has_offset())
+    m_imm_ival = offset;
 }
 
 Operand::~Operand() {
@@ -170,8 +177,13 @@ bool Operand::operator==(const Operand &rhs) const {
 
   case Operand::LABEL:
   case Operand::IMM_LABEL:
+  case Operand::LABEL_MEM_RIP:
     return lhs.get_label() == rhs.get_label();
 
+  case Operand::LABEL_MEM_FS:
+    return lhs.get_label() == rhs.get_label() &&
+           lhs.get_offset() == rhs.get_offset();
+
   case Operand::IMM_IVAL:
     return lhs.get_imm_ival() == rhs.get_imm_ival();
 
@@ -278,6 +290,6 @@ Operand Operand::to_memref() const {
 }
 
 std::string Operand::get_label() const {
-  assert(m_kind == Operand::LABEL || m_kind == Operand::IMM_LABEL);
+  assert(oprops(m_kind).has_label());
   return m_label;
 }
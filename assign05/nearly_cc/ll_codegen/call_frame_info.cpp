@@ -0,0 +1,193 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <deque>
+#include "lowlevel_formatter.h"
+#include "call_frame_info.h"
+
+namespace {
+
+// Values of the words pushed on the stack which matter to the frame
+// (other than the saved value of a callee-saved register, which is
+// recorded as the register)
+const int OTHER_VALUE = -1;
+const int FRAME_POINTER = -2;
+
+bool is_callee_saved(MachineReg mreg) {
+  return mreg == MREG_RBX || mreg == MREG_RBP
+      || (mreg >= MREG_R12 && mreg <= MREG_R15);
+}
+
+bool is_mreg64(const Operand &operand, MachineReg mreg) {
+  return operand.get_kind() == Operand::MREG64 && operand.get_base_reg() == mreg;
+}
+
+std::string format_reg(MachineReg mreg) {
+  LowLevelFormatter formatter;
+  return formatter.format_operand(Operand(Operand::MREG64, mreg));
+}
+
+}
+
+CallFrameInfo::CallFrameInfo(std::shared_ptr<InstructionSequence> iseq)
+  : m_iseq(iseq) {
+}
+
+CallFrameInfo::~CallFrameInfo() {
+}
+
+void CallFrameInfo::execute() {
+  unsigned num_instructions = m_iseq->get_length();
+
+  std::map<std::string, unsigned> label_indices;
+  for (unsigned i = 0; i < num_instructions; ++i) {
+    if (m_iseq->has_label(i))
+      label_indices[m_iseq->get_label_at_index(i)] = i;
+  }
+
+  // find the frame before each reachable instruction: the frame
+  // is the same along every path reaching an instruction, so the
+  // first path found determines it
+  std::vector<Frame> frames(num_instructions);
+  std::vector<bool> reached(num_instructions, false);
+  std::deque<unsigned> worklist;
+  if (num_instructions > 0) {
+    frames[0] = get_entry_frame();
+    reached[0] = true;
+    worklist.push_back(0);
+  }
+  while (!worklist.empty()) {
+    unsigned index = worklist.front();
+    worklist.pop_front();
+
+    Instruction *ins = m_iseq->get_instruction(index);
+    int opcode = ins->get_opcode();
+    Frame after = get_frame_after(frames[index], ins);
+
+    std::vector<unsigned> succs;
+    if (opcode >= MINS_JMP && opcode <= MINS_JAE) {
+      auto target = label_indices.find(ins->get_operand(0).get_label());
+      if (target != label_indices.end())
+        succs.push_back(target->second);
+    }
+    if (opcode != MINS_JMP && opcode != MINS_RET && opcode != MINS_UD2 && index + 1 < num_instructions)
+      succs.push_back(index + 1);
+
+    for (auto i = succs.begin(); i != succs.end(); ++i) {
+      if (!reached[*i]) {
+        frames[*i] = after;
+        reached[*i] = true;
+        worklist.push_back(*i);
+      }
+    }
+  }
+
+  // the directives before each instruction describe the change from
+  // the frame in effect (following the code in order) to its frame
+  m_directives.assign(num_instructions, std::vector<std::string>());
+  Frame current = get_entry_frame();
+  for (unsigned i = 0; i < num_instructions; ++i) {
+    if (!reached[i])
+      continue;
+    describe_change(current, frames[i], m_directives[i]);
+    current = frames[i];
+  }
+}
+
+// On entry the CFA is just above the return address
+CallFrameInfo::Frame CallFrameInfo::get_entry_frame() {
+  Frame frame;
+  frame.cfa_reg = MREG_RSP;
+  frame.cfa_offset = 8;
+  frame.depth = 8;
+  return frame;
+}
+
+CallFrameInfo::Frame CallFrameInfo::get_frame_after(const Frame &frame, Instruction *ins) {
+  Frame after = frame;
+  int opcode = ins->get_opcode();
+
+  if (opcode == MINS_PUSHQ) {
+    after.depth += 8;
+    int value = OTHER_VALUE;
+    const Operand &operand = ins->get_operand(0);
+    if (operand.get_kind() == Operand::MREG64) {
+      MachineReg mreg = MachineReg(operand.get_base_reg());
+      if (is_callee_saved(mreg) && after.saved.count(mreg) == 0) {
+        after.saved[mreg] = -after.depth;
+        value = mreg;
+      } else if (mreg == MREG_RBP && after.cfa_reg == MREG_RBP) {
+        value = FRAME_POINTER;
+      }
+    }
+    after.pushed.push_back(value);
+  } else if (opcode == MINS_POPQ) {
+    after.depth -= 8;
+    int value = OTHER_VALUE;
+    if (!after.pushed.empty()) {
+      value = after.pushed.back();
+      after.pushed.pop_back();
+    }
+    const Operand &operand = ins->get_operand(0);
+    if (operand.get_kind() == Operand::MREG64) {
+      MachineReg mreg = MachineReg(operand.get_base_reg());
+      if (value == mreg)
+        after.saved.erase(mreg);
+      // unless the frame pointer is popped back into %rbp, %rbp
+      // no longer locates the CFA
+      if (mreg == MREG_RBP && after.cfa_reg == MREG_RBP && value != FRAME_POINTER)
+        after.cfa_reg = MREG_RSP;
+    }
+  } else if ((opcode == MINS_SUBQ || opcode == MINS_ADDQ) && is_mreg64(ins->get_operand(1), MREG_RSP)) {
+    assert(ins->get_operand(0).is_imm_ival());
+    long amount = ins->get_operand(0).get_imm_ival();
+    after.depth += (opcode == MINS_SUBQ) ? amount : -amount;
+  } else if (opcode == MINS_MOVQ && is_mreg64(ins->get_operand(0), MREG_RSP) && is_mreg64(ins->get_operand(1), MREG_RBP)) {
+    // set up the frame pointer
+    if (after.cfa_reg == MREG_RSP)
+      after.cfa_reg = MREG_RBP;
+  }
+
+  // %rsp moves with the stack, %rbp stays where the frame pointer
+  // was set up
+  if (after.cfa_reg == MREG_RSP)
+    after.cfa_offset = after.depth;
+  return after;
+}
+
+void CallFrameInfo::describe_change(const Frame &from, const Frame &to, std::vector<std::string> &directives) {
+  if (from.cfa_reg != to.cfa_reg && from.cfa_offset != to.cfa_offset)
+    directives.push_back(".cfi_def_cfa " + format_reg(to.cfa_reg) + ", " + std::to_string(to.cfa_offset));
+  else if (from.cfa_reg != to.cfa_reg)
+    directives.push_back(".cfi_def_cfa_register " + format_reg(to.cfa_reg));
+  else if (from.cfa_offset != to.cfa_offset)
+    directives.push_back(".cfi_def_cfa_offset " + std::to_string(to.cfa_offset));
+
+  for (auto i = to.saved.begin(); i != to.saved.end(); ++i) {
+    auto j = from.saved.find(i->first);
+    if (j == from.saved.end() || j->second != i->second)
+      directives.push_back(".cfi_offset " + format_reg(i->first) + ", " + std::to_string(i->second));
+  }
+  for (auto i = from.saved.begin(); i != from.saved.end(); ++i) {
+    if (to.saved.count(i->first) == 0)
+      directives.push_back(".cfi_restore " + format_reg(i->first));
+  }
+}
@@ -51,6 +51,14 @@ const char *lowlevel_opcode_to_str(LowLevelOpcode opcode) {
     return "subq";
   case MINS_LEAQ:
     return "leaq";
+  case MINS_ANDB:
+    return "andb";
+  case MINS_ANDW:
+    return "andw";
+  case MINS_ANDL:
+    return "andl";
+  case MINS_ANDQ:
+    return "andq";
   case MINS_JMP:
     return "jmp";
   case MINS_JE:
@@ -137,6 +145,60 @@ const char *lowlevel_opcode_to_str(LowLevelOpcode opcode) {
     return "sete";
   case MINS_SETNE:
     return "setne";
+  case MINS_POPCNTL:
+    return "popcntl";
+  case MINS_POPCNTQ:
+    return "popcntq";
+  case MINS_LZCNTL:
+    return "lzcntl";
+  case MINS_LZCNTQ:
+    return "lzcntq";
+  case MINS_TZCNTL:
+    return "tzcntl";
+  case MINS_TZCNTQ:
+    return "tzcntq";
+  case MINS_BSWAPL:
+    return "bswapl";
+  case MINS_BSWAPQ:
+    return "bswapq";
+  case MINS_PREFETCHNTA:
+    return "prefetchnta";
+  case MINS_PREFETCHT2:
+    return "prefetcht2";
+  case MINS_PREFETCHT1:
+    return "prefetcht1";
+  case MINS_PREFETCHT0:
+    return "prefetcht0";
+  case MINS_UD2:
+    return "ud2";
+  case MINS_LOCK_XADDB:
+    return "lock xaddb";
+  case MINS_LOCK_XADDW:
+    return "lock xaddw";
+  case MINS_LOCK_XADDL:
+    return "lock xaddl";
+  case MINS_LOCK_XADDQ:
+    return "lock xaddq";
+  case MINS_XCHGB:
+    return "xchgb";
+  case MINS_XCHGW:
+    return "xchgw";
+  case MINS_XCHGL:
+    return "xchgl";
+  case MINS_XCHGQ:
+    return "xchgq";
+  case MINS_LOCK_CMPXCHGB:
+    return "lock cmpxchgb";
+  case MINS_LOCK_CMPXCHGW:
+    return "lock cmpxchgw";
+  case MINS_LOCK_CMPXCHGL:
+    return "lock cmpxchgl";
+  case MINS_LOCK_CMPXCHGQ:
+    return "lock cmpxchgq";
+  case MINS_MFENCE:
+    return "mfence";
+  case MINS_ASM:
+    return "asm";
   default:
     assert(false);
     return nullptr;
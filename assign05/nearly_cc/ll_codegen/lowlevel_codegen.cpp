@@ -33,7 +33,9 @@ TODO LIST:
 
 
 #include <cassert>
+#include <algorithm>
 #include <map>
+#include <set>
 #include <sstream>
 #include "node.h"
 #include "instruction.h"
@@ -42,7 +44,10 @@ TODO LIST:
 #include "highlevel.h"
 #include "lowlevel.h"
 #include "highlevel_formatter.h"
+#include "inline_asm.h"
+#include "highlevel_defuse.h"
 #include "exceptions.h"
+#include "builtins.h"
 #include "lowlevel_codegen.h"
 
 int get_size(HighLevelOpcode opcode);
@@ -61,6 +66,10 @@ const std::map<HighLevelOpcode, LowLevelOpcode> HL_TO_LL = {
   { HINS_sub_q, MINS_SUBQ },
   { HINS_mul_l, MINS_IMULL },
   { HINS_mul_q, MINS_IMULQ },
+  { HINS_and_b, MINS_ANDB },
+  { HINS_and_w, MINS_ANDW },
+  { HINS_and_l, MINS_ANDL },
+  { HINS_and_q, MINS_ANDQ },
   { HINS_mov_b, MINS_MOVB },
   { HINS_mov_w, MINS_MOVW },
   { HINS_mov_l, MINS_MOVL },
@@ -153,6 +162,7 @@ std::shared_ptr<InstructionSequence> LowLevelCodeGen::translate_hl_to_ll(std::sh
     m_total_memory_storage += (16 - (m_total_memory_storage % 16));
 
   m_register_base = m_total_memory_storage;
+  m_function->set_vreg_slot_offset(-(m_register_base + 8));
 
   
   // Symbol *fn_id = funcdef_ast->get_kid(1)->get_symbol();
@@ -168,7 +178,22 @@ std::shared_ptr<InstructionSequence> LowLevelCodeGen::translate_hl_to_ll(std::sh
   //     ;
   //   }
   // }
-  m_total_memory_storage += 8*(m_function->get_vra()->get_size());
+  // Every vreg from vr10 up gets a stack slot. (The VregAllocator's
+  // count only covers the outermost scope, and optimizations allocate
+  // vregs of their own, so the highest vreg number in the code
+  // determines how many slots are needed.)
+  int max_vreg = 9;
+  for (auto i = hl_iseq->cbegin(); i != hl_iseq->cend(); ++i) {
+    Instruction *hl_ins = *i;
+    for (unsigned j = 0; j < hl_ins->get_num_operands(); ++j) {
+      Operand operand = hl_ins->get_operand(j);
+      if (operand.has_base_reg())
+        max_vreg = std::max(max_vreg, operand.get_base_reg());
+      if (operand.has_index_reg())
+        max_vreg = std::max(max_vreg, operand.get_index_reg());
+    }
+  }
+  m_total_memory_storage += 8*(max_vreg - 9);
 
   if ((m_total_memory_storage) % 16 != 0)
     m_total_memory_storage += (16 - (m_total_memory_storage % 16));
@@ -178,6 +203,11 @@ std::shared_ptr<InstructionSequence> LowLevelCodeGen::translate_hl_to_ll(std::sh
   // If the total memory storage required is not a multiple of 16, add to
   // it so that it is.
 
+  // Find vregs whose values are cheap enough to recompute at each use
+  // rather than storing them and reloading them from their stack slots
+  m_remat.clear();
+  if (m_options.has_option(Options::OPTIMIZE))
+    find_remat_candidates(hl_iseq);
 
   // Iterate through high level instructions
   for (auto i = hl_iseq->cbegin(); i != hl_iseq->cend(); ++i) {
@@ -193,8 +223,15 @@ std::shared_ptr<InstructionSequence> LowLevelCodeGen::translate_hl_to_ll(std::sh
     // representation of the high-level instruction.
     unsigned ll_idx = ll_iseq->get_length();
     translate_instruction(hl_ins, ll_iseq);
+    if (ll_iseq->get_length() == ll_idx)
+      continue; // definition of a rematerialized vreg, nothing generated
     HighLevelFormatter hl_formatter;
     ll_iseq->get_instruction(ll_idx)->set_comment(hl_formatter.format_instruction(hl_ins));
+
+    // Every low-level instruction inherits the source Location
+    // of the high-level instruction it was generated from
+    for (unsigned j = ll_idx; j < ll_iseq->get_length(); ++j)
+      ll_iseq->get_instruction(j)->set_loc(hl_ins->get_loc());
   }
 
   return ll_iseq;
@@ -268,7 +305,7 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
     // save callee-saved registers (if any)
     //if you allocated callee-saved registers as storage for local variables,
     //emit pushq instructions to save their original values
-    std::vector<MachineReg> callee_saved = {MREG_RBP, MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+    std::vector<MachineReg> callee_saved = get_saved_regs();
     for (MachineReg reg : callee_saved) {
       Instruction* push_inst = new Instruction(MINS_PUSHQ, Operand(Operand::MREG64,reg));
       push_inst->set_comment("Pushing Callee saved to stack");
@@ -285,7 +322,7 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
 
     //if you allocated callee-saved registers as storage for local variables,
     //emit popq instructions to save their original values
-    std::vector<MachineReg> callee_saved = {MREG_RBP, MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+    std::vector<MachineReg> callee_saved = get_saved_regs();
     for (int i = callee_saved.size() - 1; i >= 0; --i){//reverse iterate for popq
       Instruction* push_inst = new Instruction(MINS_POPQ, Operand(Operand::MREG64,callee_saved[i]));
       push_inst->set_comment("Popping callee saved back to proper register");
@@ -304,6 +341,16 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
     return;
   }
 
+  if (hl_opcode == HINS_nop) {
+    ll_iseq->append(new Instruction(MINS_NOP));
+    return;
+  }
+
+  // The definition of a rematerialized vreg is dropped: every use
+  // recomputes the value instead
+  if (HighLevel::is_def(hl_ins) && m_remat.count(HighLevel::get_def_vreg(hl_ins)) > 0)
+    return;
+
   // TODO: handle other high-level instructions
   // Note that you can use the highlevel_opcode_get_source_operand_size() and
   // highlevel_opcode_get_dest_operand_size() functions to determine the
@@ -320,7 +367,8 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
                                          HINS_sub_b,HINS_sub_w,HINS_sub_l,HINS_sub_q,
                                          HINS_div_b,HINS_div_w,HINS_div_l,HINS_div_q,
                                          HINS_mul_b,HINS_mul_w,HINS_mul_l,HINS_mul_q,
-                                         HINS_mod_b,HINS_mod_w,HINS_mod_l,HINS_mod_q};
+                                         HINS_mod_b,HINS_mod_w,HINS_mod_l,HINS_mod_q,
+                                         HINS_and_b,HINS_and_w,HINS_and_l,HINS_and_q};
 
   if (ARITH_OPS.count(hl_opcode) > 0) {//found a binary arithmatic operation
     Operand dest = get_ll_operand(hl_ins->get_operand(0), get_size(hl_opcode),ll_iseq);
@@ -340,6 +388,8 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
       comment = "dst = src1 / src2";
     } else if (match_hl(HINS_mod_b,hl_opcode)){
       comment = "dst = src1 \% src2";
+    } else if (match_hl(HINS_and_b,hl_opcode)){
+      comment = "dst = src1 & src2";
     }
     no_inst->set_comment(comment);
     ll_iseq->append(no_inst);
@@ -506,21 +556,25 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
   std::set<HighLevelOpcode> MOV_OPS = {HINS_mov_b,HINS_mov_w,HINS_mov_l,HINS_mov_q};
 
   if (MOV_OPS.count(hl_opcode) > 0) {//found a move operation
-    Operand dest = get_ll_operand(hl_ins->get_operand(0), 8,ll_iseq);
     Operand src = get_ll_operand(hl_ins->get_operand(1), get_size(hl_opcode),ll_iseq);
 
-    Instruction* clear_inst = new Instruction(select_ll_opcode(MINS_MOVB,8), Operand(Operand::IMM_IVAL,0), dest);
-    clear_inst->set_comment("Clear dest register");
-    ll_iseq->append(clear_inst);
+    //only clear a whole vreg: a store through a pointer must not touch
+    //the bytes following the stored value
+    if (hl_ins->get_operand(0).get_kind() == Operand::VREG) {
+      Operand dest = get_ll_operand(hl_ins->get_operand(0), 8,ll_iseq);
+      Instruction* clear_inst = new Instruction(select_ll_opcode(MINS_MOVB,8), Operand(Operand::IMM_IVAL,0), dest);
+      clear_inst->set_comment("Clear dest register");
+      ll_iseq->append(clear_inst);
+    }
 
 
-    dest = get_ll_operand(hl_ins->get_operand(0), get_size(hl_opcode),ll_iseq);
+    Operand dest = get_ll_operand(hl_ins->get_operand(0), get_size(hl_opcode),ll_iseq);
 
 
 
     Operand temp = Operand(select_mreg_kind(8),MachineReg::MREG_R11);
 
-    clear_inst = new Instruction(select_ll_opcode(MINS_MOVB,8), Operand(Operand::IMM_IVAL,0), temp);
+    Instruction* clear_inst = new Instruction(select_ll_opcode(MINS_MOVB,8), Operand(Operand::IMM_IVAL,0), temp);
     clear_inst->set_comment("Clear temp register");
     ll_iseq->append(clear_inst);
 
@@ -572,12 +626,15 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
       mv_t_inst->set_comment("Moving dst to temp");
       ll_iseq->append(mv_t_inst);
       
-      Instruction* cmp_inst = new Instruction(MINS_CMPB, temp, dst);
+      // a rematerialized constant can't be the destination of a compare
+      Instruction* cmp_inst = dst.is_imm_ival() ? new Instruction(MINS_CMPB, dst, temp)
+                                                : new Instruction(MINS_CMPB, temp, dst);
       cmp_inst->set_comment("Compare dst with 0");
       ll_iseq->append(cmp_inst);
 
       Instruction* jmp_inst = new Instruction(MINS_JNE, label);
       jmp_inst->set_comment("jumping if to dst if true (dst !=0)");
+      jmp_inst->set_branch_hint(hl_ins->get_branch_hint());
       ll_iseq->append(jmp_inst);
     } else if (match_hl(hl_opcode,HINS_cjmp_f)) {
       Operand dst = get_ll_operand(hl_ins->get_operand(0), get_size(hl_opcode),ll_iseq);
@@ -596,17 +653,48 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
       mv_t_inst->set_comment("Moving dst to temp");
       ll_iseq->append(mv_t_inst);
 
-      Instruction* cmp_inst = new Instruction(MINS_CMPB, temp, dst);
+      // a rematerialized constant can't be the destination of a compare
+      Instruction* cmp_inst = dst.is_imm_ival() ? new Instruction(MINS_CMPB, dst, temp)
+                                                : new Instruction(MINS_CMPB, temp, dst);
       cmp_inst->set_comment("Compare dst with 0");
       ll_iseq->append(cmp_inst);
 
       Instruction* jmp_inst = new Instruction(MINS_JE, label);
       jmp_inst->set_comment("jumping if to dst if false (dst == 0)");
+      jmp_inst->set_branch_hint(hl_ins->get_branch_hint());
       ll_iseq->append(jmp_inst);
     }
     return;
   }
 
+  if (hl_opcode == HINS_tlsaddr) {
+    // Thread-local variables are at fixed offsets from the thread
+    // pointer (%fs:0). A variable defined in the executable has a
+    // link-time constant offset (local-exec model); otherwise the offset
+    // is loaded from the GOT (initial-exec model). (With optimization,
+    // a local-exec variable is usually accessed as %fs:x@tpoff instead,
+    // see find_remat_candidates.)
+    Operand dst = get_ll_operand(hl_ins->get_operand(0), 8, ll_iseq);
+    std::string name = hl_ins->get_operand(1).get_label();
+    Operand temp = Operand(Operand::MREG64, MachineReg::MREG_R11);
+
+    Instruction* tp_inst = new Instruction(MINS_MOVQ, Operand(Operand::LABEL_MEM_FS, ""), temp);
+    tp_inst->set_comment("Load thread pointer");
+    ll_iseq->append(tp_inst);
+
+    Operand offset = hl_ins->get_operand(2).get_imm_ival() != 0
+        ? Operand(Operand::LABEL_MEM_RIP, name + "@gottpoff")
+        : Operand(Operand::IMM_LABEL, name + "@tpoff");
+    Instruction* add_inst = new Instruction(MINS_ADDQ, offset, temp);
+    add_inst->set_comment("Add thread-local offset");
+    ll_iseq->append(add_inst);
+
+    Instruction* mv_inst = new Instruction(MINS_MOVQ, temp, dst);
+    mv_inst->set_comment("Moving temp to dst");
+    ll_iseq->append(mv_inst);
+    return;
+  }
+
   if (hl_opcode == HINS_localaddr) {
     Operand dst = get_ll_operand(hl_ins->get_operand(0), get_size(hl_opcode),ll_iseq);
     Operand immediate = get_ll_operand(hl_ins->get_operand(1), get_size(hl_opcode),ll_iseq);
@@ -675,6 +763,100 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
     return;
   }
 
+  if (hl_opcode >= HINS_sconv_bw && hl_opcode <= HINS_uconv_lq) {//found a promotion
+    int src_size = highlevel_opcode_get_source_operand_size(hl_opcode);
+    int dest_size = highlevel_opcode_get_dest_operand_size(hl_opcode);
+    Operand src = get_ll_operand(hl_ins->get_operand(1), src_size, ll_iseq);
+    Operand dest = get_ll_operand(hl_ins->get_operand(0), dest_size, ll_iseq);
+
+    //EXTEND SOURCE into TEMP (a 32-bit move zero extends to 64 bits,
+    //there is no movzlq instruction)
+    Operand temp = Operand(select_mreg_kind(dest_size),MachineReg::MREG_R11);
+    Instruction* ext_inst = hl_opcode == HINS_uconv_lq
+                          ? new Instruction(MINS_MOVL, src, Operand(select_mreg_kind(4),MachineReg::MREG_R11))
+                          : new Instruction(HL_TO_LL.at(hl_opcode), src, temp);
+    ext_inst->set_comment("Extending src into temp");
+    ll_iseq->append(ext_inst);
+
+    //MOVE TEMP to DST
+    Instruction* mv_b_inst = new Instruction(select_ll_opcode(MINS_MOVB, dest_size), temp, dest);
+    mv_b_inst->set_comment("Moving temp to dest");
+    ll_iseq->append(mv_b_inst);
+
+    return;
+  }
+
+  if (hl_opcode >= HINS_popcount_b && hl_opcode <= HINS_bswap_q) {//found a bit operation
+    int size = highlevel_opcode_get_source_operand_size(hl_opcode);
+    if (size < 4)
+      RuntimeError::raise("high level opcode %d not handled", int(hl_opcode));
+    Operand src = get_ll_operand(hl_ins->get_operand(1), size, ll_iseq);
+    Operand dest = get_ll_operand(hl_ins->get_operand(0), hl_ins->get_operand(0).get_kind() == Operand::VREG ? 8 : size, ll_iseq);
+
+    //MOVE SOURCE to TEMP
+    Operand temp = Operand(select_mreg_kind(size),MachineReg::MREG_R10);
+    Instruction* mv_t_inst = new Instruction(size == 4 ? MINS_MOVL : MINS_MOVQ, src, temp);
+    mv_t_inst->set_comment("Moving src to temp");
+    ll_iseq->append(mv_t_inst);
+
+    //OPERATION: a 32-bit result is zero extended to the whole register,
+    //so a vreg gets a value which can be read with any size
+    Operand result = Operand(select_mreg_kind(8),MachineReg::MREG_R10);
+    int variant = size == 4 ? 0 : 1;
+    if (match_hl(HINS_bswap_b,hl_opcode)) {
+      Instruction* op_inst = new Instruction(LowLevelOpcode(MINS_BSWAPL + variant), temp);
+      op_inst->set_comment("Reverse bytes of temp");
+      ll_iseq->append(op_inst);
+    } else if (m_options.has_option(Options::BASELINE_ISA)) {
+      result = Operand(select_mreg_kind(8),MachineReg::MREG_R11);
+      translate_bit_loop(hl_opcode, temp, Operand(select_mreg_kind(4),MachineReg::MREG_R11), ll_iseq);
+    } else {
+      LowLevelOpcode base = match_hl(HINS_popcount_b,hl_opcode) ? MINS_POPCNTL
+                          : match_hl(HINS_clz_b,hl_opcode) ? MINS_LZCNTL : MINS_TZCNTL;
+      Instruction* op_inst = new Instruction(LowLevelOpcode(base + variant), temp, temp);
+      op_inst->set_comment("Count bits of temp");
+      ll_iseq->append(op_inst);
+    }
+
+    //MOVE TEMP to DST
+    if (hl_ins->get_operand(0).get_kind() != Operand::VREG)
+      result = Operand(select_mreg_kind(size),MachineReg(result.get_base_reg()));
+    Instruction* mv_b_inst = new Instruction(select_ll_opcode(MINS_MOVB, hl_ins->get_operand(0).get_kind() == Operand::VREG ? 8 : size), result, dest);
+    mv_b_inst->set_comment("Moving temp to dest");
+    ll_iseq->append(mv_b_inst);
+
+    return;
+  }
+
+  if (hl_opcode == HINS_prefetch) {
+    Operand addr = get_ll_operand(Operand(Operand::VREG_MEM, hl_ins->get_operand(1).get_base_reg()), 8, ll_iseq);
+    LowLevelOpcode opcode = LowLevelOpcode(MINS_PREFETCHNTA + hl_ins->get_operand(0).get_imm_ival());
+    Instruction* pf_inst = new Instruction(opcode, addr);
+    pf_inst->set_comment("Prefetch");
+    ll_iseq->append(pf_inst);
+
+    return;
+  }
+
+  if (hl_opcode == HINS_asm) {
+    translate_inline_asm(hl_ins, ll_iseq);
+    return;
+  }
+
+  if (hl_opcode >= HINS_atomic_load_b && hl_opcode <= HINS_fence) {
+    translate_atomic(hl_ins, ll_iseq);
+    return;
+  }
+
+  if (hl_opcode == HINS_call && find_builtin(hl_ins->get_operand(0).get_label()) != nullptr) {
+    //__builtin_unreachable is the only builtin which is called
+    Instruction* ud_inst = new Instruction(MINS_UD2);
+    ud_inst->set_comment("Unreachable");
+    ll_iseq->append(ud_inst);
+
+    return;
+  }
+
   if (hl_opcode == HINS_call) {
     Operand label = hl_ins->get_operand(0);
     Instruction* mv_inst = new Instruction(MINS_CALL, label);
@@ -688,9 +870,252 @@ void LowLevelCodeGen::translate_instruction(Instruction *hl_ins, std::shared_ptr
 }
 
 // TODO: implement other private member functions
+
+// Count bits of the value in a register with a loop (for processors
+// without popcnt, lzcnt, and tzcnt). The value is shifted left one bit
+// at a time: popcount counts the shifted-out 1 bits, clz counts the
+// shifts before the top bit is 1, and ctz subtracts the number of
+// shifts leaving a nonzero value from the width. As with lzcnt and
+// tzcnt, the leading and trailing zero counts of 0 are the width.
+void LowLevelCodeGen::translate_bit_loop(HighLevelOpcode hl_opcode, Operand value, Operand count, std::shared_ptr<InstructionSequence> ll_iseq) {
+  int size = highlevel_opcode_get_source_operand_size(hl_opcode);
+  std::string label = ".L" + m_function->get_name() + "_bit" + std::to_string(m_bit_loop_num++);
+  Operand loop_label = Operand(Operand::LABEL, label + "_loop");
+  Operand next_label = Operand(Operand::LABEL, label + "_next");
+  Operand done_label = Operand(Operand::LABEL, label + "_done");
+  Operand zero = Operand(Operand::IMM_IVAL, 0);
+  Operand one = Operand(Operand::IMM_IVAL, 1);
+  LowLevelOpcode cmp_opcode = select_ll_opcode(MINS_CMPB, size);
+  bool is_ctz = match_hl(HINS_ctz_b,hl_opcode);
+
+  Instruction* init_inst = new Instruction(MINS_MOVL, is_ctz ? Operand(Operand::IMM_IVAL, 8 * size) : zero, count);
+  init_inst->set_comment("Initialize bit count");
+  ll_iseq->append(init_inst);
+
+  ll_iseq->define_label(loop_label.get_label());
+  if (match_hl(HINS_clz_b,hl_opcode)) {
+    ll_iseq->append(new Instruction(MINS_CMPL, Operand(Operand::IMM_IVAL, 8 * size), count));
+    ll_iseq->append(new Instruction(MINS_JE, done_label));
+    ll_iseq->append(new Instruction(cmp_opcode, zero, value));
+    ll_iseq->append(new Instruction(MINS_JL, done_label));
+    ll_iseq->append(new Instruction(MINS_ADDL, one, count));
+  } else {
+    ll_iseq->append(new Instruction(cmp_opcode, zero, value));
+    ll_iseq->append(new Instruction(MINS_JE, done_label));
+    if (is_ctz) {
+      ll_iseq->append(new Instruction(MINS_SUBL, one, count));
+    } else {
+      ll_iseq->append(new Instruction(MINS_JGE, next_label));
+      ll_iseq->append(new Instruction(MINS_ADDL, one, count));
+      ll_iseq->define_label(next_label.get_label());
+    }
+  }
+  Instruction* shift_inst = new Instruction(select_ll_opcode(MINS_ADDB, size), value, value);
+  shift_inst->set_comment("Shift value left by one bit");
+  ll_iseq->append(shift_inst);
+  ll_iseq->append(new Instruction(MINS_JMP, loop_label));
+
+  ll_iseq->define_label(done_label.get_label());
+}
+
+// Translate an inline assembly instruction. Each register operand is
+// bound to its fixed register or to the next free assignable register
+// (a tied input to its output's register), and each memory operand to
+// its slot. Inputs are loaded into their registers before the asm, and
+// register outputs are stored to their slots after it.
+void LowLevelCodeGen::translate_inline_asm(Instruction *hl_ins, std::shared_ptr<InstructionSequence> ll_iseq) {
+  std::shared_ptr<InlineAsm> inline_asm = hl_ins->get_inline_asm();
+  unsigned num_operands = hl_ins->get_num_operands();
+
+  std::set<MachineReg> taken(inline_asm->get_clobbers().begin(), inline_asm->get_clobbers().end());
+  for (unsigned i = 0; i < num_operands; ++i) {
+    if (inline_asm->get_constraint(i).mreg >= 0)
+      taken.insert(MachineReg(inline_asm->get_constraint(i).mreg));
+  }
+  auto next_free_reg = [&]() {
+    for (MachineReg mreg : InlineAsm::get_assignable_regs()) {
+      if (taken.count(mreg) == 0) {
+        taken.insert(mreg);
+        return mreg;
+      }
+    }
+    RuntimeError::raise("not enough registers for asm operands");
+  };
+
+  std::vector<Operand> operands;
+  for (unsigned i = 0; i < num_operands; ++i) {
+    const InlineAsm::Constraint &constraint = inline_asm->get_constraint(i);
+    Operand hl_operand = hl_ins->get_operand(i);
+    if (constraint.kind == InlineAsm::IMM)
+      operands.push_back(hl_operand);
+    else if (constraint.kind == InlineAsm::MEM)
+      operands.push_back(get_asm_slot(hl_operand, next_free_reg(), ll_iseq));
+    else if (constraint.tied_to >= 0)
+      operands.push_back(operands[constraint.tied_to]);
+    else
+      operands.push_back(Operand(select_mreg_kind(constraint.size), constraint.mreg >= 0 ? MachineReg(constraint.mreg) : next_free_reg()));
+  }
+
+  for (unsigned i = 0; i < num_operands; ++i) {
+    const InlineAsm::Constraint &constraint = inline_asm->get_constraint(i);
+    if (constraint.kind != InlineAsm::REG || (constraint.is_output && !constraint.is_inout))
+      continue;
+    Operand hl_operand = hl_ins->get_operand(i);
+    Operand src = constraint.is_output ? get_asm_slot(hl_operand, MREG_R11, ll_iseq)
+                                       : get_ll_operand(hl_operand, constraint.size, ll_iseq);
+    Instruction* ld_inst = new Instruction(select_ll_opcode(MINS_MOVB, constraint.size), src, operands[i]);
+    ld_inst->set_comment("Load asm input");
+    ll_iseq->append(ld_inst);
+  }
+
+  Instruction* asm_inst = new Instruction(MINS_ASM);
+  for (const Operand &operand : operands)
+    asm_inst->append_operand(operand);
+  asm_inst->set_inline_asm(inline_asm);
+  ll_iseq->append(asm_inst);
+
+  for (unsigned i = 0; i < num_operands; ++i) {
+    const InlineAsm::Constraint &constraint = inline_asm->get_constraint(i);
+    if (constraint.kind != InlineAsm::REG || !constraint.is_output)
+      continue;
+    Operand dest = get_asm_slot(hl_ins->get_operand(i), MREG_R11, ll_iseq);
+    Instruction* st_inst = new Instruction(select_ll_opcode(MINS_MOVB, constraint.size), operands[i], dest);
+    st_inst->set_comment("Store asm output");
+    ll_iseq->append(st_inst);
+  }
+}
+
+// The stack slot an asm operand is passed through: an %rbp-relative
+// memory reference if the slot address is rematerialized, otherwise
+// the address is loaded into addr_reg
+Operand LowLevelCodeGen::get_asm_slot(Operand hl_operand, MachineReg addr_reg, std::shared_ptr<InstructionSequence> ll_iseq) {
+  auto remat = m_remat.find(hl_operand.get_base_reg());
+  if (remat != m_remat.end() && remat->second.value.is_memref())
+    return remat->second.value;
+
+  Operand addr = get_ll_operand(Operand(Operand::VREG, hl_operand.get_base_reg()), 8, ll_iseq);
+  Instruction* addr_inst = new Instruction(MINS_MOVQ, addr, Operand(Operand::MREG64, addr_reg));
+  addr_inst->set_comment("Load address of asm operand slot");
+  ll_iseq->append(addr_inst);
+  return Operand(Operand::MREG64_MEM, addr_reg);
+}
+
+// Atomic accesses. Aligned loads and stores are atomic on x86-64, and
+// neither loads nor stores are reordered with earlier loads, so only a
+// sequentially consistent store needs more than a mov: it is an xchg,
+// which is locked when one operand is in memory. The value goes through
+// %r11, which is cleared first, so the old value read by an exchange
+// or fetch and add is zero extended to the whole destination vreg.
+// cmpxchg implicitly compares with (and returns the old value in) %rax,
+// which holds vr0, so %rax is saved in %r10 around it.
+void LowLevelCodeGen::translate_atomic(Instruction *hl_ins, std::shared_ptr<InstructionSequence> ll_iseq) {
+  HighLevelOpcode hl_opcode = HighLevelOpcode(hl_ins->get_opcode());
+  if (hl_opcode == HINS_fence) {
+    Instruction* fence_inst = new Instruction(MINS_MFENCE);
+    fence_inst->set_comment("Memory barrier");
+    ll_iseq->append(fence_inst);
+    return;
+  }
+
+  int size = highlevel_opcode_get_source_operand_size(hl_opcode);
+  bool is_store = match_hl(HINS_atomic_store_b, hl_opcode);
+  Operand mem = get_ll_operand(hl_ins->get_operand(is_store ? 0 : 1), size, ll_iseq);
+  Operand temp = Operand(select_mreg_kind(size),MachineReg::MREG_R11);
+  Operand temp64 = Operand(select_mreg_kind(8),MachineReg::MREG_R11);
+
+  if (is_store) {
+    Operand src = get_ll_operand(hl_ins->get_operand(1), size, ll_iseq);
+    Instruction* mv_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), src, temp);
+    mv_inst->set_comment("Moving src to temp");
+    ll_iseq->append(mv_inst);
+
+    bool seq_cst = hl_ins->get_operand(2).get_imm_ival() == long(MemoryOrder::SEQ_CST);
+    Instruction* st_inst = new Instruction(select_ll_opcode(seq_cst ? MINS_XCHGB : MINS_MOVB, size), temp, mem);
+    st_inst->set_comment(seq_cst ? "Sequentially consistent store" : "Atomic store");
+    ll_iseq->append(st_inst);
+    return;
+  }
+
+  Operand dest = get_ll_operand(hl_ins->get_operand(0), 8, ll_iseq);
+  Instruction* clear_inst = new Instruction(MINS_MOVQ, Operand(Operand::IMM_IVAL,0), temp64);
+  clear_inst->set_comment("Clear temp register");
+  ll_iseq->append(clear_inst);
+
+  if (match_hl(HINS_atomic_load_b, hl_opcode)) {
+    Instruction* ld_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), mem, temp);
+    ld_inst->set_comment("Atomic load");
+    ll_iseq->append(ld_inst);
+  } else if (match_hl(HINS_atomic_cmpxchg_b, hl_opcode)) {
+    Operand expected = get_ll_operand(hl_ins->get_operand(2), size, ll_iseq);
+    Operand desired = get_ll_operand(hl_ins->get_operand(3), size, ll_iseq);
+    Operand rax = Operand(select_mreg_kind(8),MachineReg::MREG_RAX);
+    Operand saved_rax = Operand(select_mreg_kind(8),MachineReg::MREG_R10);
+    Instruction* save_inst = new Instruction(MINS_MOVQ, rax, saved_rax);
+    save_inst->set_comment("Save %rax");
+    ll_iseq->append(save_inst);
+
+    //operands referring to %rax now find its value in %r10
+    auto without_rax = [](Operand operand) {
+      if (!operand.is_non_reg() && operand.get_base_reg() == MREG_RAX)
+        return Operand(operand.get_kind(), MREG_R10);
+      return operand;
+    };
+    mem = without_rax(mem);
+
+    Instruction* mv_a_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), without_rax(desired), temp);
+    mv_a_inst->set_comment("Moving new value to temp");
+    ll_iseq->append(mv_a_inst);
+    Operand cmp = Operand(select_mreg_kind(size),MachineReg::MREG_RAX);
+    Instruction* mv_b_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), without_rax(expected), cmp);
+    mv_b_inst->set_comment("Moving expected value to %rax");
+    ll_iseq->append(mv_b_inst);
+
+    Instruction* cas_inst = new Instruction(select_ll_opcode(MINS_LOCK_CMPXCHGB, size), temp, mem);
+    cas_inst->set_comment("Atomic compare and swap");
+    ll_iseq->append(cas_inst);
+
+    Instruction* clear_b_inst = new Instruction(MINS_MOVQ, Operand(Operand::IMM_IVAL,0), temp64);
+    clear_b_inst->set_comment("Clear temp register");
+    ll_iseq->append(clear_b_inst);
+    Instruction* mv_c_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), cmp, temp);
+    mv_c_inst->set_comment("Moving old value to temp");
+    ll_iseq->append(mv_c_inst);
+    Instruction* restore_inst = new Instruction(MINS_MOVQ, saved_rax, rax);
+    restore_inst->set_comment("Restore %rax");
+    ll_iseq->append(restore_inst);
+  } else {
+    Operand src = get_ll_operand(hl_ins->get_operand(2), size, ll_iseq);
+    Instruction* mv_inst = new Instruction(select_ll_opcode(MINS_MOVB, size), src, temp);
+    mv_inst->set_comment("Moving src to temp");
+    ll_iseq->append(mv_inst);
+
+    bool is_xadd = match_hl(HINS_atomic_xadd_b, hl_opcode);
+    Instruction* op_inst = new Instruction(select_ll_opcode(is_xadd ? MINS_LOCK_XADDB : MINS_XCHGB, size), temp, mem);
+    op_inst->set_comment(is_xadd ? "Atomic fetch and add" : "Atomic exchange");
+    ll_iseq->append(op_inst);
+  }
+
+  Instruction* mv_d_inst = new Instruction(MINS_MOVQ, temp64, dest);
+  mv_d_inst->set_comment("Moving temp to dest");
+  ll_iseq->append(mv_d_inst);
+}
+
+// Registers saved by the prologue and restored by the epilogue.
+// The extra save of %rbp keeps %rsp 16-byte aligned at calls, which
+// a leaf function doesn't make.
+std::vector<MachineReg> LowLevelCodeGen::get_saved_regs() const {
+  if (m_function->has_attribute(Function::ATTR_LEAF))
+    return {MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+  return {MREG_RBP, MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+}
+
 Operand LowLevelCodeGen::get_ll_operand(Operand hl_opcode, int size, std::shared_ptr<InstructionSequence> ll_iseq){
   if (hl_opcode.get_kind() != Operand::IMM_IVAL && hl_opcode.has_base_reg()){//assert we are passed a VR 
     if (hl_opcode.get_base_reg()>=10) {//standard VR
+      auto remat = m_remat.find(hl_opcode.get_base_reg());
+      if (remat != m_remat.end())
+        return rematerialize(remat->second, hl_opcode, size, ll_iseq);
+
       int reg_index = hl_opcode.get_base_reg()-10;
       int mem_offset = -1*(m_register_base + 8*(reg_index+1));
       
@@ -711,10 +1136,14 @@ Operand LowLevelCodeGen::get_ll_operand(Operand hl_opcode, int size, std::shared
       }
       return Operand(Operand::MREG64_MEM_OFF,MachineReg::MREG_RBP,mem_offset);
     } else if (hl_opcode.get_base_reg()==0) { //passed return register
+      if (hl_opcode.get_kind() == Operand::VREG_MEM)//dereference the pointer it holds
+        return Operand(Operand::MREG64_MEM,MachineReg::MREG_RAX);
       return Operand(select_mreg_kind(size),MachineReg::MREG_RAX);
     } else { //passed an input register
       std::vector<MachineReg> args = {MREG_RDI,MREG_RSI,MREG_RDX,MREG_RCX,MREG_R8,MREG_R9};
       int reg_index = hl_opcode.get_base_reg() -1;
+      if (hl_opcode.get_kind() == Operand::VREG_MEM)//dereference the pointer it holds
+        return Operand(Operand::MREG64_MEM,args[reg_index]);
       return Operand(select_mreg_kind(size),args[reg_index]);
     }
   } else { //passed a literal memref
@@ -722,6 +1151,133 @@ Operand LowLevelCodeGen::get_ll_operand(Operand hl_opcode, int size, std::shared
   }
 }
 
+// Recompute the value of a rematerialized vreg at one of its uses.
+// Constants and labels are used directly as immediates, and a dereferenced
+// local (or thread-local) address becomes an %rbp-relative (or
+// %fs-relative) memory reference. Otherwise the
+// value is recomputed into one of the (otherwise unused) callee-saved
+// registers pushed by the prologue.
+Operand LowLevelCodeGen::rematerialize(const RematInfo &remat, Operand hl_opcode, int size, std::shared_ptr<InstructionSequence> ll_iseq) {
+  bool is_addr = remat.value.is_memref();
+  if (hl_opcode.get_kind() == Operand::VREG_MEM && is_addr)
+    return remat.value;
+  if (hl_opcode.get_kind() == Operand::VREG && !is_addr)
+    return remat.value;
+
+  MachineReg reg = m_remat_regs[m_remat_reg];
+  m_remat_reg ++;
+  m_remat_reg %= int(m_remat_regs.size());
+
+  Operand temp = Operand(Operand::MREG64, reg);
+  std::string comment = "Rematerialize vr" + std::to_string(hl_opcode.get_base_reg());
+  if (remat.value.get_kind() == Operand::LABEL_MEM_FS) {
+    // leaq ignores the segment, so add the offset to the thread pointer
+    Instruction* tp_inst = new Instruction(MINS_MOVQ, Operand(Operand::LABEL_MEM_FS, ""), temp);
+    tp_inst->set_comment(comment);
+    ll_iseq->append(tp_inst);
+    ll_iseq->append(new Instruction(MINS_ADDQ, Operand(Operand::IMM_LABEL, remat.value.get_label()), temp));
+  } else {
+    Instruction* remat_inst = new Instruction(is_addr ? MINS_LEAQ : MINS_MOVQ, remat.value, temp);
+    remat_inst->set_comment(comment);
+    ll_iseq->append(remat_inst);
+  }
+
+  if (hl_opcode.get_kind() == Operand::VREG_MEM)
+    return Operand(Operand::MREG64_MEM, reg);
+  assert(size == 8);
+  return temp;
+}
+
+namespace {
+
+// Does val fit in a signed immediate operand of the given size?
+// (Immediates of 8 byte instructions are sign-extended 32 bit values.)
+bool fits_in_size(long val, int size) {
+  if (size != 1 && size != 2 && size != 4 && size != 8)
+    return false;
+  long limit = 1L << (std::min(size, 4)*8 - 1);
+  return val >= -limit && val < limit;
+}
+
+}
+
+// Find the vregs that can be rematerialized: those with a single definition
+// that loads an integer constant, a string constant label, or the address
+// of a local variable or a local-exec thread-local variable, and whose uses
+// can all take the recomputed value in place of a load from the stack slot.
+void LowLevelCodeGen::find_remat_candidates(std::shared_ptr<InstructionSequence> hl_iseq) {
+  std::map<int, int> num_defs;
+
+  for (auto i = hl_iseq->cbegin(); i != hl_iseq->cend(); ++i) {
+    Instruction *hl_ins = *i;
+    if (!HighLevel::is_def(hl_ins))
+      continue;
+    int vreg = HighLevel::get_def_vreg(hl_ins);
+    if (vreg < 10 || ++num_defs[vreg] > 1 || i.has_label())
+      continue; // a labeled definition is kept so the label has an instruction
+
+    HighLevelOpcode hl_opcode = HighLevelOpcode(hl_ins->get_opcode());
+    Operand src = hl_ins->get_operand(1);
+    if (match_hl(HINS_mov_b, hl_opcode) && src.is_imm_ival() && fits_in_size(src.get_imm_ival(), get_size(hl_opcode))) {
+      m_remat[vreg] = { get_size(hl_opcode), src };
+    } else if (hl_opcode == HINS_mov_q && src.is_imm_label()) {
+      m_remat[vreg] = { 8, src };
+    } else if (hl_opcode == HINS_localaddr && src.is_imm_ival()) {
+      int mem_offset = -1*(m_data_base - src.get_imm_ival());
+      m_remat[vreg] = { 8, Operand(Operand::MREG64_MEM_OFF, MachineReg::MREG_RBP, mem_offset) };
+    } else if (hl_opcode == HINS_tlsaddr && hl_ins->get_operand(2).get_imm_ival() == 0) {
+      // a local-exec thread-local variable is at %fs:x@tpoff
+      m_remat[vreg] = { 8, Operand(Operand::LABEL_MEM_FS, src.get_label() + "@tpoff") };
+    }
+  }
+
+  for (auto i = num_defs.begin(); i != num_defs.end(); ++i) {
+    if (i->second > 1)
+      m_remat.erase(i->first);
+  }
+
+  // Check the uses
+  for (auto i = hl_iseq->cbegin(); i != hl_iseq->cend() && !m_remat.empty(); ++i) {
+    Instruction *hl_ins = *i;
+    HighLevelOpcode hl_opcode = HighLevelOpcode(hl_ins->get_opcode());
+    bool is_cjmp = (hl_opcode == HINS_cjmp_t || hl_opcode == HINS_cjmp_f);
+    int use_size = is_cjmp ? 1 : get_size(hl_opcode);
+
+    for (unsigned j = 0; j < hl_ins->get_num_operands(); ++j) {
+      if (!HighLevel::is_use(hl_ins, j))
+        continue;
+      Operand operand = hl_ins->get_operand(j);
+      if (operand.has_index_reg())
+        m_remat.erase(operand.get_index_reg());
+      if (!operand.has_base_reg())
+        continue;
+      auto remat = m_remat.find(operand.get_base_reg());
+      if (remat == m_remat.end())
+        continue;
+
+      const RematInfo &info = remat->second;
+      bool ok;
+      if (operand.get_kind() == Operand::VREG_MEM) {
+        // dereferenced: the value must be a full 8 byte address
+        ok = (info.def_size == 8);
+      } else if (operand.get_kind() != Operand::VREG) {
+        ok = false;
+      } else if (info.value.is_imm_ival()) {
+        // a narrower read must see the truncated value, and a wider
+        // read sees unspecified upper bytes of the stack slot (so the
+        // zero-extended value is as good as any), so the value must be
+        // the same at either size
+        long val = info.value.get_imm_ival();
+        ok = (use_size == info.def_size) || (val >= 0 && fits_in_size(val, use_size));
+      } else {
+        ok = (use_size == 8 && !is_cjmp);
+      }
+      if (!ok)
+        m_remat.erase(remat);
+    }
+  }
+}
+
 
 int get_size(HighLevelOpcode opcode) {
     switch (opcode) {
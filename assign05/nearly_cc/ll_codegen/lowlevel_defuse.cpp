@@ -26,6 +26,7 @@
 #include "instruction.h"
 #include "symtab.h"
 #include "lowlevel.h"
+#include "inline_asm.h"
 #include "lowlevel_defuse.h"
 
 namespace {
@@ -48,6 +49,10 @@ const std::set<LowLevelOpcode> NORMAL_OPCODES = {
   MINS_SUBL,
   MINS_SUBQ,
   MINS_LEAQ,
+  MINS_ANDB,
+  MINS_ANDW,
+  MINS_ANDL,
+  MINS_ANDQ,
   MINS_IMULL,
   MINS_IMULQ,
   MINS_POPQ,
@@ -69,11 +74,19 @@ const std::set<LowLevelOpcode> NORMAL_OPCODES = {
   MINS_SETGE,
   MINS_SETE,
   MINS_SETNE,
+  MINS_POPCNTL,
+  MINS_POPCNTQ,
+  MINS_LZCNTL,
+  MINS_LZCNTQ,
+  MINS_TZCNTL,
+  MINS_TZCNTQ,
+  MINS_BSWAPL,
+  MINS_BSWAPQ,
 };
 
 // Subset of NORMAL_OPCODES where the destination is not a use
 // (basically, just the move instructions, set instructions,
-// leaq, and popq)
+// leaq, popq, and the bit counts)
 const std::set<LowLevelOpcode> MOVE_OPCODES = {
   MINS_MOVB,
   MINS_MOVW,
@@ -99,6 +112,12 @@ const std::set<LowLevelOpcode> MOVE_OPCODES = {
   MINS_SETNE,
   MINS_LEAQ,
   MINS_POPQ,
+  MINS_POPCNTL,
+  MINS_POPCNTQ,
+  MINS_LZCNTL,
+  MINS_LZCNTQ,
+  MINS_TZCNTL,
+  MINS_TZCNTQ,
 };
 
 // Opcodes that are defs, but have implicit operands
@@ -108,6 +127,19 @@ const std::set<LowLevelOpcode> IMPLICIT_DEF_OPCODES = {
   MINS_CDQ,
   MINS_CQTO,
   MINS_CALL,
+  MINS_ASM,
+  MINS_LOCK_XADDB,
+  MINS_LOCK_XADDW,
+  MINS_LOCK_XADDL,
+  MINS_LOCK_XADDQ,
+  MINS_XCHGB,
+  MINS_XCHGW,
+  MINS_XCHGL,
+  MINS_XCHGQ,
+  MINS_LOCK_CMPXCHGB,
+  MINS_LOCK_CMPXCHGW,
+  MINS_LOCK_CMPXCHGL,
+  MINS_LOCK_CMPXCHGQ,
 };
 
 // Opcodes that are never defs, and in which explicit operands
@@ -129,6 +161,12 @@ const std::set<LowLevelOpcode> NON_DEF_OPCODES = {
   MINS_CMPW,
   MINS_CMPL,
   MINS_CMPQ,
+  MINS_PREFETCHNTA,
+  MINS_PREFETCHT2,
+  MINS_PREFETCHT1,
+  MINS_PREFETCHT0,
+  MINS_UD2,
+  MINS_MFENCE,
 };
 
 // Opcodes that are never uses
@@ -150,6 +188,10 @@ const std::set<LowLevelOpcode> NON_USE_OPCODES = {
 // MINS_CALL: def of %rax, use of whichever arg regs are used
 // MINS_IDIVL, MINS_IDIVQ: implicit def and use of %rax and %rdx
 // MINS_CDQ, MINS_CQTO: implicit use of %rax, implicit def of %rdx
+// MINS_ASM: def of the output and clobbered registers, use of the
+//           input (and input/output) registers
+// MINS_LOCK_XADDx, MINS_XCHGx: def and use of the register operand
+// MINS_LOCK_CMPXCHGx: implicit def and use of %rax
 // MINS_RET: implicit use of %rax?
 
 }
@@ -191,6 +233,23 @@ std::vector<MachineReg> LowLevel::get_def_mregs(Instruction *ins) {
   if (ll_opcode == MINS_RET)
     return std::vector<MachineReg>();
 
+  if (ll_opcode >= MINS_LOCK_XADDB && ll_opcode <= MINS_XCHGQ)
+    return std::vector<MachineReg>({ MachineReg(ins->get_operand(0).get_base_reg()) });
+
+  if (ll_opcode >= MINS_LOCK_CMPXCHGB && ll_opcode <= MINS_LOCK_CMPXCHGQ)
+    return std::vector<MachineReg>({ MREG_RAX });
+
+  if (ll_opcode == MINS_ASM) {
+    std::shared_ptr<InlineAsm> inline_asm = ins->get_inline_asm();
+    std::vector<MachineReg> defs = inline_asm->get_clobbers();
+    for (unsigned i = 0; i < ins->get_num_operands(); ++i) {
+      Operand operand = ins->get_operand(i);
+      if (inline_asm->get_constraint(i).is_output && !operand.is_non_reg() && !operand.is_memref())
+        defs.push_back(MachineReg(operand.get_base_reg()));
+    }
+    return defs;
+  }
+
   // For all "normal" instructions, the last operand is the one
   // being defined
   if (NORMAL_OPCODES.count(ll_opcode) > 0) {
@@ -250,6 +309,36 @@ std::vector<MachineReg> LowLevel::get_use_mregs(Instruction *ins) {
   if (ll_opcode == MINS_POPQ)
     return std::vector<MachineReg>();
 
+  if (ll_opcode >= MINS_LOCK_XADDB && ll_opcode <= MINS_LOCK_CMPXCHGQ) {
+    std::set<MachineReg> uses;
+    if (ll_opcode >= MINS_LOCK_CMPXCHGB)
+      uses.insert(MREG_RAX);
+    for (unsigned i = 0; i < num_operands; ++i) {
+      Operand operand = ins->get_operand(i);
+      if (operand.has_base_reg())
+        uses.insert(MachineReg(operand.get_base_reg()));
+      if (operand.has_index_reg())
+        uses.insert(MachineReg(operand.get_index_reg()));
+    }
+    return std::vector<MachineReg>(uses.begin(), uses.end());
+  }
+
+  if (ll_opcode == MINS_ASM) {
+    std::shared_ptr<InlineAsm> inline_asm = ins->get_inline_asm();
+    std::set<MachineReg> uses;
+    for (unsigned i = 0; i < num_operands; ++i) {
+      Operand operand = ins->get_operand(i);
+      const InlineAsm::Constraint &constraint = inline_asm->get_constraint(i);
+      if (operand.is_non_reg() || (constraint.is_output && !constraint.is_inout && !operand.is_memref()))
+        continue;
+      if (operand.has_base_reg())
+        uses.insert(MachineReg(operand.get_base_reg()));
+      if (operand.has_index_reg())
+        uses.insert(MachineReg(operand.get_index_reg()));
+    }
+    return std::vector<MachineReg>(uses.begin(), uses.end());
+  }
+
 
   // For "normal" opcodes and "non-def" opcodes: any mreg mentioned that isn't
   // the destination operand is a use
@@ -22,6 +22,7 @@
 #include "instruction.h"
 #include "exceptions.h"
 #include "lowlevel.h"
+#include "inline_asm.h"
 #include "lowlevel_formatter.h"
 
 namespace {
@@ -69,6 +70,18 @@ LowLevelFormatter::~LowLevelFormatter() {
 }
 
 std::string LowLevelFormatter::format_operand(const Operand &operand) const {
+  if (operand.get_kind() == Operand::LABEL_MEM_FS) {
+    // %fs:0 is the thread pointer itself
+    std::string label = operand.get_label();
+    long offset = operand.get_offset();
+    if (label.empty())
+      return "%fs:" + std::to_string(offset);
+    return "%fs:" + label + (offset > 0 ? "+" : "") + (offset != 0 ? std::to_string(offset) : "");
+  }
+
+  if (operand.get_kind() == Operand::LABEL_MEM_RIP)
+    return operand.get_label() + "(%rip)";
+
   if (operand.is_non_reg()) {
     // non-register operands are handled by the base class
     return Formatter::format_operand(operand);
@@ -112,6 +125,8 @@ std::string LowLevelFormatter::format_operand(const Operand &operand) const {
 
 std::string LowLevelFormatter::format_instruction(const Instruction *ins) const {
   LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+  if (opcode == MINS_ASM)
+    return format_inline_asm(ins);
 
   const char *mnemonic_ptr = lowlevel_opcode_to_str(opcode);
   if (mnemonic_ptr == nullptr)
@@ -135,3 +150,28 @@ std::string LowLevelFormatter::format_instruction(const Instruction *ins) const
 
   return buf;
 }
+
+// Expand the operand references in an inline assembly template.
+// A register operand is named at the size selected by its modifier
+// (b, w, k, or q) if it has one, and an immediate operand is printed
+// without the '$' with the c modifier.
+std::string LowLevelFormatter::format_inline_asm(const Instruction *ins) const {
+  std::string buf;
+  for (const InlineAsm::Piece &piece : ins->get_inline_asm()->get_pieces()) {
+    if (piece.operand < 0) {
+      buf += piece.text;
+      continue;
+    }
+
+    const Operand &operand = ins->get_operand(piece.operand);
+    if (operand.is_imm_ival() && piece.modifier == 'c') {
+      buf += std::to_string(operand.get_imm_ival());
+    } else if (operand.is_non_reg() || operand.is_memref() || piece.modifier == 0 || piece.modifier == 'c') {
+      buf += format_operand(operand);
+    } else {
+      int size = piece.modifier == 'b' ? BYTE : piece.modifier == 'w' ? WORD : piece.modifier == 'k' ? DWORD : QUAD;
+      buf += format_reg(operand.get_base_reg(), size);
+    }
+  }
+  return buf;
+}
@@ -18,10 +18,402 @@
 // ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <cassert>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
 #include "cfg_builder.h"
+#include "cfg_transform.h"
+#include "loop_info.h"
+#include "block_frequency.h"
+#include "lowlevel.h"
+#include "lowlevel_defuse.h"
 #include "peephole_ll.h"
 #include "lowlevel_opt.h"
 
+Operand::Kind select_mreg_kind(int operand_size);
+
+namespace {
+
+// Size in bytes of an operand of a low-level instruction, or 0 if it
+// can't be determined from the opcode
+int get_ll_operand_size(LowLevelOpcode opcode, unsigned index) {
+  if (opcode >= MINS_MOVB && opcode <= MINS_SUBQ)
+    return 1 << ((opcode - MINS_MOVB) % 4);
+  if (opcode >= MINS_CMPB && opcode <= MINS_CMPQ)
+    return 1 << (opcode - MINS_CMPB);
+  if (opcode >= MINS_ANDB && opcode <= MINS_DECQ)
+    return 1 << ((opcode - MINS_ANDB) % 4);
+  if (opcode >= MINS_SETL && opcode <= MINS_SETNE)
+    return 1;
+  if (opcode >= MINS_MOVSBW && opcode <= MINS_MOVZLQ) {
+    // source and destination sizes of the sign/zero extending moves
+    static const int SIZES[6][2] = { {1, 2}, {1, 4}, {1, 8}, {2, 4}, {2, 8}, {4, 8} };
+    return SIZES[(opcode - MINS_MOVSBW) % 6][index];
+  }
+  if (opcode >= MINS_POPCNTL && opcode <= MINS_BSWAPQ)
+    return 4 << ((opcode - MINS_POPCNTL) % 2);
+  if (opcode == MINS_IMULL)
+    return 4;
+  if (opcode == MINS_IMULQ || opcode == MINS_PUSHQ || opcode == MINS_POPQ)
+    return 8;
+  return 0;
+}
+
+// Does operand index of the instruction get written?
+bool is_written(Instruction *ins, unsigned index) {
+  LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+  if (index != ins->get_num_operands() - 1)
+    return false;
+  return (opcode >= MINS_MOVB && opcode <= MINS_SUBQ)
+      || (opcode >= MINS_ANDB && opcode <= MINS_DECQ)
+      || (opcode >= MINS_SETL && opcode <= MINS_SETNE)
+      || (opcode >= MINS_MOVSBW && opcode <= MINS_MOVZLQ)
+      || opcode == MINS_IMULL || opcode == MINS_IMULQ || opcode == MINS_POPQ;
+}
+
+bool is_jump(LowLevelOpcode opcode) {
+  return opcode >= MINS_JMP && opcode <= MINS_JAE;
+}
+
+bool is_callee_saved(MachineReg mreg) {
+  return mreg == MREG_RBX || mreg == MREG_RBP || mreg == MREG_RSP
+      || (mreg >= MREG_R12 && mreg <= MREG_R15);
+}
+
+// Registers that can hold promoted vreg slots, callee-saved first
+// (LowLevelCodeGen's prologue saves all of them, and they survive calls)
+const MachineReg PROMOTION_REGS[] = {
+  MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15,
+  MREG_R10, MREG_RCX, MREG_RDX, MREG_RSI, MREG_RDI, MREG_R8, MREG_R9,
+};
+
+// The same registers for a leaf function, caller-saved first: with no
+// calls, they are as good as callee-saved ones, and don't need to be
+// saved by the prologue
+const MachineReg LEAF_PROMOTION_REGS[] = {
+  MREG_R10, MREG_RCX, MREG_RDX, MREG_RSI, MREG_RDI, MREG_R8, MREG_R9,
+  MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15,
+};
+
+// Live-range splitting for vreg stack slots in innermost loops.
+// LowLevelCodeGen keeps every vreg in a stack slot. Inside a loop, a slot
+// that is read often gets a copy in a register the function doesn't
+// otherwise use, and reads in the loop use the register. Stores still go
+// to the slot, so memory is always up to date and nothing needs to be
+// spilled: the register is loaded in the blocks branching into the loop,
+// refreshed after each store, and (if it is caller-saved) reloaded right
+// after each call in the loop. A rarely taken call therefore only costs
+// reloads on its own (cold) path instead of keeping the values in memory
+// for the whole loop. Slots and registers are chosen by comparing the
+// estimated frequency of reads against the reloads they need.
+class LiveRangeSplit : public ControlFlowGraphTransform {
+private:
+  struct Promotion {
+    long offset;       // %rbp offset of the vreg slot
+    MachineReg mreg;   // register holding a copy of the slot
+  };
+
+  BlockFrequency m_block_frequency;
+  int m_vreg_slot_offset;
+  bool m_leaf;
+  // block id -> slots promoted in the loop containing the block
+  std::map<unsigned, std::vector<Promotion>> m_promoted;
+  // block id -> registers to load before the block branches into a loop
+  std::map<unsigned, std::vector<Promotion>> m_entry_loads;
+
+public:
+  LiveRangeSplit(std::shared_ptr<ControlFlowGraph> cfg, int vreg_slot_offset, bool leaf)
+    : ControlFlowGraphTransform(cfg)
+    , m_block_frequency(cfg, false)
+    , m_vreg_slot_offset(vreg_slot_offset)
+    , m_leaf(leaf) {
+    m_block_frequency.execute();
+    if (m_vreg_slot_offset < 0)
+      choose_promotions();
+  }
+
+  virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
+    std::shared_ptr<InstructionSequence> result_bb(new InstructionSequence());
+    unsigned id = orig_bb->get_block_id();
+    const std::vector<Promotion> &promoted = m_promoted[id];
+    const std::vector<Promotion> &entry_loads = m_entry_loads[id];
+    bool loaded = entry_loads.empty();
+
+    unsigned index = 0;
+    for (auto i = orig_bb->cbegin(); i != orig_bb->cend(); ++i, ++index) {
+      Instruction *orig_ins = *i;
+      LowLevelOpcode opcode = LowLevelOpcode(orig_ins->get_opcode());
+
+      // loads for the loop go just before the branch into it
+      // (moves don't change the condition codes)
+      if (!loaded && index == orig_bb->get_length() - 1 && is_jump(opcode)) {
+        append_loads(result_bb, entry_loads, "Load vreg slot for loop");
+        loaded = true;
+      }
+
+      Instruction *ins = orig_ins->duplicate();
+      std::vector<Promotion> refresh;
+      for (unsigned j = 0; j < ins->get_num_operands(); ++j) {
+        Operand operand = ins->get_operand(j);
+        if (!is_vreg_slot(operand))
+          continue;
+        for (auto k = promoted.cbegin(); k != promoted.cend(); ++k) {
+          if (k->offset != operand.get_offset())
+            continue;
+          if (is_written(ins, j))
+            refresh.push_back(*k);
+          else
+            ins->set_operand(j, Operand(select_mreg_kind(get_ll_operand_size(opcode, j)), k->mreg));
+        }
+      }
+      result_bb->append(ins);
+
+      append_loads(result_bb, refresh, "Refresh register copy of vreg slot");
+
+      if (opcode == MINS_CALL) {
+        std::vector<Promotion> reload;
+        for (auto k = promoted.cbegin(); k != promoted.cend(); ++k) {
+          if (!is_callee_saved(k->mreg))
+            reload.push_back(*k);
+        }
+        append_loads(result_bb, reload, "Reload vreg slot after call");
+      }
+    }
+
+    if (!loaded)
+      append_loads(result_bb, entry_loads, "Load vreg slot for loop");
+
+    return result_bb;
+  }
+
+private:
+  bool is_vreg_slot(const Operand &operand) const {
+    return operand.get_kind() == Operand::MREG64_MEM_OFF
+        && operand.get_base_reg() == MREG_RBP
+        && operand.get_offset() <= m_vreg_slot_offset;
+  }
+
+  void append_loads(std::shared_ptr<InstructionSequence> bb, const std::vector<Promotion> &loads, const std::string &comment) {
+    for (auto i = loads.cbegin(); i != loads.cend(); ++i) {
+      Operand slot(Operand::MREG64_MEM_OFF, MREG_RBP, i->offset);
+      Instruction *load = new Instruction(MINS_MOVQ, slot, Operand(Operand::MREG64, i->mreg));
+      load->set_comment(comment);
+      bb->append(load);
+    }
+  }
+
+  std::shared_ptr<InstructionSequence> get_block(unsigned id) {
+    return *(get_orig_cfg()->bb_begin() + id);
+  }
+
+  // Estimate how often each block of a loop executes per iteration
+  std::map<unsigned, double> estimate_frequencies(const LoopInfo::Loop &loop) {
+    std::map<unsigned, double> freq;
+    double header_freq = m_block_frequency.get_frequency(loop.header);
+    for (auto i = loop.blocks.cbegin(); i != loop.blocks.cend(); ++i) {
+      if (header_freq > 0.0)
+        freq[*i] = m_block_frequency.get_frequency(get_block(*i)) / header_freq;
+    }
+    return freq;
+  }
+
+  void choose_promotions() {
+    std::shared_ptr<ControlFlowGraph> cfg = get_orig_cfg();
+
+    // Only registers the function never mentions are candidates
+    // (saving and restoring callee-saved registers doesn't count).
+    // Slots whose address is taken anywhere can be modified through
+    // a pointer, so they are never promoted.
+    std::vector<bool> used(MREG_END, false);
+    std::set<long> address_taken;
+    for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+      for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) {
+        Instruction *ins = *j;
+        LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+        if ((opcode == MINS_PUSHQ || opcode == MINS_POPQ) && ins->get_operand(0).get_kind() == Operand::MREG64
+            && is_callee_saved(MachineReg(ins->get_operand(0).get_base_reg())))
+          continue;
+        for (unsigned k = 0; k < ins->get_num_operands(); ++k) {
+          Operand operand = ins->get_operand(k);
+          if (opcode == MINS_LEAQ && is_vreg_slot(operand))
+            address_taken.insert(operand.get_offset());
+          if (operand.has_base_reg())
+            used[operand.get_base_reg()] = true;
+          if (operand.has_index_reg())
+            used[operand.get_index_reg()] = true;
+        }
+        if (opcode == MINS_IDIVL || opcode == MINS_IDIVQ || opcode == MINS_CDQ || opcode == MINS_CQTO)
+          used[MREG_RAX] = used[MREG_RDX] = true;
+        if (opcode >= MINS_LOCK_CMPXCHGB && opcode <= MINS_LOCK_CMPXCHGQ)
+          used[MREG_RAX] = true;
+        if (opcode == MINS_RET)
+          used[MREG_RAX] = true;
+        if (opcode == MINS_ASM) {
+          for (MachineReg mreg : LowLevel::get_def_mregs(ins))
+            used[mreg] = true;
+        }
+      }
+    }
+
+    // block id -> registers written by promotions in (or entering) that block
+    std::map<unsigned, std::set<MachineReg>> reserved;
+
+    const std::vector<LoopInfo::Loop> &loops = m_block_frequency.get_loop_info().get_loops();
+    for (auto i = loops.cbegin(); i != loops.cend(); ++i) {
+      const LoopInfo::Loop &loop = *i;
+      if (!loop.innermost)
+        continue;
+
+      // find the blocks outside the loop that branch to the header
+      std::set<unsigned> entries;
+      bool ok = true;
+      const ControlFlowGraph::EdgeList &incoming_edges = cfg->get_incoming_edges(loop.header);
+      for (auto j = incoming_edges.cbegin(); j != incoming_edges.cend(); ++j) {
+        std::shared_ptr<InstructionSequence> pred = (*j)->get_source();
+        if (loop.contains(pred))
+          continue;
+        if (pred->get_kind() != BASICBLOCK_INTERIOR)
+          ok = false;
+        entries.insert(pred->get_block_id());
+      }
+      if (!ok || entries.empty())
+        continue;
+
+      // weigh the reads and writes of each vreg slot, and the calls,
+      // by the estimated frequency of their blocks
+      std::map<unsigned, double> freq = estimate_frequencies(loop);
+      std::map<long, double> reads, writes;
+      std::set<long> unsafe;
+      double calls = 0.0;
+      for (auto j = loop.blocks.cbegin(); j != loop.blocks.cend(); ++j) {
+        std::shared_ptr<InstructionSequence> bb = get_block(*j);
+        for (auto k = bb->cbegin(); k != bb->cend(); ++k) {
+          Instruction *ins = *k;
+          LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+          if (opcode == MINS_CALL)
+            calls += freq[*j];
+          for (unsigned m = 0; m < ins->get_num_operands(); ++m) {
+            Operand operand = ins->get_operand(m);
+            if (!is_vreg_slot(operand))
+              continue;
+            if (get_ll_operand_size(opcode, m) == 0)
+              unsafe.insert(operand.get_offset());
+            else if (is_written(ins, m))
+              writes[operand.get_offset()] += freq[*j];
+            else
+              reads[operand.get_offset()] += freq[*j];
+          }
+        }
+      }
+
+      // registers already used by promotions for a loop sharing a block
+      // with this loop or its entries
+      std::set<MachineReg> taken;
+      std::set<unsigned> touched(loop.blocks);
+      touched.insert(entries.begin(), entries.end());
+      for (auto j = touched.cbegin(); j != touched.cend(); ++j)
+        taken.insert(reserved[*j].begin(), reserved[*j].end());
+
+      // most profitable slots first
+      std::vector<std::pair<double, long>> candidates;
+      for (auto j = reads.cbegin(); j != reads.cend(); ++j) {
+        if (unsafe.count(j->first) == 0 && address_taken.count(j->first) == 0 && j->second > writes[j->first])
+          candidates.push_back({ j->second - writes[j->first], j->first });
+      }
+      std::stable_sort(candidates.begin(), candidates.end(), [](const std::pair<double, long> &a, const std::pair<double, long> &b) {
+        return a.first > b.first;
+      });
+
+      std::vector<Promotion> promotions;
+      for (auto j = candidates.cbegin(); j != candidates.cend(); ++j) {
+        for (MachineReg mreg : (m_leaf ? LEAF_PROMOTION_REGS : PROMOTION_REGS)) {
+          if (used[mreg] || taken.count(mreg) > 0)
+            continue;
+          // a caller-saved register must be reloaded after every call
+          double cost = writes[j->second] + (is_callee_saved(mreg) ? 0.0 : calls);
+          if (reads[j->second] > cost) {
+            promotions.push_back({ j->second, mreg });
+            taken.insert(mreg);
+          }
+          break;
+        }
+      }
+      if (promotions.empty())
+        continue;
+
+      for (auto j = loop.blocks.cbegin(); j != loop.blocks.cend(); ++j)
+        m_promoted[*j] = promotions;
+      for (auto j = entries.cbegin(); j != entries.cend(); ++j) {
+        std::vector<Promotion> &loads = m_entry_loads[*j];
+        loads.insert(loads.end(), promotions.begin(), promotions.end());
+      }
+      for (auto j = touched.cbegin(); j != touched.cend(); ++j) {
+        for (auto k = promotions.cbegin(); k != promotions.cend(); ++k)
+          reserved[*j].insert(k->mreg);
+      }
+    }
+  }
+};
+
+// Removal of the saves and restores of callee-saved registers that a leaf
+// function never uses. Since a leaf function makes no calls, its
+// prologue only needs to preserve the registers its own code writes.
+class LeafFrame : public ControlFlowGraphTransform {
+private:
+  std::vector<bool> m_used;
+
+public:
+  LeafFrame(std::shared_ptr<ControlFlowGraph> cfg)
+    : ControlFlowGraphTransform(cfg)
+    , m_used(MREG_END, false) {
+    for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+      for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) {
+        Instruction *ins = *j;
+        if (is_save_or_restore(ins))
+          continue;
+        for (unsigned k = 0; k < ins->get_num_operands(); ++k) {
+          Operand operand = ins->get_operand(k);
+          if (operand.has_base_reg())
+            m_used[operand.get_base_reg()] = true;
+          if (operand.has_index_reg())
+            m_used[operand.get_index_reg()] = true;
+        }
+        // registers clobbered by inline assembly
+        if (ins->get_opcode() == MINS_ASM) {
+          for (MachineReg mreg : LowLevel::get_def_mregs(ins))
+            m_used[mreg] = true;
+        }
+      }
+    }
+  }
+
+  virtual std::shared_ptr<InstructionSequence> transform_basic_block(std::shared_ptr<InstructionSequence> orig_bb) {
+    std::shared_ptr<InstructionSequence> result_bb(new InstructionSequence());
+    for (auto i = orig_bb->cbegin(); i != orig_bb->cend(); ++i) {
+      Instruction *ins = *i;
+      if (is_save_or_restore(ins) && !m_used[ins->get_operand(0).get_base_reg()])
+        continue;
+      result_bb->append(ins->duplicate());
+    }
+    return result_bb;
+  }
+
+private:
+  // pushq/popq of a callee-saved register other than %rbp
+  // (the frame pointer is always used)
+  static bool is_save_or_restore(Instruction *ins) {
+    LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+    if ((opcode != MINS_PUSHQ && opcode != MINS_POPQ) || ins->get_operand(0).get_kind() != Operand::MREG64)
+      return false;
+    MachineReg mreg = MachineReg(ins->get_operand(0).get_base_reg());
+    return is_callee_saved(mreg) && mreg != MREG_RBP && mreg != MREG_RSP;
+  }
+};
+
+}
+
 LowLevelOpt::LowLevelOpt(const Options &options)
   : m_options(options) {
 }
@@ -32,21 +424,23 @@ LowLevelOpt::~LowLevelOpt() {
 void LowLevelOpt::optimize(std::shared_ptr<Function> function) {
   assert(m_options.has_option(Options::OPTIMIZE));
 
-  // Like HighLevelOpt, LowLevelOpt will be most easily implemented
-  // using optimizations deriving from ControlFlowGraphTransform.
-  // E.g.:
-  //
-  //   std::shared_ptr<InstructionSequence> ll_iseq = function.get_ll_iseq();
-  //   auto ll_cfg_builder = ::make_lowlevel_cfg_builder(ll_iseq);
-  //   std::shared_ptr<ControlFlowGraph> ll_cfg = ll_cfg_builder.build();
-  //
-  //   Optimization1 opt1(ll_cfg, m_options);
-  //   ll_cfg = opt1.transform_cfg();
-  //
-  //   Optimization2 opt2(ll_cfg, m_options);
-  //   ll_cfg = opt2.transform_cfg();
-  //
-  //   ll_iseq = ll_cfg.create_instruction_sequence();
-  //   function->set_ll_iseq(ll_iseq);
-}
+  m_function = function;
+
+  std::shared_ptr<InstructionSequence> ll_iseq = m_function->get_ll_iseq();
+  auto ll_cfg_builder = ::make_lowlevel_cfg_builder(ll_iseq);
+  std::shared_ptr<ControlFlowGraph> ll_cfg = ll_cfg_builder.build();
 
+  // Keep vreg slots that are read often in loops in registers
+  bool leaf = m_function->has_attribute(Function::ATTR_LEAF);
+  LiveRangeSplit live_range_split(ll_cfg, m_function->get_vreg_slot_offset(), leaf);
+  ll_cfg = live_range_split.transform_cfg();
+
+  // Leaf functions only save the callee-saved registers they use
+  if (leaf) {
+    LeafFrame leaf_frame(ll_cfg);
+    ll_cfg = leaf_frame.transform_cfg();
+  }
+
+  ll_iseq = ll_cfg->create_instruction_sequence();
+  m_function->set_ll_iseq(ll_iseq);
+}
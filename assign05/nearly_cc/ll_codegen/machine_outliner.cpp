@@ -0,0 +1,271 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cassert>
+#include <algorithm>
+#include "lowlevel.h"
+#include "lowlevel_formatter.h"
+#include "cfg_builder.h"
+#include "block_frequency.h"
+#include "machine_outliner.h"
+
+namespace {
+
+// Lengths (in instructions) of the sequences considered for outlining
+const unsigned MIN_LENGTH = 2;
+const unsigned MAX_LENGTH = 32;
+
+// Blocks estimated to execute at most this many times per call of
+// their function are cold (the slack allows for rounding)
+const double COLD_FREQUENCY = 1.001;
+
+// Sizes (in bytes) of the instructions calling and returning
+// from an outlined function
+const long CALL_SIZE = 5;
+const long RET_SIZE = 1;
+
+bool fits_in_byte(long value) {
+  return value >= -128 && value < 128;
+}
+
+}
+
+MachineOutliner::MachineOutliner(const std::vector<std::shared_ptr<Function> > &functions)
+  : m_functions(functions) {
+}
+
+MachineOutliner::~MachineOutliner() {
+}
+
+void MachineOutliner::execute() {
+  number_instructions();
+  build_suffix_tree();
+
+  // the sequences which would be profitable to outline if none of their
+  // occurrences overlapped, most profitable first
+  std::vector<unsigned> candidates;
+  for (unsigned i = 0; i < m_nodes.size(); ++i) {
+    const Node &node = m_nodes[i];
+    if (node.length >= MIN_LENGTH && node.starts.size() >= 2 && get_benefit(node, node.starts.size()) > 0)
+      candidates.push_back(i);
+  }
+  std::stable_sort(candidates.begin(), candidates.end(), [this](unsigned a, unsigned b) {
+    long benefit_a = get_benefit(m_nodes[a], m_nodes[a].starts.size());
+    long benefit_b = get_benefit(m_nodes[b], m_nodes[b].starts.size());
+    return benefit_a != benefit_b ? benefit_a > benefit_b : m_nodes[a].length > m_nodes[b].length;
+  });
+
+  // an instruction is only outlined once, so the occurrences still
+  // available shrink as sequences are outlined
+  std::vector<bool> outlined(m_positions.size(), false);
+  std::map<unsigned, std::pair<unsigned, std::string> > calls;
+  for (auto i = candidates.begin(); i != candidates.end(); ++i) {
+    const Node &node = m_nodes[*i];
+    std::vector<unsigned> starts = select_starts(node, outlined);
+    if (starts.size() < 2 || get_benefit(node, starts.size()) <= 0)
+      continue;
+
+    // names which can't be C identifiers don't clash with the
+    // functions of the unit
+    std::string name = "outlined." + std::to_string(m_new_functions.size() + 1);
+    const Position &first = m_positions[starts[0]];
+    std::shared_ptr<InstructionSequence> source = m_functions[first.function]->get_ll_iseq();
+    std::shared_ptr<InstructionSequence> body(new InstructionSequence());
+    // the body is shared by several source lines, so it gets no Location
+    for (unsigned j = 0; j < node.length; ++j) {
+      Instruction *ins = source->get_instruction(first.index + j)->duplicate();
+      ins->set_loc(Location());
+      body->append(ins);
+    }
+    body->append(new Instruction(MINS_RET));
+    std::shared_ptr<Function> function(new Function(name, nullptr, nullptr));
+    function->set_ll_iseq(body);
+    m_new_functions.push_back(function);
+
+    for (auto j = starts.begin(); j != starts.end(); ++j) {
+      std::fill(outlined.begin() + *j, outlined.begin() + *j + node.length, true);
+      calls[*j] = { node.length, name };
+    }
+  }
+
+  if (!calls.empty())
+    rewrite(calls);
+}
+
+// Number the instructions of the unit, so that equal instructions get
+// the same number. Instructions which can't be outlined (or aren't in
+// cold code) get -1, and so does a separator after each function.
+void MachineOutliner::number_instructions() {
+  LowLevelFormatter formatter;
+  std::map<std::string, int> numbers;
+
+  for (unsigned i = 0; i < m_functions.size(); ++i) {
+    std::shared_ptr<InstructionSequence> iseq = m_functions[i]->get_ll_iseq();
+    auto cfg_builder = ::make_lowlevel_cfg_builder(iseq);
+    std::shared_ptr<ControlFlowGraph> cfg = cfg_builder.build();
+    BlockFrequency block_frequency(cfg, false);
+    block_frequency.execute();
+
+    // the code order of a block is the index of its first instruction
+    std::vector<bool> cold(iseq->get_length(), false);
+    for (auto j = cfg->bb_begin(); j != cfg->bb_end(); ++j) {
+      std::shared_ptr<InstructionSequence> bb = *j;
+      if (bb->get_kind() != BASICBLOCK_INTERIOR || block_frequency.get_frequency(bb) > COLD_FREQUENCY)
+        continue;
+      unsigned begin = unsigned(bb->get_code_order());
+      std::fill(cold.begin() + begin, cold.begin() + begin + bb->get_length(), true);
+    }
+
+    for (unsigned j = 0; j < iseq->get_length(); ++j) {
+      Instruction *ins = iseq->get_instruction(j);
+      int number = -1;
+      if (cold[j] && is_outlinable(ins))
+        number = numbers.emplace(formatter.format_instruction(ins), int(numbers.size())).first->second;
+      m_positions.push_back({ i, j });
+      m_numbers.push_back(number);
+      m_labeled.push_back(iseq->has_label(j));
+      m_sizes.push_back(estimate_size(ins));
+    }
+    m_positions.push_back({ i, iseq->get_length() });
+    m_numbers.push_back(-1);
+    m_labeled.push_back(false);
+    m_sizes.push_back(0);
+  }
+}
+
+// Build the suffix tree of the instruction numbers. A path from the
+// root spells out a sequence of instructions in the same basic block
+// (only its first instruction may have a label), and its last node
+// records where the sequence occurs.
+void MachineOutliner::build_suffix_tree() {
+  m_nodes.push_back({ {}, {}, 0 });
+  for (unsigned i = 0; i < m_numbers.size(); ++i) {
+    unsigned node = 0;
+    for (unsigned j = i; j < m_numbers.size() && j - i < MAX_LENGTH; ++j) {
+      if (m_numbers[j] < 0 || (j > i && m_labeled[j]))
+        break;
+      auto child = m_nodes[node].children.find(m_numbers[j]);
+      if (child != m_nodes[node].children.end()) {
+        node = child->second;
+      } else {
+        m_nodes.push_back({ {}, {}, j - i + 1 });
+        m_nodes[node].children[m_numbers[j]] = m_nodes.size() - 1;
+        node = m_nodes.size() - 1;
+      }
+      m_nodes[node].starts.push_back(i);
+    }
+  }
+}
+
+// Choose the occurrences of a sequence to replace: from first to last,
+// those which don't overlap an earlier one, or instructions which are
+// already outlined.
+std::vector<unsigned> MachineOutliner::select_starts(const Node &node, const std::vector<bool> &outlined) const {
+  std::vector<unsigned> starts;
+  for (auto i = node.starts.begin(); i != node.starts.end(); ++i) {
+    if (!starts.empty() && *i < starts.back() + node.length)
+      continue;
+    if (std::find(outlined.begin() + *i, outlined.begin() + *i + node.length, true) == outlined.begin() + *i + node.length)
+      starts.push_back(*i);
+  }
+  return starts;
+}
+
+// Estimate how many bytes outlining a sequence saves, if the given
+// number of its occurrences is replaced by calls.
+long MachineOutliner::get_benefit(const Node &node, unsigned num_starts) const {
+  long size = 0;
+  for (unsigned i = 0; i < node.length; ++i)
+    size += m_sizes[node.starts[0] + i];
+  return long(num_starts) * size - (long(num_starts) * CALL_SIZE + size + RET_SIZE);
+}
+
+// Replace the outlined occurrences (each given by its start position,
+// its length and the outlined function's name) with calls.
+void MachineOutliner::rewrite(const std::map<unsigned, std::pair<unsigned, std::string> > &calls) {
+  unsigned position = 0;
+  for (unsigned i = 0; i < m_functions.size(); ++i) {
+    std::shared_ptr<InstructionSequence> iseq = m_functions[i]->get_ll_iseq();
+    std::shared_ptr<InstructionSequence> result(new InstructionSequence());
+    bool changed = false;
+    unsigned j = 0;
+    while (j < iseq->get_length()) {
+      if (iseq->has_label(j))
+        result->define_label(iseq->get_label_at_index(j));
+      auto call = calls.find(position + j);
+      if (call != calls.end()) {
+        Instruction *call_ins = new Instruction(MINS_CALL, Operand(Operand::LABEL, call->second.second));
+        call_ins->set_comment("Outlined");
+        call_ins->set_loc(iseq->get_instruction(j)->get_loc());
+        result->append(call_ins);
+        j += call->second.first;
+        changed = true;
+      } else {
+        result->append(iseq->get_instruction(j)->duplicate());
+        ++j;
+      }
+    }
+    position += iseq->get_length() + 1;
+
+    if (changed)
+      m_functions[i]->set_ll_iseq(result);
+  }
+}
+
+// Check whether an instruction can be executed in an outlined function.
+bool MachineOutliner::is_outlinable(Instruction *ins) {
+  LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+  if ((opcode >= MINS_JMP && opcode <= MINS_JAE) || opcode == MINS_CALL || opcode == MINS_RET
+      || opcode == MINS_PUSHQ || opcode == MINS_POPQ || opcode == MINS_UD2)
+    return false;
+  // inline assembly may use the stack, or define labels
+  if (opcode == MINS_ASM)
+    return false;
+  for (unsigned i = 0; i < ins->get_num_operands(); ++i) {
+    Operand operand = ins->get_operand(i);
+    if ((operand.has_base_reg() && operand.get_base_reg() == MREG_RSP)
+        || (operand.has_index_reg() && operand.get_index_reg() == MREG_RSP))
+      return false;
+  }
+  return true;
+}
+
+// Estimate the size of the encoding of an instruction: a REX prefix,
+// the opcode, and the ModRM byte, followed by its displacement and
+// immediate (moves have no short form for small immediates).
+unsigned MachineOutliner::estimate_size(Instruction *ins) {
+  LowLevelOpcode opcode = LowLevelOpcode(ins->get_opcode());
+  if (opcode == MINS_NOP)
+    return 1;
+  bool is_move = opcode >= MINS_MOVB && opcode <= MINS_MOVQ;
+  unsigned size = 3;
+  for (unsigned i = 0; i < ins->get_num_operands(); ++i) {
+    Operand operand = ins->get_operand(i);
+    if (operand.is_imm_ival())
+      size += fits_in_byte(operand.get_imm_ival()) && !is_move ? 1 : 4;
+    else if (operand.get_kind() == Operand::LABEL || operand.get_kind() == Operand::IMM_LABEL)
+      size += 4;
+    else if (operand.is_memref() && operand.has_index_reg())
+      size += 1;
+    if (operand.is_memref() && operand.has_offset())
+      size += fits_in_byte(operand.get_offset()) ? 1 : 4;
+  }
+  return size;
+}
@@ -788,6 +788,7 @@ bool PeepholeMatcher::match(std::deque<Instruction *> &window,
   // FIXME: we should probably only preserve comments if there is only one comment
 
   std::string comment;
+  Location loc = window.front()->get_loc();
 
   unsigned num_matched = m_instruction_matchers.size();
   while (num_matched > 0) {
@@ -804,6 +805,7 @@ bool PeepholeMatcher::match(std::deque<Instruction *> &window,
   for (auto i = m_instruction_templates.begin(); i != m_instruction_templates.end(); ++i) {
     const InstructionTemplate *ins_template = *i;
     Instruction *gen_ins = ins_template->generate(ctx);
+    gen_ins->set_loc(loc);
     if (!comment.empty() && !added_comment) {
       gen_ins->set_comment(comment);
       added_comment = true;
@@ -104,6 +104,7 @@ namespace {
 %token<node> TOK_RETURN TOK_BREAK TOK_CONTINUE
 %token<node> TOK_CONST TOK_VOLATILE
 %token<node> TOK_STRUCT TOK_UNION
+%token<node> TOK_ASM
 
   /*
    * Storage class specifiers: because storage class is optional,
@@ -115,21 +116,29 @@ namespace {
    *
    * The parse-tree-building parser (parse.y) does not use
    * TOK_UNSPECIFIED_STORAGE, and it will never appear in a parse tree.
+   *
+   * A thread-local variable's storage class is TOK_THREAD_LOCAL,
+   * with the static, extern, or unspecified storage class as its
+   * child. An explicit storage class of a function declaration or
+   * definition is the child of the function's name.
    */
 %token<node> TOK_UNSPECIFIED_STORAGE
 %token<node> TOK_STATIC TOK_EXTERN TOK_AUTO
+%token<node> TOK_THREAD_LOCAL
 
 %token<node> TOK_IDENT
 
 %token<node> TOK_STR_LIT TOK_CHAR_LIT TOK_INT_LIT TOK_FP_LIT
 
 %type<node> unit top_level_declaration function_or_variable_declaration_or_definition
-%type<node> simple_variable_declaration
+%type<node> simple_variable_declaration thread_local_storage
 %type<node> declarator_list declarator non_pointer_declarator
 %type<node> function_definition_or_declaration
 %type<node> function_parameter_list opt_parameter_list parameter_list parameter
 %type<node> type basic_type basic_type_keyword
 %type<node> opt_statement_list statement_list statement
+%type<node> asm_statement asm_operands opt_asm_operand_list asm_operand_list asm_operand
+%type<node> opt_asm_clobber_list asm_clobber_list
 %type<node> struct_type_definition union_type_definition
 %type<node> opt_simple_variable_declaration_list simple_variable_declaration_list
 %type<node> assignment_expression assignment_op
@@ -153,9 +162,11 @@ top_level_declaration
   : function_or_variable_declaration_or_definition
     { $$ = $1; }
   | TOK_STATIC function_or_variable_declaration_or_definition
-    { $$ = $2; $$->shift_kid(); $$->prepend_kid($1); }
+    { $$ = $2; if ($$->get_tag() == AST_VARIABLE_DECLARATION) { $$->shift_kid(); $$->prepend_kid($1); } else { $$->get_kid(1)->append_kid($1); } }
   | TOK_EXTERN function_or_variable_declaration_or_definition
-    { $$ = $2; $$->shift_kid(); $$->prepend_kid($1); }
+    { $$ = $2; if ($$->get_tag() == AST_VARIABLE_DECLARATION) { $$->shift_kid(); $$->prepend_kid($1); } else { $$->get_kid(1)->append_kid($1); } }
+  | thread_local_storage simple_variable_declaration
+    { $$ = $2; if ($1->get_num_kids() == 0) $1->append_kid($$->get_kid(0)); $$->shift_kid(); $$->prepend_kid($1); }
   | struct_type_definition
     { $$ = $1; }
   | union_type_definition
@@ -174,6 +185,15 @@ simple_variable_declaration
     { $$ = new Node(AST_VARIABLE_DECLARATION, {$1, $2}); handle_unspecified_storage($$, pp);  }
   ;
 
+thread_local_storage
+  : TOK_THREAD_LOCAL
+    { $$ = $1; }
+  | TOK_STATIC TOK_THREAD_LOCAL
+    { $$ = $2; $$->append_kid($1); }
+  | TOK_EXTERN TOK_THREAD_LOCAL
+    { $$ = $2; $$->append_kid($1); }
+  ;
+
 declarator_list
   : declarator
     { $$ = new Node(AST_DECLARATOR_LIST, {$1}); }
@@ -299,6 +319,8 @@ statement
     { $$ = $2; $$->shift_kid(); $$->prepend_kid($1); }
   | TOK_EXTERN simple_variable_declaration
     { $$ = $2; $$->shift_kid(); $$->prepend_kid($1); }
+  | thread_local_storage simple_variable_declaration
+    { $$ = $2; if ($1->get_num_kids() == 0) $1->append_kid($$->get_kid(0)); $$->shift_kid(); $$->prepend_kid($1); }
   | assignment_expression TOK_SEMICOLON
     { $$ = new Node(AST_EXPRESSION_STATEMENT, {$1}); }
   | TOK_RETURN TOK_SEMICOLON
@@ -324,6 +346,64 @@ statement
     { $$ = new Node(AST_IF_STATEMENT, {$3, $5}); }
   | TOK_IF TOK_LPAREN assignment_expression TOK_RPAREN statement TOK_ELSE statement
     { $$ = new Node(AST_IF_ELSE_STATEMENT, {$3, $5, $7}); }
+  | asm_statement
+    { $$ = $1; }
+  ;
+
+  /*
+   * GCC-style extended asm: asm [volatile] ( template [: outputs [: inputs [: clobbers]]] );
+   * An asm statement is always treated as volatile, so the qualifier
+   * is accepted but not recorded.
+   */
+asm_statement
+  : TOK_ASM TOK_LPAREN TOK_STR_LIT asm_operands TOK_RPAREN TOK_SEMICOLON
+    { $$ = $4; $$->prepend_kid($3); }
+  | TOK_ASM TOK_VOLATILE TOK_LPAREN TOK_STR_LIT asm_operands TOK_RPAREN TOK_SEMICOLON
+    { $$ = $5; $$->prepend_kid($4); }
+  ;
+
+asm_operands
+  : /* nothing */
+    { $$ = new Node(AST_ASM_STATEMENT, {new Node(AST_ASM_OPERAND_LIST), new Node(AST_ASM_OPERAND_LIST), new Node(AST_ASM_CLOBBER_LIST)}); }
+  | TOK_COLON opt_asm_operand_list
+    { $$ = new Node(AST_ASM_STATEMENT, {$2, new Node(AST_ASM_OPERAND_LIST), new Node(AST_ASM_CLOBBER_LIST)}); }
+  | TOK_COLON opt_asm_operand_list TOK_COLON opt_asm_operand_list
+    { $$ = new Node(AST_ASM_STATEMENT, {$2, $4, new Node(AST_ASM_CLOBBER_LIST)}); }
+  | TOK_COLON opt_asm_operand_list TOK_COLON opt_asm_operand_list TOK_COLON opt_asm_clobber_list
+    { $$ = new Node(AST_ASM_STATEMENT, {$2, $4, $6}); }
+  ;
+
+opt_asm_operand_list
+  : asm_operand_list
+    { $$ = $1; }
+  | /* nothing */
+    { $$ = new Node(AST_ASM_OPERAND_LIST); }
+  ;
+
+asm_operand_list
+  : asm_operand
+    { $$ = new Node(AST_ASM_OPERAND_LIST, {$1}); }
+  | asm_operand TOK_COMMA asm_operand_list
+    { $$ = $3; $$->prepend_kid($1); }
+  ;
+
+asm_operand
+  : TOK_STR_LIT TOK_LPAREN assignment_expression TOK_RPAREN
+    { $$ = new Node(AST_ASM_OPERAND, {$1, $3}); }
+  ;
+
+opt_asm_clobber_list
+  : asm_clobber_list
+    { $$ = $1; }
+  | /* nothing */
+    { $$ = new Node(AST_ASM_CLOBBER_LIST); }
+  ;
+
+asm_clobber_list
+  : TOK_STR_LIT
+    { $$ = new Node(AST_ASM_CLOBBER_LIST, {$1}); }
+  | TOK_STR_LIT TOK_COMMA asm_clobber_list
+    { $$ = $3; $$->prepend_kid($1); }
   ;
 
 struct_type_definition
@@ -498,7 +578,7 @@ cast_expression
   : unary_expression
     { $$ = $1; }
   | TOK_LPAREN type TOK_RPAREN cast_expression
-    { $$ = new Node(AST_CAST_EXPRESSION, {$1, $2}); }
+    { $$ = new Node(AST_CAST_EXPRESSION, {$2, $4}); }
   ;
 
 unary_expression
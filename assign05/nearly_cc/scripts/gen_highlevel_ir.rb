@@ -53,6 +53,12 @@ ARITH = [
   :inc,     # Increment integer
   :dec,     # Decrement integer
 
+  # Unary bit operations
+  :popcount, # Number of 1 bits
+  :clz,      # Number of leading 0 bits
+  :ctz,      # Number of trailing 0 bits
+  :bswap,    # Reverse the order of the bytes
+
   # The (variants of the) mov instruction is used for
   # all moves of data values involving some combination of
   # registers, immediate values, and memory locations.
@@ -64,6 +70,24 @@ ARITH = [
   :restore,
 ]
 
+# Atomic memory accesses: these are also generated in the 4 widths.
+# The memory operand is always the second operand (except for the
+# store, where it is the destination). These are ordered with respect
+# to the memory accesses of other threads, so the optimizer never
+# removes, combines, or moves memory accesses across them.
+ATOMIC = [
+  :atomic_load,    # Load memory into the destination vreg
+  :atomic_store,   # Store the second operand; the third operand is the
+                   # memory order (a seq_cst store is an exchange)
+  :atomic_xchg,    # Exchange: store the third operand, and set the
+                   # destination vreg to the old value
+  :atomic_xadd,    # Fetch and add: add the third operand, and set the
+                   # destination vreg to the old value
+  :atomic_cmpxchg, # Compare and swap: if memory holds the third operand,
+                   # store the fourth; the destination vreg is set to
+                   # the old value either way
+]
+
 SIZES = [ :b, :w, :l, :q ]
 
 NBYTES = {
@@ -119,9 +143,32 @@ OPCODES = [
   # in local storage, storing it in a vreg.
   :localaddr,
 
+  # Compute the address of a thread-local variable (the immediate label
+  # operand) in the current thread, storing it in a vreg. The third
+  # operand is $1 if the variable may be defined in another module (so
+  # its offset from the thread pointer must be loaded from the GOT),
+  # $0 otherwise.
+  :tlsaddr,
+
   # conditional jump
   :cjmp_t,    # conditional jump if boolean is true
   :cjmp_f,    # conditional jump if boolean is false
+
+  # Fetch the memory at an address into the cache: the first operand
+  # is the temporal locality (0-3), the second is the vreg containing
+  # the address.
+  :prefetch,
+
+  # Inline assembly: the operands are the outputs followed by the
+  # inputs, and the template, constraints, and clobbers are in the
+  # instruction's InlineAsm object.
+  :asm,
+
+  # Atomic memory accesses, with variations for different operand sizes
+  *(ATOMIC.product(SIZES).map { |pair| "#{pair[0]}_#{pair[1]}".to_sym }),
+
+  # Full memory barrier
+  :fence,
 ]
 
 $opcode_names = OPCODES.map { |sym| "HINS_#{sym.to_s}" }
@@ -155,7 +202,7 @@ EOF5
       operand_size = 4
     elsif opcode_name_str.end_with?('_q')
       operand_size = 8
-    elsif opcode_name_str == 'HINS_localaddr'
+    elsif opcode_name_str == 'HINS_localaddr' || opcode_name_str == 'HINS_tlsaddr'
       operand_size = 8
     end
     outf.puts "  case #{opcode_name}: return #{operand_size};"
@@ -261,7 +308,7 @@ EOF3
   $opcode_names.each do |opcode_name|
     len = opcode_name.length
     mnemonic = opcode_name[5..len-1]
-    pad = ' ' * (16 - len)
+    pad = ' ' * [16 - len, 0].max
     outf.puts "  case #{opcode_name}:#{pad}return \"#{mnemonic}\";"
   end
 
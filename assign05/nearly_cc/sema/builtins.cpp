@@ -0,0 +1,70 @@
+// Copyright (c) 2021-2024, David H. Hovemeyer <david.hovemeyer@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "builtins.h"
+
+namespace {
+
+const Builtin BUILTINS[] = {
+  { "__builtin_popcount",    BuiltinKind::POPCOUNT,    4 },
+  { "__builtin_popcountl",   BuiltinKind::POPCOUNT,    8 },
+  { "__builtin_popcountll",  BuiltinKind::POPCOUNT,    8 },
+  { "__builtin_clz",         BuiltinKind::CLZ,         4 },
+  { "__builtin_clzl",        BuiltinKind::CLZ,         8 },
+  { "__builtin_clzll",       BuiltinKind::CLZ,         8 },
+  { "__builtin_ctz",         BuiltinKind::CTZ,         4 },
+  { "__builtin_ctzl",        BuiltinKind::CTZ,         8 },
+  { "__builtin_ctzll",       BuiltinKind::CTZ,         8 },
+  { "__builtin_bswap32",     BuiltinKind::BSWAP,       4 },
+  { "__builtin_bswap64",     BuiltinKind::BSWAP,       8 },
+  { "__builtin_expect",      BuiltinKind::EXPECT,      8 },
+  { "__builtin_unreachable", BuiltinKind::UNREACHABLE, 0 },
+  { "__builtin_prefetch",    BuiltinKind::PREFETCH,    0 },
+  { "__sync_fetch_and_add",         BuiltinKind::FETCH_ADD,    0 },
+  { "__sync_fetch_and_sub",         BuiltinKind::FETCH_SUB,    0 },
+  { "__sync_add_and_fetch",         BuiltinKind::ADD_FETCH,    0 },
+  { "__sync_sub_and_fetch",         BuiltinKind::SUB_FETCH,    0 },
+  { "__sync_bool_compare_and_swap", BuiltinKind::BOOL_CAS,     0 },
+  { "__sync_val_compare_and_swap",  BuiltinKind::VAL_CAS,      0 },
+  { "__sync_lock_test_and_set",     BuiltinKind::EXCHANGE,     0 },
+  { "__sync_lock_release",          BuiltinKind::LOCK_RELEASE, 0 },
+  { "__sync_synchronize",           BuiltinKind::SYNCHRONIZE,  0 },
+  { "__atomic_load_n",              BuiltinKind::LOAD,         0, true },
+  { "__atomic_store_n",             BuiltinKind::STORE,        0, true },
+  { "__atomic_exchange_n",          BuiltinKind::EXCHANGE,     0, true },
+  { "__atomic_fetch_add",           BuiltinKind::FETCH_ADD,    0, true },
+  { "__atomic_fetch_sub",           BuiltinKind::FETCH_SUB,    0, true },
+  { "__atomic_add_fetch",           BuiltinKind::ADD_FETCH,    0, true },
+  { "__atomic_sub_fetch",           BuiltinKind::SUB_FETCH,    0, true },
+};
+
+}
+
+const Builtin *find_builtin(const std::string &name) {
+  for (const Builtin &builtin : BUILTINS) {
+    if (name == builtin.name)
+      return &builtin;
+  }
+  return nullptr;
+}
+
+bool is_atomic_builtin(const Builtin &builtin) {
+  return builtin.kind >= BuiltinKind::FETCH_ADD;
+}
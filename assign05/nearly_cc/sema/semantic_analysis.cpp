@@ -22,23 +22,37 @@
 #include <algorithm>
 #include <utility>
 #include <map>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <exception>
 #include "grammar_symbols.h"
 #include "parse.tab.h"
 #include "node.h"
 #include "ast.h"
 #include "exceptions.h"
 #include "semantic_analysis.h"
+#include "literal_value.h"
+#include "inline_asm.h"
 #include "symtab.h"
 
 
 
 SemanticAnalysis::SemanticAnalysis(const Options &options)
   : m_options(options)
-  , m_global_symtab(new SymbolTable(nullptr, "global")) {
+  , m_global_symtab(new SymbolTable(nullptr, "global"))
+  , m_num_visible_globals(UINT_MAX) {
   m_cur_symtab = m_global_symtab;
   m_all_symtabs.push_back(m_global_symtab);
 }
 
+SemanticAnalysis::SemanticAnalysis(const SemanticAnalysis &parent, const DeferredBody &body)
+  : m_options(parent.m_options)
+  , m_global_symtab(parent.m_global_symtab)
+  , m_cur_symtab(body.fn_symtab)
+  , m_num_visible_globals(body.num_globals) {
+}
+
 SemanticAnalysis::~SemanticAnalysis() {
   // The semantic analyzer owns the SymbolTables and their Symbols,
   // so delete them. Note that the AST has pointers to Symbol objects,
@@ -48,11 +62,40 @@ SemanticAnalysis::~SemanticAnalysis() {
     delete *i;
 }
 
+/*
+phase 1 handles everything at file scope in order, phase 2 checks the
+function bodies once the global symbol table can no longer change
+*/
+void SemanticAnalysis::visit_unit(Node *n) {
+  std::vector<DeferredBody> bodies;
+  std::set<std::string> defined_fns;
+
+  for (auto i = n->cbegin(); i != n->cend(); ++i) {
+    Node *decl = *i;
+    if (decl->get_tag() != AST_FUNCTION_DEFINITION) {
+      visit(decl);
+      continue;
+    }
+
+    // two bodies for one function would share (and race on) its scope
+    std::string fn_name = decl->get_kid(1)->get_str();
+    if (!defined_fns.insert(fn_name).second) {
+      SemanticError::raise(decl->get_loc(), "Redefinition of function '%s'", fn_name.c_str());
+    }
+
+    visit_function_declaration(decl);
+    bodies.push_back({ decl, find_symbol_table_by_name("function " + fn_name),
+                       unsigned(m_all_symtabs.size()), m_global_symtab->get_num_entries() });
+  }
+
+  analyze_deferred_bodies(bodies);
+}
+
 void SemanticAnalysis::visit_struct_type(Node *n) {
   std::shared_ptr<Type> type; 
   std::string struct_name = n->get_kid(0)->get_str();
 
-  Symbol* target_struct = m_cur_symtab->lookup_recursive("struct " + struct_name);
+  Symbol* target_struct = lookup("struct " + struct_name);
 
   if (target_struct == nullptr) {
     SemanticError::raise(n->get_loc(),"Struct type not defined");
@@ -72,6 +115,20 @@ void SemanticAnalysis::visit_variable_declaration(Node *n) {
   visit(n->get_kid(1));
   std::shared_ptr<Type> base_type = n->get_kid(1)->get_type();
   n->set_type(base_type);
+  // determine the storage class (a thread-local storage class has
+  // the static, extern, or unspecified storage class as its child)
+  Node *storage = n->get_kid(0);
+  bool is_thread_local = (storage->get_tag() == TOK_THREAD_LOCAL);
+  if (is_thread_local) {
+    if (m_cur_symtab != m_global_symtab)
+      SemanticError::raise(n->get_loc(),"Thread-local storage is only supported for global variables");
+    storage = storage->get_kid(0);
+  }
+  StorageClass storage_class = StorageClass::UNSPECIFIED;
+  if (storage->get_tag() == TOK_STATIC)
+    storage_class = StorageClass::STATIC;
+  else if (storage->get_tag() == TOK_EXTERN)
+    storage_class = StorageClass::EXTERN;
   // iterate through declarators, adding variables
   // to the symbol table
   Node *decl_list = n->get_kid(2);
@@ -79,7 +136,9 @@ void SemanticAnalysis::visit_variable_declaration(Node *n) {
     Node *declarator = *i;
     declarator->set_type(base_type);
     visit(declarator);
-    m_cur_symtab->add_entry(n->get_loc(),SymbolKind::VARIABLE,declarator->get_str(),declarator->get_type());
+    Symbol *sym = m_cur_symtab->add_entry(n->get_loc(),SymbolKind::VARIABLE,declarator->get_str(),declarator->get_type());
+    sym->set_storage(storage_class);
+    sym->set_thread_local(is_thread_local);
   }
 }
 
@@ -188,7 +247,11 @@ void SemanticAnalysis::visit_function_definition(Node *n) {
   std::string fn_name = n->get_kid(1)->get_str();
 
   //visit statement list
-  m_cur_symtab = find_symbol_table_by_name("function " + fn_name);
+  analyze_function_body(n, find_symbol_table_by_name("function " + fn_name));
+}
+
+void SemanticAnalysis::analyze_function_body(Node *n, SymbolTable *fn_symtab) {
+  m_cur_symtab = fn_symtab;
   Node* stmt_list = n->get_kid(3);
   for (auto i = stmt_list->cbegin(); i != stmt_list->cend(); ++i) {
     Node *stmt = *i;
@@ -197,6 +260,54 @@ void SemanticAnalysis::visit_function_definition(Node *n) {
   leave_scope();
 }
 
+void SemanticAnalysis::analyze_deferred_bodies(const std::vector<DeferredBody> &bodies) {
+  unsigned num_bodies = bodies.size();
+  std::vector<std::unique_ptr<SemanticAnalysis>> workers;
+  std::vector<std::exception_ptr> errors(num_bodies);
+  for (unsigned i = 0; i < num_bodies; ++i) {
+    workers.emplace_back(new SemanticAnalysis(*this, bodies[i]));
+  }
+
+  // each thread claims the next unanalyzed body until none are left
+  std::atomic<unsigned> next(0);
+  auto run = [&]() {
+    for (unsigned i = next++; i < num_bodies; i = next++) {
+      try {
+        workers[i]->analyze_function_body(bodies[i].fn_def, bodies[i].fn_symtab);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  unsigned num_threads = std::min(num_bodies, std::max(1U, std::thread::hardware_concurrency()));
+  if (num_threads <= 1) {
+    run();
+  } else {
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < num_threads; ++i) {
+      threads.emplace_back(run);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  // adopt the workers' scopes, back to front so earlier positions stay valid
+  for (unsigned i = num_bodies; i-- > 0; ) {
+    SymbolTableList &scopes = workers[i]->m_all_symtabs;
+    m_all_symtabs.insert(m_all_symtabs.begin() + bodies[i].symtab_pos, scopes.begin(), scopes.end());
+    scopes.clear();
+  }
+
+  // report the first error in source order, as a sequential pass would
+  for (unsigned i = 0; i < num_bodies; ++i) {
+    if (errors[i]) {
+      std::rethrow_exception(errors[i]);
+    }
+  }
+}
+
 void SemanticAnalysis::visit_function_declaration(Node *n) {
   // visit the base type and setup function creation
   visit(n->get_kid(0));
@@ -204,6 +315,16 @@ void SemanticAnalysis::visit_function_declaration(Node *n) {
   std::string fn_name = n->get_kid(1)->get_str();
   bool first_time = false;
 
+  // an explicit storage class is the child of the function name
+  StorageClass storage_class = StorageClass::UNSPECIFIED;
+  if (n->get_kid(1)->get_num_kids() > 0) {
+    int storage = n->get_kid(1)->get_kid(0)->get_tag();
+    if (storage == TOK_STATIC)
+      storage_class = StorageClass::STATIC;
+    else if (storage == TOK_EXTERN)
+      storage_class = StorageClass::EXTERN;
+  }
+
   //enter function scope
   if (find_symbol_table_by_name("function " + fn_name)==nullptr) {
     enter_scope("function " + fn_name);
@@ -240,6 +361,10 @@ void SemanticAnalysis::visit_function_declaration(Node *n) {
     m_cur_symtab->add_entry(n->get_loc(),SymbolKind::FUNCTION,fn_name,n->get_type());//store new function in parent
     n->get_kid(1)->set_symbol(m_cur_symtab->lookup_local(fn_name));
     n->get_kid(1)->get_symbol()->set_symtab_k(find_symbol_table_by_name("function " + fn_name));
+    n->get_kid(1)->get_symbol()->set_storage(storage_class);
+  } else if (storage_class == StorageClass::STATIC
+             && m_cur_symtab->lookup_local(fn_name)->get_storage() != StorageClass::STATIC) {
+    SemanticError::raise(n->get_loc(),"Static declaration of '%s' follows non-static declaration", fn_name.c_str());
   }
 }
 
@@ -338,6 +463,98 @@ void SemanticAnalysis::visit_return_expression_statement(Node *n) {
   n->set_type(return_type);
 }
 
+/*
+checks an inline assembly statement: every constraint, clobber, and
+operand reference in the template must be supported, outputs must be
+assignable integer or pointer lvalues, and there must be enough
+registers left over for the operands that need one
+*/
+void SemanticAnalysis::visit_asm_statement(Node *n) {
+  std::string asm_template = LiteralValue::from_str_literal(n->get_kid(0)->get_str(), n->get_loc()).get_str_value();
+  Node *outputs = n->get_kid(1);
+  Node *inputs = n->get_kid(2);
+  Node *clobber_list = n->get_kid(3);
+
+  std::vector<InlineAsm::Constraint> constraints;
+  std::vector<int> fixed_outputs, fixed_inputs;
+  for (Node *operand_list : {outputs, inputs}) {
+    bool is_output = (operand_list == outputs);
+    for (auto i = operand_list->cbegin(); i != operand_list->cend(); ++i) {
+      Node *operand = *i;
+      std::string text = LiteralValue::from_str_literal(operand->get_kid(0)->get_str(), operand->get_loc()).get_str_value();
+      InlineAsm::Constraint constraint;
+      if (!InlineAsm::parse_constraint(text, is_output, constraint)) {
+        SemanticError::raise(operand->get_loc(),"Unsupported asm constraint \"%s\"", text.c_str());
+      }
+
+      Node *expr = operand->get_kid(1);
+      visit(expr);
+      std::shared_ptr<Type> type = expr->get_type();
+      if (constraint.kind == InlineAsm::IMM) {
+        if (expr->get_tag() != AST_LITERAL_VALUE || type->get_basic_type_kind() != BasicTypeKind::INT) {
+          SemanticError::raise(operand->get_loc(),"asm operand is not an integer constant");
+        }
+      } else if (!type->is_integral() && !type->is_pointer()) {
+        SemanticError::raise(operand->get_loc(),"asm operand is not an integer or pointer");
+      }
+
+      if (is_output) {
+        int tag = expr->get_tag();
+        bool is_lvalue = tag == AST_VARIABLE_REF || tag == AST_ARRAY_ELEMENT_REF_EXPRESSION
+          || tag == AST_FIELD_REF_EXPRESSION || tag == AST_INDIRECT_FIELD_REF_EXPRESSION
+          || (tag == AST_UNARY_EXPRESSION && expr->get_kid(0)->get_str() == "*");
+        if (!is_lvalue) {
+          SemanticError::raise(operand->get_loc(),"asm output is not an lvalue");
+        }
+        if (type->is_const()) {
+          SemanticError::raise(operand->get_loc(),"Invalid attempt to assign to a const variable");
+        }
+      }
+
+      if (constraint.tied_to >= 0) {
+        if (unsigned(constraint.tied_to) >= outputs->get_num_kids()
+            || constraints[constraint.tied_to].kind != InlineAsm::REG) {
+          SemanticError::raise(operand->get_loc(),"asm input is not tied to a register output");
+        }
+      }
+
+      // an input and an output can share a fixed register,
+      // but two inputs or two outputs can't
+      std::vector<int> &fixed = is_output ? fixed_outputs : fixed_inputs;
+      if (constraint.mreg >= 0) {
+        if (std::find(fixed.begin(), fixed.end(), constraint.mreg) != fixed.end()) {
+          SemanticError::raise(operand->get_loc(),"asm register is used by more than one operand");
+        }
+        fixed.push_back(constraint.mreg);
+      }
+
+      constraints.push_back(constraint);
+    }
+  }
+
+  std::vector<MachineReg> clobbers;
+  for (auto i = clobber_list->cbegin(); i != clobber_list->cend(); ++i) {
+    Node *clobber = *i;
+    std::string text = LiteralValue::from_str_literal(clobber->get_str(), clobber->get_loc()).get_str_value();
+    if (!InlineAsm::parse_clobber(text, clobbers)) {
+      SemanticError::raise(clobber->get_loc(),"Unsupported asm clobber \"%s\"", text.c_str());
+    }
+  }
+  for (const InlineAsm::Constraint &constraint : constraints) {
+    if (constraint.mreg >= 0 && std::find(clobbers.begin(), clobbers.end(), constraint.mreg) != clobbers.end()) {
+      SemanticError::raise(n->get_loc(),"asm operand register is also clobbered");
+    }
+  }
+
+  std::vector<InlineAsm::Piece> pieces;
+  if (!InlineAsm::parse_template(asm_template, unsigned(constraints.size()), pieces)) {
+    SemanticError::raise(n->get_loc(),"Invalid operand reference in asm template");
+  }
+  if (!InlineAsm(asm_template, constraints, clobbers).has_enough_regs()) {
+    SemanticError::raise(n->get_loc(),"asm statement needs more registers than are available");
+  }
+}
+
 /*
 setups a struct type
 */
@@ -537,7 +754,12 @@ processes function call
 void SemanticAnalysis::visit_function_call_expression(Node *n) {
   //setup
   std::string fn_name = n->get_kid(0)->get_kid(0)->get_str();
-  Symbol* function = m_cur_symtab->lookup_recursive(fn_name);
+  const Builtin *builtin = find_builtin(fn_name);
+  if (builtin != nullptr) {
+    visit_builtin_call(n, *builtin);
+    return;
+  }
+  Symbol* function = lookup(fn_name);
   if (function == nullptr) {
     SemanticError::raise(n->get_loc(),"Undefined Function");
   }
@@ -561,6 +783,157 @@ void SemanticAnalysis::visit_function_call_expression(Node *n) {
   n->set_type(return_type);
 }
 
+/*
+processes call to a builtin function: the bit operations take an
+unsigned int or unsigned long and return an int (bswap returns its
+argument type), expect takes and returns a long, and prefetch takes
+an address plus optional integer constants for rw and locality
+*/
+void SemanticAnalysis::visit_builtin_call(Node *n, const Builtin &builtin) {
+  visit(n->get_kid(1));
+  if (is_atomic_builtin(builtin)) {
+    visit_atomic_builtin_call(n, builtin);
+    return;
+  }
+  Node *arg_list = n->get_kid(1);
+  unsigned num_args = arg_list->get_num_kids();
+
+  unsigned min_args = 1, max_args = 1;
+  if (builtin.kind == BuiltinKind::EXPECT) {
+    min_args = max_args = 2;
+  } else if (builtin.kind == BuiltinKind::UNREACHABLE) {
+    min_args = max_args = 0;
+  } else if (builtin.kind == BuiltinKind::PREFETCH) {
+    max_args = 3;
+  }
+  if (num_args < min_args || num_args > max_args) {
+    SemanticError::raise(n->get_loc(),"Improper number of arguments");
+  }
+
+  std::shared_ptr<Type> void_type = std::make_shared<BasicType>(BasicTypeKind::VOID, true);
+  if (builtin.kind == BuiltinKind::UNREACHABLE) {
+    n->set_type(void_type);
+    return;
+  }
+  if (builtin.kind == BuiltinKind::PREFETCH) {
+    std::shared_ptr<Type> addr_type = arg_list->get_kid(0)->get_type();
+    if (!addr_type->is_pointer() && !addr_type->is_array()) {
+      SemanticError::raise(n->get_loc(),"Prefetch address is not a pointer");
+    }
+    for (unsigned i = 1; i < num_args; ++i) {
+      Node *arg = arg_list->get_kid(i);
+      if (!arg->get_literal() || arg->get_type()->get_basic_type_kind() != BasicTypeKind::INT) {
+        SemanticError::raise(n->get_loc(),"Prefetch argument is not an integer constant");
+      }
+      long value = LiteralValue::from_int_literal(arg->get_str(), arg->get_loc()).get_int_value();
+      if (value < 0 || value > (i == 1 ? 1 : 3)) {
+        SemanticError::raise(n->get_loc(),"Prefetch argument is out of range");
+      }
+    }
+    n->set_type(void_type);
+    return;
+  }
+
+  //check that all args can be converted to the integer parameter type
+  BasicTypeKind kind = builtin.size == 8 ? BasicTypeKind::LONG : BasicTypeKind::INT;
+  std::shared_ptr<Type> param_type = std::make_shared<BasicType>(kind, builtin.kind == BuiltinKind::EXPECT);
+  for (auto i = arg_list->cbegin(); i != arg_list->cend(); ++i) {
+    Node *argument = *i;
+    if (!argument->get_type()->is_integral()) {
+      SemanticError::raise(n->get_loc(),"Builtin argument is not an integer");
+    }
+    test_assignment(n,param_type,argument->get_type());
+  }
+
+  if (builtin.kind == BuiltinKind::BSWAP || builtin.kind == BuiltinKind::EXPECT) {
+    n->set_type(param_type);
+  } else {
+    n->set_type(std::make_shared<BasicType>(BasicTypeKind::INT, true));
+  }
+}
+
+/*
+processes call to an atomic builtin (arguments already visited): the
+first argument points to an integer or pointer object, the values are
+converted to the object's type, and the __atomic builtins end with a
+constant memory order
+*/
+void SemanticAnalysis::visit_atomic_builtin_call(Node *n, const Builtin &builtin) {
+  Node *arg_list = n->get_kid(1);
+  unsigned num_args = arg_list->get_num_kids();
+
+  //the number of value arguments following the address
+  unsigned num_values = 1;
+  if (builtin.kind == BuiltinKind::LOCK_RELEASE || builtin.kind == BuiltinKind::LOAD) {
+    num_values = 0;
+  } else if (builtin.kind == BuiltinKind::BOOL_CAS || builtin.kind == BuiltinKind::VAL_CAS) {
+    num_values = 2;
+  }
+  unsigned expected_args = builtin.kind == BuiltinKind::SYNCHRONIZE ? 0 : 1 + num_values + (builtin.memory_order ? 1 : 0);
+  if (num_args != expected_args) {
+    SemanticError::raise(n->get_loc(),"Improper number of arguments");
+  }
+
+  std::shared_ptr<Type> void_type = std::make_shared<BasicType>(BasicTypeKind::VOID, true);
+  if (builtin.kind == BuiltinKind::SYNCHRONIZE) {
+    n->set_type(void_type);
+    return;
+  }
+
+  //the object the first argument points to
+  std::shared_ptr<Type> addr_type = arg_list->get_kid(0)->get_type();
+  if (!addr_type->is_pointer() && !addr_type->is_array()) {
+    SemanticError::raise(n->get_loc(),"Atomic address is not a pointer");
+  }
+  std::shared_ptr<Type> object_type = addr_type->get_base_type();
+  if (!object_type->is_integral() && !object_type->is_pointer()) {
+    SemanticError::raise(n->get_loc(),"Atomic object is not an integer or pointer");
+  }
+  bool is_arith = builtin.kind == BuiltinKind::FETCH_ADD || builtin.kind == BuiltinKind::FETCH_SUB
+               || builtin.kind == BuiltinKind::ADD_FETCH || builtin.kind == BuiltinKind::SUB_FETCH;
+  if (is_arith && !object_type->is_integral()) {
+    SemanticError::raise(n->get_loc(),"Atomic arithmetic on a non-integer object");
+  }
+  if (builtin.kind != BuiltinKind::LOAD && object_type->is_const()) {
+    SemanticError::raise(n->get_loc(),"Invalid attempt to modify a const atomic object");
+  }
+
+  //check that the values can be converted to the object type
+  std::shared_ptr<Type> value_type = object_type;
+  while (auto qualified = std::dynamic_pointer_cast<QualifiedType>(value_type)) {
+    value_type = qualified->get_base_type();
+  }
+  for (unsigned i = 1; i <= num_values; ++i) {
+    test_assignment(n,value_type,arg_list->get_kid(i)->get_type());
+  }
+
+  if (builtin.memory_order) {
+    Node *arg = arg_list->get_kid(num_args - 1);
+    if (!arg->get_literal() || arg->get_type()->get_basic_type_kind() != BasicTypeKind::INT) {
+      SemanticError::raise(n->get_loc(),"Memory order is not an integer constant");
+    }
+    long order = LiteralValue::from_int_literal(arg->get_str(), arg->get_loc()).get_int_value();
+    bool valid = order >= long(MemoryOrder::RELAXED) && order <= long(MemoryOrder::SEQ_CST);
+    if (builtin.kind == BuiltinKind::LOAD) {
+      valid = valid && order != long(MemoryOrder::RELEASE) && order != long(MemoryOrder::ACQ_REL);
+    } else if (builtin.kind == BuiltinKind::STORE) {
+      valid = valid && (order == long(MemoryOrder::RELAXED) || order == long(MemoryOrder::RELEASE)
+                        || order == long(MemoryOrder::SEQ_CST));
+    }
+    if (!valid) {
+      SemanticError::raise(n->get_loc(),"Invalid memory order");
+    }
+  }
+
+  if (builtin.kind == BuiltinKind::BOOL_CAS) {
+    n->set_type(std::make_shared<BasicType>(BasicTypeKind::INT, true));
+  } else if (builtin.kind == BuiltinKind::LOCK_RELEASE || builtin.kind == BuiltinKind::STORE) {
+    n->set_type(void_type);
+  } else {
+    n->set_type(value_type);
+  }
+}
+
 /*
 look at member of a struct that isnt a pointer
 */
@@ -573,7 +946,7 @@ void SemanticAnalysis::visit_field_ref_expression(Node *n) {
 
   //bc/rc for chains of referencing 
   if (n->get_kid(0)->get_tag() == AST_VARIABLE_REF) {
-    Symbol* target_struct = m_cur_symtab->lookup_recursive(struct_name);
+    Symbol* target_struct = lookup(struct_name);
     struct_type = target_struct->get_type();
   } else {
     struct_type = n->get_kid(0)->get_type();
@@ -603,7 +976,7 @@ void SemanticAnalysis::visit_indirect_field_ref_expression(Node *n) {
   //controls if we are in base case struct or recursive case
   if (n->get_kid(0)->get_tag() == AST_VARIABLE_REF) {
     //bc involves looking up ds
-    Symbol* target_struct = m_cur_symtab->lookup_recursive(struct_name);
+    Symbol* target_struct = lookup(struct_name);
     struct_type = target_struct->get_type()->get_base_type();
     if (!target_struct->get_type()->is_pointer()) {
       SemanticError::raise(n->get_loc(),"incorrect struct reference");
@@ -633,7 +1006,7 @@ void SemanticAnalysis::visit_array_element_ref_expression(Node *n) {
   //if controls weather we are in a base case or if this is going to be part of a longer chain of dereferencing 
   if (n->get_kid(0)->get_tag() == AST_VARIABLE_REF) {
     arr_name = n->get_kid(0)->get_kid(0)->get_str();
-    Symbol* arr = m_cur_symtab->lookup_recursive(arr_name); //basecase looks up the original ds
+    Symbol* arr = lookup(arr_name); //basecase looks up the original ds
     if (arr == nullptr) {
       SemanticError::raise(n->get_loc(),"Undefined array");
     }
@@ -665,7 +1038,7 @@ looksup type for a variable in the symbol table
 */
 void SemanticAnalysis::visit_variable_ref(Node *n) {
   std::string target_name = n->get_kid(0)->get_str();
-  Symbol* var_symbol = m_cur_symtab->lookup_recursive(target_name);
+  Symbol* var_symbol = lookup(target_name);
   if (var_symbol == nullptr) {
     SemanticError::raise(n->get_loc(),"Undefined variable reference in this scope");
   }
@@ -679,7 +1052,10 @@ sets up typing information for literal values
 */
 void SemanticAnalysis::visit_literal_value(Node *n) {
   if (n->get_kid(0)->get_tag() == TOK_INT_LIT) {
-    std::shared_ptr<Type> type(new BasicType(BasicTypeKind::INT, true));
+    // an L suffix, or a value too large for int, makes the literal a long
+    LiteralValue val = LiteralValue::from_int_literal(n->get_kid(0)->get_str(), n->get_loc());
+    bool is_long = val.is_long() || val.get_int_value() != int64_t(int32_t(val.get_int_value()));
+    std::shared_ptr<Type> type(new BasicType(is_long ? BasicTypeKind::LONG : BasicTypeKind::INT, true));
     n->set_type(type);
   } else {
     std::shared_ptr<Type> type(new BasicType(BasicTypeKind::CHAR, true));
@@ -702,6 +1078,15 @@ void SemanticAnalysis::leave_scope() {
 }
 
 // TODO: implement helper functions
+Symbol *SemanticAnalysis::lookup(const std::string &name) const {
+  Symbol *sym = m_cur_symtab->lookup_recursive(name);
+  if (sym != nullptr && sym->get_symtab() == m_global_symtab
+      && m_global_symtab->get_entry_index(sym) >= m_num_visible_globals) {
+    return nullptr;
+  }
+  return sym;
+}
+
 SymbolTable* SemanticAnalysis::find_symbol_table_by_name(const std::string& name) {
   for (const auto& symtab : m_all_symtabs) {
       if (symtab->get_name() == name) {
@@ -108,6 +108,11 @@ Symbol *SymbolTable::get_entry(unsigned index) const {
   return m_symbols[index];
 }
 
+unsigned SymbolTable::get_entry_index(const Symbol *sym) const {
+  assert(sym->get_symtab() == this);
+  return m_lookup.at(sym->get_name());
+}
+
 unsigned SymbolTable::get_num_parameters() const {
   assert(m_fn_type);
   return m_fn_type->get_num_members();